@@ -2,4 +2,8 @@ package java.lang
 
 class InheritableThreadLocal[T] extends ThreadLocal[T] {
   protected def childValue(parentValue: T): T = parentValue
+
+  // the value of a thread created by a thread that has `parentValue`
+  private[lang] def inherit(parentValue: Any): Any =
+    childValue(parentValue.asInstanceOf[T])
 }
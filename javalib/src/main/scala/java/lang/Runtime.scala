@@ -4,12 +4,16 @@ import java.io.File
 import scala.collection.JavaConverters._
 import scala.scalanative.annotation.stub
 import scala.scalanative.libc.stdlib
+import scala.scalanative.runtime.GCStats
 
 class Runtime private () {
   import Runtime.ProcessBuilderOps
   def availableProcessors(): Int = 1
   def exit(status: Int): Unit    = stdlib.exit(status)
   def gc(): Unit                 = ()
+  def totalMemory(): Long        = GCStats.current().heapSize
+  def freeMemory(): Long         = GCStats.current().freeBytes
+  def maxMemory(): Long          = GCStats.current().maxHeapSize
 
   @stub
   def addShutdownHook(thread: java.lang.Thread): Unit = ???
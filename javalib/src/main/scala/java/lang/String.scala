@@ -2,7 +2,7 @@ package java.lang
 
 import scalanative.unsafe._
 import scalanative.libc.string.memcmp
-import scalanative.runtime.CharArray
+import scalanative.runtime.{CharArray, fromRawPtr}
 import java.io.Serializable
 import java.util._
 import java.util.regex._
@@ -234,16 +234,13 @@ final class _String()
           if (thisHash != thatHash && thisHash != 0 && thatHash != 0) {
             false
           } else {
+            // the pointers are not kept, the arrays need not be pinned
             val data1 =
-              value
-                .asInstanceOf[CharArray]
-                .at(offset)
-                .asInstanceOf[Ptr[scala.Byte]]
+              fromRawPtr[scala.Byte](
+                value.asInstanceOf[CharArray].atRaw(offset))
             val data2 =
-              s.value
-                .asInstanceOf[CharArray]
-                .at(s.offset)
-                .asInstanceOf[Ptr[scala.Byte]]
+              fromRawPtr[scala.Byte](
+                s.value.asInstanceOf[CharArray].atRaw(s.offset))
             memcmp(data1, data2, count * 2) == 0
           }
         }
@@ -343,7 +340,8 @@ final class _String()
       if (count == 0) {
         0
       } else {
-        val data = value.asInstanceOf[CharArray].at(offset)
+        val data =
+          fromRawPtr[Char](value.asInstanceOf[CharArray].atRaw(offset))
         var hash = 0
         var i    = 0
         while (i < count) {
@@ -21,9 +21,12 @@ object System {
   def exit(status: Int): Unit =
     Runtime.getRuntime().exit(status)
 
-  def identityHashCode(x: Object): scala.Int =
-    java.lang.Long
-      .hashCode(Intrinsics.castRawPtrToLong(Intrinsics.castObjectToRawPtr(x)))
+  def identityHashCode(x: Object): scala.Int = {
+    val rawptr = Intrinsics.castObjectToRawPtr(x)
+    // the hash is derived from the address, the object must not move anymore
+    scalanative.runtime.pin(rawptr)
+    java.lang.Long.hashCode(Intrinsics.castRawPtrToLong(rawptr))
+  }
 
   private def loadProperties() = {
     val sysProps = new Properties()
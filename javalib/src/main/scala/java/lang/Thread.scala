@@ -1,22 +1,170 @@
 package java.lang
 
-import scalanative.unsigned._
+import java.util.{HashMap, HashSet}
+import scalanative.unsafe._
+import scalanative.runtime.{Intrinsics, Monitor, RawPtr}
+import scalanative.runtime.{fromRawPtr, pin, toRawPtr}
+import scalanative.posix.sched
+import scalanative.posix.errno.ENOTSUP
+import scalanative.posix.pthread.{pthread_create, pthread_detach}
+import scalanative.posix.sys.types.pthread_t
 import scalanative.annotation.stub
-import scalanative.libc.errno
 
-class Thread private (runnable: Runnable) extends Runnable {
-  if (runnable ne Thread.MainRunnable) ???
+class Thread(target: Runnable, private[this] var name: String)
+    extends Runnable {
+  import Thread._
 
-  private var interruptedState   = false
-  private[this] var name: String = "main" // default name of the main thread
+  def this() = this(null, Thread.nextName())
+  def this(target: Runnable) = this(target, Thread.nextName())
+  def this(name: String) = this(null, name)
 
-  def run(): Unit = ()
+  private[this] val id = Thread.nextId()
+  private[this] var daemon = {
+    val parent = Thread.attachedOrNull()
+    parent != null && parent.isDaemon()
+  }
+  private[this] var uncaughtExceptionHandler: UncaughtExceptionHandler = null
+
+  // guarded by the monitor of the thread
+  private[this] var started          = false
+  private[this] var alive            = false
+  private[this] var pendingInterrupt = false
+  // the native state of the running thread, see monitor.c
+  private[this] var state: RawPtr = null
+
+  // the values of the thread locals of this thread, only used by itself
+  private[lang] val threadLocals = new HashMap[ThreadLocal[_], Any]
+  locally {
+    val parent = Thread.attachedOrNull()
+    if (parent != null) {
+      val it = parent.threadLocals.entrySet().iterator()
+      while (it.hasNext()) {
+        val entry = it.next()
+        entry.getKey() match {
+          case local: InheritableThreadLocal[_] =>
+            threadLocals.put(local, local.inherit(entry.getValue()))
+          case _ =>
+            ()
+        }
+      }
+    }
+  }
+
+  def run(): Unit =
+    if (target != null) target.run()
+
+  def start(): Unit = {
+    synchronized {
+      if (started) {
+        throw new IllegalThreadStateException()
+      }
+      started = true
+      alive = true
+    }
+    register(this)
+    val rawptr = Intrinsics.castObjectToRawPtr(this)
+    // the new thread finds its object by the address
+    pin(rawptr)
+    val handle = stackalloc[pthread_t]
+    val result = pthread_create(handle, null, Start, fromRawPtr[Byte](rawptr))
+    if (result != 0) {
+      unregister(this)
+      synchronized {
+        alive = false
+      }
+      if (result == ENOTSUP) {
+        throw new UnsupportedOperationException(
+          "threads are not supported by the garbage collector, or with " +
+            "nativePreciseStack := true")
+      }
+      throw new OutOfMemoryError("unable to create native thread")
+    }
+    pthread_detach(!handle)
+  }
+
+  /** Runs the thread that `start` created. */
+  private def runStarted(): Unit = {
+    val self = NativeThread.self()
+    NativeThread.setObject(self, Intrinsics.castObjectToRawPtr(this))
+    synchronized {
+      state = self
+      if (pendingInterrupt) {
+        NativeThread.interrupt(self)
+      }
+    }
+    try {
+      run()
+    } catch {
+      case e: Throwable =>
+        try getUncaughtExceptionHandler().uncaughtException(this, e)
+        catch { case _: Throwable => () }
+    }
+    NativeThread.setObject(self, null)
+    exited()
+  }
 
-  def interrupt(): Unit =
-    interruptedState = true
+  /** Makes this the object of a thread that was not started by `start`. */
+  private def attach(self: RawPtr): Unit = synchronized {
+    started = true
+    alive = true
+    state = self
+  }
 
-  def isInterrupted(): scala.Boolean =
-    interruptedState
+  /** Called when the thread ends, its native state is freed afterwards. */
+  private def exited(): Unit = {
+    synchronized {
+      state = null
+      alive = false
+      notifyAll()
+    }
+    unregister(this)
+  }
+
+  def interrupt(): Unit = synchronized {
+    if (state != null) {
+      NativeThread.interrupt(state)
+    } else if (alive) {
+      // started, but not running yet
+      pendingInterrupt = true
+    }
+  }
+
+  def isInterrupted(): scala.Boolean = synchronized {
+    if (state != null) NativeThread.interrupted(state, clear = false)
+    else pendingInterrupt
+  }
+
+  final def isAlive(): scala.Boolean = synchronized {
+    alive
+  }
+
+  final def join(): Unit = join(0L)
+
+  final def join(millis: scala.Long): Unit = join(millis, 0)
+
+  final def join(millis: scala.Long, nanos: scala.Int): Unit = {
+    if (millis < 0) {
+      throw new IllegalArgumentException("timeout value is negative")
+    }
+    if (nanos < 0 || nanos > 999999) {
+      throw new IllegalArgumentException(
+        "nanosecond timeout value out of range")
+    }
+    synchronized {
+      if (millis == 0 && nanos == 0) {
+        while (alive) {
+          wait()
+        }
+      } else {
+        val deadline  = System.nanoTime() + millis * 1000000L + nanos
+        var remaining = deadline - System.nanoTime()
+        while (alive && remaining > 0) {
+          wait(remaining / 1000000L, (remaining % 1000000L).toInt)
+          remaining = deadline - System.nanoTime()
+        }
+      }
+    }
+  }
 
   final def setName(name: String): Unit =
     this.name = name
@@ -24,63 +172,141 @@ class Thread private (runnable: Runnable) extends Runnable {
   final def getName(): String =
     this.name
 
-  @stub
-  def getStackTrace(): Array[StackTraceElement] = ???
+  def getId(): scala.Long = id
 
-  def getId(): scala.Long = 1
+  final def isDaemon(): scala.Boolean = daemon
 
-  @stub
-  def getUncaughtExceptionHandler(): UncaughtExceptionHandler = ???
-
-  @stub
-  def setUncaughtExceptionHandler(handler: UncaughtExceptionHandler): Unit =
-    ???
-
-  @stub
-  def setDaemon(on: scala.Boolean): Unit = ???
+  /** Daemon threads are not waited for, no thread is when `main` returns. */
+  final def setDaemon(on: scala.Boolean): Unit = synchronized {
+    if (started) {
+      throw new IllegalThreadStateException()
+    }
+    daemon = on
+  }
 
-  @stub
-  def this(name: String) = this(??? : Runnable)
+  def getUncaughtExceptionHandler(): UncaughtExceptionHandler =
+    if (uncaughtExceptionHandler != null) uncaughtExceptionHandler
+    else DefaultUncaughtExceptionHandler
 
-  @stub
-  def this() = this(??? : Runnable)
+  def setUncaughtExceptionHandler(handler: UncaughtExceptionHandler): Unit =
+    uncaughtExceptionHandler = handler
 
-  @stub
-  def join(): Unit = ???
+  override def toString(): String = "Thread[" + name + "]"
 
   @stub
-  def start(): Unit = ???
+  def getStackTrace(): Array[StackTraceElement] = ???
 
   @stub
   def getContextClassLoader(): java.lang.ClassLoader = ???
+}
 
+object Thread {
   trait UncaughtExceptionHandler {
     def uncaughtException(thread: Thread, e: Throwable): Unit
   }
-}
 
-object Thread {
-  private val MainRunnable = new Runnable { def run(): Unit = () }
-  private val MainThread   = new Thread(MainRunnable)
+  private var defaultUncaughtExceptionHandler: UncaughtExceptionHandler = null
 
-  def currentThread(): Thread = MainThread
+  def getDefaultUncaughtExceptionHandler(): UncaughtExceptionHandler =
+    defaultUncaughtExceptionHandler
 
-  def interrupted(): scala.Boolean = {
-    val ret = currentThread.isInterrupted
-    currentThread.interruptedState = false
-    ret
+  def setDefaultUncaughtExceptionHandler(
+      handler: UncaughtExceptionHandler): Unit =
+    defaultUncaughtExceptionHandler = handler
+
+  private object DefaultUncaughtExceptionHandler
+      extends UncaughtExceptionHandler {
+    def uncaughtException(thread: Thread, e: Throwable): Unit = {
+      val handler = defaultUncaughtExceptionHandler
+      if (handler != null) {
+        handler.uncaughtException(thread, e)
+      } else {
+        System.err.print("Exception in thread \"" + thread.getName() + "\" ")
+        e.printStackTrace()
+      }
+    }
   }
 
-  def sleep(millis: scala.Long, nanos: scala.Int): Unit = {
-    import scala.scalanative.posix.errno.EINTR
-    import scala.scalanative.unsafe._
-    import scala.scalanative.posix.unistd
+  // The threads that run or are about to, which keeps their objects alive
+  // while only the native state of the threads refers to them.
+  private val threads = new HashSet[Thread]
 
-    def checkErrno() =
-      if (errno.errno == EINTR) {
-        throw new InterruptedException("Sleep was interrupted")
-      }
+  private def register(thread: Thread): Unit = threads.synchronized {
+    threads.add(thread)
+  }
 
+  private def unregister(thread: Thread): Unit = threads.synchronized {
+    threads.remove(thread)
+  }
+
+  private var lastId           = 0L
+  private var lastThreadNumber = 0
+
+  private def nextId(): scala.Long = synchronized {
+    lastId += 1
+    lastId
+  }
+
+  private def nextName(): String = synchronized {
+    val number = lastThreadNumber
+    lastThreadNumber += 1
+    "Thread-" + number
+  }
+
+  private val Start = new CFuncPtr1[Ptr[Byte], Ptr[Byte]] {
+    def apply(arg: Ptr[Byte]): Ptr[Byte] = {
+      val thread = Intrinsics.castRawPtrToObject(toRawPtr(arg))
+      thread.asInstanceOf[Thread].runStarted()
+      null
+    }
+  }
+
+  // Ends the threads that were attached by `currentThread`, when they exit.
+  private val Exit = new CFuncPtr1[Ptr[Byte], Unit] {
+    def apply(arg: Ptr[Byte]): Unit = {
+      val thread = Intrinsics.castRawPtrToObject(toRawPtr(arg))
+      thread.asInstanceOf[Thread].exited()
+    }
+  }
+
+  /** The object of the calling thread, or null if it has none yet. */
+  private def attachedOrNull(): Thread = {
+    val obj = NativeThread.getObject(NativeThread.self())
+    if (obj == null) null
+    else Intrinsics.castRawPtrToObject(obj).asInstanceOf[Thread]
+  }
+
+  def currentThread(): Thread = {
+    val current = attachedOrNull()
+    if (current != null) {
+      current
+    } else {
+      // the main thread or one started by native code
+      val self = NativeThread.self()
+      val thread =
+        if (NativeThread.isMain()) new Thread(null, "main")
+        else new Thread()
+      thread.attach(self)
+      register(thread)
+      NativeThread.setExitHook(Exit)
+      NativeThread.setObject(self, Intrinsics.castObjectToRawPtr(thread))
+      thread
+    }
+  }
+
+  def interrupted(): scala.Boolean = {
+    currentThread()
+    NativeThread.interrupted(NativeThread.self(), clear = true)
+  }
+
+  def holdsLock(obj: Object): scala.Boolean = {
+    if (obj == null) {
+      throw new NullPointerException()
+    }
+    Monitor.holds(obj)
+  }
+
+  def sleep(millis: scala.Long, nanos: scala.Int): Unit = {
     if (millis < 0) {
       throw new IllegalArgumentException("millis must be >= 0")
     }
@@ -88,14 +314,38 @@ object Thread {
       throw new IllegalArgumentException("nanos value out of range")
     }
 
-    val secs  = millis / 1000
-    val usecs = (millis % 1000) * 1000 + nanos / 1000
-    if (secs > 0 && unistd.sleep(secs.toUInt) != 0.toUInt) checkErrno()
-    if (usecs > 0 && unistd.usleep(usecs.toUInt) != 0) checkErrno()
+    val duration =
+      if (millis > (scala.Long.MaxValue - nanos) / 1000000L) scala.Long.MaxValue
+      else millis * 1000000L + nanos
+    if (NativeThread.sleep(duration)) {
+      throw new InterruptedException("sleep interrupted")
+    }
   }
 
   def sleep(millis: scala.Long): Unit = sleep(millis, 0)
 
+  def `yield`(): Unit = sched.sched_yield()
+
   @stub
   def dumpStack(): Unit = ???
+
+  @extern
+  private object NativeThread {
+    @name("scalanative_thread_self")
+    def self(): RawPtr = extern
+    @name("scalanative_thread_get_object")
+    def getObject(state: RawPtr): RawPtr = extern
+    @name("scalanative_thread_set_object")
+    def setObject(state: RawPtr, thread: RawPtr): Unit = extern
+    @name("scalanative_thread_set_exit_hook")
+    def setExitHook(hook: CFuncPtr1[Ptr[Byte], Unit]): Unit = extern
+    @name("scalanative_thread_is_main")
+    def isMain(): CBool = extern
+    @name("scalanative_thread_interrupt")
+    def interrupt(state: RawPtr): Unit = extern
+    @name("scalanative_thread_interrupted")
+    def interrupted(state: RawPtr, clear: CBool): CBool = extern
+    @name("scalanative_thread_sleep")
+    def sleep(durationNanos: scala.Long): CBool = extern
+  }
 }
@@ -1,24 +1,23 @@
 package java.lang
 
+// The values are kept by each thread, keyed by their thread local.
 class ThreadLocal[T] {
-  private var hasValue: Boolean = false
-  private var v: T              = _
-
   protected def initialValue(): T = null.asInstanceOf[T]
 
   def get(): T = {
-    if (!hasValue)
-      set(initialValue)
-    v
+    val values = Thread.currentThread().threadLocals
+    if (!values.containsKey(this)) {
+      val v = initialValue()
+      values.put(this, v)
+      v
+    } else {
+      values.get(this).asInstanceOf[T]
+    }
   }
 
-  def set(o: T): Unit = {
-    v = o
-    hasValue = true
-  }
+  def set(o: T): Unit =
+    Thread.currentThread().threadLocals.put(this, o)
 
-  def remove(): Unit = {
-    hasValue = false
-    v = null.asInstanceOf[T] // for gc
-  }
+  def remove(): Unit =
+    Thread.currentThread().threadLocals.remove(this)
 }
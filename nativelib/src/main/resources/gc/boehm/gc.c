@@ -1,32 +1,149 @@
+// Threads are registered with the collector and allocate from thread-local
+// free lists. Threads started through `scalanative_pthread_create` are
+// registered before they run, other threads on their first allocation.
+#define GC_THREADS
 #include <gc.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "../shared/GCStats.h"
+#include "../../pprof/CpuProfiler.h"
 
 // At the moment we rely on the conservative
 // mode of Boehm GC as our garbage collector.
 
-void scalanative_init() { GC_init(); }
+extern long long scalanative_nano_time();
+
+// collection events are reported from Boehm GC 7.6 on, the times stay 0 before
+#if GC_VERSION_MAJOR > 7 || (GC_VERSION_MAJOR == 7 && GC_VERSION_MINOR >= 6)
+#define GC_HAS_COLLECTION_EVENTS
+#endif
+
+// times of the collections so far, updated while the world is stopped
+static struct {
+    uint64_t lastPause_ns;
+    uint64_t maxPause_ns;
+    uint64_t totalPause_ns;
+    uint64_t mark_ns;
+    uint64_t sweep_ns;
+    uint64_t start_ns;
+    uint64_t markStart_ns;
+    uint64_t sweepStart_ns;
+} totals;
+
+#ifdef GC_HAS_COLLECTION_EVENTS
+static void scalanative_gc_event(GC_EventType event) {
+    uint64_t now_ns = scalanative_nano_time();
+    switch (event) {
+    case GC_EVENT_START:
+        totals.start_ns = now_ns;
+        CpuProfiler_EnterPhase(cpu_gc);
+        break;
+    case GC_EVENT_MARK_START:
+        totals.markStart_ns = now_ns;
+        CpuProfiler_EnterPhase(cpu_gc_mark);
+        break;
+    case GC_EVENT_MARK_END:
+        totals.mark_ns += now_ns - totals.markStart_ns;
+        CpuProfiler_EnterPhase(cpu_gc);
+        break;
+    case GC_EVENT_RECLAIM_START:
+        totals.sweepStart_ns = now_ns;
+        CpuProfiler_EnterPhase(cpu_gc_sweep);
+        break;
+    case GC_EVENT_RECLAIM_END:
+        totals.sweep_ns += now_ns - totals.sweepStart_ns;
+        CpuProfiler_EnterPhase(cpu_gc);
+        break;
+    case GC_EVENT_END: {
+        uint64_t pause_ns = now_ns - totals.start_ns;
+        totals.lastPause_ns = pause_ns;
+        totals.totalPause_ns += pause_ns;
+        if (pause_ns > totals.maxPause_ns) {
+            totals.maxPause_ns = pause_ns;
+        }
+        CpuProfiler_LeavePhase(cpu_mutator);
+        break;
+    }
+    default:
+        break;
+    }
+}
+#endif
+
+// the calling thread is known to the collector
+static _Thread_local bool registered = false;
+// the value is set for the threads registered by register_thread, which are
+// unregistered by its destructor when they exit
+static pthread_key_t registered_key;
+
+// see monitor.c, detaches the java.lang.Thread of the exiting thread
+void scalanative_thread_exiting();
+
+static void unregister_thread(void *data) {
+    // may run Scala code, which allocates
+    scalanative_thread_exiting();
+    GC_unregister_my_thread();
+}
+
+/**
+ * Registers a thread that was not started by scalanative_pthread_create, it
+ * is stopped and its stack scanned by the collections from now on.
+ */
+static void register_thread() {
+    struct GC_stack_base base;
+    registered = true;
+    GC_get_stack_base(&base);
+    if (GC_register_my_thread(&base) == GC_SUCCESS) {
+        pthread_setspecific(registered_key, &registered);
+    }
+}
+
+void scalanative_init() {
+    CpuProfiler_Init();
+    GC_init();
+    // threads that were not started by scalanative_pthread_create register
+    // themselves, see register_thread
+    GC_allow_register_threads();
+    pthread_key_create(&registered_key, unregister_thread);
+#ifdef GC_HAS_COLLECTION_EVENTS
+    GC_set_on_collection_event(scalanative_gc_event);
+#endif
+}
 
 void *scalanative_alloc(void *info, size_t size) {
+    if (!registered) {
+        register_thread();
+    }
     void **alloc = (void **)GC_malloc(size);
     *alloc = info;
     return (void *)alloc;
 }
 
 void *scalanative_alloc_small(void *info, size_t size) {
+    if (!registered) {
+        register_thread();
+    }
     void **alloc = (void **)GC_malloc(size);
     *alloc = info;
     return (void *)alloc;
 }
 
 void *scalanative_alloc_large(void *info, size_t size) {
+    if (!registered) {
+        register_thread();
+    }
     void **alloc = (void **)GC_malloc(size);
     *alloc = info;
     return (void *)alloc;
 }
 
 void *scalanative_alloc_atomic(void *info, size_t size) {
+    if (!registered) {
+        register_thread();
+    }
     void **alloc = (void **)GC_malloc_atomic(size);
     memset(alloc, 0, size);
     *alloc = info;
@@ -34,3 +151,83 @@ void *scalanative_alloc_atomic(void *info, size_t size) {
 }
 
 void scalanative_collect() { GC_gcollect(); }
+
+void scalanative_write_barrier(void *address) {}
+
+void scalanative_write_barrier_range(void *address, size_t size) {}
+
+bool scalanative_gc_moves_objects = false;
+
+bool scalanative_gc_generational = false;
+
+void scalanative_pin(void *address) {}
+
+void scalanative_gc_trace(const char *path) {}
+
+bool scalanative_gc_heap_dump(const char *histogramPath, const char *dumpPath) {
+    return false;
+}
+
+// Boehm GC has no blocks of its own and does not expose its maximum heap size.
+void scalanative_gc_stats(GCStats *stats) {
+    GC_word heapSize, freeBytes, unmappedBytes, sinceCollection, totalBytes;
+    GC_get_heap_usage_safe(&heapSize, &freeBytes, &unmappedBytes,
+                           &sinceCollection, &totalBytes);
+    memset(stats, 0, sizeof(GCStats));
+    // both exclude the memory returned to the OS
+    stats->heapSize = heapSize;
+    stats->maxHeapSize = GC_STATS_UNLIMITED;
+    stats->usedBytes = heapSize - freeBytes;
+    stats->allocatedBytes = totalBytes;
+    stats->collections = GC_get_gc_no();
+    stats->lastPause_ns = totals.lastPause_ns;
+    stats->maxPause_ns = totals.maxPause_ns;
+    stats->totalPause_ns = totals.totalPause_ns;
+    stats->mark_ns = totals.mark_ns;
+    stats->sweep_ns = totals.sweep_ns;
+}
+
+// see monitor.c, the monitors are only recorded while there is one thread
+void scalanative_monitor_start_threads();
+
+typedef struct {
+    void *(*routine)(void *);
+    void *arg;
+} thread_start;
+
+// the thread is unregistered by the cleanup handler GC_pthread_create
+// installs, which runs before the destructors of the thread-specific values
+static void *run_thread(void *data) {
+    thread_start *start = (thread_start *)data;
+    void *result = start->routine(start->arg);
+    scalanative_thread_exiting();
+    return result;
+}
+
+int scalanative_pthread_create(pthread_t *thread, pthread_attr_t *attr,
+                               void *(*routine)(void *), void *arg) {
+    scalanative_monitor_start_threads();
+    if (!registered) {
+        register_thread();
+    }
+    // collected, `arg` is reachable through it until the thread runs
+    thread_start *start = (thread_start *)GC_malloc(sizeof(thread_start));
+    start->routine = routine;
+    start->arg = arg;
+    return GC_pthread_create(thread, attr, run_thread, start);
+}
+
+int scalanative_pthread_detach(pthread_t thread) {
+    return GC_pthread_detach(thread);
+}
+
+void scalanative_pthread_exit(void *result) {
+    scalanative_thread_exiting();
+#ifdef GC_HAVE_PTHREAD_EXIT
+    GC_pthread_exit(result);
+#else
+    // the thread is unregistered by the cleanup handler GC_pthread_create
+    // installs
+    pthread_exit(result);
+#endif
+}
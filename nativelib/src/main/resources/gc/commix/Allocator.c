@@ -2,6 +2,12 @@
 #include "Allocator.h"
 #include "State.h"
 #include "Sweeper.h"
+#include "Trace.h"
+#include "../../pprof/CpuProfiler.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "MutatorThread.h"
+#include "Safepoint.h"
 #include <stdio.h>
 #include <memory.h>
 
@@ -9,54 +15,134 @@ bool Allocator_getNextLine(Allocator *allocator);
 bool Allocator_newBlock(Allocator *allocator);
 bool Allocator_newOverflowBlock(Allocator *allocator);
 
+/**
+ * Forgets the objects that crossed lines in a free block before it is reused.
+ */
+static inline void Allocator_clearCrossings(Allocator *allocator,
+                                            word_t *blockStart) {
+    Crossing_ClearLines(Crossing_ForWord(allocator->crossingMetaStart,
+                                         allocator->heapStart, blockStart),
+                        LINE_COUNT);
+}
+
+static inline uint64_t Allocator_bytesBetween(word_t *start, word_t *end) {
+    return (uint64_t)((uint8_t *)end - (uint8_t *)start);
+}
+
+/**
+ * Returns the bytes allocated so far, which is what the holes taken add up to
+ * without the rest of the current ones. Counting holes keeps the fast path
+ * as it is.
+ */
+uint64_t Allocator_AllocatedBytes(Allocator *allocator) {
+    word_t *limit = allocator->limitAfterSample != NULL
+                        ? allocator->limitAfterSample
+                        : allocator->limit;
+    return allocator->holeBytes -
+           Allocator_bytesBetween(allocator->cursor, limit) -
+           Allocator_bytesBetween(allocator->largeCursor,
+                                  allocator->largeLimit);
+}
+
+/**
+ * Pulls the limit back to the next sample of the profiler if it falls in the
+ * current hole, so that the fast path takes the slow one there.
+ */
+void Allocator_ArmSample(Allocator *allocator) {
+    uint64_t allocated = Allocator_AllocatedBytes(allocator);
+    if (allocator->limitAfterSample != NULL ||
+        allocator->nextSample <= allocated) {
+        return;
+    }
+    uint64_t distance = allocator->nextSample - allocated;
+    word_t *cursor = allocator->cursor;
+    if (distance < Allocator_bytesBetween(cursor, allocator->limit)) {
+        allocator->limitAfterSample = allocator->limit;
+        allocator->limit = (word_t *)((uint8_t *)cursor + distance);
+    }
+}
+
+/**
+ * Gives the limit back its place at the end of the hole, before the slow path
+ * moves on to another one.
+ */
+void Allocator_DisarmSample(Allocator *allocator) {
+    if (allocator->limitAfterSample != NULL) {
+        allocator->limit = allocator->limitAfterSample;
+        allocator->limitAfterSample = NULL;
+    }
+}
+
+static inline void Allocator_setHole(Allocator *allocator, word_t *cursor,
+                                     word_t *limit) {
+    allocator->holeBytes += Allocator_bytesBetween(cursor, limit) -
+                            Allocator_bytesBetween(allocator->cursor,
+                                                   allocator->limit);
+    allocator->cursor = cursor;
+    allocator->limit = limit;
+}
+
+static inline void Allocator_setLargeHole(Allocator *allocator,
+                                          word_t *cursor, word_t *limit) {
+    allocator->holeBytes += Allocator_bytesBetween(cursor, limit) -
+                            Allocator_bytesBetween(allocator->largeCursor,
+                                                   allocator->largeLimit);
+    allocator->largeCursor = cursor;
+    allocator->largeLimit = limit;
+}
+
 void Allocator_Init(Allocator *allocator, BlockAllocator *blockAllocator,
                     Bytemap *bytemap, word_t *blockMetaStart,
-                    word_t *heapStart) {
+                    word_t *crossingMetaStart, word_t *heapStart) {
     allocator->blockMetaStart = blockMetaStart;
     allocator->blockAllocator = blockAllocator;
     allocator->bytemap = bytemap;
+    allocator->crossingMetaStart = crossingMetaStart;
     allocator->heapStart = heapStart;
 
-    BlockList_Init(&allocator->recycledBlocks);
-
-    allocator->recycledBlockCount = 0;
+    allocator->holeBytes = 0;
+    allocator->limitAfterSample = NULL;
+    allocator->nextSample = UINT64_MAX;
 
-    // Init cursor
-    bool didInit = Allocator_newBlock(allocator);
-    assert(didInit);
-
-    // Init large cursor
-    bool didLargeInit = Allocator_newOverflowBlock(allocator);
-    assert(didLargeInit);
+    // the cursors are set by the first allocation
+    allocator->cursor = NULL;
+    allocator->limit = NULL;
+    allocator->block = NULL;
+    allocator->largeCursor = NULL;
+    allocator->largeLimit = NULL;
+    allocator->largeBlock = NULL;
 }
 
 /**
- * The Allocator needs one free block for overflow allocation and a free or
+ * An Allocator needs one free block for overflow allocation and a free or
  * recyclable block for normal allocation.
  *
- * @param allocator
+ * @param blockAllocator
  * @return `true` if there are enough block to initialise the cursors, `false`
  * otherwise.
  */
-bool Allocator_CanInitCursors(Allocator *allocator) {
-    uint32_t freeBlockCount =
-        (uint32_t)allocator->blockAllocator->freeBlockCount;
+bool Allocator_CanInitCursors(BlockAllocator *blockAllocator) {
+    uint32_t freeBlockCount = (uint32_t)blockAllocator->freeBlockCount;
     return freeBlockCount >= 2 ||
-           (freeBlockCount == 1 && allocator->recycledBlockCount > 0);
+           (freeBlockCount == 1 && blockAllocator->recycledBlockCount > 0);
 }
 
 void Allocator_Clear(Allocator *allocator) {
-    BlockList_Clear(&allocator->recycledBlocks);
-    allocator->recycledBlockCount = 0;
+    allocator->holeBytes = Allocator_AllocatedBytes(allocator);
+    allocator->limitAfterSample = NULL;
+    allocator->cursor = NULL;
     allocator->limit = NULL;
     allocator->block = NULL;
+    allocator->largeCursor = NULL;
     allocator->largeLimit = NULL;
     allocator->largeBlock = NULL;
 }
 
 bool Allocator_newOverflowBlock(Allocator *allocator) {
+    BlockAllocator_Lock(allocator->blockAllocator);
     BlockMeta *largeBlock =
         BlockAllocator_GetFreeBlock(allocator->blockAllocator);
+    BlockAllocator_Unlock(allocator->blockAllocator);
     if (largeBlock == NULL) {
         return false;
     }
@@ -64,8 +150,9 @@ bool Allocator_newOverflowBlock(Allocator *allocator) {
     word_t *largeBlockStart = BlockMeta_GetBlockStart(
         allocator->blockMetaStart, allocator->heapStart, largeBlock);
     allocator->largeBlockStart = largeBlockStart;
-    allocator->largeCursor = largeBlockStart;
-    allocator->largeLimit = Block_GetBlockEnd(largeBlockStart);
+    Allocator_setLargeHole(allocator, largeBlockStart,
+                           Block_GetBlockEnd(largeBlockStart));
+    Allocator_clearCrossings(allocator, largeBlockStart);
     return true;
 }
 
@@ -88,6 +175,8 @@ word_t *Allocator_overflowAllocation(Allocator *allocator, size_t size) {
     }
 
     allocator->largeCursor = end;
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          start, size);
 
     return start;
 }
@@ -117,6 +206,8 @@ INLINE word_t *Allocator_tryAlloc(Allocator *allocator, size_t size) {
     }
 
     allocator->cursor = end;
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          start, size);
 
     return start;
 }
@@ -138,11 +229,10 @@ bool Allocator_getNextLine(Allocator *allocator) {
 
     word_t *line = Block_GetLineAddress(blockStart, lineIndex);
 
-    allocator->cursor = line;
     FreeLineMeta *lineMeta = (FreeLineMeta *)line;
     BlockMeta_SetFirstFreeLine(block, lineMeta->next);
     uint16_t size = lineMeta->size;
-    allocator->limit = line + (size * WORDS_IN_LINE);
+    Allocator_setHole(allocator, line, line + (size * WORDS_IN_LINE));
     assert(allocator->limit <= Block_GetBlockEnd(blockStart));
 
     return true;
@@ -153,18 +243,24 @@ bool Allocator_getNextLine(Allocator *allocator) {
  * free line of the new block.
  */
 bool Allocator_newBlock(Allocator *allocator) {
-    bool concurrent = allocator->blockAllocator->concurrent;
+    BlockAllocator *blockAllocator = allocator->blockAllocator;
     word_t *blockMetaStart = allocator->blockMetaStart;
     BlockMeta *block;
-    if (concurrent) {
-        block = BlockList_Pop(&allocator->recycledBlocks, blockMetaStart);
+    BlockAllocator_Lock(blockAllocator);
+    if (blockAllocator->concurrent) {
+        block = BlockList_Pop(&blockAllocator->recycledBlocks, blockMetaStart);
     } else {
-        block = BlockList_PopOnlyThread(&allocator->recycledBlocks,
+        block = BlockList_PopOnlyThread(&blockAllocator->recycledBlocks,
                                         blockMetaStart);
     }
+    bool recycled = block != NULL;
+    if (!recycled) {
+        block = BlockAllocator_GetFreeBlock(blockAllocator);
+    }
+    BlockAllocator_Unlock(blockAllocator);
     word_t *blockStart;
 
-    if (block != NULL) {
+    if (recycled) {
         // get all the changes done by sweeping
         atomic_thread_fence(memory_order_acquire);
 #ifdef DEBUG_PRINT
@@ -183,15 +279,13 @@ bool Allocator_newBlock(Allocator *allocator) {
         assert(lineIndex < LINE_COUNT);
         word_t *line = Block_GetLineAddress(blockStart, lineIndex);
 
-        allocator->cursor = line;
         FreeLineMeta *lineMeta = (FreeLineMeta *)line;
         BlockMeta_SetFirstFreeLine(block, lineMeta->next);
         uint16_t size = lineMeta->size;
         assert(size > 0);
-        allocator->limit = line + (size * WORDS_IN_LINE);
+        Allocator_setHole(allocator, line, line + (size * WORDS_IN_LINE));
         assert(allocator->limit <= Block_GetBlockEnd(blockStart));
     } else {
-        block = BlockAllocator_GetFreeBlock(allocator->blockAllocator);
 #ifdef DEBUG_PRINT
         printf("Allocator_newBlock %p %" PRIu32 "\n", block,
                BlockMeta_GetBlockIndex(blockMetaStart, block));
@@ -203,9 +297,10 @@ bool Allocator_newBlock(Allocator *allocator) {
         blockStart = BlockMeta_GetBlockStart(blockMetaStart,
                                              allocator->heapStart, block);
 
-        allocator->cursor = blockStart;
-        allocator->limit = Block_GetBlockEnd(blockStart);
+        Allocator_setHole(allocator, blockStart,
+                          Block_GetBlockEnd(blockStart));
         BlockMeta_SetFirstFreeLine(block, LAST_HOLE);
+        Allocator_clearCrossings(allocator, blockStart);
     }
 
     allocator->block = block;
@@ -217,29 +312,58 @@ bool Allocator_newBlock(Allocator *allocator) {
 INLINE
 word_t *Allocator_lazySweep(Heap *heap, uint32_t size) {
     word_t *object = NULL;
+    uint64_t sweepStart_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
     Stats_DefineOrNothing(stats, heap->stats);
     Stats_RecordTime(stats, start_ns);
-    // mark as active
-    heap->lazySweep.lastActivity = BlockRange_Pack(1, heap->sweep.cursor);
-    while (object == NULL && heap->sweep.cursor < heap->sweep.limit) {
-        Sweeper_Sweep(heap, heap->stats, &heap->lazySweep.cursorDone,
-                      LAZY_SWEEP_MIN_BATCH);
-        object = Allocator_tryAlloc(&allocator, size);
+    // one mutator thread sweeps at a time, the others wait for the sweep
+    if (pthread_mutex_trylock(&heap->lazySweep.mutex) == 0) {
+        // mark as active
+        heap->lazySweep.lastActivity = BlockRange_Pack(1, heap->sweep.cursor);
+        while (object == NULL && heap->sweep.cursor < heap->sweep.limit) {
+            Sweeper_Sweep(heap, heap->stats, &heap->lazySweep.cursorDone,
+                          LAZY_SWEEP_MIN_BATCH);
+            object = Allocator_tryAlloc(&allocator, size);
+        }
+        // mark as inactive
+        heap->lazySweep.lastActivity = BlockRange_Pack(0, heap->sweep.cursor);
+        pthread_mutex_unlock(&heap->lazySweep.mutex);
     }
-    // mark as inactive
-    heap->lazySweep.lastActivity = BlockRange_Pack(0, heap->sweep.cursor);
+    Parker *parker = &heap->sweep.parker;
+    Parker_Signal(parker);
     while (object == NULL && !Sweeper_IsSweepDone(heap)) {
+        Safepoint_Poll();
+        uint32_t epoch = Parker_Prepare(parker);
         object = Allocator_tryAlloc(&allocator, size);
-        if (object == NULL) {
-            sched_yield();
+        if (object == NULL && !Sweeper_IsSweepDone(heap)) {
+            // wait for the GC threads or the other mutator threads to sweep
+            // or coalesce more blocks
+            Parker_Park(parker, heap->stats, epoch);
         }
+        Parker_Leave(parker);
+    }
+    if (object == NULL) {
+        // the last blocks may have been freed since the last attempt
+        object = Allocator_tryAlloc(&allocator, size);
     }
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_sweep, start_ns, end_ns);
+    Heap_RecordSweep(heap, trace_lazy_sweep, sweepStart_ns);
+    CpuProfiler_LeavePhase(phase);
     return object;
 }
 
 NOINLINE word_t *Allocator_allocSlow(Heap *heap, uint32_t size) {
+    if (!mutatorThread.registered) {
+        // a thread that was not started by scalanative_pthread_create
+        MutatorThread_Register(MutatorThread_StackBottom());
+    }
+    Safepoint_Poll();
+    // the fast path may have stopped at the sample point
+    Allocator_DisarmSample(&allocator);
+    if (HeapDump_Requested()) {
+        HeapDump_OnRequest(heap);
+    }
     word_t *object = Allocator_tryAlloc(&allocator, size);
 
     if (object != NULL) {
@@ -252,6 +376,12 @@ NOINLINE word_t *Allocator_allocSlow(Heap *heap, uint32_t size) {
         ObjectMeta_AssertIsValidAllocation(objectMeta, size);
 #endif
         ObjectMeta_SetAllocated(objectMeta);
+        if (Allocator_ReachedSample(&allocator)) {
+            Profiler_Sample(object, size);
+            allocator.nextSample = Allocator_AllocatedBytes(&allocator) +
+                                   Profiler_NextSampleDistance();
+        }
+        Allocator_ArmSample(&allocator);
         return object;
     }
 
@@ -275,12 +405,21 @@ NOINLINE word_t *Allocator_allocSlow(Heap *heap, uint32_t size) {
             goto done;
     }
 
-    // A small object can always fit in a single free block
-    // because it is no larger than 8K while the block is 32K.
-    Heap_Grow(heap, 1);
-    object = Allocator_tryAlloc(&allocator, size);
+    // Recommitted blocks must not be in the range being swept. Another
+    // thread may have collected since, it cannot start a sweep before this
+    // thread polls.
+    if (Sweeper_IsSweepDone(heap)) {
+        // A small object can always fit in a single free block
+        // because it is no larger than 8K while the block is 32K.
+        Heap_Grow(heap, 1);
+        object = Allocator_tryAlloc(&allocator, size);
+
+        if (object != NULL)
+            goto done;
+    }
 
-    goto done;
+    // another thread took the new block or collected
+    return Allocator_allocSlow(heap, size);
 }
 
 INLINE word_t *Allocator_Alloc(Heap *heap, uint32_t size) {
@@ -298,6 +437,8 @@ INLINE word_t *Allocator_Alloc(Heap *heap, uint32_t size) {
     allocator.cursor = end;
 
     memset(start, 0, size);
+    Crossing_RecordObject(allocator.crossingMetaStart, allocator.heapStart,
+                          start, size);
 
     word_t *object = start;
     ObjectMeta *objectMeta = Bytemap_Get(allocator.bytemap, object);
@@ -5,11 +5,13 @@
 #include <stddef.h>
 #include "datastructures/BlockList.h"
 #include "datastructures/Bytemap.h"
+#include "metadata/CrossingMeta.h"
 #include "metadata/BlockMeta.h"
 #include "metadata/ObjectMeta.h"
 #include "BlockAllocator.h"
 #include "Heap.h"
 
+// Every mutator thread allocates from its own allocator, see MutatorThread.h.
 typedef struct {
     // The fields here are sorted by how often it is accessed.
     // This should improve cache performance.
@@ -26,23 +28,34 @@ typedef struct {
     word_t *largeCursor;
     word_t *largeLimit;
     // additional things used for Allocator_newBlock
-    BlockList recycledBlocks;
     word_t *blockMetaStart;
+    word_t *crossingMetaStart;
     word_t *heapStart;
     BlockAllocator *blockAllocator;
     // additional things used for
     BlockMeta *largeBlock;
     word_t *largeBlockStart;
-    // This gets concurrently updated by other threads, keep if it as far away
-    // as possible from fast path.
-    atomic_uint_fast32_t recycledBlockCount;
+    // bytes of all the holes taken, including the rest of the current ones
+    uint64_t holeBytes;
+    // the end of the hole while `limit` is pulled back to the next sample of
+    // the profiler, NULL otherwise
+    word_t *limitAfterSample;
+    // the allocated bytes at which the next sample is taken
+    uint64_t nextSample;
 } Allocator;
 
 void Allocator_Init(Allocator *allocator, BlockAllocator *blockAllocator,
                     Bytemap *bytemap, word_t *blockMetaStart,
-                    word_t *heapStart);
-bool Allocator_CanInitCursors(Allocator *allocator);
+                    word_t *crossingMetaStart, word_t *heapStart);
+bool Allocator_CanInitCursors(BlockAllocator *blockAllocator);
 void Allocator_Clear(Allocator *allocator);
 word_t *Allocator_Alloc(Heap *heap, uint32_t objectSize);
+uint64_t Allocator_AllocatedBytes(Allocator *allocator);
+void Allocator_ArmSample(Allocator *allocator);
+void Allocator_DisarmSample(Allocator *allocator);
+
+static inline bool Allocator_ReachedSample(Allocator *allocator) {
+    return Allocator_AllocatedBytes(allocator) >= allocator->nextSample;
+}
 
 #endif // IMMIX_ALLOCATOR_H
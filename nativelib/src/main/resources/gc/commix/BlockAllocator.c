@@ -3,19 +3,18 @@
 #include "utils/MathUtils.h"
 #include <stdio.h>
 #include "Heap.h"
+#include "SweepResult.h"
 
-void BlockAllocator_splitAndAdd(BlockAllocator *blockAllocator,
-                                BlockMeta *superblock, uint32_t count);
-
-void BlockAllocator_splitAndAddLocal(BlockAllocator *blockAllocator,
-                                     LocalBlockList *localBlockListStart,
-                                     BlockMeta *superblock, uint32_t count);
+void BlockAllocator_addSuperblock(BlockAllocator *blockAllocator,
+                                  BlockMeta *superblock, uint32_t count);
 
 void BlockAllocator_Init(BlockAllocator *blockAllocator, word_t *blockMetaStart,
                          uint32_t blockCount) {
     for (int i = 0; i < SUPERBLOCK_LIST_SIZE; i++) {
         BlockList_Init(&blockAllocator->freeSuperblocks[i]);
     }
+    BlockList_Init(&blockAllocator->recycledBlocks);
+    pthread_mutex_init(&blockAllocator->lock, NULL);
     BlockAllocator_Clear(blockAllocator);
 
     blockAllocator->blockMetaStart = blockMetaStart;
@@ -38,40 +37,140 @@ void BlockAllocator_Init(BlockAllocator *blockAllocator, word_t *blockMetaStart,
 #endif
 }
 
-inline static int BlockAllocator_sizeToLinkedListIndex(uint32_t size) {
-    int result = MathUtils_Log2Floor((size_t)size);
-    assert(result >= 0);
+/**
+ * Returns the list of free superblocks of `size` blocks. Sizes below
+ * SUPERBLOCK_SUBCLASS_COUNT have a list each, larger ones are classified by
+ * their highest bit and the SUPERBLOCK_SUBCLASS_BITS bits below it.
+ */
+inline static int BlockAllocator_sizeClass(uint32_t size) {
+    assert(size > 0);
+    if (size < SUPERBLOCK_SUBCLASS_COUNT) {
+        return (int)size;
+    }
+    int log2 = MathUtils_Log2Floor((size_t)size);
+    int subclass = (size >> (log2 - SUPERBLOCK_SUBCLASS_BITS)) &
+                   (SUPERBLOCK_SUBCLASS_COUNT - 1);
+    int result = ((log2 - SUPERBLOCK_SUBCLASS_BITS + 1)
+                  << SUPERBLOCK_SUBCLASS_BITS) +
+                 subclass;
     assert(result < SUPERBLOCK_LIST_SIZE);
     return result;
 }
 
-inline static BlockMeta *
-BlockAllocator_pollSuperblock(BlockAllocator *blockAllocator, int *index) {
-    // acquire all the changes done by sweeping
-    atomic_thread_fence(memory_order_acquire);
-    word_t *blockMetaStart = blockAllocator->blockMetaStart;
-    for (int i = *index; i < SUPERBLOCK_LIST_SIZE; i++) {
-        BlockMeta *superblock =
-            BlockList_Pop(&blockAllocator->freeSuperblocks[i], blockMetaStart);
-        if (superblock != NULL) {
-            *index = i;
-            return superblock;
+/**
+ * Returns the smallest list in which every superblock has at least `size`
+ * blocks, by rounding `size` up to the start of the next size class.
+ */
+inline static int BlockAllocator_fitClass(uint32_t size) {
+    if (size >= SUPERBLOCK_SUBCLASS_COUNT) {
+        int log2 = MathUtils_Log2Floor((size_t)size);
+        size += (1U << (log2 - SUPERBLOCK_SUBCLASS_BITS)) - 1;
+    }
+    return BlockAllocator_sizeClass(size);
+}
+
+// The bitmap is a hint. A list is pushed before its bit is set, and its bit is
+// only cleared after a pop found it empty. If a push raced with that, the bit
+// is set again, so no non-empty list stays hidden.
+
+inline static void BlockAllocator_setNonEmpty(BlockAllocator *blockAllocator,
+                                              int index) {
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    atomic_uint_fast64_t *word = &blockAllocator->nonEmptyLists[index / 64];
+    // a bit cleared after this check is set again by the clearing thread
+    if ((*word & bit) == 0) {
+        atomic_fetch_or(word, bit);
+    }
+}
+
+inline static void
+BlockAllocator_clearNonEmpty(BlockAllocator *blockAllocator, int index) {
+    atomic_fetch_and(&blockAllocator->nonEmptyLists[index / 64],
+                     ~((uint64_t)1 << (index % 64)));
+    BlockList *list = &blockAllocator->freeSuperblocks[index];
+    if (atomic_load(&list->head) != (word_t)NULL) {
+        BlockAllocator_setNonEmpty(blockAllocator, index);
+    }
+}
+
+/** Returns the first possibly non-empty list from `index` on, or -1. */
+inline static int BlockAllocator_nextNonEmpty(BlockAllocator *blockAllocator,
+                                              int index) {
+    for (int word = index / 64; word < SUPERBLOCK_BITMAP_WORDS; word++) {
+        uint64_t bits = blockAllocator->nonEmptyLists[word];
+        if (word == index / 64) {
+            bits &= ~(uint64_t)0 << (index % 64);
+        }
+        if (bits != 0) {
+            return word * 64 + __builtin_ctzll(bits);
         }
     }
-    return NULL;
+    return -1;
 }
 
-inline static BlockMeta *
-BlockAllocator_pollSuperblockOnlyThread(BlockAllocator *blockAllocator,
-                                        int *index) {
+/** Returns the last possibly non-empty list up to `index`, or -1. */
+inline static int BlockAllocator_prevNonEmpty(BlockAllocator *blockAllocator,
+                                              int index) {
+    if (index < 0) {
+        return -1;
+    }
+    for (int word = index / 64; word >= 0; word--) {
+        uint64_t bits = blockAllocator->nonEmptyLists[word];
+        if (word == index / 64 && index % 64 < 63) {
+            bits &= ((uint64_t)1 << (index % 64 + 1)) - 1;
+        }
+        if (bits != 0) {
+            return word * 64 + 63 - __builtin_clzll(bits);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Pops a free superblock from the list `index` and returns it with its size
+ * in `size`, NULL if the list is empty.
+ */
+inline static BlockMeta *BlockAllocator_popList(BlockAllocator *blockAllocator,
+                                               int index, uint32_t *size) {
+    BlockList *list = &blockAllocator->freeSuperblocks[index];
     word_t *blockMetaStart = blockAllocator->blockMetaStart;
-    for (int i = *index; i < SUPERBLOCK_LIST_SIZE; i++) {
-        BlockMeta *superblock = BlockList_PopOnlyThread(
-            &blockAllocator->freeSuperblocks[i], blockMetaStart);
+    BlockMeta *superblock;
+    if (blockAllocator->concurrent) {
+        superblock = BlockList_Pop(list, blockMetaStart);
+    } else {
+        superblock = BlockList_PopOnlyThread(list, blockMetaStart);
+    }
+    if (superblock == NULL) {
+        BlockAllocator_clearNonEmpty(blockAllocator, index);
+        return NULL;
+    }
+    assert(BlockMeta_IsFree(superblock));
+    *size = BlockMeta_SuperblockSize(superblock);
+    assert(*size > 0);
+    // the size is only kept while the superblock is in a free list
+    BlockMeta_SetFlagAndSuperblockSize(superblock, block_free, 0);
+    return superblock;
+}
+
+/**
+ * Takes the smallest free superblock of at least `minSize` blocks out of the
+ * free lists, NULL if there is none.
+ */
+inline static BlockMeta *
+BlockAllocator_pollSuperblock(BlockAllocator *blockAllocator, uint32_t minSize,
+                              uint32_t *size) {
+    // acquire all the changes done by sweeping
+    atomic_thread_fence(memory_order_acquire);
+    int index = BlockAllocator_nextNonEmpty(
+        blockAllocator, BlockAllocator_fitClass(minSize));
+    while (index >= 0) {
+        BlockMeta *superblock =
+            BlockAllocator_popList(blockAllocator, index, size);
         if (superblock != NULL) {
-            *index = i;
+            assert(*size >= minSize);
             return superblock;
         }
+        index = BlockAllocator_nextNonEmpty(blockAllocator, index + 1);
     }
     return NULL;
 }
@@ -80,18 +179,12 @@ extern Heap heap;
 
 NOINLINE BlockMeta *
 BlockAllocator_getFreeBlockSlow(BlockAllocator *blockAllocator) {
-    int index = 0;
-    BlockMeta *superblock;
+    uint32_t size;
     bool concurrent = blockAllocator->concurrent;
-    if (concurrent) {
-        superblock = BlockAllocator_pollSuperblock(blockAllocator, &index);
-    } else {
-        superblock =
-            BlockAllocator_pollSuperblockOnlyThread(blockAllocator, &index);
-    }
+    BlockMeta *superblock =
+        BlockAllocator_pollSuperblock(blockAllocator, 1, &size);
     if (superblock != NULL) {
         blockAllocator->smallestSuperblock.cursor = superblock + 1;
-        uint32_t size = 1 << index;
         blockAllocator->smallestSuperblock.limit = superblock + size;
         assert(BlockMeta_IsFree(superblock));
         assert(superblock->debugFlag == dbg_free_in_collection);
@@ -169,21 +262,15 @@ BlockMeta *BlockAllocator_GetFreeSuperblock(BlockAllocator *blockAllocator,
         superblock = sCursor;
     } else {
         // look in the freelists
-        int index = MathUtils_Log2Ceil((size_t)size);
-        bool concurrent = blockAllocator->concurrent;
-        if (concurrent) {
-            superblock = BlockAllocator_pollSuperblock(blockAllocator, &index);
-        } else {
-            superblock = BlockAllocator_pollSuperblockOnlyThread(
-                blockAllocator, &index);
-        }
-        uint32_t receivedSize = 1 << index;
+        uint32_t receivedSize;
+        superblock =
+            BlockAllocator_pollSuperblock(blockAllocator, size, &receivedSize);
 
         if (superblock != NULL) {
             if (receivedSize > size) {
                 BlockMeta *leftover = superblock + size;
-                BlockAllocator_splitAndAdd(blockAllocator, leftover,
-                                           receivedSize - size);
+                BlockAllocator_addSuperblock(blockAllocator, leftover,
+                                             receivedSize - size);
             }
         } else {
             // as the last resort look in the superblock being coalesced
@@ -228,45 +315,14 @@ BlockMeta *BlockAllocator_GetFreeSuperblock(BlockAllocator *blockAllocator,
     return superblock;
 }
 
-void BlockAllocator_splitAndAdd(BlockAllocator *blockAllocator,
-                                BlockMeta *superblock, uint32_t count) {
-    uint32_t remaining_count = count;
-    uint32_t powerOf2 = 1;
-    BlockMeta *current = superblock;
-    word_t *blockMetaStart = blockAllocator->blockMetaStart;
-    // splits the superblock into smaller superblocks that are a powers of 2
-    while (remaining_count > 0) {
-        if ((powerOf2 & remaining_count) > 0) {
-            int i = BlockAllocator_sizeToLinkedListIndex(powerOf2);
-            BlockList_Push(&blockAllocator->freeSuperblocks[i], blockMetaStart,
-                           current);
-
-            remaining_count -= powerOf2;
-            current += powerOf2;
-        }
-        powerOf2 <<= 1;
-    }
-}
-
-void BlockAllocator_splitAndAddLocal(BlockAllocator *blockAllocator,
-                                     LocalBlockList *localBlockListStart,
-                                     BlockMeta *superblock, uint32_t count) {
-    uint32_t remaining_count = count;
-    uint32_t powerOf2 = 1;
-    BlockMeta *current = superblock;
-    word_t *blockMetaStart = blockAllocator->blockMetaStart;
-    // splits the superblock into smaller superblocks that are a powers of 2
-    while (remaining_count > 0) {
-        if ((powerOf2 & remaining_count) > 0) {
-            int i = BlockAllocator_sizeToLinkedListIndex(powerOf2);
-            LocalBlockList_Push(localBlockListStart + i, blockMetaStart,
-                                current);
-
-            remaining_count -= powerOf2;
-            current += powerOf2;
-        }
-        powerOf2 <<= 1;
-    }
+void BlockAllocator_addSuperblock(BlockAllocator *blockAllocator,
+                                  BlockMeta *superblock, uint32_t count) {
+    assert(BlockMeta_IsFree(superblock));
+    BlockMeta_SetFlagAndSuperblockSize(superblock, block_free, count);
+    int i = BlockAllocator_sizeClass(count);
+    BlockList_Push(&blockAllocator->freeSuperblocks[i],
+                   blockAllocator->blockMetaStart, superblock);
+    BlockAllocator_setNonEmpty(blockAllocator, i);
 }
 
 void BlockAllocator_AddFreeSuperblockLocal(BlockAllocator *blockAllocator,
@@ -291,7 +347,11 @@ void BlockAllocator_AddFreeSuperblockLocal(BlockAllocator *blockAllocator,
         current->debugFlag = dbg_free_in_collection;
 #endif
     }
-    BlockAllocator_splitAndAdd(blockAllocator, superblock, count);
+    BlockMeta_SetFlagAndSuperblockSize(superblock, block_free, count);
+    int i = BlockAllocator_sizeClass(count);
+    assert(i < SUPERBLOCK_LOCAL_LIST_SIZE);
+    LocalBlockList_Push(localBlockListStart + i, blockAllocator->blockMetaStart,
+                        superblock);
     // blockAllocator->freeBlockCount += count;
     atomic_fetch_add_explicit(&blockAllocator->freeBlockCount, count,
                               memory_order_relaxed);
@@ -317,7 +377,7 @@ void BlockAllocator_AddFreeSuperblock(BlockAllocator *blockAllocator,
         current->debugFlag = dbg_free_in_collection;
 #endif
     }
-    BlockAllocator_splitAndAdd(blockAllocator, superblock, count);
+    BlockAllocator_addSuperblock(blockAllocator, superblock, count);
     // blockAllocator->freeBlockCount += count;
     atomic_fetch_add_explicit(&blockAllocator->freeBlockCount, count,
                               memory_order_relaxed);
@@ -353,13 +413,62 @@ void BlockAllocator_AddFreeBlocks(BlockAllocator *blockAllocator,
     if (size > 0) {
         BlockMeta *replaced = BlockMeta_GetFromIndex(
             blockAllocator->blockMetaStart, BlockRange_First(oldRange));
-        BlockAllocator_splitAndAdd(blockAllocator, replaced, size);
+        BlockAllocator_addSuperblock(blockAllocator, replaced, size);
     }
     // blockAllocator->freeBlockCount += count;
     atomic_fetch_add_explicit(&blockAllocator->freeBlockCount, count,
                               memory_order_relaxed);
 }
 
+/**
+ * Publishes the superblocks a sweeper collected in its local lists, one per
+ * size class.
+ */
+void BlockAllocator_AddLocalLists(BlockAllocator *blockAllocator,
+                                  LocalBlockList *localBlockListStart,
+                                  int count) {
+    assert(count <= SUPERBLOCK_LIST_SIZE);
+    for (int i = 0; i < count; i++) {
+        LocalBlockList *item = localBlockListStart + i;
+        if (item->first != NULL) {
+            BlockList_PushAll(&blockAllocator->freeSuperblocks[i],
+                              blockAllocator->blockMetaStart, item->first,
+                              item->last);
+            BlockAllocator_setNonEmpty(blockAllocator, i);
+        }
+    }
+}
+
+/**
+ * Takes the largest free superblock out of the free lists, NULL if there is
+ * none. If it has more than `maxSize` blocks, the rest is put back. Its size is
+ * returned in `size`.
+ */
+BlockMeta *BlockAllocator_PollFreeSuperblock(BlockAllocator *blockAllocator,
+                                             uint32_t maxSize, uint32_t *size) {
+    assert(maxSize > 0);
+    atomic_thread_fence(memory_order_acquire);
+    int index =
+        BlockAllocator_prevNonEmpty(blockAllocator, SUPERBLOCK_LIST_SIZE - 1);
+    while (index >= 0) {
+        BlockMeta *superblock =
+            BlockAllocator_popList(blockAllocator, index, size);
+        if (superblock != NULL) {
+            if (*size > maxSize) {
+                BlockAllocator_addSuperblock(blockAllocator,
+                                             superblock + maxSize,
+                                             *size - maxSize);
+                *size = maxSize;
+            }
+            atomic_fetch_sub_explicit(&blockAllocator->freeBlockCount, *size,
+                                      memory_order_relaxed);
+            return superblock;
+        }
+        index = BlockAllocator_prevNonEmpty(blockAllocator, index - 1);
+    }
+    return NULL;
+}
+
 void BlockAllocator_FinishCoalescing(BlockAllocator *blockAllocator) {
     blockAllocator->concurrent = false;
 }
@@ -368,27 +477,30 @@ void BlockAllocator_Clear(BlockAllocator *blockAllocator) {
     for (int i = 0; i < SUPERBLOCK_LIST_SIZE; i++) {
         BlockList_Clear(&blockAllocator->freeSuperblocks[i]);
     }
+    for (int i = 0; i < SUPERBLOCK_BITMAP_WORDS; i++) {
+        blockAllocator->nonEmptyLists[i] = 0;
+    }
     // sweeping is about to start, use concurrent data structures
     blockAllocator->concurrent = true;
     blockAllocator->freeBlockCount = 0;
     blockAllocator->smallestSuperblock.cursor = NULL;
     blockAllocator->smallestSuperblock.limit = NULL;
     BlockRange_Clear(&blockAllocator->coalescingSuperblock);
+    BlockList_Clear(&blockAllocator->recycledBlocks);
+    blockAllocator->recycledBlockCount = 0;
 }
 
 void BlockAllocator_ReserveBlocks(BlockAllocator *blockAllocator) {
-    int index = MathUtils_Log2Ceil((size_t)SWEEP_RESERVE_BLOCKS);
     assert(blockAllocator->concurrent);
-    BlockMeta *superblock =
-        BlockAllocator_pollSuperblock(blockAllocator, &index);
-
-    uint32_t receivedSize = 1 << index;
+    uint32_t receivedSize;
+    BlockMeta *superblock = BlockAllocator_pollSuperblock(
+        blockAllocator, SWEEP_RESERVE_BLOCKS, &receivedSize);
 
     if (superblock != NULL) {
         if (receivedSize > SWEEP_RESERVE_BLOCKS) {
             BlockMeta *leftover = superblock + SWEEP_RESERVE_BLOCKS;
-            BlockAllocator_splitAndAdd(blockAllocator, leftover,
-                                       receivedSize - SWEEP_RESERVE_BLOCKS);
+            BlockAllocator_addSuperblock(blockAllocator, leftover,
+                                         receivedSize - SWEEP_RESERVE_BLOCKS);
         }
     } else {
         // as the last resort look in the superblock being coalesced
@@ -418,7 +530,7 @@ void BlockAllocator_ReserveBlocks(BlockAllocator *blockAllocator) {
 void BlockAllocator_UseReserve(BlockAllocator *blockAllocator) {
     BlockMeta *reserved = (BlockMeta *)blockAllocator->reservedSuperblock;
     if (reserved != NULL) {
-        BlockAllocator_splitAndAdd(blockAllocator, reserved,
-                                   SWEEP_RESERVE_BLOCKS);
+        BlockAllocator_addSuperblock(blockAllocator, reserved,
+                                     SWEEP_RESERVE_BLOCKS);
     }
 }
\ No newline at end of file
@@ -7,12 +7,21 @@
 #include <stddef.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <pthread.h>
 
-#define SUPERBLOCK_LIST_SIZE (BLOCK_COUNT_BITS + 1)
+// Free superblocks are kept in segregated lists by size class, in the manner
+// of TLSF: every power of two is divided into SUPERBLOCK_SUBCLASS_COUNT linear
+// subclasses, so the superblocks in one list differ by less than 25% in size.
+// A bitmap tracks the lists that may be non-empty, the smallest list that
+// fits a request is found with a find-first-set.
+#define SUPERBLOCK_SUBCLASS_BITS 2
+#define SUPERBLOCK_SUBCLASS_COUNT (1 << SUPERBLOCK_SUBCLASS_BITS)
+#define SUPERBLOCK_LIST_SIZE (BLOCK_COUNT_BITS << SUPERBLOCK_SUBCLASS_BITS)
+#define SUPERBLOCK_BITMAP_WORDS ((SUPERBLOCK_LIST_SIZE + 63) / 64)
 
 typedef struct {
-    // no need to synchronize smallestSuperblock,
-    // it is only accessed from the mutator thread
+    // no need to synchronize smallestSuperblock, it is only accessed by the
+    // mutator thread that holds `lock`
     struct {
         BlockMeta *cursor;
         BlockMeta *limit;
@@ -22,7 +31,14 @@ typedef struct {
     word_t *blockMetaStart;
     atomic_bool concurrent;
     BlockList freeSuperblocks[SUPERBLOCK_LIST_SIZE];
+    atomic_uint_fast64_t nonEmptyLists[SUPERBLOCK_BITMAP_WORDS];
     atomic_uintptr_t reservedSuperblock;
+    // blocks with free lines, filled by the sweepers
+    BlockList recycledBlocks;
+    atomic_uint_fast32_t recycledBlockCount;
+    // Held by the mutator threads while they take blocks. The parts meant for
+    // a single mutator thread see one at a time, the sweepers do not take it.
+    pthread_mutex_t lock;
 } BlockAllocator;
 
 void BlockAllocator_Init(BlockAllocator *blockAllocator, word_t *blockMetaStart,
@@ -38,9 +54,22 @@ void BlockAllocator_AddFreeSuperblockLocal(BlockAllocator *blockAllocator,
                                            LocalBlockList *localBlockListStart,
                                            BlockMeta *superblock,
                                            uint32_t count);
+void BlockAllocator_AddLocalLists(BlockAllocator *blockAllocator,
+                                  LocalBlockList *localBlockListStart,
+                                  int count);
+BlockMeta *BlockAllocator_PollFreeSuperblock(BlockAllocator *blockAllocator,
+                                             uint32_t maxSize, uint32_t *size);
 void BlockAllocator_FinishCoalescing(BlockAllocator *blockAllocator);
 void BlockAllocator_ReserveBlocks(BlockAllocator *blockAllocator);
 void BlockAllocator_UseReserve(BlockAllocator *blockAllocator);
 void BlockAllocator_Clear(BlockAllocator *blockAllocator);
 
+static inline void BlockAllocator_Lock(BlockAllocator *blockAllocator) {
+    pthread_mutex_lock(&blockAllocator->lock);
+}
+
+static inline void BlockAllocator_Unlock(BlockAllocator *blockAllocator) {
+    pthread_mutex_unlock(&blockAllocator->lock);
+}
+
 #endif // IMMIX_BLOCKALLOCATOR_H
\ No newline at end of file
@@ -0,0 +1,216 @@
+#ifndef _GNU_SOURCE
+// for CPU_COUNT
+#define _GNU_SOURCE
+#endif
+#include "Container.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifndef CGROUP_MOUNT
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#endif
+
+#ifdef __linux__
+
+/**
+ * Finds the path of the cgroup of the process in the hierarchy that has
+ * `controller`, or in the unified hierarchy of cgroup v2 if it is NULL.
+ */
+static bool Container_cgroupPath(const char *controller, char *path,
+                                 size_t size) {
+    FILE *file = fopen("/proc/self/cgroup", "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[PATH_MAX + 64];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        // hierarchy-id:controller-list:cgroup-path
+        char *controllers = strchr(line, ':');
+        char *cgroup = controllers == NULL ? NULL : strchr(controllers + 1, ':');
+        if (cgroup == NULL) {
+            continue;
+        }
+        controllers++;
+        *cgroup++ = '\0';
+        cgroup[strcspn(cgroup, "\n")] = '\0';
+        if (controller == NULL) {
+            found = *controllers == '\0';
+        } else {
+            char *saved;
+            for (char *name = strtok_r(controllers, ",", &saved);
+                 name != NULL && !found; name = strtok_r(NULL, ",", &saved)) {
+                found = strcmp(name, controller) == 0;
+            }
+        }
+        if (found) {
+            snprintf(path, size, "%s", cgroup);
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+static bool Container_readFile(const char *dir, const char *name, char *buffer,
+                               size_t size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    bool read = fgets(buffer, (int)size, file) != NULL;
+    fclose(file);
+    return read;
+}
+
+// reads a limit of the cgroup in `dir`, UINT64_MAX if it has none
+typedef uint64_t (*Container_LimitReader)(const char *dir);
+
+/**
+ * Returns the lowest limit of the cgroup and its ancestors. Inside a cgroup
+ * namespace the path does not exist under the mount, the root of the mount is
+ * the cgroup of the process then.
+ */
+static uint64_t Container_hierarchyLimit(const char *mount, const char *cgroup,
+                                         Container_LimitReader read) {
+    char dir[PATH_MAX];
+    int length = snprintf(dir, sizeof(dir), "%s%s", mount, cgroup);
+    if (length >= (int)sizeof(dir) || access(dir, F_OK) != 0) {
+        return read(mount);
+    }
+    size_t mountLength = strlen(mount);
+    uint64_t limit = UINT64_MAX;
+    while (true) {
+        uint64_t value = read(dir);
+        if (value < limit) {
+            limit = value;
+        }
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL || (size_t)(slash - dir) < mountLength) {
+            break;
+        }
+        *slash = '\0';
+    }
+    return limit;
+}
+
+static uint64_t Container_readBytes(const char *dir, const char *name) {
+    char value[64];
+    unsigned long long bytes;
+    // "max" does not parse, there is no limit
+    if (Container_readFile(dir, name, value, sizeof(value)) &&
+        sscanf(value, "%llu", &bytes) == 1) {
+        return bytes;
+    }
+    return UINT64_MAX;
+}
+
+static uint64_t Container_memoryMax(const char *dir) {
+    return Container_readBytes(dir, "memory.max");
+}
+
+static uint64_t Container_memoryLimitInBytes(const char *dir) {
+    return Container_readBytes(dir, "memory.limit_in_bytes");
+}
+
+static uint64_t Container_processors(long long quota, long long period) {
+    if (quota <= 0 || period <= 0) {
+        return UINT64_MAX;
+    }
+    return (uint64_t)((quota + period - 1) / period);
+}
+
+static uint64_t Container_cpuMax(const char *dir) {
+    char value[64];
+    long long quota, period;
+    // "max 100000" does not parse, there is no quota
+    if (Container_readFile(dir, "cpu.max", value, sizeof(value)) &&
+        sscanf(value, "%lld %lld", &quota, &period) == 2) {
+        return Container_processors(quota, period);
+    }
+    return UINT64_MAX;
+}
+
+static uint64_t Container_cfsQuota(const char *dir) {
+    char value[64];
+    long long quota, period;
+    if (Container_readFile(dir, "cpu.cfs_quota_us", value, sizeof(value)) &&
+        sscanf(value, "%lld", &quota) == 1 &&
+        Container_readFile(dir, "cpu.cfs_period_us", value, sizeof(value)) &&
+        sscanf(value, "%lld", &period) == 1) {
+        // the quota is -1 when there is none
+        return Container_processors(quota, period);
+    }
+    return UINT64_MAX;
+}
+
+static bool Container_isUnified() {
+    return access(CGROUP_MOUNT "/cgroup.controllers", F_OK) == 0;
+}
+
+#endif // __linux__
+
+/**
+ * Returns the memory limit of the cgroup in bytes, 0 if there is none.
+ * cgroup v1 reports no limit as a huge value, the caller takes the minimum
+ * with the physical memory anyway.
+ */
+size_t Container_MemoryLimit() {
+    uint64_t limit = UINT64_MAX;
+#ifdef __linux__
+    char cgroup[PATH_MAX];
+    if (Container_isUnified()) {
+        if (Container_cgroupPath(NULL, cgroup, sizeof(cgroup))) {
+            limit = Container_hierarchyLimit(CGROUP_MOUNT, cgroup,
+                                             Container_memoryMax);
+        }
+    } else if (Container_cgroupPath("memory", cgroup, sizeof(cgroup))) {
+        limit = Container_hierarchyLimit(CGROUP_MOUNT "/memory", cgroup,
+                                         Container_memoryLimitInBytes);
+    }
+#endif
+    if (limit == UINT64_MAX || limit > SIZE_MAX) {
+        return 0;
+    }
+    return (size_t)limit;
+}
+
+/**
+ * Returns the number of processors the process can use: the online ones,
+ * bounded by the affinity mask and by the CPU quota of the cgroup rounded up.
+ */
+int Container_ProcessorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        int affinity = CPU_COUNT(&set);
+        if (affinity > 0 && affinity < count) {
+            count = affinity;
+        }
+    }
+    char cgroup[PATH_MAX];
+    uint64_t quota = UINT64_MAX;
+    if (Container_isUnified()) {
+        if (Container_cgroupPath(NULL, cgroup, sizeof(cgroup))) {
+            quota = Container_hierarchyLimit(CGROUP_MOUNT, cgroup,
+                                             Container_cpuMax);
+        }
+    } else if (Container_cgroupPath("cpu", cgroup, sizeof(cgroup))) {
+        quota = Container_hierarchyLimit(CGROUP_MOUNT "/cpu", cgroup,
+                                         Container_cfsQuota);
+    }
+    if (quota < (uint64_t)count) {
+        count = (long)quota;
+    }
+#endif
+    return count < 1 ? 1 : (int)count;
+}
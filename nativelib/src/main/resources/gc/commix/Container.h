@@ -0,0 +1,12 @@
+#ifndef IMMIX_CONTAINER_H
+#define IMMIX_CONTAINER_H
+
+#include <stddef.h>
+
+// Limits put on the process by the cgroup it runs in, v1 or v2, which can be
+// far below what the machine has. Containers set them, as does systemd.
+
+size_t Container_MemoryLimit();
+int Container_ProcessorCount();
+
+#endif // IMMIX_CONTAINER_H
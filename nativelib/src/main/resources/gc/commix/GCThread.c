@@ -3,40 +3,51 @@
 #include "Sweeper.h"
 #include "Marker.h"
 #include "Phase.h"
+#include "Trace.h"
+#include "../../pprof/CpuProfiler.h"
 #include <semaphore.h>
 
-static inline void GCThread_markMaster(Heap *heap, Stats *stats) {
+static inline void GCThread_markMaster(GCThread *thread, Heap *heap,
+                                       Stats *stats) {
+    uint64_t traceStart_ns = Trace_Start();
     Stats_RecordTime(stats, start_ns);
     Stats_MarkStarted(stats);
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_mark);
 
     while (!Marker_IsMarkDone(heap)) {
-        Marker_MarkAndScale(heap, stats);
-        if (!Marker_IsMarkDone(heap)) {
-            sched_yield();
-        }
+        Marker_MarkAndScale(heap, stats, thread->deque);
+        Marker_AwaitWork(heap, stats);
     }
 
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_concurrent_mark, start_ns, end_ns);
     Stats_RecordEventSync(stats, mark_waiting, stats->mark_waiting_start_ns,
                           stats->mark_waiting_end_ns);
+    CpuProfiler_LeavePhase(phase);
+    Trace_End(trace_mark, traceStart_ns, 0);
 }
 
-static inline void GCThread_mark(Heap *heap, Stats *stats) {
+static inline void GCThread_mark(GCThread *thread, Heap *heap, Stats *stats) {
+    uint64_t traceStart_ns = Trace_Start();
     Stats_RecordTime(stats, start_ns);
     Stats_MarkStarted(stats);
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_mark);
 
-    Marker_Mark(heap, stats);
+    Marker_Mark(heap, stats, thread->deque);
     // Marker on the worker thread stops after failing to get a full packet.
 
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_concurrent_mark, start_ns, end_ns);
     Stats_RecordEvent(stats, mark_waiting, stats->mark_waiting_start_ns,
                       stats->mark_waiting_end_ns);
+    CpuProfiler_LeavePhase(phase);
+    Trace_End(trace_mark, traceStart_ns, 0);
 }
 
 static inline void GCThread_sweep(GCThread *thread, Heap *heap, Stats *stats) {
     thread->sweep.cursorDone = 0;
+    uint64_t sweepStart_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
     Stats_RecordTime(stats, start_ns);
 
     while (heap->sweep.cursor < heap->sweep.limit) {
@@ -46,11 +57,15 @@ static inline void GCThread_sweep(GCThread *thread, Heap *heap, Stats *stats) {
 
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_concurrent_sweep, start_ns, end_ns);
+    CpuProfiler_LeavePhase(phase);
+    Heap_RecordSweep(heap, trace_sweep, sweepStart_ns);
 }
 
 static inline void GCThread_sweepMaster(GCThread *thread, Heap *heap,
                                         Stats *stats) {
     thread->sweep.cursorDone = 0;
+    uint64_t sweepStart_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
     Stats_RecordTime(stats, start_ns);
 
     while (heap->sweep.cursor < heap->sweep.limit) {
@@ -58,14 +73,22 @@ static inline void GCThread_sweepMaster(GCThread *thread, Heap *heap,
         Sweeper_LazyCoalesce(heap, stats);
     }
     thread->sweep.cursorDone = heap->sweep.limit;
+    Parker *parker = &heap->sweep.parker;
     while (!Sweeper_IsCoalescingDone(heap)) {
-        Sweeper_LazyCoalesce(heap, stats);
+        uint32_t epoch = Parker_Prepare(parker);
+        if (!Sweeper_LazyCoalesce(heap, stats)) {
+            // wait for the other sweepers to finish their batches
+            Parker_Park(parker, stats, epoch);
+        }
+        Parker_Leave(parker);
     }
     if (!heap->sweep.postSweepDone) {
         Phase_SweepDone(heap, stats);
     }
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_concurrent_sweep, start_ns, end_ns);
+    CpuProfiler_LeavePhase(phase);
+    Heap_RecordSweep(heap, trace_sweep, sweepStart_ns);
 }
 
 void *GCThread_loop(void *arg) {
@@ -73,9 +96,13 @@ void *GCThread_loop(void *arg) {
     Heap *heap = thread->heap;
     sem_t *start = heap->gcThreads.startWorkers;
     Stats *stats = Stats_OrNull(thread->stats);
+    Trace_NameThread("gc thread", thread->id);
+    CpuProfiler_EnterPhase(cpu_gc);
 
     while (true) {
         thread->active = false;
+        // the master may be waiting to coalesce what this thread swept
+        Parker_Signal(&heap->sweep.parker);
         sem_wait(start);
         // hard fence before proceeding with the next phase
         atomic_thread_fence(memory_order_seq_cst);
@@ -86,7 +113,7 @@ void *GCThread_loop(void *arg) {
         case gc_idle:
             break;
         case gc_mark:
-            GCThread_mark(heap, stats);
+            GCThread_mark(thread, heap, stats);
             break;
         case gc_sweep:
             GCThread_sweep(thread, heap, stats);
@@ -104,8 +131,12 @@ void *GCThread_loopMaster(void *arg) {
     Heap *heap = thread->heap;
     sem_t *start = heap->gcThreads.startMaster;
     Stats *stats = Stats_OrNull(thread->stats);
+    Trace_NameThread("gc thread", thread->id);
+    CpuProfiler_EnterPhase(cpu_gc);
     while (true) {
         thread->active = false;
+        // the master may be waiting to coalesce what this thread swept
+        Parker_Signal(&heap->sweep.parker);
         sem_wait(start);
         // hard fence before proceeding with the next phase
         atomic_thread_fence(memory_order_seq_cst);
@@ -116,7 +147,7 @@ void *GCThread_loopMaster(void *arg) {
         case gc_idle:
             break;
         case gc_mark:
-            GCThread_markMaster(heap, stats);
+            GCThread_markMaster(thread, heap, stats);
             break;
         case gc_sweep:
             GCThread_sweepMaster(thread, heap, stats);
@@ -132,6 +163,7 @@ void *GCThread_loopMaster(void *arg) {
 void GCThread_Init(GCThread *thread, int id, Heap *heap, Stats *stats) {
     thread->id = id;
     thread->heap = heap;
+    thread->deque = &heap->mark.deques[id];
     thread->stats = stats;
     thread->active = false;
     // we do not use the pthread value
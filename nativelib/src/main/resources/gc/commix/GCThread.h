@@ -10,6 +10,7 @@
 typedef struct {
     int id;
     Heap *heap;
+    GreyDeque *deque;
     atomic_bool active;
     struct {
         // making cursorDone atomic so it keeps sequential consistency with the
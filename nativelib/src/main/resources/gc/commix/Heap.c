@@ -11,9 +11,16 @@
 #include "StackTrace.h"
 #include "Settings.h"
 #include "Memory.h"
+#include "Container.h"
+#include "Trace.h"
 #include "GCThread.h"
 #include "Sweeper.h"
 #include "Phase.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "MutatorThread.h"
+#include "Safepoint.h"
+#include "../../pprof/CpuProfiler.h"
 #include <memory.h>
 #include <time.h>
 #include <inttypes.h>
@@ -25,19 +32,36 @@
 // Map anonymous memory (not a file)
 #define HEAP_MEM_FD -1
 #define HEAP_MEM_FD_OFFSET 0
+// Release the pages of free blocks, they read as zero when touched again
+#if defined(__linux__)
+#define HEAP_MEM_UNCOMMIT MADV_DONTNEED
+#else
+#define HEAP_MEM_UNCOMMIT MADV_FREE
+#endif
 
 void Heap_exitWithOutOfMemory() {
     printf("Out of heap space\n");
+    HeapDump_OnOutOfMemory(&heap);
     StackTrace_PrintStackTrace();
     exit(1);
 }
 
 bool Heap_isGrowingPossible(Heap *heap, uint32_t incrementInBlocks) {
-    return heap->blockCount + incrementInBlocks <= heap->maxBlockCount;
+    return Heap_CommittedBlockCount(heap) + incrementInBlocks <=
+           heap->maxBlockCount;
 }
 
+/**
+ * Returns the default maximum heap size, the physical memory unless the cgroup
+ * allows less. Then only a part of the cgroup limit is taken, the rest of the
+ * process has to fit under it too.
+ */
 size_t Heap_getMemoryLimit() {
     size_t memorySize = getMemorySize();
+    size_t containerLimit = Container_MemoryLimit();
+    if (containerLimit != 0 && containerLimit < memorySize) {
+        memorySize = (size_t)(containerLimit * CONTAINER_HEAP_RATIO);
+    }
     if ((uint64_t)memorySize > MAX_HEAP_SIZE) {
         return (size_t)MAX_HEAP_SIZE;
     } else {
@@ -63,26 +87,58 @@ word_t *Heap_mapAndAlign(size_t memoryLimit, size_t alignmentSize) {
     return heapStart;
 }
 
+/**
+ * Asks the OS to back the range with transparent huge pages where the
+ * alignment allows it.
+ */
+static void Heap_adviseHugePages(void *start, size_t size) {
+#ifdef MADV_HUGEPAGE
+    word_t pageMask = (word_t)sysconf(_SC_PAGESIZE) - 1;
+    word_t first = (word_t)start & ~pageMask;
+    madvise((void *)first, (word_t)start + size - first, MADV_HUGEPAGE);
+#endif
+}
+
+/**
+ * Faults in the pages of the range, so that the allocation fast path does not
+ * pay for first touches.
+ */
+static void Heap_prefault(void *start, void *end) {
+    word_t pageSize = (word_t)sysconf(_SC_PAGESIZE);
+    word_t first = (word_t)start & ~(pageSize - 1);
+#ifdef MADV_POPULATE_WRITE
+    if (madvise((void *)first, (word_t)end - first, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    // the memory is freshly mapped, writing zeros does not change it
+    for (word_t page = first; page < (word_t)end; page += pageSize) {
+        *(volatile ubyte_t *)page = 0;
+    }
+}
+
 #ifdef ENABLE_GC_STATS
-INLINE Stats *Heap_createMutatorStats(void) {
+INLINE Stats *Heap_createMutatorStats(Heap *heap) {
     char *statsFile = Settings_StatsFileName();
     if (statsFile != NULL) {
         Stats *stats = malloc(sizeof(Stats));
-        Stats_Init(stats, statsFile, MUTATOR_THREAD_ID);
+        Stats_Init(stats, statsFile, MUTATOR_THREAD_ID, heap->hugePages,
+                   heap->prefault);
         return stats;
     } else {
         return NULL;
     }
 }
 
-INLINE Stats *Heap_createStatsForThread(int id) {
+INLINE Stats *Heap_createStatsForThread(Heap *heap, int id) {
     char *statsFile = Settings_StatsFileName();
     if (statsFile != NULL) {
         int len = strlen(statsFile) + 5;
         char *threadSpecificFile = (char *)malloc(len);
         snprintf(threadSpecificFile, len, "%s.t%d", statsFile, id);
         Stats *stats = malloc(sizeof(Stats));
-        Stats_Init(stats, threadSpecificFile, (uint8_t)id);
+        Stats_Init(stats, threadSpecificFile, (uint8_t)id, heap->hugePages,
+                   heap->prefault);
         return stats;
     } else {
         return NULL;
@@ -91,6 +147,24 @@ INLINE Stats *Heap_createStatsForThread(int id) {
 
 #endif
 
+/**
+ * Reports the limits the defaults are derived from and the effective values,
+ * in the runs that record stats.
+ */
+static void Heap_logLimits(Heap *heap) {
+    size_t memorySize = getMemorySize();
+    size_t containerLimit = Container_MemoryLimit();
+    fprintf(stderr, "GC limits: memory %zum, cgroup memory ", memorySize >> 20);
+    if (containerLimit == 0 || containerLimit >= memorySize) {
+        fprintf(stderr, "none");
+    } else {
+        fprintf(stderr, "%zum", containerLimit >> 20);
+    }
+    fprintf(stderr, ", processors %d, max heap %zum, GC threads %u\n",
+            Container_ProcessorCount(), heap->maxHeapSize >> 20,
+            heap->gcThreads.count);
+}
+
 /**
  * Allocates the heap struct and initializes it
  */
@@ -136,6 +210,12 @@ void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize) {
     heap->maxBlockCount = maxNumberOfBlocks;
     heap->maxMarkTimeRatio = Settings_MaxMarkTimeRatio();
     heap->minFreeRatio = Settings_MinFreeRatio();
+    heap->uncommit.delay_ns = Settings_UncommitDelay() * 1000000;
+    heap->uncommit.excessSince_ns = 0;
+    heap->uncommit.blockCount = 0;
+    heap->uncommit.minBlockCount = initialBlockCount;
+    SizingPolicy_Init(&heap->sizing, Settings_PauseTarget(),
+                      Settings_OverheadTarget());
 
     // reserve space for block headers
     size_t blockMetaSpaceSize = maxNumberOfBlocks * sizeof(BlockMeta);
@@ -154,25 +234,73 @@ void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize) {
     heap->lineMetaEnd = lineMetaStart + initialBlockCount * LINE_COUNT *
                                             LINE_METADATA_SIZE / WORD_SIZE;
 
-    word_t *heapStart = Heap_mapAndAlign(maxHeapSize, BLOCK_TOTAL_SIZE);
+    // reserve space for the crossing map
+    size_t crossingMetaSpaceSize =
+        (size_t)maxNumberOfBlocks * LINE_COUNT * CROSSING_METADATA_SIZE;
+    word_t *crossingMetaStart =
+        Heap_mapAndAlign(crossingMetaSpaceSize, WORD_SIZE);
+    heap->crossingMetaStart = crossingMetaStart;
+    assert(LINE_COUNT * CROSSING_METADATA_SIZE % WORD_SIZE == 0);
+    heap->crossingMetaEnd =
+        crossingMetaStart +
+        initialBlockCount * LINE_COUNT * CROSSING_METADATA_SIZE / WORD_SIZE;
+
+    heap->generational.enabled = Settings_Generational();
+    if (heap->generational.enabled) {
+        // reserve space for the card table
+        size_t cardMetaSpaceSize =
+            (size_t)maxNumberOfBlocks * CARD_COUNT * CARD_METADATA_SIZE;
+        word_t *cardMetaStart = Heap_mapAndAlign(cardMetaSpaceSize, WORD_SIZE);
+        heap->cardMetaStart = cardMetaStart;
+        assert(CARD_COUNT * CARD_METADATA_SIZE % WORD_SIZE == 0);
+        heap->cardMetaEnd = cardMetaStart + initialBlockCount * CARD_COUNT *
+                                                CARD_METADATA_SIZE / WORD_SIZE;
+    }
+
+    heap->hugePages = Settings_HugePages();
+    heap->prefault = Settings_Prefault();
+    heap->markPrefetchDistance = Settings_MarkPrefetchDistance();
+
+    word_t *heapStart;
+    if (heap->hugePages) {
+        // map one more huge page so that aligning the start keeps the size
+        heapStart =
+            Heap_mapAndAlign(maxHeapSize + HUGE_PAGE_SIZE, HUGE_PAGE_SIZE);
+        Heap_adviseHugePages(heapStart, maxHeapSize);
+    } else {
+        heapStart = Heap_mapAndAlign(maxHeapSize, BLOCK_TOTAL_SIZE);
+    }
 
     BlockAllocator_Init(&blockAllocator, blockMetaStart, initialBlockCount);
     GreyList_Init(&heap->mark.empty);
     GreyList_Init(&heap->mark.full);
-    uint32_t greyPacketCount =
+    // the region is reserved for the largest pool, packets are only touched
+    // once the pool has grown over them, see `Marker_takeEmptyPacket`
+    uint32_t greyPacketLimit =
         (uint32_t)(maxHeapSize * GREY_PACKET_RATIO / GREY_PACKET_SIZE);
-    heap->mark.total = greyPacketCount;
+    if (greyPacketLimit < GREY_PACKET_INITIAL_COUNT) {
+        greyPacketLimit = GREY_PACKET_INITIAL_COUNT;
+    }
+    heap->mark.limit = greyPacketLimit;
+    heap->mark.total = GREY_PACKET_INITIAL_COUNT;
+    heap->mark.grown = false;
+    heap->mark.overflow = false;
+    pthread_mutex_init(&heap->mark.growMutex, NULL);
+    Parker_Init(&heap->mark.parker);
     word_t *greyPacketsStart =
-        Heap_mapAndAlign(greyPacketCount * sizeof(GreyPacket), WORD_SIZE);
+        Heap_mapAndAlign(greyPacketLimit * sizeof(GreyPacket), WORD_SIZE);
     heap->greyPacketsStart = greyPacketsStart;
     GreyList_PushAll(&heap->mark.empty, greyPacketsStart,
-                     (GreyPacket *)greyPacketsStart, greyPacketCount);
+                     (GreyPacket *)greyPacketsStart, GREY_PACKET_INITIAL_COUNT);
 
     // reserve space for bytemap
     Bytemap *bytemap = (Bytemap *)Heap_mapAndAlign(
         maxHeapSize / ALLOCATION_ALIGNMENT + sizeof(Bytemap),
         ALLOCATION_ALIGNMENT);
     heap->bytemap = bytemap;
+    if (heap->hugePages) {
+        Heap_adviseHugePages(bytemap, maxHeapSize / ALLOCATION_ALIGNMENT);
+    }
 
     // Init heap for small objects
     heap->heapSize = minHeapSize;
@@ -182,53 +310,236 @@ void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize) {
     Phase_Init(heap, initialBlockCount);
 
     Bytemap_Init(bytemap, heapStart, maxHeapSize);
-    Allocator_Init(&allocator, &blockAllocator, bytemap, blockMetaStart,
-                   heapStart);
+    if (heap->prefault) {
+        Heap_prefault(heapStart, heap->heapEnd);
+        Heap_prefault(Bytemap_Get(bytemap, heapStart),
+                      Bytemap_Get(bytemap, heap->heapEnd));
+        Heap_prefault(blockMetaStart, heap->blockMetaEnd);
+        Heap_prefault(lineMetaStart, heap->lineMetaEnd);
+        Heap_prefault(crossingMetaStart, heap->crossingMetaEnd);
+    }
+    heap->totals.nextLargeSample = Profiler_NextSampleDistance();
 
     LargeAllocator_Init(&largeAllocator, &blockAllocator, bytemap,
-                        blockMetaStart, heapStart);
+                        blockMetaStart, crossingMetaStart, heapStart);
 
     // Init all GCThreads
     // Init stats if enabled.
     // This must done before initializing other threads.
-    heap->stats = Stats_OrNull(Heap_createMutatorStats());
+    heap->stats = Stats_OrNull(Heap_createMutatorStats(heap));
 
-    int gcThreadCount = Settings_GCThreadCount();
+    uint32_t gcThreadCount = Settings_GCThreadCount();
     heap->gcThreads.count = gcThreadCount;
+    heap->mark.deques =
+        (GreyDeque *)malloc(sizeof(GreyDeque) * (gcThreadCount + 1));
+    for (uint32_t i = 0; i <= gcThreadCount; i++) {
+        GreyDeque_Init(&heap->mark.deques[i]);
+    }
+    heap->mark.workStealing = Settings_WorkStealing();
     Phase_Set(heap, gc_idle);
     GCThread *gcThreads = (GCThread *)malloc(sizeof(GCThread) * gcThreadCount);
     heap->gcThreads.all = (void *)gcThreads;
-    for (int i = 0; i < gcThreadCount; i++) {
-        Stats *stats = Stats_OrNull(Heap_createStatsForThread(i));
+    for (uint32_t i = 0; i < gcThreadCount; i++) {
+        Stats *stats = Stats_OrNull(Heap_createStatsForThread(heap, i));
         GCThread_Init(&gcThreads[i], i, heap, stats);
     }
 
     heap->mark.lastEnd_ns = scalanative_nano_time();
 
     pthread_mutex_init(&heap->sweep.growMutex, NULL);
+    pthread_mutex_init(&heap->lazySweep.mutex, NULL);
+    Parker_Init(&heap->sweep.parker);
+
+    if (heap->stats != NULL) {
+        Heap_logLimits(heap);
+    }
+}
+
+/**
+ * Marks every object as allocated again and forgets all remembered old
+ * objects, so that a full collection can trace the whole heap.
+ */
+void Heap_unstick(Heap *heap) {
+    ObjectMeta *bytemapStart = Bytemap_Get(heap->bytemap, heap->heapStart);
+    ObjectMeta_UnstickRange(bytemapStart,
+                            bytemapStart + (heap->heapEnd - heap->heapStart) /
+                                               ALLOCATION_ALIGNMENT_WORDS);
+    memset(heap->lineMetaStart, 0,
+           (heap->lineMetaEnd - heap->lineMetaStart) * WORD_SIZE);
+    memset(heap->cardMetaStart, 0,
+           (heap->cardMetaEnd - heap->cardMetaStart) * WORD_SIZE);
+    BlockMeta *current = (BlockMeta *)heap->blockMetaStart;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    for (; current < end; current++) {
+        if (BlockMeta_IsMarked(current)) {
+            BlockMeta_Unmark(current);
+        }
+    }
+}
+
+static void Heap_uncommitRange(void *start, size_t size) {
+    word_t pageMask = (word_t)sysconf(_SC_PAGESIZE) - 1;
+    // only pages that belong to the range alone
+    word_t first = ((word_t)start + pageMask) & ~pageMask;
+    word_t limit = ((word_t)start + size) & ~pageMask;
+    if (first < limit) {
+        madvise((void *)first, limit - first, HEAP_MEM_UNCOMMIT);
+    }
 }
 
+/**
+ * Halves the grey packet pool, down to its initial size, unless it had to grow
+ * during the marking that just finished. The memory of the packets that are
+ * dropped is returned to the OS. All the packets are empty at this point.
+ */
+static void Heap_shrinkGreyPackets(Heap *heap) {
+    uint32_t total = heap->mark.total;
+    bool grown = heap->mark.grown;
+    heap->mark.grown = false;
+    if (grown || total <= GREY_PACKET_INITIAL_COUNT) {
+        return;
+    }
+    uint32_t count = total / 2;
+    if (count < GREY_PACKET_INITIAL_COUNT) {
+        count = GREY_PACKET_INITIAL_COUNT;
+    }
+    GreyPacket *packets = (GreyPacket *)heap->greyPacketsStart;
+    word_t pageMask = (word_t)sysconf(_SC_PAGESIZE) - 1;
+    // The empty list is rebuilt in address order. Packets whose next reference
+    // is 0 link to the one that follows them, that must hold for the packets
+    // the pool grows over later as well. The pages that are returned read as
+    // zero, the packets on the pages at either end are cleared here.
+    word_t releasedStart = ((word_t)&packets[count] + pageMask) & ~pageMask;
+    word_t releasedEnd = (word_t)&packets[total] & ~pageMask;
+    for (GreyPacket *packet = packets; packet < &packets[total]; packet++) {
+        if ((word_t)packet < releasedStart || (word_t)packet >= releasedEnd) {
+            packet->next.atom = 0;
+        }
+    }
+    Heap_uncommitRange(&packets[count], (total - count) * sizeof(GreyPacket));
+    GreyList_Init(&heap->mark.empty);
+    heap->mark.total = count;
+    GreyList_PushAll(&heap->mark.empty, heap->greyPacketsStart, packets, count);
+}
+
+/**
+ * Returns `object` if it is marked, NULL if it is dead, see
+ * `Profiler_OnMarked`.
+ */
+static word_t *Heap_survivor(void *heapPtr, word_t *object) {
+    Heap *heap = (Heap *)heapPtr;
+    return ObjectMeta_IsMarked(Bytemap_Get(heap->bytemap, object)) ? object
+                                                                    : NULL;
+}
+
+/**
+ * Collects with the other mutator threads stopped. Returns without collecting
+ * if another thread collected in the meantime, its sweep frees memory.
+ */
 void Heap_Collect(Heap *heap) {
+    uint64_t start_ns = scalanative_nano_time();
+    // nothing is allocated while the world is stopped, a stopped thread may
+    // hold the lock of malloc
+    Trace_Reserve(heap->gcThreads.count);
+    if (!Safepoint_StopWorld()) {
+        return;
+    }
+    if (!Sweeper_IsSweepDone(heap)) {
+        Safepoint_ResumeWorld();
+        return;
+    }
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc);
     Stats *stats = Stats_OrNull(heap->stats);
     Stats_CollectionStarted(stats);
-    assert(Sweeper_IsSweepDone(heap));
+    bool young =
+        heap->generational.enabled && !heap->generational.fullRequested;
+    heap->generational.young = young;
+    heap->generational.fullRequested = false;
+    if (heap->generational.enabled && !young) {
+        Heap_unstick(heap);
+    }
 #ifdef DEBUG_ASSERT
     Sweeper_ClearIsSwept(heap);
-    Sweeper_AssertIsConsistent(heap);
+    if (!young) {
+        Sweeper_AssertIsConsistent(heap);
+    }
 #endif
     Phase_StartMark(heap);
-    Marker_MarkRoots(heap, stats);
+    CpuProfiler_EnterPhase(cpu_gc_mark);
+    Marker_MarkRoots(heap, stats, young);
     Marker_MarkUntilDone(heap, stats);
+    CpuProfiler_EnterPhase(cpu_gc);
+    Heap_shrinkGreyPackets(heap);
     Phase_MarkDone(heap);
-    Stats_RecordEvent(stats, event_mark, heap->mark.currentStart_ns,
-                      heap->mark.currentEnd_ns);
+    SizingPolicy_Record(&heap->sizing, heap->mark.currentStart_ns,
+                        heap->mark.currentEnd_ns, !young);
+    Stats_RecordEvent(stats, young ? event_mark_young : event_mark,
+                      heap->mark.currentStart_ns, heap->mark.currentEnd_ns);
+    Profiler_OnMarked(heap, Heap_survivor);
     Phase_StartSweep(heap);
+    uint64_t end_ns = scalanative_nano_time();
+    uint64_t pause_ns = end_ns - start_ns;
+    heap->totals.collections++;
+    heap->totals.lastPause_ns = pause_ns;
+    heap->totals.totalPause_ns += pause_ns;
+    if (pause_ns > heap->totals.maxPause_ns) {
+        heap->totals.maxPause_ns = pause_ns;
+    }
+    heap->totals.mark_ns +=
+        heap->mark.currentEnd_ns - heap->mark.currentStart_ns;
+    if (Trace_Enabled()) {
+        Trace_Record(trace_collection, start_ns, end_ns, young);
+        Trace_Record(trace_mark, heap->mark.currentStart_ns,
+                     heap->mark.currentEnd_ns, 0);
+    }
+    Safepoint_ResumeWorld();
+    Profiler_OnResumed();
+    Stats_WriteToFile(stats);
+    CpuProfiler_LeavePhase(phase);
+}
+
+/**
+ * Fills in `stats`. Blocks count with their metadata, like the maximum heap
+ * size. The free blocks are only known once the sweep is done, so it is
+ * finished first. The other mutator threads keep allocating meanwhile.
+ */
+void Heap_Stats(Heap *heap, GCStats *stats) {
+    Sweeper_SweepAll(heap);
+    uint64_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint64_t freeBlockCount = blockAllocator.freeBlockCount;
+    stats->heapSize = committedBlockCount * SPACE_USED_PER_BLOCK;
+    stats->maxHeapSize = heap->maxHeapSize;
+    stats->usedBytes =
+        (committedBlockCount - freeBlockCount) * SPACE_USED_PER_BLOCK;
+    stats->freeBlocks = freeBlockCount;
+    stats->recycledBlocks = blockAllocator.recycledBlockCount;
+    stats->allocatedBytes =
+        MutatorThreads_AllocatedBytes() + heap->totals.largeBytes;
+    stats->collections = heap->totals.collections;
+    stats->lastPause_ns = heap->totals.lastPause_ns;
+    stats->maxPause_ns = heap->totals.maxPause_ns;
+    stats->totalPause_ns = heap->totals.totalPause_ns;
+    stats->mark_ns = heap->totals.mark_ns;
+    stats->sweep_ns = atomic_load_explicit(&heap->totals.sweep_ns,
+                                           memory_order_relaxed);
+}
+
+void Heap_WriteBarrierRange(Heap *heap, word_t *address, size_t size) {
+    if (heap->generational.enabled && size > 0 &&
+        Heap_IsWordInHeap(heap, address)) {
+        word_t *last = (word_t *)((ubyte_t *)address + size - 1);
+        CardMeta *lastCard = Heap_CardMetaForWord(heap, last);
+        for (CardMeta *card = Heap_CardMetaForWord(heap, address);
+             card <= lastCard; card++) {
+            Card_MarkDirty(card);
+        }
+    }
 }
 
 bool Heap_shouldGrow(Heap *heap) {
     uint32_t freeBlockCount = (uint32_t)blockAllocator.freeBlockCount;
-    uint32_t blockCount = heap->blockCount;
-    uint32_t recycledBlockCount = (uint32_t)allocator.recycledBlockCount;
+    uint32_t blockCount = Heap_CommittedBlockCount(heap);
+    uint32_t recycledBlockCount = (uint32_t)blockAllocator.recycledBlockCount;
     uint32_t unavailableBlockCount =
         blockCount - (freeBlockCount + recycledBlockCount);
 
@@ -250,36 +561,238 @@ bool Heap_shouldGrow(Heap *heap) {
            unavailableBlockCount > blockCount * MAX_UNAVAILABLE_RATIO;
 }
 
+/**
+ * Returns the committed block count that meets the goals of the sizing policy
+ * after a full collection, within the bounds on the free part of the heap.
+ */
+static uint32_t Heap_sizingTarget(Heap *heap) {
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint32_t freeBlockCount = (uint32_t)blockAllocator.freeBlockCount;
+    uint32_t usedBlockCount = freeBlockCount < committedBlockCount
+                                  ? committedBlockCount - freeBlockCount
+                                  : 0;
+    double target = committedBlockCount * SizingPolicy_Factor(&heap->sizing);
+    double minTarget = usedBlockCount / (1.0 - SIZING_MIN_FREE_RATIO);
+    double maxTarget = usedBlockCount / (1.0 - SIZING_MAX_FREE_RATIO);
+    if (target > maxTarget) {
+        target = maxTarget;
+    }
+    if (target < minTarget) {
+        target = minTarget;
+    }
+    if (target < heap->uncommit.minBlockCount) {
+        target = heap->uncommit.minBlockCount;
+    }
+    if (target > heap->maxBlockCount) {
+        target = heap->maxBlockCount;
+    }
+    return (uint32_t)target;
+}
+
 void Heap_GrowIfNeeded(Heap *heap) {
     // make all writes to block counts visible
     atomic_thread_fence(memory_order_seq_cst);
-    if (Heap_shouldGrow(heap)) {
+    if (heap->sizing.enabled && !heap->generational.young) {
+        uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+        uint32_t target = Heap_sizingTarget(heap);
+        if (target > committedBlockCount) {
+            Heap_Grow(heap, target - committedBlockCount);
+        }
+    } else if (Heap_shouldGrow(heap) && heap->generational.young &&
+               Allocator_CanInitCursors(&blockAllocator)) {
+        // Too little was freed by the young collection, the old generation is
+        // filling up. Collect it next time before growing the heap.
+        heap->generational.fullRequested = true;
+    } else if (Heap_shouldGrow(heap)) {
         double growth;
-        if (heap->heapSize < EARLY_GROWTH_THRESHOLD) {
+        // no doubling close to the maximum, which may be a small cgroup limit
+        if (heap->heapSize < EARLY_GROWTH_THRESHOLD &&
+            heap->heapSize < heap->maxHeapSize * EARLY_GROWTH_MAX_RATIO) {
             growth = EARLY_GROWTH_RATE;
         } else {
             growth = GROWTH_RATE;
         }
-        uint32_t blocks = heap->blockCount * (growth - 1);
+        uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+        uint32_t blocks = committedBlockCount * (growth - 1);
         if (Heap_isGrowingPossible(heap, blocks)) {
             Heap_Grow(heap, blocks);
         } else {
-            uint32_t remainingGrowth = heap->maxBlockCount - heap->blockCount;
+            uint32_t remainingGrowth =
+                heap->maxBlockCount - committedBlockCount;
             if (remainingGrowth > 0) {
                 Heap_Grow(heap, remainingGrowth);
             }
         }
     }
-    if (!Allocator_CanInitCursors(&allocator)) {
+    if (!Allocator_CanInitCursors(&blockAllocator)) {
         Heap_exitWithOutOfMemory();
     }
 }
 
+/**
+ * Returns the memory of `count` free blocks, and the metadata pages that only
+ * describe them, to the OS.
+ */
+void Heap_uncommitBlocks(Heap *heap, BlockMeta *superblock, uint32_t count) {
+    uint64_t start_ns = Trace_Start();
+    uint32_t index = BlockMeta_GetBlockIndex(heap->blockMetaStart, superblock);
+    BlockMeta *limit = superblock + count;
+    for (BlockMeta *current = superblock; current < limit; current++) {
+        assert(BlockMeta_IsFree(current));
+        BlockMeta_SetFlag(current, block_uncommitted);
+    }
+    word_t *blockStart = Block_GetStartFromIndex(heap->heapStart, index);
+    Heap_uncommitRange(blockStart, (size_t)count * BLOCK_TOTAL_SIZE);
+    Heap_uncommitRange(Line_getFromBlockIndex(heap->lineMetaStart, index),
+                       (size_t)count * LINE_COUNT * LINE_METADATA_SIZE);
+    Heap_uncommitRange((CrossingMeta *)heap->crossingMetaStart +
+                           (size_t)index * LINE_COUNT,
+                       (size_t)count * LINE_COUNT * CROSSING_METADATA_SIZE);
+    Heap_uncommitRange(Bytemap_Get(heap->bytemap, blockStart),
+                       (size_t)count * WORDS_IN_BLOCK /
+                           ALLOCATION_ALIGNMENT_WORDS);
+    if (heap->generational.enabled) {
+        Heap_uncommitRange((CardMeta *)heap->cardMetaStart +
+                               (size_t)index * CARD_COUNT,
+                           (size_t)count * CARD_COUNT * CARD_METADATA_SIZE);
+    }
+    heap->uncommit.blockCount += count;
+    Trace_End(trace_uncommit, start_ns, count);
+}
+
+/**
+ * Returns the committed block count that would not make the heap grow after
+ * this collection, with some headroom.
+ */
+static double Heap_idleTarget(Heap *heap) {
+    // uncommitting free blocks does not change these, see `Heap_shouldGrow`
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint32_t freeBlockCount = (uint32_t)blockAllocator.freeBlockCount;
+    uint32_t usedBlockCount =
+        freeBlockCount < committedBlockCount
+            ? committedBlockCount - freeBlockCount
+            : 0;
+    uint32_t recycledBlockCount = (uint32_t)blockAllocator.recycledBlockCount;
+    uint32_t unavailableBlockCount = usedBlockCount > recycledBlockCount
+                                         ? usedBlockCount - recycledBlockCount
+                                         : 0;
+    double needed = usedBlockCount / (1.0 - heap->minFreeRatio);
+    if (unavailableBlockCount / MAX_UNAVAILABLE_RATIO > needed) {
+        needed = unavailableBlockCount / MAX_UNAVAILABLE_RATIO;
+    }
+    double target = needed * UNCOMMIT_HEADROOM;
+    if (target < heap->uncommit.minBlockCount) {
+        target = heap->uncommit.minBlockCount;
+    }
+    return target;
+}
+
+/**
+ * Shrinks the committed heap once it has been larger than needed for
+ * `uncommit.delay_ns`. It keeps the blocks that would not make the heap grow
+ * after this collection, with some headroom, and uncommits the largest free
+ * superblocks beyond that. `Heap_Grow` commits them again. The mutator may be
+ * allocating, so only blocks taken out of the free lists are touched.
+ * With a sizing policy the heap is shrunk to its target instead.
+ */
+void Heap_UncommitIfIdle(Heap *heap, Stats *stats) {
+    if (heap->uncommit.delay_ns < 0 || heap->minFreeRatio >= 1.0) {
+        return;
+    }
+    Stats_RecordTime(stats, start_ns);
+    pthread_mutex_lock(&heap->sweep.growMutex);
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    double target;
+    if (!heap->sizing.enabled) {
+        target = Heap_idleTarget(heap);
+    } else if (heap->generational.young) {
+        target = committedBlockCount;
+    } else {
+        target = Heap_sizingTarget(heap);
+    }
+
+    if (target >= committedBlockCount) {
+        heap->uncommit.excessSince_ns = 0;
+    } else {
+        uint64_t now_ns = scalanative_nano_time();
+        if (heap->uncommit.excessSince_ns == 0) {
+            heap->uncommit.excessSince_ns = now_ns;
+        }
+        // the sizing policy shrinks the heap right away
+        if (heap->sizing.enabled || now_ns - heap->uncommit.excessSince_ns >=
+                                        (uint64_t)heap->uncommit.delay_ns) {
+            heap->uncommit.excessSince_ns = 0;
+            uint32_t excess = committedBlockCount - (uint32_t)target;
+            while (excess > 0) {
+                uint32_t size;
+                BlockMeta *superblock = BlockAllocator_PollFreeSuperblock(
+                    &blockAllocator, excess, &size);
+                if (superblock == NULL) {
+                    break;
+                }
+                Heap_uncommitBlocks(heap, superblock, size);
+                excess -= size;
+            }
+        }
+    }
+#ifdef ENABLE_GC_STATS
+    size_t uncommittedBytes =
+        (size_t)heap->uncommit.blockCount * BLOCK_TOTAL_SIZE;
+#endif
+    pthread_mutex_unlock(&heap->sweep.growMutex);
+    Stats_RecordTime(stats, end_ns);
+    Stats_RecordUncommit(stats, start_ns, end_ns, uncommittedBytes);
+}
+
+/**
+ * Gives uncommitted blocks back to the block allocator, until
+ * `incrementInBlocks` have been recommitted or there are none left. Their
+ * pages are committed again by the OS when they are touched.
+ */
+uint32_t Heap_recommit(Heap *heap, uint32_t incrementInBlocks) {
+    uint32_t recommitted = 0;
+    BlockMeta *current = (BlockMeta *)heap->blockMetaStart;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    while (current < end && recommitted < incrementInBlocks &&
+           recommitted < heap->uncommit.blockCount) {
+        if (!BlockMeta_IsUncommitted(current)) {
+            current++;
+            continue;
+        }
+        BlockMeta *first = current;
+        while (current < end && BlockMeta_IsUncommitted(current) &&
+               recommitted < incrementInBlocks) {
+            BlockMeta_SetFlag(current, block_free);
+#ifdef DEBUG_ASSERT
+            current->debugFlag = dbg_free;
+#endif
+            recommitted++;
+            current++;
+        }
+        BlockAllocator_AddFreeBlocks(&blockAllocator, first,
+                                     (uint32_t)(current - first));
+    }
+    heap->uncommit.blockCount -= recommitted;
+    return recommitted;
+}
+
 void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
     pthread_mutex_lock(&heap->sweep.growMutex);
     if (!Heap_isGrowingPossible(heap, incrementInBlocks)) {
         Heap_exitWithOutOfMemory();
     }
+    uint64_t start_ns = Trace_Start();
+    // the free blocks are added while no mutator thread takes any
+    BlockAllocator_Lock(&blockAllocator);
+    uint32_t recommitted = Heap_recommit(heap, incrementInBlocks);
+    if (recommitted == incrementInBlocks) {
+        BlockAllocator_Unlock(&blockAllocator);
+        pthread_mutex_unlock(&heap->sweep.growMutex);
+        Trace_End(trace_grow, start_ns, incrementInBlocks);
+        return;
+    }
+    // there is nothing left to recommit
+    incrementInBlocks -= recommitted;
 
 #ifdef DEBUG_PRINT
     printf("Growing small heap by %zu bytes, to %zu bytes\n",
@@ -296,6 +809,12 @@ void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
         (word_t *)(((BlockMeta *)heap->blockMetaEnd) + incrementInBlocks);
     heap->lineMetaEnd +=
         incrementInBlocks * LINE_COUNT * LINE_METADATA_SIZE / WORD_SIZE;
+    heap->crossingMetaEnd +=
+        incrementInBlocks * LINE_COUNT * CROSSING_METADATA_SIZE / WORD_SIZE;
+    if (heap->generational.enabled) {
+        heap->cardMetaEnd +=
+            incrementInBlocks * CARD_COUNT * CARD_METADATA_SIZE / WORD_SIZE;
+    }
 
 #ifdef DEBUG_ASSERT
     BlockMeta *end = (BlockMeta *)blockMetaEnd;
@@ -308,5 +827,7 @@ void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
                                  incrementInBlocks);
 
     heap->blockCount += incrementInBlocks;
+    BlockAllocator_Unlock(&blockAllocator);
     pthread_mutex_unlock(&heap->sweep.growMutex);
+    Trace_End(trace_grow, start_ns, recommitted + incrementInBlocks);
 }
@@ -5,8 +5,15 @@
 #include "datastructures/Bytemap.h"
 #include "datastructures/BlockRange.h"
 #include "datastructures/GreyPacket.h"
+#include "datastructures/GreyDeque.h"
 #include "metadata/LineMeta.h"
+#include "metadata/CardMeta.h"
+#include "metadata/CrossingMeta.h"
 #include "Stats.h"
+#include "Parker.h"
+#include "SizingPolicy.h"
+#include "Trace.h"
+#include "../shared/GCStats.h"
 #include <stdio.h>
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -19,6 +26,10 @@ typedef struct {
     word_t *blockMetaEnd;
     word_t *lineMetaStart;
     word_t *lineMetaEnd;
+    word_t *cardMetaStart;
+    word_t *cardMetaEnd;
+    word_t *crossingMetaStart;
+    word_t *crossingMetaEnd;
     word_t *heapStart;
     word_t *heapEnd;
     word_t *greyPacketsStart;
@@ -28,11 +39,20 @@ typedef struct {
     uint32_t maxBlockCount;
     double maxMarkTimeRatio;
     double minFreeRatio;
+    // goals for the heap size set by the user, if any
+    SizingPolicy sizing;
+    // the heap is aligned for and advised to use transparent huge pages
+    bool hugePages;
+    // the memory of the initial heap is touched when it is mapped
+    bool prefault;
+    // objects are prefetched this many pops before they are marked, 0 turns
+    // the prefetching of objects and of their fields' metadata off
+    int markPrefetchDistance;
     struct {
         sem_t *startWorkers;
         sem_t *startMaster;
         atomic_uint_fast8_t phase;
-        int count;
+        uint32_t count;
         void *all;
     } gcThreads;
     struct {
@@ -41,6 +61,8 @@ typedef struct {
         atomic_uint_fast32_t coalesceDone;
         atomic_bool postSweepDone;
         pthread_mutex_t growMutex;
+        // signalled when sweeping or coalescing moves on
+        Parker parker;
     } sweep;
     struct {
         // making cursorDone atomic so it keeps sequential consistency with the
@@ -52,21 +74,77 @@ typedef struct {
         BlockRange lastActivity;
         // _First = 1 if active, _Limit = last cursor observed
         BlockRangeVal lastActivityObserved;
+        // held by the mutator thread that sweeps
+        pthread_mutex_t mutex;
     } lazySweep;
     struct {
         uint64_t lastEnd_ns;
         uint64_t currentStart_ns;
         uint64_t currentEnd_ns;
+        // packets in the pool, the rest of the reserved region is untouched
         atomic_uint_fast32_t total;
+        // packets that fit in the reserved region
+        uint32_t limit;
+        // the pool grew during the current marking, it is not shrunk after it
+        bool grown;
+        // objects were marked without being pushed, see Marker_MarkUntilDone
+        atomic_bool overflow;
+        pthread_mutex_t growMutex;
+        // signalled when a full packet is given or a marker stops
+        Parker parker;
         GreyList empty;
+        // full packets that did not fit in the deques
         GreyList full;
+        // a deque for each GC thread followed by one for the mutator
+        GreyDeque *deques;
+        // full packets go to the deques first, see Settings_WorkStealing
+        bool workStealing;
     } mark;
+    struct {
+        bool enabled;
+        // the current (or last) collection is young
+        bool young;
+        // the last young collection freed too little, next one is full
+        bool fullRequested;
+    } generational;
+    struct {
+        // how long free memory is kept in excess, negative to keep it forever
+        int64_t delay_ns;
+        // when the committed heap was first found too large, 0 if it is not
+        uint64_t excessSince_ns;
+        // free blocks whose memory has been returned to the OS, guarded by
+        // sweep.growMutex
+        uint32_t blockCount;
+        uint32_t minBlockCount;
+    } uncommit;
+    // what `scalanative_gc_stats` reports besides the sizes, see GCStats
+    struct {
+        uint64_t collections;
+        uint64_t lastPause_ns;
+        uint64_t maxPause_ns;
+        uint64_t totalPause_ns;
+        uint64_t mark_ns;
+        // summed over the threads that sweep
+        atomic_uint_fast64_t sweep_ns;
+        // bytes of the objects that do not come from the allocators' holes
+        atomic_uint_fast64_t largeBytes;
+        // the large bytes at which the profiler samples next, see Profiler.h
+        uint64_t nextLargeSample;
+    } totals;
     Bytemap *bytemap;
     Stats *stats;
 } Heap;
 
 extern long long scalanative_nano_time();
 
+static inline uint32_t Heap_CommittedBlockCount(Heap *heap) {
+    return heap->blockCount - heap->uncommit.blockCount;
+}
+
+static inline GreyDeque *Heap_MutatorDeque(Heap *heap) {
+    return &heap->mark.deques[heap->gcThreads.count];
+}
+
 static inline bool Heap_IsWordInHeap(Heap *heap, word_t *word) {
     return word >= heap->heapStart && word < heap->heapEnd;
 }
@@ -83,10 +161,59 @@ static inline LineMeta *Heap_LineMetaForWord(Heap *heap, word_t *word) {
     return lineMeta;
 }
 
+static inline CardMeta *Heap_CardMetaForWord(Heap *heap, word_t *word) {
+    assert(Heap_IsWordInHeap(heap, word));
+    word_t cardGlobalIndex =
+        ((word_t)word - (word_t)heap->heapStart) >> CARD_SIZE_BITS;
+    CardMeta *cardMeta = (CardMeta *)heap->cardMetaStart + cardGlobalIndex;
+    assert(cardMeta < (CardMeta *)heap->cardMetaEnd);
+    return cardMeta;
+}
+
+static inline CrossingMeta *Heap_CrossingMetaForWord(Heap *heap,
+                                                     word_t *word) {
+    // conservative roots can point past the last block, the reserved entries
+    // there are empty
+    assert(Heap_IsWordInHeap(heap, word));
+    return Crossing_ForWord(heap->crossingMetaStart, heap->heapStart, word);
+}
+
+static inline word_t *Heap_CardStart(Heap *heap, CardMeta *cardMeta) {
+    word_t cardGlobalIndex = cardMeta - (CardMeta *)heap->cardMetaStart;
+    return heap->heapStart + cardGlobalIndex * WORDS_IN_CARD;
+}
+
+/**
+ * Adds the time since `start_ns` to the sweep time, and records it as an event
+ * of `type` while tracing.
+ */
+static inline void Heap_RecordSweep(Heap *heap, TraceEventType type,
+                                    uint64_t start_ns) {
+    uint64_t end_ns = scalanative_nano_time();
+    atomic_fetch_add_explicit(&heap->totals.sweep_ns, end_ns - start_ns,
+                              memory_order_relaxed);
+    if (Trace_Enabled()) {
+        Trace_Record(type, start_ns, end_ns, 0);
+    }
+}
+
+/**
+ * Records a reference store to `address` so that young collections can find
+ * old-to-young pointers. Stores outside of the heap are ignored.
+ */
+static inline void Heap_WriteBarrier(Heap *heap, word_t *address) {
+    if (heap->generational.enabled && Heap_IsWordInHeap(heap, address)) {
+        Card_MarkDirty(Heap_CardMetaForWord(heap, address));
+    }
+}
+
 void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize);
 
 void Heap_Collect(Heap *heap);
+void Heap_WriteBarrierRange(Heap *heap, word_t *address, size_t size);
 void Heap_GrowIfNeeded(Heap *heap);
+void Heap_UncommitIfIdle(Heap *heap, Stats *stats);
 void Heap_Grow(Heap *heap, uint32_t increment);
+void Heap_Stats(Heap *heap, GCStats *stats);
 
 #endif // IMMIX_HEAP_H
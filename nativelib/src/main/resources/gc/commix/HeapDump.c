@@ -0,0 +1,409 @@
+#include "HeapDump.h"
+#include "Object.h"
+#include "Sweeper.h"
+#include "Safepoint.h"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// characters of a class name in the histogram and the dump
+#define HEAP_DUMP_NAME_SIZE 256
+#define HEAP_DUMP_INITIAL_CAPACITY 1024
+
+volatile atomic_bool heapDumpRequested = false;
+static const char *HeapDump_histogramPath = NULL;
+static const char *HeapDump_dumpPath = NULL;
+static bool HeapDump_outOfMemory = false;
+
+typedef struct {
+    Rtti *rtti;
+    uint64_t count;
+    uint64_t bytes;
+} HeapDumpClass;
+
+// The heap is walked with the other mutator threads stopped, one of them may
+// hold the lock of malloc or of a stream. The walk takes its memory from mmap
+// and the files are written once the threads are resumed.
+typedef struct {
+    // open addressing table of the classes seen so far
+    HeapDumpClass *classes;
+    uint32_t classCount;
+    uint32_t capacity;
+    // the records of the dump, if one is written
+    bool recording;
+    uint8_t *records;
+    size_t recordsSize;
+    size_t recordsCapacity;
+    // the memory ran out, the histogram is incomplete
+    bool failed;
+} HeapDump;
+
+static void HeapDump_onSignal(int signal) {
+    atomic_store(&heapDumpRequested, true);
+}
+
+/**
+ * Remembers the files written on SIGQUIT and out of memory. The signal is only
+ * handled if one of them is set and the program does not handle it itself.
+ */
+void HeapDump_Init(const char *histogramPath, const char *dumpPath) {
+    HeapDump_histogramPath = histogramPath;
+    HeapDump_dumpPath = dumpPath;
+    if (histogramPath == NULL && dumpPath == NULL) {
+        return;
+    }
+    struct sigaction previous;
+    if (sigaction(SIGQUIT, NULL, &previous) != 0 ||
+        previous.sa_handler != SIG_DFL) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = HeapDump_onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGQUIT, &action, NULL);
+}
+
+static void *HeapDump_map(size_t size) {
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+static void HeapDump_unmap(void *memory, size_t size) {
+    if (memory != NULL) {
+        munmap(memory, size);
+    }
+}
+
+static void HeapDump_append(HeapDump *dump, const void *bytes, size_t size) {
+    if (dump->failed) {
+        return;
+    }
+    if (dump->recordsSize + size > dump->recordsCapacity) {
+        size_t capacity = dump->recordsCapacity == 0
+                              ? HEAP_DUMP_INITIAL_CAPACITY * 1024
+                              : 2 * dump->recordsCapacity;
+        while (dump->recordsSize + size > capacity) {
+            capacity *= 2;
+        }
+        uint8_t *records = HeapDump_map(capacity);
+        if (records == NULL) {
+            dump->failed = true;
+            return;
+        }
+        memcpy(records, dump->records, dump->recordsSize);
+        HeapDump_unmap(dump->records, dump->recordsCapacity);
+        dump->records = records;
+        dump->recordsCapacity = capacity;
+    }
+    memcpy(dump->records + dump->recordsSize, bytes, size);
+    dump->recordsSize += size;
+}
+
+static void HeapDump_write8(HeapDump *dump, uint8_t value) {
+    HeapDump_append(dump, &value, sizeof(value));
+}
+
+static void HeapDump_write32(HeapDump *dump, uint32_t value) {
+    HeapDump_append(dump, &value, sizeof(value));
+}
+
+static void HeapDump_write64(HeapDump *dump, uint64_t value) {
+    HeapDump_append(dump, &value, sizeof(value));
+}
+
+static inline uint32_t HeapDump_hash(Rtti *rtti, uint32_t capacity) {
+    return (uint32_t)(((uintptr_t)rtti >> 4) * 0x9E3779B97F4A7C15ULL >> 32) &
+           (capacity - 1);
+}
+
+static bool HeapDump_grow(HeapDump *dump) {
+    uint32_t capacity = dump->capacity == 0 ? HEAP_DUMP_INITIAL_CAPACITY
+                                            : 2 * dump->capacity;
+    // zeroed like calloc
+    HeapDumpClass *classes = HeapDump_map(capacity * sizeof(HeapDumpClass));
+    if (classes == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < dump->capacity; i++) {
+        HeapDumpClass *class = &dump->classes[i];
+        if (class->rtti != NULL) {
+            uint32_t slot = HeapDump_hash(class->rtti, capacity);
+            while (classes[slot].rtti != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            classes[slot] = *class;
+        }
+    }
+    HeapDump_unmap(dump->classes, dump->capacity * sizeof(HeapDumpClass));
+    dump->classes = classes;
+    dump->capacity = capacity;
+    return true;
+}
+
+/**
+ * Returns the entry of the class, added and written to the dump the first
+ * time. Returns NULL if the memory ran out.
+ */
+static HeapDumpClass *HeapDump_class(HeapDump *dump, Rtti *rtti) {
+    if (2 * (dump->classCount + 1) > dump->capacity && !HeapDump_grow(dump)) {
+        return NULL;
+    }
+    uint32_t slot = HeapDump_hash(rtti, dump->capacity);
+    while (dump->classes[slot].rtti != NULL) {
+        if (dump->classes[slot].rtti == rtti) {
+            return &dump->classes[slot];
+        }
+        slot = (slot + 1) & (dump->capacity - 1);
+    }
+    HeapDumpClass *class = &dump->classes[slot];
+    class->rtti = rtti;
+    dump->classCount++;
+    if (dump->recording) {
+        char name[HEAP_DUMP_NAME_SIZE];
+        Object_ClassName(rtti, name, sizeof(name));
+        uint32_t length = strlen(name);
+        HeapDump_write8(dump, HEAP_DUMP_CLASS);
+        HeapDump_write32(dump, (uint32_t)rtti->rt.id);
+        HeapDump_write32(dump, length);
+        HeapDump_append(dump, name, length);
+    }
+    return class;
+}
+
+static void HeapDump_addReference(HeapDump *dump, word_t *reference,
+                                  uint32_t *count) {
+    if (reference != NULL) {
+        HeapDump_write64(dump, (uint64_t)reference);
+        (*count)++;
+    }
+}
+
+static void HeapDump_writeObject(HeapDump *dump, Object *object, size_t size) {
+    Rtti *rtti = object->rtti;
+    HeapDump_write8(dump, HEAP_DUMP_OBJECT);
+    HeapDump_write64(dump, (uint64_t)object);
+    HeapDump_write32(dump, (uint32_t)rtti->rt.id);
+    HeapDump_write64(dump, size);
+    // the number of references is filled in once they are written
+    size_t countOffset = dump->recordsSize;
+    uint32_t count = 0;
+    HeapDump_write32(dump, count);
+    if (Object_IsArray(object)) {
+        if (rtti->rt.id == __object_array_id) {
+            ArrayHeader *arrayHeader = (ArrayHeader *)object;
+            word_t **fields = (word_t **)(arrayHeader + 1);
+            for (int32_t i = 0; i < arrayHeader->length; i++) {
+                HeapDump_addReference(dump, fields[i], &count);
+            }
+        }
+    } else if (rtti->refMapBits != 0) {
+        for (uint64_t bits = rtti->refMapBits; bits != 0; bits &= bits - 1) {
+            HeapDump_addReference(dump, object->fields[__builtin_ctzll(bits)],
+                                  &count);
+        }
+    } else {
+        for (int64_t *offset = rtti->refMapStruct;
+             *offset != LAST_FIELD_OFFSET; offset++) {
+            HeapDump_addReference(dump, object->fields[*offset], &count);
+        }
+    }
+    if (!dump->failed) {
+        memcpy(dump->records + countOffset, &count, sizeof(count));
+    }
+}
+
+static void HeapDump_visit(HeapDump *dump, Object *object) {
+    // allocated, but its class is not stored yet
+    if (object->rtti == NULL) {
+        return;
+    }
+    size_t size = Object_Size(object);
+    HeapDumpClass *class = HeapDump_class(dump, object->rtti);
+    if (class == NULL) {
+        dump->failed = true;
+        return;
+    }
+    class->count++;
+    class->bytes += size;
+    if (dump->recording) {
+        HeapDump_writeObject(dump, object, size);
+    }
+}
+
+/**
+ * Visits the objects of a swept heap, which are the allocated and the marked
+ * ones. Free blocks have no objects.
+ */
+static void HeapDump_walk(Heap *heap, HeapDump *dump) {
+    Bytemap *bytemap = heap->bytemap;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    word_t *blockStart = heap->heapStart;
+    for (BlockMeta *blockMeta = (BlockMeta *)heap->blockMetaStart;
+         blockMeta < end; blockMeta++, blockStart += WORDS_IN_BLOCK) {
+        if (BlockMeta_IsFree(blockMeta) || BlockMeta_IsUncommitted(blockMeta)) {
+            continue;
+        }
+        ObjectMeta *first = Bytemap_Get(bytemap, blockStart);
+        uint64_t *cursor = (uint64_t *)first;
+        uint64_t *limit = cursor + WORDS_IN_BLOCK / ALLOCATION_ALIGNMENT_WORDS /
+                                       sizeof(uint64_t);
+        for (; cursor < limit; cursor++) {
+            // skips eight free entries at once
+            if (*cursor == 0) {
+                continue;
+            }
+            ObjectMeta *objectMeta = (ObjectMeta *)cursor;
+            for (int i = 0; i < sizeof(uint64_t); i++, objectMeta++) {
+                if (ObjectMeta_IsAllocated(objectMeta) ||
+                    ObjectMeta_IsMarked(objectMeta)) {
+                    HeapDump_visit(
+                        dump,
+                        (Object *)(blockStart + (objectMeta - first) *
+                                                   ALLOCATION_ALIGNMENT_WORDS));
+                }
+            }
+        }
+    }
+}
+
+static int HeapDump_compareBytes(const void *a, const void *b) {
+    uint64_t aBytes = ((HeapDumpClass *)a)->bytes;
+    uint64_t bBytes = ((HeapDumpClass *)b)->bytes;
+    return aBytes < bBytes ? 1 : aBytes > bBytes ? -1 : 0;
+}
+
+/**
+ * Writes the classes by decreasing bytes, this takes the table apart.
+ */
+static bool HeapDump_writeHistogram(HeapDump *dump, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return false;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < dump->capacity; i++) {
+        if (dump->classes[i].rtti != NULL) {
+            dump->classes[count++] = dump->classes[i];
+        }
+    }
+    qsort(dump->classes, count, sizeof(HeapDumpClass), HeapDump_compareBytes);
+    fprintf(out, " num     #instances         #bytes  class name\n"
+                 "----------------------------------------------\n");
+    uint64_t totalCount = 0;
+    uint64_t totalBytes = 0;
+    char name[HEAP_DUMP_NAME_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        HeapDumpClass *class = &dump->classes[i];
+        Object_ClassName(class->rtti, name, sizeof(name));
+        fprintf(out, "%4" PRIu32 ": %14" PRIu64 " %14" PRIu64 "  %s\n", i + 1,
+                class->count, class->bytes, name);
+        totalCount += class->count;
+        totalBytes += class->bytes;
+    }
+    fprintf(out, "Total %14" PRIu64 " %14" PRIu64 "\n", totalCount,
+            totalBytes);
+    bool written = !ferror(out);
+    return fclose(out) == 0 && written;
+}
+
+/**
+ * Records the classes of a swept heap and, if `recording`, the records of the
+ * dump. Neither allocates with malloc nor writes to a stream.
+ */
+static void HeapDump_record(Heap *heap, HeapDump *dump, bool recording) {
+    dump->recording = recording;
+    if (recording) {
+        HeapDump_append(dump, HEAP_DUMP_MAGIC, strlen(HEAP_DUMP_MAGIC));
+    }
+    HeapDump_walk(heap, dump);
+    if (recording) {
+        HeapDump_write8(dump, HEAP_DUMP_END);
+    }
+}
+
+static bool HeapDump_writeRecords(HeapDump *dump, const char *path) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        return false;
+    }
+    bool written =
+        fwrite(dump->records, 1, dump->recordsSize, out) == dump->recordsSize;
+    return fclose(out) == 0 && written;
+}
+
+/**
+ * Writes the histogram and the dump recorded by `HeapDump_record`, either
+ * path may be NULL, and frees the recording. Returns false if a file could
+ * not be written in full.
+ */
+static bool HeapDump_write(HeapDump *dump, const char *histogramPath,
+                           const char *dumpPath) {
+    bool written = true;
+    if (dumpPath != NULL) {
+        written = HeapDump_writeRecords(dump, dumpPath) && written;
+    }
+    if (histogramPath != NULL) {
+        written = HeapDump_writeHistogram(dump, histogramPath) && written;
+    }
+    HeapDump_unmap(dump->classes, dump->capacity * sizeof(HeapDumpClass));
+    HeapDump_unmap(dump->records, dump->recordsCapacity);
+    return written && !dump->failed;
+}
+
+/**
+ * Collects the whole heap and writes what survived, either path may be NULL.
+ * Returns false if a file could not be written in full.
+ */
+bool HeapDump_Collect(Heap *heap, const char *histogramPath,
+                      const char *dumpPath) {
+    Sweeper_SweepAll(heap);
+    heap->generational.fullRequested = true;
+    Heap_Collect(heap);
+    // the other mutator threads stay stopped while the heap is walked, a
+    // collection by one of them meanwhile is swept as well
+    while (!Safepoint_StopWorld()) {
+    }
+    // the dead objects are only told apart from the live ones by the marks
+    // until they are swept
+    Sweeper_SweepAll(heap);
+    HeapDump dump = {0};
+    HeapDump_record(heap, &dump, dumpPath != NULL);
+    Safepoint_ResumeWorld();
+    return HeapDump_write(&dump, histogramPath, dumpPath);
+}
+
+void HeapDump_OnRequest(Heap *heap) {
+    // only one of the threads that see the request dumps
+    if (!atomic_exchange(&heapDumpRequested, false)) {
+        return;
+    }
+    if (!HeapDump_Collect(heap, HeapDump_histogramPath, HeapDump_dumpPath)) {
+        fprintf(stderr, "GC heap dump: cannot write %s\n",
+                HeapDump_histogramPath != NULL ? HeapDump_histogramPath
+                                               : HeapDump_dumpPath);
+    }
+}
+
+void HeapDump_OnOutOfMemory(Heap *heap) {
+    // only the first out of memory is dumped
+    if (HeapDump_outOfMemory ||
+        (HeapDump_histogramPath == NULL && HeapDump_dumpPath == NULL)) {
+        return;
+    }
+    HeapDump_outOfMemory = true;
+    // The heap may grow on a GC thread while it sweeps, which cannot wait
+    // for the sweep. An unfinished sweep leaves dead objects in the dump.
+    HeapDump dump = {0};
+    HeapDump_record(heap, &dump, HeapDump_dumpPath != NULL);
+    if (!HeapDump_write(&dump, HeapDump_histogramPath, HeapDump_dumpPath)) {
+        fprintf(stderr, "GC heap dump: cannot write %s\n",
+                HeapDump_histogramPath != NULL ? HeapDump_histogramPath
+                                               : HeapDump_dumpPath);
+    }
+}
@@ -13,9 +13,22 @@
 #include "Constants.h"
 #include "Settings.h"
 #include "GCThread.h"
+#include "Trace.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "MutatorThread.h"
+#include "Safepoint.h"
+#include "../../pprof/CpuProfiler.h"
+
+extern word_t **__stack_bottom;
 
 void scalanative_collect();
 
+// Whether the card table has to be kept up to date, read by `Array.copy`
+// before it calls `scalanative_write_barrier_range`. Only with
+// `nativeGenerational`, see Settings_Generational.
+bool scalanative_gc_generational = false;
+
 void scalanative_afterexit() {
 #ifdef ENABLE_GC_STATS
     Stats_OnExit(heap.stats);
@@ -26,19 +39,28 @@ void scalanative_afterexit() {
         Stats_OnExit(gcThreads[i].stats);
     }
 #endif
+    Trace_OnExit();
+    Profiler_OnExit();
 }
 
 NOINLINE void scalanative_init() {
+    CpuProfiler_Init();
+    Trace_Init(Settings_TraceFileName());
+    Profiler_Init(Settings_ProfileFileName(), Settings_ProfileInterval());
+    HeapDump_Init(Settings_HistogramFileName(), Settings_HeapDumpFileName());
     Heap_Init(&heap, Settings_MinHeapSize(), Settings_MaxHeapSize());
-#ifdef ENABLE_GC_STATS
+    MutatorThreads_Init(__stack_bottom);
+    scalanative_gc_generational = heap.generational.enabled;
     atexit(scalanative_afterexit);
-#endif
 }
 
 INLINE void *scalanative_alloc(void *info, size_t size) {
     size = MathUtils_RoundToNextMultiple(size, ALLOCATION_ALIGNMENT);
     assert(size % ALLOCATION_ALIGNMENT == 0);
 
+    // a thread stopped before the header is written would leave a hole
+    // that looks like an object
+    Safepoint_EnterGC();
     void **alloc;
     if (size >= LARGE_BLOCK_SIZE) {
         alloc = (void **)LargeAllocator_Alloc(&heap, size);
@@ -47,22 +69,27 @@ INLINE void *scalanative_alloc(void *info, size_t size) {
     }
 
     *alloc = info;
+    Safepoint_LeaveGC();
     return (void *)alloc;
 }
 
 INLINE void *scalanative_alloc_small(void *info, size_t size) {
     size = MathUtils_RoundToNextMultiple(size, ALLOCATION_ALIGNMENT);
 
+    Safepoint_EnterGC();
     void **alloc = (void **)Allocator_Alloc(&heap, size);
     *alloc = info;
+    Safepoint_LeaveGC();
     return (void *)alloc;
 }
 
 INLINE void *scalanative_alloc_large(void *info, size_t size) {
     size = MathUtils_RoundToNextMultiple(size, ALLOCATION_ALIGNMENT);
 
+    Safepoint_EnterGC();
     void **alloc = (void **)LargeAllocator_Alloc(&heap, size);
     *alloc = info;
+    Safepoint_LeaveGC();
     return (void *)alloc;
 }
 
@@ -70,4 +97,40 @@ INLINE void *scalanative_alloc_atomic(void *info, size_t size) {
     return scalanative_alloc(info, size);
 }
 
-INLINE void scalanative_collect() { Heap_Collect(&heap); }
+INLINE void scalanative_collect() {
+    Safepoint_EnterGC();
+    Heap_Collect(&heap);
+    Safepoint_LeaveGC();
+}
+
+INLINE void scalanative_write_barrier(void *address) {
+    Heap_WriteBarrier(&heap, (word_t *)address);
+}
+
+void scalanative_write_barrier_range(void *address, size_t size) {
+    Heap_WriteBarrierRange(&heap, (word_t *)address, size);
+}
+
+// commix never moves objects
+bool scalanative_gc_moves_objects = false;
+
+void scalanative_pin(void *address) {}
+
+// Starts tracing into the file at `path`, or stops and writes the trace when it
+// is NULL, see Trace.h
+void scalanative_gc_trace(const char *path) { Trace_Set(path); }
+
+void scalanative_gc_stats(GCStats *stats) {
+    Safepoint_EnterGC();
+    Heap_Stats(&heap, stats);
+    Safepoint_LeaveGC();
+}
+
+// Collects the heap and writes the class histogram to `histogramPath` and the
+// dump to `dumpPath`, either may be NULL, see HeapDump.h
+bool scalanative_gc_heap_dump(const char *histogramPath, const char *dumpPath) {
+    Safepoint_EnterGC();
+    bool written = HeapDump_Collect(&heap, histogramPath, dumpPath);
+    Safepoint_LeaveGC();
+    return written;
+}
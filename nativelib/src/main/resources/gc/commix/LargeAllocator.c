@@ -6,6 +6,12 @@
 #include "Object.h"
 #include "State.h"
 #include "Sweeper.h"
+#include "Trace.h"
+#include "../../pprof/CpuProfiler.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "MutatorThread.h"
+#include "Safepoint.h"
 #include "Log.h"
 #include "headers/ObjectHeader.h"
 
@@ -66,9 +72,11 @@ void LargeAllocator_freeListInit(FreeList *freeList) {
 
 void LargeAllocator_Init(LargeAllocator *allocator,
                          BlockAllocator *blockAllocator, Bytemap *bytemap,
-                         word_t *blockMetaStart, word_t *heapStart) {
+                         word_t *blockMetaStart, word_t *crossingMetaStart,
+                         word_t *heapStart) {
     allocator->heapStart = heapStart;
     allocator->blockMetaStart = blockMetaStart;
+    allocator->crossingMetaStart = crossingMetaStart;
     allocator->bytemap = bytemap;
     allocator->blockAllocator = blockAllocator;
 
@@ -132,6 +140,7 @@ word_t *LargeAllocator_tryAlloc(LargeAllocator *allocator,
         MathUtils_RoundToNextMultiple(requestedBlockSize, MIN_BLOCK_SIZE);
 
     Chunk *chunk = NULL;
+    BlockAllocator_Lock(allocator->blockAllocator);
     if (actualBlockSize < BLOCK_TOTAL_SIZE) {
         // only need to look in free lists for chunks smaller than a block
         if (allocator->blockAllocator->concurrent) {
@@ -156,6 +165,7 @@ word_t *LargeAllocator_tryAlloc(LargeAllocator *allocator,
     }
 
     if (chunk == NULL) {
+        BlockAllocator_Unlock(allocator->blockAllocator);
         return NULL;
     }
 
@@ -169,6 +179,7 @@ word_t *LargeAllocator_tryAlloc(LargeAllocator *allocator,
         size_t remainingChunkSize = chunkSize - actualBlockSize;
         LargeAllocator_AddChunk(allocator, remainingChunk, remainingChunkSize);
     }
+    BlockAllocator_Unlock(allocator->blockAllocator);
 
     ObjectMeta *objectMeta = Bytemap_Get(allocator->bytemap, (word_t *)chunk);
 #ifdef DEBUG_ASSERT
@@ -177,6 +188,8 @@ word_t *LargeAllocator_tryAlloc(LargeAllocator *allocator,
     ObjectMeta_SetAllocated(objectMeta);
     word_t *object = (word_t *)chunk;
     memset(object, 0, actualBlockSize);
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          object, actualBlockSize);
     return object;
 }
 
@@ -191,25 +204,43 @@ word_t *LargeAllocator_lazySweep(Heap *heap, uint32_t size) {
     fflush(stdout);
 #endif
     // lazy sweep will happen
+    uint64_t sweepStart_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
     Stats_DefineOrNothing(stats, heap->stats);
     Stats_RecordTime(stats, start_ns);
-    // mark as active
-    heap->lazySweep.lastActivity = BlockRange_Pack(1, heap->sweep.cursor);
-    while (object == NULL && heap->sweep.cursor < heap->sweep.limit) {
-        Sweeper_Sweep(heap, heap->stats, &heap->lazySweep.cursorDone,
-                      LAZY_SWEEP_MIN_BATCH);
-        object = LargeAllocator_tryAlloc(&largeAllocator, size);
+    // one mutator thread sweeps at a time, the others wait for the sweep
+    if (pthread_mutex_trylock(&heap->lazySweep.mutex) == 0) {
+        // mark as active
+        heap->lazySweep.lastActivity = BlockRange_Pack(1, heap->sweep.cursor);
+        while (object == NULL && heap->sweep.cursor < heap->sweep.limit) {
+            Sweeper_Sweep(heap, heap->stats, &heap->lazySweep.cursorDone,
+                          LAZY_SWEEP_MIN_BATCH);
+            object = LargeAllocator_tryAlloc(&largeAllocator, size);
+        }
+        // mark as inactive
+        heap->lazySweep.lastActivity = BlockRange_Pack(0, heap->sweep.cursor);
+        pthread_mutex_unlock(&heap->lazySweep.mutex);
     }
-    // mark as inactive
-    heap->lazySweep.lastActivity = BlockRange_Pack(0, heap->sweep.cursor);
+    Parker *parker = &heap->sweep.parker;
+    Parker_Signal(parker);
     while (object == NULL && !Sweeper_IsSweepDone(heap)) {
+        Safepoint_Poll();
+        uint32_t epoch = Parker_Prepare(parker);
         object = LargeAllocator_tryAlloc(&largeAllocator, size);
-        if (object == NULL) {
-            sched_yield();
+        if (object == NULL && !Sweeper_IsSweepDone(heap)) {
+            // wait for the GC threads to sweep or coalesce more blocks
+            Parker_Park(parker, heap->stats, epoch);
         }
+        Parker_Leave(parker);
+    }
+    if (object == NULL) {
+        // the last blocks may have been freed since the last attempt
+        object = LargeAllocator_tryAlloc(&largeAllocator, size);
     }
     Stats_RecordTime(stats, end_ns);
     Stats_RecordEvent(stats, event_sweep, start_ns, end_ns);
+    Heap_RecordSweep(heap, trace_lazy_sweep, sweepStart_ns);
+    CpuProfiler_LeavePhase(phase);
     return object;
 }
 
@@ -218,11 +249,28 @@ word_t *LargeAllocator_Alloc(Heap *heap, uint32_t size) {
     assert(size % ALLOCATION_ALIGNMENT == 0);
     assert(size >= MIN_BLOCK_SIZE);
 
+    if (!mutatorThread.registered) {
+        // a thread that was not started by scalanative_pthread_create
+        MutatorThread_Register(MutatorThread_StackBottom());
+    }
+    Safepoint_Poll();
+    if (HeapDump_Requested()) {
+        HeapDump_OnRequest(heap);
+    }
     word_t *object = LargeAllocator_tryAlloc(&largeAllocator, size);
     if (object != NULL) {
     done:
         assert(object != NULL);
         assert(Heap_IsWordInHeap(heap, (word_t *)object));
+        uint64_t largeBytes = atomic_fetch_add_explicit(
+            &heap->totals.largeBytes, size, memory_order_relaxed);
+        largeBytes += size;
+        // sampled apart from the allocator's holes
+        if (largeBytes >= heap->totals.nextLargeSample) {
+            Profiler_Sample(object, size);
+            heap->totals.nextLargeSample =
+                largeBytes + Profiler_NextSampleDistance();
+        }
         return object;
     }
 
@@ -246,9 +294,16 @@ word_t *LargeAllocator_Alloc(Heap *heap, uint32_t size) {
 
     size_t increment = MathUtils_DivAndRoundUp(size, BLOCK_TOTAL_SIZE);
     uint32_t pow2increment = 1U << MathUtils_Log2Ceil(increment);
-    Heap_Grow(heap, pow2increment);
-
-    object = LargeAllocator_tryAlloc(&largeAllocator, size);
+    // recommitted blocks are not necessarily contiguous, keep growing until
+    // the heap is extended. They must not be in the range being swept, see
+    // `Allocator_allocSlow`.
+    while (Sweeper_IsSweepDone(heap)) {
+        Heap_Grow(heap, pow2increment);
+        object = LargeAllocator_tryAlloc(&largeAllocator, size);
+        if (object != NULL)
+            goto done;
+    }
 
-    goto done;
+    // another thread collected
+    return LargeAllocator_Alloc(heap, size);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define IMMIX_LARGEALLOCATOR_H
 
 #include "datastructures/Bytemap.h"
+#include "metadata/CrossingMeta.h"
 #include "GCTypes.h"
 #include "Constants.h"
 #include "headers/ObjectHeader.h"
@@ -19,13 +20,15 @@ typedef struct {
     FreeList freeLists[FREE_LIST_COUNT];
     word_t *heapStart;
     word_t *blockMetaStart;
+    word_t *crossingMetaStart;
     Bytemap *bytemap;
     BlockAllocator *blockAllocator;
 } LargeAllocator;
 
 void LargeAllocator_Init(LargeAllocator *allocator,
                          BlockAllocator *blockAllocator, Bytemap *bytemap,
-                         word_t *blockMetaStart, word_t *heapStart);
+                         word_t *blockMetaStart, word_t *crossingMetaStart,
+                         word_t *heapStart);
 word_t *LargeAllocator_Alloc(Heap *heap, uint32_t objectSize);
 void LargeAllocator_Clear(LargeAllocator *allocator);
 void LargeAllocator_AddChunk(LargeAllocator *allocator, Chunk *chunk,
@@ -1,19 +1,35 @@
 #include <stdio.h>
-#include <setjmp.h>
 #include "Marker.h"
 #include "Object.h"
 #include "Log.h"
 #include "State.h"
+#include "MutatorThread.h"
 #include "headers/ObjectHeader.h"
 #include "datastructures/GreyPacket.h"
 #include "GCThread.h"
-#include <sched.h>
+#include "Trace.h"
 
 extern word_t *__modules;
 extern int __modules_size;
-extern word_t **__stack_bottom;
 
-#define LAST_FIELD_OFFSET -1
+// LLVM's shadow stack, see ShadowStackGCLowering. With precise stack maps
+// every frame that has gcroot slots links a StackEntry into
+// llvm_gc_root_chain, the slots with metadata come first.
+typedef struct {
+    int32_t numRoots;
+    int32_t numMeta;
+    const void *meta[0];
+} FrameMap;
+
+typedef struct StackEntry {
+    struct StackEntry *next;
+    const FrameMap *map;
+    word_t *roots[0];
+} StackEntry;
+
+// The generated code only has linkonce definitions of the chain, so this one
+// is used. It stays NULL unless the code was compiled with precise stack maps.
+StackEntry *llvm_gc_root_chain = NULL;
 
 // Marking uses multiple threads in parallel. Note that there is no need to
 // synchronize on any of the mark bytes in BlockMeta, LineMeta or ObjectMeta,
@@ -31,9 +47,13 @@ extern word_t **__stack_bottom;
 // Each marker has a grey packet with references to check ("in" packet).
 // When it finds a new unmarked object the marker puts a pointer to
 // it in the "out" packet. When the "in" packet is empty it gets
-// another from the full packet list and returns the empty one to the empty
-// packet list. Similarly, when the "out" packet get full, marker gets another
-// empty packet and pushes the full one on the full packet list.
+// another full packet and returns the empty one to the empty packet list.
+// Similarly, when the "out" packet get full, marker gets another
+// empty packet and pushes the full one on its own work-stealing deque.
+// Each GC thread and the mutator have a deque (see heap->mark.deques). Full
+// packets are taken from the bottom of the own deque first, then from the
+// global full packet list, which only holds the packets that did not fit in
+// a deque, and finally stolen from the top of the other deques.
 // Marking is done when all the packets are empty and in the empty packet list.
 //
 // An object can have different number of outgoing pointers. Therefore, the number
@@ -55,11 +75,49 @@ extern word_t **__stack_bottom;
 // find any more full packets. If we left these threads running they would
 // continuously query for new packets spending CPU resources, slowing other
 // threads and not doing any work.
+//
+// The packet pool starts small and doubles whenever the empty list runs dry,
+// until the region reserved for it is exhausted. From then on a marker that
+// cannot get an empty packet leaves the objects it could not push marked but
+// untraced, and sets mark.overflow. Once marking is done, every marked object
+// in the heap is traced again, see `Marker_rescanMarked`.
+
+/**
+ * Makes the next part of the reserved region available once the empty list
+ * has run dry. Returns one of the new packets, or NULL if there are no packets
+ * left to be had.
+ */
+static GreyPacket *Marker_growPackets(Heap *heap) {
+    pthread_mutex_lock(&heap->mark.growMutex);
+    // another marker may have grown the pool in the meantime
+    GreyPacket *packet =
+        GreyList_Pop(&heap->mark.empty, heap->greyPacketsStart);
+    uint32_t total = heap->mark.total;
+    if (packet == NULL && total < heap->mark.limit) {
+        uint32_t count = heap->mark.limit - total;
+        if (count > total) {
+            count = total;
+        }
+        // counted before they are pushed, so marking cannot look done
+        heap->mark.total = total + count;
+        heap->mark.grown = true;
+        packet = (GreyPacket *)heap->greyPacketsStart + total;
+        if (count > 1) {
+            GreyList_PushAll(&heap->mark.empty, heap->greyPacketsStart,
+                             packet + 1, count - 1);
+        }
+    }
+    pthread_mutex_unlock(&heap->mark.growMutex);
+    return packet;
+}
 
 static inline GreyPacket *Marker_takeEmptyPacket(Heap *heap, Stats *stats) {
     Stats_RecordTimeSync(stats, start_ns);
     GreyPacket *packet =
         GreyList_Pop(&heap->mark.empty, heap->greyPacketsStart);
+    if (packet == NULL) {
+        packet = Marker_growPackets(heap);
+    }
     Stats_RecordTimeSync(stats, end_ns);
     Stats_RecordEventSync(stats, event_sync, start_ns, end_ns);
     if (packet != NULL) {
@@ -68,15 +126,41 @@ static inline GreyPacket *Marker_takeEmptyPacket(Heap *heap, Stats *stats) {
         packet->size = 0;
         packet->type = grey_packet_reflist;
     }
-    assert(packet != NULL);
     return packet;
 }
 
-static inline GreyPacket *Marker_takeFullPacket(Heap *heap, Stats *stats) {
+static inline GreyPacket *Marker_steal(Heap *heap, GreyDeque *deque) {
+    GreyDeque *deques = heap->mark.deques;
+    int count = heap->gcThreads.count + 1;
+    int self = (int)(deque - deques);
+    for (int i = 1; i < count; i++) {
+        GreyDeque *victim = &deques[(self + i) % count];
+        // a failed steal means another marker took the packet, try again
+        // while there is something left
+        while (GreyDeque_Size(victim) > 0) {
+            GreyPacket *packet = GreyDeque_Steal(victim);
+            if (packet != NULL) {
+                return packet;
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline GreyPacket *Marker_takeFullPacket(Heap *heap, Stats *stats,
+                                                GreyDeque *deque) {
     Stats_RecordTimeSync(stats, start_ns);
-    GreyPacket *packet = GreyList_Pop(&heap->mark.full, heap->greyPacketsStart);
-    if (packet != NULL) {
-        atomic_thread_fence(memory_order_release);
+    GreyPacket *packet = GreyDeque_Pop(deque);
+    if (packet == NULL) {
+        packet = GreyList_Pop(&heap->mark.full, heap->greyPacketsStart);
+        if (packet != NULL) {
+            atomic_thread_fence(memory_order_release);
+        } else if (heap->mark.workStealing) {
+            // only stealing is traced, it is rare unless markers run out
+            uint64_t traceStart_ns = Trace_Start();
+            packet = Marker_steal(heap, deque);
+            Trace_End(trace_sync, traceStart_ns, 0);
+        }
     }
     Stats_RecordTimeSync(stats, end_ns);
     Stats_RecordEventSync(stats, event_sync, stats->mark_waiting_start_ns,
@@ -102,36 +186,53 @@ static inline void Marker_giveEmptyPacket(Heap *heap, Stats *stats,
 }
 
 static inline void Marker_giveFullPacket(Heap *heap, Stats *stats,
-                                         GreyPacket *packet) {
+                                         GreyDeque *deque, GreyPacket *packet) {
     assert(packet->type == grey_packet_refrange || packet->size > 0);
     // make all the contents visible to other threads
     atomic_thread_fence(memory_order_acquire);
-    assert(GreyList_Size(&heap->mark.full) <= heap->mark.total);
     Stats_RecordTimeSync(stats, start_ns);
-    GreyList_Push(&heap->mark.full, heap->greyPacketsStart, packet);
+    if (!heap->mark.workStealing || !GreyDeque_Push(deque, packet)) {
+        // no deques or the own deque is full, use the global list
+        assert(GreyList_Size(&heap->mark.full) <= heap->mark.total);
+        GreyList_Push(&heap->mark.full, heap->greyPacketsStart, packet);
+    }
+    Parker_Signal(&heap->mark.parker);
     Stats_RecordTimeSync(stats, end_ns);
     Stats_RecordEventSync(stats, event_sync, start_ns, end_ns);
 }
 
-void Marker_markObject(Heap *heap, Stats *stats, GreyPacket **outHolder,
-                       Bytemap *bytemap, Object *object,
+/**
+ * Pushes a marked object to the out packet. If the packet is full and there
+ * is no empty one to replace it, the object is left for `Marker_rescanMarked`.
+ */
+static inline void Marker_push(Heap *heap, Stats *stats, GreyDeque *deque,
+                               GreyPacket **outHolder, Object *object) {
+    GreyPacket *out = *outHolder;
+    if (!GreyPacket_Push(out, object)) {
+        GreyPacket *fresh = Marker_takeEmptyPacket(heap, stats);
+        if (fresh == NULL) {
+            heap->mark.overflow = true;
+            return;
+        }
+        Marker_giveFullPacket(heap, stats, deque, out);
+        *outHolder = out = fresh;
+        GreyPacket_Push(out, object);
+    }
+}
+
+void Marker_markObject(Heap *heap, Stats *stats, GreyDeque *deque,
+                       GreyPacket **outHolder, Bytemap *bytemap, Object *object,
                        ObjectMeta *objectMeta) {
     assert(ObjectMeta_IsAllocated(objectMeta) ||
            ObjectMeta_IsMarked(objectMeta));
 
     assert(Object_Size(object) != 0);
     Object_Mark(heap, object, objectMeta);
-
-    GreyPacket *out = *outHolder;
-    if (!GreyPacket_Push(out, object)) {
-        Marker_giveFullPacket(heap, stats, out);
-        *outHolder = out = Marker_takeEmptyPacket(heap, stats);
-        GreyPacket_Push(out, object);
-    }
+    Marker_push(heap, stats, deque, outHolder, object);
 }
 
-void Marker_markConservative(Heap *heap, Stats *stats, GreyPacket **outHolder,
-                             word_t *address) {
+void Marker_markConservative(Heap *heap, Stats *stats, GreyDeque *deque,
+                             GreyPacket **outHolder, word_t *address) {
     assert(Heap_IsWordInHeap(heap, address));
     Object *object = Object_GetUnmarkedObject(heap, address);
     Bytemap *bytemap = heap->bytemap;
@@ -139,199 +240,303 @@ void Marker_markConservative(Heap *heap, Stats *stats, GreyPacket **outHolder,
         ObjectMeta *objectMeta = Bytemap_Get(bytemap, (word_t *)object);
         assert(ObjectMeta_IsAllocated(objectMeta));
         if (ObjectMeta_IsAllocated(objectMeta)) {
-            Marker_markObject(heap, stats, outHolder, bytemap, object,
+            Marker_markObject(heap, stats, deque, outHolder, bytemap, object,
                               objectMeta);
         }
     }
 }
 
-int Marker_markRange(Heap *heap, Stats *stats, GreyPacket **outHolder,
-                     Bytemap *bytemap, word_t **fields, size_t length) {
+static inline void Marker_prefetchFieldMeta(Heap *heap, Bytemap *bytemap,
+                                            word_t *field) {
+    if (heap->markPrefetchDistance > 0 && Heap_IsWordInHeap(heap, field)) {
+        // rw = 1 => the metadata is written when the field gets marked
+        __builtin_prefetch(Bytemap_Get(bytemap, field), 1, 3);
+    }
+}
+
+static inline int Marker_markField(Heap *heap, Stats *stats, GreyDeque *deque,
+                                   GreyPacket **outHolder, Bytemap *bytemap,
+                                   word_t *field) {
+    if (Heap_IsWordInHeap(heap, field)) {
+        ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
+        if (ObjectMeta_IsAllocated(fieldMeta)) {
+            Marker_markObject(heap, stats, deque, outHolder, bytemap,
+                              (Object *)field, fieldMeta);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int Marker_markRange(Heap *heap, Stats *stats, GreyDeque *deque,
+                     GreyPacket **outHolder, Bytemap *bytemap, word_t **fields,
+                     size_t length) {
     int objectsTraced = 0;
     word_t **limit = fields + length;
-    for (word_t **current = fields; current < limit; current++) {
-        word_t *field = *current;
-        if (Heap_IsWordInHeap(heap, field)) {
-            ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
-            if (ObjectMeta_IsAllocated(fieldMeta)) {
-                Marker_markObject(heap, stats, outHolder, bytemap,
-                                  (Object *)field, fieldMeta);
-            }
-            objectsTraced += 1;
+    // the metadata of a batch of fields is fetched in parallel
+    for (word_t **batch = fields; batch < limit;
+         batch += MARK_PREFETCH_FIELDS) {
+        word_t **batchLimit = batch + MARK_PREFETCH_FIELDS;
+        if (batchLimit > limit) {
+            batchLimit = limit;
+        }
+        for (word_t **current = batch; current < batchLimit; current++) {
+            Marker_prefetchFieldMeta(heap, bytemap, *current);
+        }
+        for (word_t **current = batch; current < batchLimit; current++) {
+            objectsTraced += Marker_markField(heap, stats, deque, outHolder,
+                                              bytemap, *current);
         }
     }
     return objectsTraced;
 }
 
-int Marker_markRegularObject(Heap *heap, Stats *stats, Object *object,
-                             GreyPacket **outHolder, Bytemap *bytemap) {
+int Marker_markRegularObject(Heap *heap, Stats *stats, GreyDeque *deque,
+                             Object *object, GreyPacket **outHolder,
+                             Bytemap *bytemap) {
     int objectsTraced = 0;
-    int64_t *ptr_map = object->rtti->refMapStruct;
-    for (int64_t *current = ptr_map; *current != LAST_FIELD_OFFSET; current++) {
-        word_t *field = object->fields[*current];
-        if (Heap_IsWordInHeap(heap, field)) {
-            ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
-            if (ObjectMeta_IsAllocated(fieldMeta)) {
-                Marker_markObject(heap, stats, outHolder, bytemap,
-                                  (Object *)field, fieldMeta);
-            }
-            objectsTraced += 1;
+    uint64_t refMapBits = object->rtti->refMapBits;
+    if (refMapBits != 0) {
+        // visits the set bits from the lowest, clearing each one in turn
+        for (uint64_t bits = refMapBits; bits != 0; bits &= bits - 1) {
+            Marker_prefetchFieldMeta(heap, bytemap,
+                                     object->fields[__builtin_ctzll(bits)]);
+        }
+        for (uint64_t bits = refMapBits; bits != 0; bits &= bits - 1) {
+            objectsTraced += Marker_markField(
+                heap, stats, deque, outHolder, bytemap,
+                object->fields[__builtin_ctzll(bits)]);
+        }
+    } else {
+        int64_t *ptr_map = object->rtti->refMapStruct;
+        for (int64_t *current = ptr_map; *current != LAST_FIELD_OFFSET;
+             current++) {
+            Marker_prefetchFieldMeta(heap, bytemap, object->fields[*current]);
+        }
+        for (int64_t *current = ptr_map; *current != LAST_FIELD_OFFSET;
+             current++) {
+            objectsTraced +=
+                Marker_markField(heap, stats, deque, outHolder, bytemap,
+                                 object->fields[*current]);
         }
     }
     return objectsTraced;
 }
 
-int Marker_splitObjectArray(Heap *heap, Stats *stats, GreyPacket **outHolder,
-                            Bytemap *bytemap, word_t **fields, size_t length) {
+int Marker_splitObjectArray(Heap *heap, Stats *stats, GreyDeque *deque,
+                            GreyPacket **outHolder, Bytemap *bytemap,
+                            word_t **fields, size_t length) {
     word_t **limit = fields + length;
     word_t **lastBatch =
         fields + (length / ARRAY_SPLIT_BATCH) * ARRAY_SPLIT_BATCH;
 
     assert(lastBatch <= limit);
-    for (word_t **batchFields = fields; batchFields < limit;
+    for (word_t **batchFields = fields; batchFields < lastBatch;
          batchFields += ARRAY_SPLIT_BATCH) {
         GreyPacket *slice = Marker_takeEmptyPacket(heap, stats);
-        assert(slice != NULL);
+        if (slice == NULL) {
+            // no packets left, the rest of the array is marked right here
+            return Marker_markRange(heap, stats, deque, outHolder, bytemap,
+                                    batchFields, limit - batchFields);
+        }
         slice->type = grey_packet_refrange;
         slice->items[0] = (Stack_Type)batchFields;
         // no point writing the size, because it is constant
-        Marker_giveFullPacket(heap, stats, slice);
+        Marker_giveFullPacket(heap, stats, deque, slice);
     }
 
     size_t lastBatchSize = limit - lastBatch;
     int objectsTraced = 0;
     if (lastBatchSize > 0) {
-        objectsTraced = Marker_markRange(heap, stats, outHolder, bytemap,
+        objectsTraced = Marker_markRange(heap, stats, deque, outHolder, bytemap,
                                          lastBatch, lastBatchSize);
     }
     return objectsTraced;
 }
 
-int Marker_markObjectArray(Heap *heap, Stats *stats, Object *object,
-                            GreyPacket **outHolder, Bytemap *bytemap) {
+int Marker_markObjectArray(Heap *heap, Stats *stats, GreyDeque *deque,
+                           Object *object, GreyPacket **outHolder,
+                           Bytemap *bytemap) {
     ArrayHeader *arrayHeader = (ArrayHeader *)object;
     size_t length = arrayHeader->length;
     word_t **fields = (word_t **)(arrayHeader + 1);
     int objectsTraced;
     if (length <= ARRAY_SPLIT_THRESHOLD) {
-        objectsTraced =
-            Marker_markRange(heap, stats, outHolder, bytemap, fields, length);
+        objectsTraced = Marker_markRange(heap, stats, deque, outHolder, bytemap,
+                                         fields, length);
     } else {
         // object array is two large, split it into pieces for multiple threads
         // to handle
-        objectsTraced = Marker_splitObjectArray(heap, stats, outHolder, bytemap,
-                                                fields, length);
+        objectsTraced = Marker_splitObjectArray(heap, stats, deque, outHolder,
+                                                bytemap, fields, length);
     }
     return objectsTraced;
 }
 
-static inline void Marker_splitIncomingPacket(Heap *heap, Stats *stats, GreyPacket *in) {
+static inline void Marker_splitIncomingPacket(Heap *heap, Stats *stats,
+                                              GreyDeque *deque,
+                                              GreyPacket *in) {
     int toMove = in->size / 2;
     if (toMove > 0) {
         GreyPacket *slice = Marker_takeEmptyPacket(heap, stats);
-        assert(slice != NULL);
-        GreyPacket_MoveItems(in, slice, toMove);
-        Marker_giveFullPacket(heap, stats, slice);
+        if (slice != NULL) {
+            GreyPacket_MoveItems(in, slice, toMove);
+            Marker_giveFullPacket(heap, stats, deque, slice);
+        }
     }
 }
 
-void Marker_markPacket(Heap *heap, Stats *stats, GreyPacket *in,
-                       GreyPacket **outHolder) {
-    Bytemap *bytemap = heap->bytemap;
-    int objectsTraced = 0;
+/**
+ * Traces the fields of a marked object.
+ */
+static inline int Marker_markFields(Heap *heap, Stats *stats, GreyDeque *deque,
+                                    Object *object, GreyPacket **outHolder,
+                                    Bytemap *bytemap) {
+    if (Object_IsArray(object)) {
+        if (object->rtti->rt.id == __object_array_id) {
+            return Marker_markObjectArray(heap, stats, deque, object,
+                                          outHolder, bytemap);
+        }
+        // non-object arrays do not contain pointers
+        return 0;
+    } else {
+        return Marker_markRegularObject(heap, stats, deque, object, outHolder,
+                                        bytemap);
+    }
+}
+
+/**
+ * Takes an out packet for a marker that does not have one. Without it the
+ * objects of the in packet cannot be traced, they are dropped and left for
+ * `Marker_rescanMarked`. Returns false in that case.
+ */
+static inline bool Marker_takeOutPacket(Heap *heap, Stats *stats,
+                                        GreyPacket *in,
+                                        GreyPacket **outHolder) {
     if (*outHolder == NULL) {
         GreyPacket *fresh = Marker_takeEmptyPacket(heap, stats);
-        assert(fresh != NULL);
+        if (fresh == NULL) {
+            heap->mark.overflow = true;
+            in->type = grey_packet_reflist;
+            in->size = 0;
+            return false;
+        }
         *outHolder = fresh;
     }
+    return true;
+}
+
+void Marker_markPacket(Heap *heap, Stats *stats, GreyDeque *deque,
+                       GreyPacket *in, GreyPacket **outHolder) {
+    Bytemap *bytemap = heap->bytemap;
+    int objectsTraced = 0;
+    if (!Marker_takeOutPacket(heap, stats, in, outHolder)) {
+        return;
+    }
+    // The packet is popped from the top, so it acts as the prefetch FIFO:
+    // the object scanned `distance` pops later is fetched now.
+    int distance = heap->markPrefetchDistance;
+    if (distance > 0) {
+        int prefetched = in->size - distance;
+        for (int i = prefetched < 0 ? 0 : prefetched; i < in->size; i++) {
+            __builtin_prefetch(in->items[i], 0, 3);
+        }
+    }
     while (!GreyPacket_IsEmpty(in)) {
-        Object *object = GreyPacket_Pop(in);
-        if (Object_IsArray(object)) {
-            if (object->rtti->rt.id == __object_array_id) {
-                objectsTraced += Marker_markObjectArray(heap, stats, object,
-                                                        outHolder, bytemap);
-            }
-            // non-object arrays do not contain pointers
-        } else {
-            objectsTraced += Marker_markRegularObject(heap, stats, object,
-                                                      outHolder, bytemap);
+        if (distance > 0 && in->size > distance) {
+            __builtin_prefetch(in->items[in->size - 1 - distance], 0, 3);
         }
+        Object *object = GreyPacket_Pop(in);
+        objectsTraced +=
+            Marker_markFields(heap, stats, deque, object, outHolder, bytemap);
         if (objectsTraced > MARK_MAX_WORK_PER_PACKET) {
             // the packet has a lot of work split the remainder in two
-            Marker_splitIncomingPacket(heap, stats, in);
+            Marker_splitIncomingPacket(heap, stats, deque, in);
             objectsTraced = 0;
         }
     }
 }
 
-void Marker_markRangePacket(Heap *heap, Stats *stats, GreyPacket *in,
-                            GreyPacket **outHolder) {
+void Marker_markRangePacket(Heap *heap, Stats *stats, GreyDeque *deque,
+                            GreyPacket *in, GreyPacket **outHolder) {
     Bytemap *bytemap = heap->bytemap;
-    if (*outHolder == NULL) {
-        GreyPacket *fresh = Marker_takeEmptyPacket(heap, stats);
-        assert(fresh != NULL);
-        *outHolder = fresh;
+    if (!Marker_takeOutPacket(heap, stats, in, outHolder)) {
+        return;
     }
     word_t **fields = (word_t **)in->items[0];
-    Marker_markRange(heap, stats, outHolder, bytemap, fields,
+    Marker_markRange(heap, stats, deque, outHolder, bytemap, fields,
                      ARRAY_SPLIT_BATCH);
     in->type = grey_packet_reflist;
     in->size = 0;
 }
 
-static inline void Marker_markBatch(Heap *heap, Stats *stats, GreyPacket *in,
-                                    GreyPacket **outHolder) {
+static inline void Marker_markBatch(Heap *heap, Stats *stats, GreyDeque *deque,
+                                    GreyPacket *in, GreyPacket **outHolder) {
     Stats_RecordTimeBatch(stats, start_ns);
     switch (in->type) {
     case grey_packet_reflist:
-        Marker_markPacket(heap, stats, in, outHolder);
+        Marker_markPacket(heap, stats, deque, in, outHolder);
         break;
     case grey_packet_refrange:
-        Marker_markRangePacket(heap, stats, in, outHolder);
+        Marker_markRangePacket(heap, stats, deque, in, outHolder);
         break;
     }
     Stats_RecordTimeBatch(stats, end_ns);
     Stats_RecordEventBatches(stats, event_mark_batch, start_ns, end_ns);
 }
 
-void Marker_Mark(Heap *heap, Stats *stats) {
-    GreyPacket *in = Marker_takeFullPacket(heap, stats);
+void Marker_Mark(Heap *heap, Stats *stats, GreyDeque *deque) {
+    GreyPacket *in = Marker_takeFullPacket(heap, stats, deque);
     GreyPacket *out = NULL;
     while (in != NULL) {
-        Marker_markBatch(heap, stats, in, &out);
+        Marker_markBatch(heap, stats, deque, in, &out);
 
-        assert(out != NULL);
         assert(GreyPacket_IsEmpty(in));
-        GreyPacket *next = Marker_takeFullPacket(heap, stats);
+        GreyPacket *next = Marker_takeFullPacket(heap, stats, deque);
         if (next != NULL) {
             Marker_giveEmptyPacket(heap, stats, in);
         } else {
-            if (!GreyPacket_IsEmpty(out)) {
+            if (out != NULL && !GreyPacket_IsEmpty(out)) {
                 // use the out packet as source
                 next = out;
                 out = in;
             } else {
                 // next == NULL, exits
                 Marker_giveEmptyPacket(heap, stats, in);
-                Marker_giveEmptyPacket(heap, stats, out);
+                if (out != NULL) {
+                    Marker_giveEmptyPacket(heap, stats, out);
+                }
             }
         }
         in = next;
     }
+    // marking may be done now
+    Parker_Signal(&heap->mark.parker);
+}
+
+/**
+ * Estimates the number of full packets in the global list and all the deques.
+ */
+static inline uint32_t Marker_fullPacketCount(Heap *heap) {
+    uint32_t count = GreyList_Size(&heap->mark.full);
+    int dequeCount = heap->gcThreads.count + 1;
+    for (int i = 0; i < dequeCount; i++) {
+        count += GreyDeque_Size(&heap->mark.deques[i]);
+    }
+    return count;
 }
 
-void Marker_MarkAndScale(Heap *heap, Stats *stats) {
-    GreyPacket *in = Marker_takeFullPacket(heap, stats);
+void Marker_MarkAndScale(Heap *heap, Stats *stats, GreyDeque *deque) {
+    GreyPacket *in = Marker_takeFullPacket(heap, stats, deque);
     GreyPacket *out = NULL;
     while (in != NULL) {
-        Marker_markBatch(heap, stats, in, &out);
+        Marker_markBatch(heap, stats, deque, in, &out);
 
-        assert(out != NULL);
         assert(GreyPacket_IsEmpty(in));
-        GreyPacket *next = Marker_takeFullPacket(heap, stats);
+        GreyPacket *next = Marker_takeFullPacket(heap, stats, deque);
         if (next != NULL) {
             Marker_giveEmptyPacket(heap, stats, in);
-            uint32_t remainingFullPackets = next->next.sep.size;
+            uint32_t remainingFullPackets = Marker_fullPacketCount(heap);
             // Make sure than enough worker threads are running
             // given the number of packets available.
             // They will automatically stop if they run out of full packets.
@@ -340,49 +545,173 @@ void Marker_MarkAndScale(Heap *heap, Stats *stats) {
             // overhead by checking the list of full packets.
             GCThread_ScaleMarkerThreads(heap, remainingFullPackets);
         } else {
-            if (!GreyPacket_IsEmpty(out)) {
+            if (out != NULL && !GreyPacket_IsEmpty(out)) {
                 // use the out packet as source
                 next = out;
                 out = in;
             } else {
                 // next == NULL, exits
                 Marker_giveEmptyPacket(heap, stats, in);
-                Marker_giveEmptyPacket(heap, stats, out);
+                if (out != NULL) {
+                    Marker_giveEmptyPacket(heap, stats, out);
+                }
             }
         }
         in = next;
     }
+    // marking may be done now
+    Parker_Signal(&heap->mark.parker);
 }
 
-void Marker_MarkUntilDone(Heap *heap, Stats *stats) {
-    while (!Marker_IsMarkDone(heap)) {
-        Marker_Mark(heap, stats);
-        if (!Marker_IsMarkDone(heap)) {
-            sched_yield();
-        }
+/**
+ * Waits until there is a full packet to take or marking is done. The other
+ * markers usually give a packet soon, otherwise the thread parks.
+ */
+void Marker_AwaitWork(Heap *heap, Stats *stats) {
+    Parker *parker = &heap->mark.parker;
+    uint32_t epoch = Parker_Prepare(parker);
+    if (!Marker_IsMarkDone(heap) && Marker_fullPacketCount(heap) == 0) {
+        Parker_Park(parker, stats, epoch);
     }
+    Parker_Leave(parker);
 }
 
-void Marker_markProgramStack(Heap *heap, Stats *stats, GreyPacket **outHolder) {
-    // Dumps registers into 'regs' which is on stack
-    jmp_buf regs;
-    setjmp(regs);
-    word_t *dummy;
+/**
+ * Traces every marked object again, after objects have been marked without
+ * being pushed because the packets ran out. Each block is drained before the
+ * next one is scanned, so that the pool is not exhausted again right away.
+ * Objects that were already traced only mark what is marked already.
+ */
+static void Marker_rescanMarked(Heap *heap, Stats *stats, GreyDeque *deque) {
+    Bytemap *bytemap = heap->bytemap;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    word_t *blockStart = heap->heapStart;
+    for (BlockMeta *blockMeta = (BlockMeta *)heap->blockMetaStart;
+         blockMeta < end; blockMeta++, blockStart += WORDS_IN_BLOCK) {
+        if (BlockMeta_IsFree(blockMeta) || BlockMeta_IsUncommitted(blockMeta)) {
+            continue;
+        }
+        GreyPacket *out = Marker_takeEmptyPacket(heap, stats);
+        if (out == NULL) {
+            // the GC threads hold all the packets, try again in the next pass
+            heap->mark.overflow = true;
+            continue;
+        }
+        ObjectMeta *first = Bytemap_Get(bytemap, blockStart);
+        uint64_t *cursor = (uint64_t *)first;
+        uint64_t *limit = cursor + WORDS_IN_BLOCK / ALLOCATION_ALIGNMENT_WORDS /
+                                       sizeof(uint64_t);
+        for (; cursor < limit; cursor++) {
+            // skips eight free entries at once
+            if (*cursor == 0) {
+                continue;
+            }
+            ObjectMeta *objectMeta = (ObjectMeta *)cursor;
+            for (int i = 0; i < sizeof(uint64_t); i++, objectMeta++) {
+                if (ObjectMeta_IsMarked(objectMeta)) {
+                    Object *object =
+                        (Object *)(blockStart + (objectMeta - first) *
+                                                    ALLOCATION_ALIGNMENT_WORDS);
+                    Marker_markFields(heap, stats, deque, object, &out,
+                                      bytemap);
+                }
+            }
+        }
+        if (GreyPacket_IsEmpty(out)) {
+            Marker_giveEmptyPacket(heap, stats, out);
+        } else {
+            Marker_giveFullPacket(heap, stats, deque, out);
+            Marker_Mark(heap, stats, deque);
+        }
+    }
+}
 
-    word_t **current = &dummy;
-    word_t **stackBottom = __stack_bottom;
+void Marker_MarkUntilDone(Heap *heap, Stats *stats) {
+    GreyDeque *deque = Heap_MutatorDeque(heap);
+    while (true) {
+        while (!Marker_IsMarkDone(heap)) {
+            Marker_Mark(heap, stats, deque);
+            Marker_AwaitWork(heap, stats);
+        }
+        // a marker that drops objects sets the flag before it gives back its
+        // packets, so it is visible once marking looks done
+        if (!heap->mark.overflow) {
+            break;
+        }
+        heap->mark.overflow = false;
+        Marker_rescanMarked(heap, stats, deque);
+    }
+}
 
-    while (current <= stackBottom) {
+/**
+ * Marks the roots in the gcroot slots of the shadow stack. Reference slots
+ * hold the start of an object, raw pointer slots may point inside one and are
+ * marked conservatively.
+ */
+void Marker_markShadowStack(Heap *heap, Stats *stats, GreyDeque *deque,
+                            GreyPacket **outHolder) {
+    Bytemap *bytemap = heap->bytemap;
+    for (StackEntry *entry = llvm_gc_root_chain; entry != NULL;
+         entry = entry->next) {
+        int32_t numMeta = entry->map->numMeta;
+        int32_t numRoots = entry->map->numRoots;
+        for (int32_t i = 0; i < numRoots; i++) {
+            word_t *root = entry->roots[i];
+            if (!Heap_IsWordInHeap(heap, root)) {
+                continue;
+            }
+            if (i < numMeta) {
+                Marker_markConservative(heap, stats, deque, outHolder, root);
+            } else {
+                ObjectMeta *rootMeta = Bytemap_Get(bytemap, root);
+                if (ObjectMeta_IsAllocated(rootMeta)) {
+                    Marker_markObject(heap, stats, deque, outHolder, bytemap,
+                                      (Object *)root, rootMeta);
+                }
+            }
+        }
+    }
+}
 
+static void Marker_markStackRange(Heap *heap, Stats *stats, GreyDeque *deque,
+                                  GreyPacket **outHolder, word_t **current,
+                                  word_t **limit) {
+    while (current <= limit) {
         word_t *stackObject = *current;
         if (Heap_IsWordInHeap(heap, stackObject)) {
-            Marker_markConservative(heap, stats, outHolder, stackObject);
+            Marker_markConservative(heap, stats, deque, outHolder, stackObject);
         }
         current += 1;
     }
 }
 
-void Marker_markModules(Heap *heap, Stats *stats, GreyPacket **outHolder) {
+/**
+ * Scans the stacks of all the mutator threads. The other threads are stopped,
+ * their registers are spilled above their `stackTop`. The stack maps of precise
+ * mode form a single chain, which is why MutatorThread_Register refuses other
+ * threads in that mode.
+ */
+void Marker_markProgramStack(Heap *heap, Stats *stats, GreyDeque *deque,
+                             GreyPacket **outHolder) {
+    if (llvm_gc_root_chain != NULL) {
+        Marker_markShadowStack(heap, stats, deque, outHolder);
+        return;
+    }
+
+    // Dumps registers on the stack, the scan of the current thread starts
+    // below them
+    __builtin_unwind_init();
+    MutatorThread_SaveStackTop(&mutatorThread);
+
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        Marker_markStackRange(heap, stats, deque, outHolder, thread->stackTop,
+                              thread->stackBottom);
+    }
+}
+
+void Marker_markModules(Heap *heap, Stats *stats, GreyDeque *deque,
+                        GreyPacket **outHolder) {
     word_t **modules = &__modules;
     int nb_modules = __modules_size;
     Bytemap *bytemap = heap->bytemap;
@@ -393,18 +722,111 @@ void Marker_markModules(Heap *heap, Stats *stats, GreyPacket **outHolder) {
             // is within heap
             ObjectMeta *objectMeta = Bytemap_Get(bytemap, (word_t *)object);
             if (ObjectMeta_IsAllocated(objectMeta)) {
-                Marker_markObject(heap, stats, outHolder, bytemap, object,
-                                  objectMeta);
+                Marker_markObject(heap, stats, deque, outHolder, bytemap,
+                                  object, objectMeta);
             }
         }
     }
 }
 
-void Marker_MarkRoots(Heap *heap, Stats *stats) {
+/**
+ * Scans the part of a remembered old object that lies on a dirty card. Object
+ * arrays are only scanned within the card, other objects are scanned whole.
+ */
+void Marker_markRememberedObject(Heap *heap, Stats *stats, GreyDeque *deque,
+                                 GreyPacket **outHolder, Object *object,
+                                 word_t *cardStart, word_t *cardEnd) {
+    if (Object_IsArray(object)) {
+        if (object->rtti->rt.id == __object_array_id) {
+            ArrayHeader *arrayHeader = (ArrayHeader *)object;
+            word_t **fields = (word_t **)(arrayHeader + 1);
+            word_t **end = fields + arrayHeader->length;
+            if (fields < (word_t **)cardStart) {
+                fields = (word_t **)cardStart;
+            }
+            if (end > (word_t **)cardEnd) {
+                end = (word_t **)cardEnd;
+            }
+            if (fields < end) {
+                Marker_markRange(heap, stats, deque, outHolder, heap->bytemap,
+                                 fields, end - fields);
+            }
+        }
+    } else {
+        Marker_push(heap, stats, deque, outHolder, object);
+    }
+}
+
+void Marker_markCard(Heap *heap, Stats *stats, GreyDeque *deque,
+                     GreyPacket **outHolder, word_t *cardStart) {
+    BlockMeta *blockMeta =
+        Block_GetBlockMeta(heap->blockMetaStart, heap->heapStart, cardStart);
+    if (BlockMeta_IsFree(blockMeta)) {
+        return;
+    }
+    word_t *cardEnd = cardStart + WORDS_IN_CARD;
+
+    // the object overlapping the start of the card
+    Object *object = Object_GetMarkedObject(heap, cardStart);
+    if (object != NULL) {
+        Marker_markRememberedObject(heap, stats, deque, outHolder, object,
+                                    cardStart, cardEnd);
+    }
+
+    // large objects are aligned to MIN_BLOCK_SIZE, so only a single one can
+    // start on a card
+    if (!BlockMeta_ContainsLargeObjects(blockMeta)) {
+        ObjectMeta *cursor = Bytemap_Get(heap->bytemap, cardStart);
+        for (word_t *current = cardStart + ALLOCATION_ALIGNMENT_WORDS;
+             current < cardEnd; current += ALLOCATION_ALIGNMENT_WORDS) {
+            cursor++;
+            if (ObjectMeta_IsMarked(cursor)) {
+                Marker_markRememberedObject(heap, stats, deque, outHolder,
+                                            (Object *)current, cardStart,
+                                            cardEnd);
+            }
+        }
+    }
+}
+
+/**
+ * Old objects on dirty cards are roots of a young collection. All cards are
+ * clean afterwards, because every survivor of a young collection is old.
+ */
+void Marker_markDirtyCards(Heap *heap, Stats *stats, GreyDeque *deque,
+                           GreyPacket **outHolder) {
+    assert(CARD_COUNT % sizeof(uint64_t) == 0);
+    uint64_t *cursor = (uint64_t *)heap->cardMetaStart;
+    uint64_t *end = (uint64_t *)heap->cardMetaEnd;
+    for (; cursor < end; cursor++) {
+        // skips eight clean cards at once
+        if (*cursor != 0) {
+            CardMeta *cardMeta = (CardMeta *)cursor;
+            for (int i = 0; i < sizeof(uint64_t); i++, cardMeta++) {
+                if (Card_IsDirty(cardMeta)) {
+                    Card_Clear(cardMeta);
+                    Marker_markCard(heap, stats, deque, outHolder,
+                                    Heap_CardStart(heap, cardMeta));
+                }
+            }
+        }
+    }
+}
+
+void Marker_MarkRoots(Heap *heap, Stats *stats, bool young) {
+    GreyDeque *deque = Heap_MutatorDeque(heap);
     GreyPacket *out = Marker_takeEmptyPacket(heap, stats);
-    Marker_markProgramStack(heap, stats, &out);
-    Marker_markModules(heap, stats, &out);
-    Marker_giveFullPacket(heap, stats, out);
+    if (young) {
+        Marker_markDirtyCards(heap, stats, deque, &out);
+    }
+    Marker_markProgramStack(heap, stats, deque, &out);
+    Marker_markModules(heap, stats, deque, &out);
+    if (GreyPacket_IsEmpty(out)) {
+        // a young collection can find all the roots already marked
+        Marker_giveEmptyPacket(heap, stats, out);
+    } else {
+        Marker_giveFullPacket(heap, stats, deque, out);
+    }
 }
 
 bool Marker_IsMarkDone(Heap *heap) {
@@ -4,10 +4,11 @@
 #include "Heap.h"
 #include "Stats.h"
 
-void Marker_MarkRoots(Heap *heap, Stats *stats);
-void Marker_Mark(Heap *heap, Stats *stats);
+void Marker_MarkRoots(Heap *heap, Stats *stats, bool young);
+void Marker_Mark(Heap *heap, Stats *stats, GreyDeque *deque);
 void Marker_MarkUntilDone(Heap *heap, Stats *stats);
-void Marker_MarkAndScale(Heap *heap, Stats *stats);
+void Marker_MarkAndScale(Heap *heap, Stats *stats, GreyDeque *deque);
+void Marker_AwaitWork(Heap *heap, Stats *stats);
 bool Marker_IsMarkDone(Heap *heap);
 
 #endif // IMMIX_MARKER_H
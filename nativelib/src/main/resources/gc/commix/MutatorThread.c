@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include "MutatorThread.h"
+#include "Safepoint.h"
+#include "State.h"
+#include "Parker.h"
+#include "Profiler.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+_Thread_local MutatorThread mutatorThread;
+MutatorThread *mutatorThreads = NULL;
+static pthread_mutex_t MutatorThreads_mutex = PTHREAD_MUTEX_INITIALIZER;
+// the thread is unregistered by the destructor of its value
+static pthread_key_t MutatorThread_key;
+// the bytes allocated by the threads that exited
+static uint64_t MutatorThreads_exitedBytes = 0;
+// signalled when a thread started by `scalanative_pthread_create` is
+// registered
+static Parker MutatorThread_started;
+// signalled when the registry is unlocked
+static Parker MutatorThreads_unlocked;
+// set by the generated code, 1 if it was built with `nativePreciseStack`. The
+// shadow stack of that mode is a single global chain, which only one thread
+// may push frames on.
+extern int __precise_stack;
+
+// see monitor.c, the monitors are only recorded while there is one thread
+void scalanative_monitor_start_threads();
+// see monitor.c, detaches the java.lang.Thread of the exiting thread
+void scalanative_thread_exiting();
+
+typedef struct {
+    void *(*routine)(void *);
+    void *arg;
+    atomic_bool registered;
+} MutatorThreadStart;
+
+void MutatorThreads_Lock() {
+    Parker *parker = &MutatorThreads_unlocked;
+    while (pthread_mutex_trylock(&MutatorThreads_mutex) != 0) {
+        // a thread that waits for the registry stops for a collection
+        // meanwhile, the wait in the kernel is bounded
+        Safepoint_Poll();
+        uint32_t epoch = Parker_Prepare(parker);
+        if (pthread_mutex_trylock(&MutatorThreads_mutex) == 0) {
+            Parker_Leave(parker);
+            return;
+        }
+        Parker_Park(parker, NULL, epoch);
+        Parker_Leave(parker);
+    }
+}
+
+void MutatorThreads_Unlock() {
+    pthread_mutex_unlock(&MutatorThreads_mutex);
+    Parker_Signal(&MutatorThreads_unlocked);
+}
+
+/**
+ * Returns the last word of the stack of the calling thread.
+ */
+word_t **MutatorThread_StackBottom() {
+    void *stackEnd;
+#ifdef __APPLE__
+    stackEnd = pthread_get_stackaddr_np(pthread_self());
+#else
+    pthread_attr_t attributes;
+    void *stackStart;
+    size_t stackSize;
+    pthread_getattr_np(pthread_self(), &attributes);
+    pthread_attr_getstack(&attributes, &stackStart, &stackSize);
+    pthread_attr_destroy(&attributes);
+    stackEnd = (uint8_t *)stackStart + stackSize;
+#endif
+    return (word_t **)stackEnd - 1;
+}
+
+/**
+ * Sets where the scan of the stack of the calling thread starts, below the
+ * frame of the caller. The caller spills its registers there first with
+ * `__builtin_unwind_init`, `setjmp` would not do as glibc mangles some of the
+ * registers it saves.
+ */
+NOINLINE void MutatorThread_SaveStackTop(MutatorThread *self) {
+    word_t *top = NULL;
+    self->stackTop = (word_t **)&top;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+/**
+ * Registers the calling thread, which is in the GC or does not run the
+ * program yet.
+ */
+void MutatorThread_Register(word_t **stackBottom) {
+    MutatorThread *self = &mutatorThread;
+    Allocator_Init(&allocator, &blockAllocator, heap.bytemap,
+                   heap.blockMetaStart, heap.crossingMetaStart,
+                   heap.heapStart);
+    allocator.nextSample = Profiler_NextSampleDistance();
+    self->allocator = &allocator;
+    self->handle = pthread_self();
+    self->stackBottom = stackBottom;
+    MutatorThreads_Lock();
+    if (__precise_stack && mutatorThreads != NULL) {
+        fprintf(stderr, "A second thread can't run Scala code, the program was "
+                        "built with nativePreciseStack := true\n");
+        fflush(stderr);
+        exit(1);
+    }
+    self->next = mutatorThreads;
+    mutatorThreads = self;
+    self->registered = true;
+    MutatorThreads_Unlock();
+    pthread_setspecific(MutatorThread_key, self);
+}
+
+/**
+ * Called when a registered thread exits. The blocks it was allocating in are
+ * swept by the next collection.
+ */
+static void MutatorThread_unregister(void *thread) {
+    MutatorThread *self = (MutatorThread *)thread;
+    // may run Scala code, which allocates
+    scalanative_thread_exiting();
+    Safepoint_EnterGC();
+    MutatorThreads_Lock();
+    MutatorThread **link = &mutatorThreads;
+    while (*link != self) {
+        link = &(*link)->next;
+    }
+    *link = self->next;
+    self->registered = false;
+    MutatorThreads_exitedBytes += Allocator_AllocatedBytes(self->allocator);
+    MutatorThreads_Unlock();
+    Safepoint_LeaveGC();
+}
+
+void MutatorThreads_Init(word_t **mainStackBottom) {
+    pthread_key_create(&MutatorThread_key, MutatorThread_unregister);
+    Parker_Init(&MutatorThread_started);
+    Parker_Init(&MutatorThreads_unlocked);
+    Safepoint_Init();
+    MutatorThread_Register(mainStackBottom);
+}
+
+/**
+ * Returns the bytes allocated by all the threads. The other threads may be
+ * allocating, the rest of their current holes counts as allocated.
+ */
+uint64_t MutatorThreads_AllocatedBytes() {
+    MutatorThreads_Lock();
+    uint64_t bytes = MutatorThreads_exitedBytes;
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        if (thread == &mutatorThread) {
+            bytes += Allocator_AllocatedBytes(thread->allocator);
+        } else {
+            bytes += thread->allocator->holeBytes;
+        }
+    }
+    MutatorThreads_Unlock();
+    return bytes;
+}
+
+static void *MutatorThread_run(void *data) {
+    MutatorThreadStart *start = (MutatorThreadStart *)data;
+    void *(*routine)(void *) = start->routine;
+    void *arg = start->arg;
+    Safepoint_EnterGC();
+    MutatorThread_Register(MutatorThread_StackBottom());
+    Safepoint_LeaveGC();
+    // `start` is on the stack of the parent, which returns once it sees this
+    atomic_store(&start->registered, true);
+    Parker_Signal(&MutatorThread_started);
+    return routine(arg);
+}
+
+// Starts a thread that is registered before `routine` runs. Until then `arg`
+// stays on the stack of the caller, which is scanned. Precise stack mode only
+// supports the main thread.
+int scalanative_pthread_create(pthread_t *thread, pthread_attr_t *attr,
+                               void *(*routine)(void *), void *arg) {
+    if (__precise_stack) {
+        return ENOTSUP;
+    }
+    scalanative_monitor_start_threads();
+    MutatorThreadStart start = {routine, arg, false};
+    int result = pthread_create(thread, attr, MutatorThread_run, &start);
+    while (result == 0 && !atomic_load(&start.registered)) {
+        uint32_t epoch = Parker_Prepare(&MutatorThread_started);
+        if (!atomic_load(&start.registered)) {
+            Parker_Park(&MutatorThread_started, NULL, epoch);
+        }
+        Parker_Leave(&MutatorThread_started);
+    }
+    return result;
+}
+
+int scalanative_pthread_detach(pthread_t thread) {
+    return pthread_detach(thread);
+}
+
+// the thread is unregistered by the destructor of MutatorThread_key
+void scalanative_pthread_exit(void *result) { pthread_exit(result); }
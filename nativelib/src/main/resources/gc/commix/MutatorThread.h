@@ -0,0 +1,47 @@
+#ifndef IMMIX_MUTATORTHREAD_H
+#define IMMIX_MUTATORTHREAD_H
+
+#include "GCTypes.h"
+#include "Allocator.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Every thread that allocates is registered with the bounds of its stack, so
+// that a collection can stop it and scan its stack. Each one allocates from
+// its own `allocator`, which takes blocks from the shared block allocator.
+// Threads started with `scalanative_pthread_create` are registered before
+// they run, other threads on their first allocation. They are unregistered
+// when they exit.
+
+typedef struct MutatorThread {
+    // the allocator of the thread, which is thread local
+    Allocator *allocator;
+    pthread_t handle;
+    word_t **stackBottom;
+    // where the scan of the stack starts while the thread is stopped, its
+    // registers are spilled above it
+    word_t **stackTop;
+    // the last safepoint at which the thread stopped, see Safepoint.h
+    atomic_uint_fast64_t stoppedEpoch;
+    // the thread is in the GC, it stops at its next poll instead of in the
+    // signal handler
+    volatile sig_atomic_t inGC;
+    bool registered;
+    struct MutatorThread *next;
+} MutatorThread;
+
+extern _Thread_local MutatorThread mutatorThread;
+// guarded by `MutatorThreads_Lock`
+extern MutatorThread *mutatorThreads;
+
+void MutatorThreads_Init(word_t **mainStackBottom);
+void MutatorThreads_Lock();
+void MutatorThreads_Unlock();
+uint64_t MutatorThreads_AllocatedBytes();
+void MutatorThread_Register(word_t **stackBottom);
+word_t **MutatorThread_StackBottom();
+void MutatorThread_SaveStackTop(MutatorThread *self);
+
+#endif // IMMIX_MUTATORTHREAD_H
@@ -12,30 +12,41 @@ word_t *Object_LastWord(Object *object) {
     return last;
 }
 
-Object *Object_getInnerPointer(Heap *heap, BlockMeta *blockMeta, word_t *word,
-                               ObjectMeta *wordMeta) {
-    int stride;
-    word_t *blockStart;
-    if (BlockMeta_ContainsLargeObjects(blockMeta)) {
-        stride = MIN_BLOCK_SIZE / ALLOCATION_ALIGNMENT;
-        BlockMeta *superblockStart =
-            BlockMeta_GetSuperblockStart(heap->blockMetaStart, blockMeta);
-        blockStart = BlockMeta_GetBlockStart(heap->blockMetaStart,
-                                             heap->heapStart, superblockStart);
-    } else {
-        stride = 1;
-        blockStart = Block_GetBlockStartForWord(word);
+/**
+ * Steps back from `current` to the closest object start in the same line, or
+ * to the start of the line if there is none.
+ */
+static inline word_t *Object_scanLine(word_t *lineStart, word_t *current,
+                                      ObjectMeta **currentMeta) {
+    while (current > lineStart && ObjectMeta_IsFree(*currentMeta)) {
+        current -= ALLOCATION_ALIGNMENT_WORDS;
+        (*currentMeta)--;
     }
+    return current;
+}
 
-    word_t *current = word;
+Object *Object_getInnerPointer(Heap *heap, word_t *word, ObjectMeta *wordMeta,
+                               bool marked) {
+    word_t *lineStart = (word_t *)((word_t)word & ~(LINE_SIZE - 1));
     ObjectMeta *currentMeta = wordMeta;
-    while (current >= blockStart && ObjectMeta_IsFree(currentMeta)) {
-        current -= ALLOCATION_ALIGNMENT_WORDS * stride;
-        currentMeta -= stride;
+    word_t *current = Object_scanLine(lineStart, word, &currentMeta);
+    if (ObjectMeta_IsFree(currentMeta)) {
+        // the object covering `word` starts in an earlier line, it is the last
+        // one that starts there
+        CrossingMeta *crossing = Heap_CrossingMetaForWord(heap, lineStart);
+        CrossingMeta *firstLine = Crossing_FirstLine(crossing);
+        if (firstLine == NULL) {
+            return NULL;
+        }
+        lineStart -= (crossing - firstLine) * WORDS_IN_LINE;
+        current = lineStart + WORDS_IN_LINE - ALLOCATION_ALIGNMENT_WORDS;
+        currentMeta = Bytemap_Get(heap->bytemap, current);
+        current = Object_scanLine(lineStart, current, &currentMeta);
     }
     Object *object = (Object *)current;
-    if (ObjectMeta_IsAllocated(currentMeta) &&
-        word < current + Object_Size(object) / WORD_SIZE) {
+    bool matches = marked ? ObjectMeta_IsMarked(currentMeta)
+                          : ObjectMeta_IsAllocated(currentMeta);
+    if (matches && word < current + Object_Size(object) / WORD_SIZE) {
         return object;
     } else {
         return NULL;
@@ -58,7 +69,30 @@ Object *Object_GetUnmarkedObject(Heap *heap, word_t *word) {
     } else if (ObjectMeta_IsAllocated(wordMeta)) {
         return (Object *)word;
     } else {
-        return Object_getInnerPointer(heap, blockMeta, word, wordMeta);
+        return Object_getInnerPointer(heap, word, wordMeta, false);
+    }
+}
+
+/**
+ * Returns the marked (old) object that contains `word`, or NULL.
+ */
+Object *Object_GetMarkedObject(Heap *heap, word_t *word) {
+    BlockMeta *blockMeta =
+        Block_GetBlockMeta(heap->blockMetaStart, heap->heapStart, word);
+
+    if (BlockMeta_ContainsLargeObjects(blockMeta)) {
+        word = (word_t *)((word_t)word & LARGE_BLOCK_MASK);
+    } else {
+        word = (word_t *)((word_t)word & ALLOCATION_ALIGNMENT_INVERSE_MASK);
+    }
+
+    ObjectMeta *wordMeta = Bytemap_Get(heap->bytemap, word);
+    if (ObjectMeta_IsMarked(wordMeta)) {
+        return (Object *)word;
+    } else if (ObjectMeta_IsFree(wordMeta)) {
+        return Object_getInnerPointer(heap, word, wordMeta, true);
+    } else {
+        return NULL;
     }
 }
 
@@ -86,4 +120,34 @@ void Object_Mark(Heap *heap, Object *object, ObjectMeta *objectMeta) {
             Line_Mark(lineMeta);
         }
     }
-}
\ No newline at end of file
+}
+
+// layout of java.lang.String, the name of a class
+typedef struct {
+    Rtti *rtti;
+    ArrayHeader *value;
+    int32_t offset;
+    int32_t count;
+    int32_t cachedHashCode;
+} JavaString;
+
+/**
+ * Writes the ASCII characters of the name of the class to `buffer`, others are
+ * replaced by '?'.
+ */
+void Object_ClassName(Rtti *rtti, char *buffer, size_t size) {
+    JavaString *name = (JavaString *)rtti->rt.name;
+    if (name == NULL || name->value == NULL) {
+        snprintf(buffer, size, "<class %d>", rtti->rt.id);
+        return;
+    }
+    uint16_t *chars =
+        (uint16_t *)((uint8_t *)name->value + sizeof(ArrayHeader)) +
+        name->offset;
+    size_t length = 0;
+    for (; length < (size_t)name->count && length < size - 1; length++) {
+        uint16_t c = chars[length];
+        buffer[length] = c >= 0x20 && c < 0x7f ? (char)c : '?';
+    }
+    buffer[length] = '\0';
+}
@@ -0,0 +1,68 @@
+#include "Parker.h"
+#include "Constants.h"
+#include "Trace.h"
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+extern long long scalanative_nano_time();
+
+void Parker_Init(Parker *parker) {
+    parker->epoch = 0;
+    parker->waiters = 0;
+    parker->spinLimit = PARK_MAX_SPINS / 2;
+}
+
+static inline void Parker_cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * Waits until the epoch moves past `epoch`. The wait in the kernel is bounded,
+ * the caller checks its condition again anyway.
+ */
+void Parker_Park(Parker *parker, Stats *stats, uint32_t epoch) {
+    int spinLimit = parker->spinLimit;
+    for (int i = 0; i < spinLimit; i++) {
+        if (parker->epoch != epoch) {
+            if (spinLimit < PARK_MAX_SPINS) {
+                parker->spinLimit = spinLimit * 2;
+            }
+            return;
+        }
+        Parker_cpuRelax();
+    }
+    if (spinLimit > PARK_MIN_SPINS) {
+        parker->spinLimit = spinLimit / 2;
+    }
+
+    uint64_t traceStart_ns = Trace_Start();
+    Stats_RecordTimeSync(stats, start_ns);
+#ifdef __linux__
+    struct timespec timeout = {0, PARK_TIMEOUT_NS};
+    syscall(SYS_futex, &parker->epoch, FUTEX_WAIT_PRIVATE, epoch, &timeout,
+            NULL, 0);
+#else
+    sched_yield();
+#endif
+    Stats_RecordTimeSync(stats, end_ns);
+    Stats_RecordEventSync(stats, event_park, start_ns, end_ns);
+    Trace_End(trace_park, traceStart_ns, 0);
+}
+
+void Parker_Wake(Parker *parker) {
+    atomic_fetch_add(&parker->epoch, 1);
+#ifdef __linux__
+    syscall(SYS_futex, &parker->epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL,
+            0);
+#endif
+}
@@ -0,0 +1,48 @@
+#ifndef IMMIX_PARKER_H
+#define IMMIX_PARKER_H
+
+#include "Stats.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Lets a thread wait for another one to make progress without burning a core.
+// The waiter spins for a while and then sleeps in the kernel. A thread that
+// makes progress somebody may wait for calls Parker_Signal, which costs a
+// fence and a load unless there is a waiter.
+//
+// A waiter calls Parker_Prepare, checks its condition and parks with the epoch
+// it got only if the condition does not hold, so a signal sent in between is
+// not lost. It calls Parker_Leave in either case.
+
+typedef struct {
+    // bumped by every wake up, the futex word
+    atomic_uint epoch;
+    atomic_int waiters;
+    // pauses spun before parking, adapts to how often spinning pays off
+    atomic_int spinLimit;
+} Parker;
+
+void Parker_Init(Parker *parker);
+void Parker_Park(Parker *parker, Stats *stats, uint32_t epoch);
+void Parker_Wake(Parker *parker);
+
+static inline uint32_t Parker_Prepare(Parker *parker) {
+    atomic_fetch_add(&parker->waiters, 1);
+    // the waiter is visible before the condition is checked
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load(&parker->epoch);
+}
+
+static inline void Parker_Leave(Parker *parker) {
+    atomic_fetch_sub(&parker->waiters, 1);
+}
+
+static inline void Parker_Signal(Parker *parker) {
+    // the progress is visible before the waiters are checked
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&parker->waiters, memory_order_relaxed) > 0) {
+        Parker_Wake(parker);
+    }
+}
+
+#endif // IMMIX_PARKER_H
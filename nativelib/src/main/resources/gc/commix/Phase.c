@@ -1,6 +1,7 @@
 #include "GCThread.h"
 #include "Phase.h"
 #include "State.h"
+#include "MutatorThread.h"
 #include "Allocator.h"
 #include "BlockAllocator.h"
 #include <stdio.h>
@@ -48,7 +49,11 @@ void Phase_MarkDone(Heap *heap) {
 }
 
 void Phase_StartSweep(Heap *heap) {
-    Allocator_Clear(&allocator);
+    // the world is stopped, the registry is locked
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        Allocator_Clear(thread->allocator);
+    }
     LargeAllocator_Clear(&largeAllocator);
     BlockAllocator_Clear(&blockAllocator);
 
@@ -91,6 +96,7 @@ void Phase_SweepDone(Heap *heap, Stats *stats) {
     if (!heap->sweep.postSweepDone) {
         Heap_GrowIfNeeded(heap);
         BlockAllocator_ReserveBlocks(&blockAllocator);
+        Heap_UncommitIfIdle(heap, stats);
         BlockAllocator_FinishCoalescing(&blockAllocator);
         Phase_Set(heap, gc_idle);
 
@@ -99,5 +105,6 @@ void Phase_SweepDone(Heap *heap, Stats *stats) {
                           heap->stats->collection_start_ns, end_ns);
 
         heap->sweep.postSweepDone = true;
+        Parker_Signal(&heap->sweep.parker);
     }
 }
\ No newline at end of file
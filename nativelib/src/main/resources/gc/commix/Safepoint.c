@@ -0,0 +1,130 @@
+#include "Safepoint.h"
+#include "Parker.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+volatile atomic_bool safepointRequested = false;
+
+// the thread that stopped the world
+static _Atomic(MutatorThread *) Safepoint_owner = NULL;
+// bumped by every stop of the world
+static atomic_uint_fast64_t Safepoint_epoch = 0;
+// the last stop the world has been resumed from
+static atomic_uint_fast64_t Safepoint_resumedEpoch = 0;
+// signalled when a thread stops
+static Parker Safepoint_parker;
+// the thread waits in `Safepoint_Park`, the signal that resumes it is nested
+static _Thread_local bool Safepoint_parked = false;
+
+static void Safepoint_onSignal(int signal) {
+    // a thread in the GC stops at its next poll
+    if (mutatorThread.inGC || Safepoint_parked) {
+        return;
+    }
+    int savedErrno = errno;
+    Safepoint_Park();
+    errno = savedErrno;
+}
+
+void Safepoint_Init() {
+    Parker_Init(&Safepoint_parker);
+    struct sigaction action;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = Safepoint_onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SAFEPOINT_SIGNAL, &action, NULL) != 0) {
+        fprintf(stderr, "GC: cannot install the safepoint signal handler\n");
+        exit(1);
+    }
+}
+
+/**
+ * Stops the calling thread while another one has stopped the world. Its
+ * registers are spilled on its stack, above where the scan starts.
+ */
+NOINLINE void Safepoint_Park() {
+    MutatorThread *self = &mutatorThread;
+    if (!self->registered || atomic_load(&Safepoint_owner) == self) {
+        return;
+    }
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SAFEPOINT_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    sigset_t waiting = previous;
+    sigdelset(&waiting, SAFEPOINT_SIGNAL);
+    Safepoint_parked = true;
+    // the world may be stopped again right after it is resumed
+    while (atomic_load(&safepointRequested)) {
+        uint64_t epoch = atomic_load(&Safepoint_epoch);
+        __builtin_unwind_init();
+        MutatorThread_SaveStackTop(self);
+        atomic_store_explicit(&self->stoppedEpoch, epoch,
+                              memory_order_release);
+        Parker_Signal(&Safepoint_parker);
+        while (atomic_load(&Safepoint_resumedEpoch) < epoch) {
+            sigsuspend(&waiting);
+        }
+    }
+    Safepoint_parked = false;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/**
+ * Stops all the other mutator threads and keeps the registry locked until
+ * `Safepoint_ResumeWorld`. Returns false if another thread got to stop the
+ * world first, once it has resumed it.
+ */
+bool Safepoint_StopWorld() {
+    MutatorThread *self = &mutatorThread;
+    if (!self->registered) {
+        // its stack is scanned as well
+        MutatorThread_Register(MutatorThread_StackBottom());
+    }
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&safepointRequested, &expected,
+                                        true)) {
+        Safepoint_Park();
+        return false;
+    }
+    atomic_store(&Safepoint_owner, self);
+    uint64_t epoch = atomic_fetch_add(&Safepoint_epoch, 1) + 1;
+    MutatorThreads_Lock();
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        if (thread != self) {
+            pthread_kill(thread->handle, SAFEPOINT_SIGNAL);
+        }
+    }
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        while (thread != self &&
+               atomic_load_explicit(&thread->stoppedEpoch,
+                                    memory_order_acquire) != epoch) {
+            uint32_t parkerEpoch = Parker_Prepare(&Safepoint_parker);
+            if (atomic_load(&thread->stoppedEpoch) != epoch) {
+                Parker_Park(&Safepoint_parker, NULL, parkerEpoch);
+            }
+            Parker_Leave(&Safepoint_parker);
+        }
+    }
+    return true;
+}
+
+void Safepoint_ResumeWorld() {
+    MutatorThread *self = &mutatorThread;
+    atomic_store(&Safepoint_owner, NULL);
+    atomic_store(&Safepoint_resumedEpoch, atomic_load(&Safepoint_epoch));
+    atomic_store(&safepointRequested, false);
+    for (MutatorThread *thread = mutatorThreads; thread != NULL;
+         thread = thread->next) {
+        if (thread != self) {
+            pthread_kill(thread->handle, SAFEPOINT_SIGNAL);
+        }
+    }
+    MutatorThreads_Unlock();
+}
@@ -0,0 +1,51 @@
+#ifndef IMMIX_SAFEPOINT_H
+#define IMMIX_SAFEPOINT_H
+
+#include "MutatorThread.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Stops the mutator threads for a collection. The collecting thread sends
+// SAFEPOINT_SIGNAL to each of the other ones. A thread that runs the program
+// stops in the signal handler, its registers are in the signal frame on its
+// stack. A thread in the GC may be halfway through an allocation, it stops at
+// its next poll instead: when it leaves the GC, in the allocation slow paths
+// and while it waits for the sweep. Stopped threads wait in `sigsuspend`
+// until the collecting thread sends the signal again.
+
+#ifdef SIGPWR
+#define SAFEPOINT_SIGNAL SIGPWR
+#else
+#define SAFEPOINT_SIGNAL SIGXCPU
+#endif
+
+extern volatile atomic_bool safepointRequested;
+
+void Safepoint_Init();
+bool Safepoint_StopWorld();
+void Safepoint_ResumeWorld();
+void Safepoint_Park();
+
+static inline void Safepoint_Poll() {
+    if (atomic_load_explicit(&safepointRequested, memory_order_relaxed)) {
+        Safepoint_Park();
+    }
+}
+
+/**
+ * Called by the entry points of the GC, the thread is not stopped until
+ * `Safepoint_LeaveGC`, or a poll on the way.
+ */
+static inline void Safepoint_EnterGC() {
+    mutatorThread.inGC = true;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+static inline void Safepoint_LeaveGC() {
+    atomic_signal_fence(memory_order_seq_cst);
+    mutatorThread.inGC = false;
+    Safepoint_Poll();
+}
+
+#endif // IMMIX_SAFEPOINT_H
@@ -1,5 +1,6 @@
 #include "Settings.h"
 #include "Constants.h"
+#include "Container.h"
 #include "metadata/BlockMeta.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -88,11 +89,12 @@ double Settings_MinFreeRatio() {
 char *Settings_StatsFileName() { return getenv(STATS_FILE_SETTING); }
 #endif
 
-int Settings_GCThreadCount() {
+uint32_t Settings_GCThreadCount() {
     char *str = getenv("SCALANATIVE_GC_THREADS");
     if (str == NULL) {
-        // default is number of cores - 1, but no less than 1 and no more than 8
-        int processorCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        // default is number of processors the process may use - 1, but no
+        // less than 1 and no more than 8
+        int processorCount = Container_ProcessorCount();
         int defaultGThreadCount = processorCount - 1;
         if (defaultGThreadCount < 1) {
             defaultGThreadCount = 1;
@@ -101,11 +103,129 @@ int Settings_GCThreadCount() {
         }
         return defaultGThreadCount;
     } else {
-        int count;
+        int count = 1;
         sscanf(str, "%d", &count);
         if (count < 1) {
             count = 1;
+        } else if (count > MAX_GC_THREADS) {
+            count = MAX_GC_THREADS;
         }
-        return count;
+        return (uint32_t)count;
     }
-}
\ No newline at end of file
+}
+
+/*
+ Opt-in flags are enabled by any value other than "0" or "false".
+*/
+bool Settings_parseFlag(const char *name) {
+    char *flagStr = getenv(name);
+    return flagStr != NULL && strcmp(flagStr, "0") != 0 &&
+           strcmp(flagStr, "false") != 0;
+}
+
+// set by the generated code, 1 if it was built with `nativeGenerational`
+extern int __write_barriers;
+
+bool Settings_Generational() {
+    if (!Settings_parseFlag("SCALANATIVE_GC_GENERATIONAL")) {
+        return false;
+    }
+    if (!__write_barriers) {
+        // without write barriers old objects would lose their young children
+        fprintf(stderr, "SCALANATIVE_GC_GENERATIONAL is ignored, the program "
+                        "was not built with nativeGenerational := true\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ Milliseconds for which free memory has to be in excess before it is returned
+ to the OS, a negative value keeps all the memory.
+*/
+int64_t Settings_UncommitDelay() {
+    char *str = getenv("SCALANATIVE_UNCOMMIT_DELAY");
+    if (str == NULL) {
+        return DEFAULT_UNCOMMIT_DELAY_MS;
+    } else {
+        long long delay;
+        sscanf(str, "%lld", &delay);
+        return delay;
+    }
+}
+
+bool Settings_HugePages() {
+    return Settings_parseFlag("SCALANATIVE_GC_HUGE_PAGES");
+}
+
+bool Settings_Prefault() {
+    return Settings_parseFlag("SCALANATIVE_GC_PREFAULT");
+}
+
+/*
+ Markers keep their full packets in work-stealing deques instead of giving
+ them all to the global list. Off by default.
+*/
+bool Settings_WorkStealing() {
+    return Settings_parseFlag("SCALANATIVE_GC_WORK_STEALING");
+}
+
+/*
+ Number of objects prefetched ahead of the one being marked, 0 marks without
+ prefetching. Defaults to MARK_PREFETCH_DISTANCE.
+*/
+int Settings_MarkPrefetchDistance() {
+    char *distanceStr = getenv("SCALANATIVE_GC_PREFETCH_DISTANCE");
+    if (distanceStr == NULL) {
+        return MARK_PREFETCH_DISTANCE;
+    }
+    int distance = 0;
+    sscanf(distanceStr, "%d", &distance);
+    return distance < 0 ? 0 : distance;
+}
+
+/*
+ Milliseconds the pauses of full collections should not exceed on average.
+ Setting it, or the overhead target, sizes the heap by SizingPolicy.
+*/
+double Settings_PauseTarget() {
+    char *str = getenv("SCALANATIVE_GC_PAUSE_TARGET_MS");
+    double target = 0;
+    if (str != NULL) {
+        sscanf(str, "%lf", &target);
+    }
+    return target;
+}
+
+/*
+ Share of the time the program may spend in collections, e.g. 0.05.
+*/
+double Settings_OverheadTarget() {
+    char *str = getenv("SCALANATIVE_GC_OVERHEAD_TARGET");
+    double target = 0;
+    if (str != NULL) {
+        sscanf(str, "%lf", &target);
+    }
+    return target;
+}
+
+char *Settings_TraceFileName() { return getenv(TRACE_FILE_SETTING); }
+
+char *Settings_ProfileFileName() { return getenv(PROFILE_FILE_SETTING); }
+
+/*
+ Average bytes allocated between two samples of the allocation profiler.
+ Accepts the same units as the heap sizes.
+*/
+size_t Settings_ProfileInterval() {
+    char *intervalStr = getenv("SCALANATIVE_GC_PROFILE_INTERVAL");
+    if (intervalStr == NULL) {
+        return DEFAULT_PROFILE_INTERVAL;
+    }
+    size_t interval = Settings_parseSizeStr(intervalStr);
+    return interval == 0 ? DEFAULT_PROFILE_INTERVAL : interval;
+}
+
+char *Settings_HistogramFileName() { return getenv(HISTOGRAM_FILE_SETTING); }
+
+char *Settings_HeapDumpFileName() { return getenv(HEAP_DUMP_FILE_SETTING); }
@@ -2,8 +2,14 @@
 #define IMMIX_SETTINGS_H
 
 #define STATS_FILE_SETTING "SCALANATIVE_STATS_FILE"
+#define TRACE_FILE_SETTING "SCALANATIVE_GC_TRACE_FILE"
+#define PROFILE_FILE_SETTING "SCALANATIVE_GC_PROFILE_FILE"
+#define HISTOGRAM_FILE_SETTING "SCALANATIVE_GC_HISTOGRAM_FILE"
+#define HEAP_DUMP_FILE_SETTING "SCALANATIVE_GC_HEAP_DUMP_FILE"
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "Stats.h"
 
 size_t Settings_MinHeapSize();
@@ -13,6 +19,19 @@ double Settings_MinFreeRatio();
 #ifdef ENABLE_GC_STATS
 char *Settings_StatsFileName();
 #endif
-int Settings_GCThreadCount();
+uint32_t Settings_GCThreadCount();
+bool Settings_Generational();
+int64_t Settings_UncommitDelay();
+bool Settings_HugePages();
+bool Settings_Prefault();
+int Settings_MarkPrefetchDistance();
+bool Settings_WorkStealing();
+double Settings_PauseTarget();
+double Settings_OverheadTarget();
+char *Settings_TraceFileName();
+char *Settings_ProfileFileName();
+size_t Settings_ProfileInterval();
+char *Settings_HistogramFileName();
+char *Settings_HeapDumpFileName();
 
 #endif // IMMIX_SETTINGS_H
\ No newline at end of file
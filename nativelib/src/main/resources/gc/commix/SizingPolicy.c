@@ -0,0 +1,81 @@
+#include "SizingPolicy.h"
+#include "Constants.h"
+
+extern long long scalanative_nano_time();
+
+/**
+ * The policy is enabled by either target. Without an overhead target the
+ * default one applies, so that the heap can still grow.
+ */
+void SizingPolicy_Init(SizingPolicy *policy, double pauseTargetMs,
+                       double overheadTarget) {
+    policy->enabled = pauseTargetMs > 0 || overheadTarget > 0;
+    policy->pauseTarget_ns =
+        pauseTargetMs > 0 ? (uint64_t)(pauseTargetMs * 1000000) : 0;
+    policy->overheadTarget =
+        overheadTarget > 0 ? overheadTarget : DEFAULT_OVERHEAD_TARGET;
+    policy->pause_ns = 0;
+    policy->overhead = 0;
+    policy->collections = 0;
+    policy->paused_ns = 0;
+    policy->lastEnd_ns = scalanative_nano_time();
+}
+
+static inline double SizingPolicy_average(SizingPolicy *policy, double average,
+                                          double sample) {
+    if (policy->collections == 0) {
+        return sample;
+    }
+    return SIZING_AVERAGE_WEIGHT * sample +
+           (1 - SIZING_AVERAGE_WEIGHT) * average;
+}
+
+/**
+ * Records the pause of a collection. The overhead is only known at full
+ * collections, it counts the young pauses since the last one.
+ */
+void SizingPolicy_Record(SizingPolicy *policy, uint64_t start_ns,
+                         uint64_t end_ns, bool full) {
+    policy->paused_ns += end_ns - start_ns;
+    if (!full || end_ns <= policy->lastEnd_ns) {
+        return;
+    }
+    double overhead =
+        (double)policy->paused_ns / (double)(end_ns - policy->lastEnd_ns);
+    policy->pause_ns =
+        SizingPolicy_average(policy, policy->pause_ns, end_ns - start_ns);
+    policy->overhead = SizingPolicy_average(policy, policy->overhead, overhead);
+    policy->collections++;
+    policy->paused_ns = 0;
+    policy->lastEnd_ns = end_ns;
+}
+
+/**
+ * Returns the factor the committed heap should be scaled by. The pause goal
+ * comes first: a smaller heap has less to sweep and fewer objects to mark,
+ * at the cost of collecting more often.
+ */
+double SizingPolicy_Factor(SizingPolicy *policy) {
+    if (policy->collections == 0) {
+        return 1.0;
+    }
+    double pauseRoom = policy->pauseTarget_ns > 0 && policy->pause_ns > 0
+                           ? policy->pauseTarget_ns / policy->pause_ns
+                           : SIZING_MAX_FACTOR;
+    if (pauseRoom < 1.0) {
+        return pauseRoom > SIZING_MIN_FACTOR ? pauseRoom : SIZING_MIN_FACTOR;
+    }
+    if (policy->overhead > policy->overheadTarget) {
+        // collections get rarer as the heap grows
+        double factor = policy->overhead / policy->overheadTarget;
+        if (factor > SIZING_MAX_FACTOR) {
+            factor = SIZING_MAX_FACTOR;
+        }
+        // the pauses may grow with the heap
+        return factor < pauseRoom ? factor : pauseRoom;
+    }
+    if (policy->overhead < policy->overheadTarget * SIZING_SHRINK_OVERHEAD) {
+        return SIZING_SHRINK_FACTOR;
+    }
+    return 1.0;
+}
@@ -0,0 +1,33 @@
+#ifndef IMMIX_SIZINGPOLICY_H
+#define IMMIX_SIZINGPOLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sizes the heap to meet the goals the user sets instead of fixed occupancy
+// ratios. After each full collection the averaged pause and the share of time
+// spent in collections are compared with the targets. The heap shrinks while
+// the pauses are too long, grows while collecting takes too much of the time,
+// and shrinks slowly while both goals are met with room to spare.
+
+typedef struct {
+    bool enabled;
+    // 0 when there is no pause goal
+    uint64_t pauseTarget_ns;
+    double overheadTarget;
+    // averages over the full collections
+    double pause_ns;
+    double overhead;
+    uint64_t collections;
+    // pauses since the end of the last full collection
+    uint64_t paused_ns;
+    uint64_t lastEnd_ns;
+} SizingPolicy;
+
+void SizingPolicy_Init(SizingPolicy *policy, double pauseTargetMs,
+                       double overheadTarget);
+void SizingPolicy_Record(SizingPolicy *policy, uint64_t start_ns,
+                         uint64_t end_ns, bool full);
+double SizingPolicy_Factor(SizingPolicy *policy);
+
+#endif // IMMIX_SIZINGPOLICY_H
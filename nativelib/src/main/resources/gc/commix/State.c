@@ -1,6 +1,6 @@
 #include "State.h"
 
 Heap heap;
-Allocator allocator;
+_Thread_local Allocator allocator;
 LargeAllocator largeAllocator;
 BlockAllocator blockAllocator;
\ No newline at end of file
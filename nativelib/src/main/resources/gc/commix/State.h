@@ -7,7 +7,8 @@
 #include "BlockAllocator.h"
 
 extern Heap heap;
-extern Allocator allocator;
+// the allocator of the calling mutator thread
+extern _Thread_local Allocator allocator;
 extern LargeAllocator largeAllocator;
 extern BlockAllocator blockAllocator;
 
@@ -1,5 +1,6 @@
 #include "Stats.h"
 #include "GCTypes.h"
+#include "Safepoint.h"
 #include <stdio.h>
 #include <inttypes.h>
 
@@ -8,12 +9,17 @@ extern long long scalanative_nano_time();
 #ifdef ENABLE_GC_STATS
 const char *const Stats_eventNames[] = {
     "mark",       "sweep",       "concmark",       "concsweep",    "collection",
-    "mark_batch", "sweep_batch", "coalesce_batch", "mark_waiting", "sync"};
+    "mark_batch", "sweep_batch", "coalesce_batch", "mark_waiting", "sync",
+    "mark_young", "uncommit",    "park"};
 
-void Stats_Init(Stats *stats, const char *statsFile, int8_t gc_thread) {
+void Stats_Init(Stats *stats, const char *statsFile, int8_t gc_thread,
+                bool hugePages, bool prefault) {
     stats->outFile = fopen(statsFile, "w");
     stats->gc_thread = gc_thread;
-    fprintf(stats->outFile, "event_type,gc_thread,start_ns,time_ns\n");
+    stats->hugePages = hugePages;
+    stats->prefault = prefault;
+    fprintf(stats->outFile, "event_type,gc_thread,start_ns,time_ns,"
+                            "uncommitted_bytes,huge_pages,prefault\n");
     stats->events = 0;
 }
 
@@ -23,30 +29,51 @@ void Stats_CollectionStarted(Stats *stats) {
     }
 }
 
-INLINE
-void Stats_RecordEvent(Stats *stats, eventType eType, uint64_t start_ns,
-                       uint64_t end_ns) {
+static inline void Stats_record(Stats *stats, eventType eType,
+                                uint64_t start_ns, uint64_t end_ns,
+                                uint64_t uncommitted_bytes) {
     if (stats != NULL && start_ns != 0) {
+        if (stats->events == STATS_MEASUREMENTS) {
+            // a stopped thread may hold the lock of the stream, the event is
+            // lost unless the buffer is written before the world is stopped
+            if (atomic_load(&safepointRequested)) {
+                return;
+            }
+            Stats_WriteToFile(stats);
+        }
         uint64_t index = stats->events;
         stats->start_ns[index] = start_ns;
         stats->time_ns[index] = end_ns - start_ns;
         stats->event_types[index] = eType;
+        stats->uncommitted_bytes[index] = uncommitted_bytes;
         stats->events += 1;
-        if (stats->events == STATS_MEASUREMENTS) {
-            Stats_WriteToFile(stats);
-        }
     }
 }
 
+INLINE
+void Stats_RecordEvent(Stats *stats, eventType eType, uint64_t start_ns,
+                       uint64_t end_ns) {
+    Stats_record(stats, eType, start_ns, end_ns, 0);
+}
+
+void Stats_RecordUncommit(Stats *stats, uint64_t start_ns, uint64_t end_ns,
+                          uint64_t uncommitted_bytes) {
+    Stats_record(stats, event_uncommit, start_ns, end_ns, uncommitted_bytes);
+}
+
 INLINE
 void Stats_WriteToFile(Stats *stats) {
     if (stats != NULL) {
         uint64_t events = stats->events;
         FILE *outFile = stats->outFile;
         for (uint64_t i = 0; i < events; i++) {
-            fprintf(outFile, "%s,%" PRId8 ",%" PRIu64 ",%" PRIu64 "\n",
+            fprintf(outFile, "%s,%" PRId8 ",%" PRIu64 ",%" PRIu64 ",",
                     Stats_eventNames[stats->event_types[i]], stats->gc_thread,
                     stats->start_ns[i], stats->time_ns[i]);
+            if (stats->event_types[i] == event_uncommit) {
+                fprintf(outFile, "%" PRIu64, stats->uncommitted_bytes[i]);
+            }
+            fprintf(outFile, ",%d,%d\n", stats->hugePages, stats->prefault);
         }
         fflush(outFile);
         stats->events = 0;
@@ -3,6 +3,7 @@
 
 #include "Constants.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -34,25 +35,38 @@ typedef enum {
     // thread is waiting for full packets to be available during mark
     mark_waiting = 0x8,
     // any synchronization on common concurrent data structures
-    event_sync = 0x9
+    event_sync = 0x9,
+    // mark phase of a young collection on mutator thread
+    event_mark_young = 0xa,
+    // returning free memory to the OS after sweep
+    event_uncommit = 0xb,
+    // thread is asleep waiting for another one, see Parker.c
+    event_park = 0xc
 } eventType;
 
 typedef struct {
     FILE *outFile;
     uint64_t events;
     int8_t gc_thread;
+    bool hugePages;
+    bool prefault;
     uint8_t event_types[STATS_MEASUREMENTS];
     uint64_t start_ns[STATS_MEASUREMENTS];
     uint64_t time_ns[STATS_MEASUREMENTS];
+    // heap bytes returned to the OS, only for event_uncommit
+    uint64_t uncommitted_bytes[STATS_MEASUREMENTS];
 
     uint64_t collection_start_ns;
     uint64_t mark_waiting_start_ns;
     uint64_t mark_waiting_end_ns;
 } Stats;
 
-void Stats_Init(Stats *stats, const char *statsFile, int8_t gc_thread);
+void Stats_Init(Stats *stats, const char *statsFile, int8_t gc_thread,
+                bool hugePages, bool prefault);
 void Stats_RecordEvent(Stats *stats, eventType eType, uint64_t start_ns,
                        uint64_t end_ns);
+void Stats_RecordUncommit(Stats *stats, uint64_t start_ns, uint64_t end_ns,
+                          uint64_t uncommitted_bytes);
 void Stats_OnExit(Stats *stats);
 void Stats_WriteToFile(Stats *stats);
 
@@ -65,6 +79,7 @@ void Stats_CollectionStarted(Stats *stats);
 typedef void *Stats;
 
 #define Stats_RecordEvent(S, E, A, B)
+#define Stats_RecordUncommit(S, A, B, U)
 // it is always NULL no need to read the expression
 #define Stats_OrNull(S) NULL
 #define Stats_DefineOrNothing(D, S)
@@ -4,8 +4,11 @@
 #include "metadata/BlockMeta.h"
 #include "datastructures/BlockList.h"
 
-#define SUPERBLOCK_LOCAL_LIST_SIZE 4
-#define SUPERBLOCK_LOCAL_LIST_MAX ((1 << SUPERBLOCK_LOCAL_LIST_SIZE) - 1)
+// Free superblocks smaller than SUPERBLOCK_LOCAL_LIST_MAX blocks are collected
+// in local lists first, one for each of the size classes of BlockAllocator
+// they fall in.
+#define SUPERBLOCK_LOCAL_LIST_MAX 16
+#define SUPERBLOCK_LOCAL_LIST_SIZE 12
 
 typedef struct {
     LocalBlockList recycledBlocks;
@@ -3,6 +3,8 @@
 #include "State.h"
 #include "GCThread.h"
 #include "GCTypes.h"
+#include "Safepoint.h"
+#include "../../pprof/CpuProfiler.h"
 #include <sched.h>
 
 // Sweeper implements concurrent sweeping by coordinating lazy sweeper on the
@@ -78,9 +80,13 @@
 //        finishes the sweeping of superblocks in some cases.
 //        See also `block_superblock_start_me` and `Sweeper_sweepSuperblock`.
 
-uint32_t Sweeper_sweepSimpleBlock(Allocator *allocator, BlockMeta *blockMeta,
+// In generational mode (`sticky`) the block, line and object marks of the
+// survivors are kept, they are the old generation for the next young
+// collection.
+
+uint32_t Sweeper_sweepSimpleBlock(Heap *heap, BlockMeta *blockMeta,
                                   word_t *blockStart, LineMeta *lineMetas,
-                                  SweepResult *result) {
+                                  SweepResult *result, bool sticky) {
 
     // If the block is not marked, it means that it's completely free
     assert(blockMeta->debugFlag == dbg_must_sweep);
@@ -88,7 +94,7 @@ uint32_t Sweeper_sweepSimpleBlock(Allocator *allocator, BlockMeta *blockMeta,
         memset(blockMeta, 0, sizeof(BlockMeta));
         // does not unmark in LineMetas because those are ignored by the
         // allocator
-        ObjectMeta_ClearBlockAt(Bytemap_Get(allocator->bytemap, blockStart));
+        ObjectMeta_ClearBlockAt(Bytemap_Get(heap->bytemap, blockStart));
 #ifdef DEBUG_ASSERT
         blockMeta->debugFlag = dbg_free;
 #endif
@@ -96,64 +102,47 @@ uint32_t Sweeper_sweepSimpleBlock(Allocator *allocator, BlockMeta *blockMeta,
     } else {
         // If the block is marked, we need to recycle line by line
         assert(BlockMeta_IsMarked(blockMeta));
-        BlockMeta_Unmark(blockMeta);
-        Bytemap *bytemap = allocator->bytemap;
+        if (!sticky) {
+            BlockMeta_Unmark(blockMeta);
+        }
+        Bytemap *bytemap = heap->bytemap;
 
-        // start at line zero, keep separate pointers into all affected data
-        // structures
-        int lineIndex = 0;
-        LineMeta *lineMeta = lineMetas;
-        word_t *lineStart = blockStart;
-        ObjectMeta *bytemapCursor = Bytemap_Get(bytemap, lineStart);
+        // works on runs of marked and free lines found in the line marks
+        uint64_t marks[LINE_MASK_WORDS];
+        Line_MarkMask(lineMetas, marks);
+        Line_SweepBlock(lineMetas, sticky);
 
         FreeLineMeta *lastRecyclable = NULL;
+        uint32_t lineIndex = 0;
         while (lineIndex < LINE_COUNT) {
-            // If the line is marked, we need to unmark all objects in the line
-            if (Line_IsMarked(lineMeta)) {
-                // Unmark line
-                Line_Unmark(lineMeta);
-                ObjectMeta_SweepLineAt(bytemapCursor);
-
-                // next line
-                lineIndex++;
-                lineMeta++;
-                lineStart += WORDS_IN_LINE;
-                bytemapCursor = Bytemap_NextLine(bytemapCursor);
-            } else {
-                // If the line is not marked, we need to merge all continuous
-                // unmarked lines.
+            // unmark all objects in the marked lines up to the next free one
+            uint32_t freeIndex = Line_NextInMask(marks, lineIndex, false);
+            ObjectMeta_SweepLinesAt(
+                Bytemap_Get(bytemap, blockStart + lineIndex * WORDS_IN_LINE),
+                freeIndex - lineIndex, sticky);
+            if (freeIndex == LINE_COUNT) {
+                break;
+            }
 
-                // If it's the first free line, update the block header to point
-                // to it.
-                if (lastRecyclable == NULL) {
-                    BlockMeta_SetFirstFreeLine(blockMeta, lineIndex);
-                } else {
-                    // Update the last recyclable line to point to the current
-                    // one
-                    lastRecyclable->next = lineIndex;
-                }
-                ObjectMeta_ClearLineAt(bytemapCursor);
-                lastRecyclable = (FreeLineMeta *)lineStart;
-
-                // next line
-                lineIndex++;
-                lineMeta++;
-                lineStart += WORDS_IN_LINE;
-                bytemapCursor = Bytemap_NextLine(bytemapCursor);
-
-                uint8_t size = 1;
-                while (lineIndex < LINE_COUNT && !Line_IsMarked(lineMeta)) {
-                    ObjectMeta_ClearLineAt(bytemapCursor);
-                    size++;
-
-                    // next line
-                    lineIndex++;
-                    lineMeta++;
-                    lineStart += WORDS_IN_LINE;
-                    bytemapCursor = Bytemap_NextLine(bytemapCursor);
-                }
-                lastRecyclable->size = size;
+            // merge all continuous free lines into one hole
+            lineIndex = Line_NextInMask(marks, freeIndex, true);
+
+            // If it's the first free line, update the block header to point
+            // to it.
+            if (lastRecyclable == NULL) {
+                BlockMeta_SetFirstFreeLine(blockMeta, freeIndex);
+            } else {
+                // Update the last recyclable line to point to the current one
+                lastRecyclable->next = freeIndex;
             }
+            word_t *lineStart = blockStart + freeIndex * WORDS_IN_LINE;
+            ObjectMeta_ClearLinesAt(Bytemap_Get(bytemap, lineStart),
+                                    lineIndex - freeIndex);
+            Crossing_ClearLines(Crossing_ForWord(heap->crossingMetaStart,
+                                                 heap->heapStart, lineStart),
+                                lineIndex - freeIndex);
+            lastRecyclable = (FreeLineMeta *)lineStart;
+            lastRecyclable->size = lineIndex - freeIndex;
         }
         // If there is no recyclable line, the block is unavailable
         if (lastRecyclable != NULL) {
@@ -161,22 +150,22 @@ uint32_t Sweeper_sweepSimpleBlock(Allocator *allocator, BlockMeta *blockMeta,
 
             assert(BlockMeta_FirstFreeLine(blockMeta) >= 0);
             assert(BlockMeta_FirstFreeLine(blockMeta) < LINE_COUNT);
-            // allocator->recycledBlockCount++;
-            atomic_fetch_add_explicit(&allocator->recycledBlockCount, 1,
+            // blockAllocator.recycledBlockCount++;
+            atomic_fetch_add_explicit(&blockAllocator.recycledBlockCount, 1,
                                       memory_order_relaxed);
 
 #ifdef DEBUG_ASSERT
             blockMeta->debugFlag = dbg_partial_free;
 #endif
-            // the allocator thread must see the sweeping changes in recycled
+            // the mutator threads must see the sweeping changes in recycled
             // blocks
             atomic_thread_fence(memory_order_release);
-            LocalBlockList_Push(&result->recycledBlocks,
-                                allocator->blockMetaStart, blockMeta);
+            LocalBlockList_Push(&result->recycledBlocks, heap->blockMetaStart,
+                                blockMeta);
 #ifdef DEBUG_PRINT
             printf(
                 "sweepSimpleBlock %p %" PRIu32 " => RECYCLED\n", blockMeta,
-                BlockMeta_GetBlockIndex(allocator->blockMetaStart, blockMeta));
+                BlockMeta_GetBlockIndex(heap->blockMetaStart, blockMeta));
             fflush(stdout);
 #endif
         } else {
@@ -190,7 +179,8 @@ uint32_t Sweeper_sweepSimpleBlock(Allocator *allocator, BlockMeta *blockMeta,
 }
 
 uint32_t Sweeper_sweepSuperblock(LargeAllocator *allocator, BlockMeta *blockMeta,
-                                 word_t *blockStart, BlockMeta *batchLimit) {
+                                 word_t *blockStart, BlockMeta *batchLimit,
+                                 bool sticky) {
     // Objects that are larger than a block
     // are always allocated at the beginning the smallest possible superblock.
     // Any gaps at the end can be filled with large objects, that are smaller
@@ -236,7 +226,11 @@ uint32_t Sweeper_sweepSuperblock(LargeAllocator *allocator, BlockMeta *blockMeta
     if (!ObjectMeta_IsMarked(firstObject)) {
         chunkStart = lastBlockStart;
     }
-    ObjectMeta_Sweep(firstObject);
+    if (sticky) {
+        ObjectMeta_SweepSticky(firstObject);
+    } else {
+        ObjectMeta_Sweep(firstObject);
+    }
 
     word_t *current = lastBlockStart + (MIN_BLOCK_SIZE / WORD_SIZE);
     ObjectMeta *currentMeta = Bytemap_Get(allocator->bytemap, current);
@@ -255,7 +249,11 @@ uint32_t Sweeper_sweepSuperblock(LargeAllocator *allocator, BlockMeta *blockMeta
                 chunkStart = NULL;
             }
         }
-        ObjectMeta_Sweep(currentMeta);
+        if (sticky) {
+            ObjectMeta_SweepSticky(currentMeta);
+        } else {
+            ObjectMeta_Sweep(currentMeta);
+        }
 
         current += MIN_BLOCK_SIZE / WORD_SIZE;
         currentMeta += MIN_BLOCK_SIZE / ALLOCATION_ALIGNMENT;
@@ -311,25 +309,18 @@ uint32_t Sweeper_sweepSuperblock(LargeAllocator *allocator, BlockMeta *blockMeta
 }
 
 
-void Sweep_applyResult(SweepResult *result, Allocator *allocator,
-                       BlockAllocator *blockAllocator) {
+void Sweep_applyResult(SweepResult *result, BlockAllocator *blockAllocator) {
     {
         BlockMeta *first = result->recycledBlocks.first;
         if (first != NULL) {
-            BlockList_PushAll(&allocator->recycledBlocks,
-                              allocator->blockMetaStart, first,
+            BlockList_PushAll(&blockAllocator->recycledBlocks,
+                              blockAllocator->blockMetaStart, first,
                               result->recycledBlocks.last);
         }
     }
 
-    for (int i = 0; i < SUPERBLOCK_LOCAL_LIST_SIZE; i++) {
-        LocalBlockList item = result->freeSuperblocks[i];
-        BlockMeta *first = item.first;
-        if (first != NULL) {
-            BlockList_PushAll(&blockAllocator->freeSuperblocks[i],
-                              allocator->blockMetaStart, first, item.last);
-        }
-    }
+    BlockAllocator_AddLocalLists(blockAllocator, result->freeSuperblocks,
+                                 SUPERBLOCK_LOCAL_LIST_SIZE);
     SweepResult_clear(result);
 }
 
@@ -356,6 +347,7 @@ void Sweeper_Sweep(Heap *heap, Stats *stats, atomic_uint_fast32_t *cursorDone,
     }
 
     BlockMeta *lastFreeBlockStart = NULL;
+    bool sticky = heap->generational.enabled;
 
     BlockMeta *first = BlockMeta_GetFromIndex(heap->blockMetaStart, startIdx);
     BlockMeta *limit = BlockMeta_GetFromIndex(heap->blockMetaStart, limitIdx);
@@ -401,18 +393,25 @@ void Sweeper_Sweep(Heap *heap, Stats *stats, atomic_uint_fast32_t *cursorDone,
             assert(reserveFirst != NULL);
             // size = 1, freeCount = 0
         } else if (BlockMeta_IsSimpleBlock(current)) {
-            freeCount = Sweeper_sweepSimpleBlock(&allocator, current, currentBlockStart,
-                                                 lineMetas, &sweepResult);
+            freeCount = Sweeper_sweepSimpleBlock(heap, current, currentBlockStart,
+                                                 lineMetas, &sweepResult, sticky);
 #ifdef DEBUG_PRINT
             printf("Sweeper_Sweep SimpleBlock %p %" PRIu32 "\n", current,
                    BlockMeta_GetBlockIndex(heap->blockMetaStart, current));
             fflush(stdout);
+#endif
+        } else if (BlockMeta_IsUncommitted(current)) {
+            // stays out of the free lists until the heap grows
+            // size = 1, freeCount = 0
+            assert(current->debugFlag == dbg_must_sweep);
+#ifdef DEBUG_ASSERT
+            current->debugFlag = dbg_not_free;
 #endif
         } else if (BlockMeta_IsSuperblockStart(current)) {
             size = BlockMeta_SuperblockSize(current);
             assert(size > 0);
             freeCount = Sweeper_sweepSuperblock(&largeAllocator, current,
-                                                currentBlockStart, limit);
+                                                currentBlockStart, limit, sticky);
 #ifdef DEBUG_PRINT
             printf("Sweeper_Sweep Superblock(%" PRIu32 ") %p %" PRIu32 "\n",
                    size, current,
@@ -482,11 +481,12 @@ void Sweeper_Sweep(Heap *heap, Stats *stats, atomic_uint_fast32_t *cursorDone,
 
     Stats_RecordTimeSync(stats, postsync_start_ns);
 
-    Sweep_applyResult(&sweepResult, &allocator, &blockAllocator);
+    Sweep_applyResult(&sweepResult, &blockAllocator);
     // coalescing might be done by another thread
     // block_coalesce_me marks should be visible
     atomic_thread_fence(memory_order_release);
     atomic_store_explicit(cursorDone, limitIdx, memory_order_release);
+    Parker_Signal(&heap->sweep.parker);
 
     Stats_RecordTimeBatch(stats, end_ns);
     Stats_RecordEventSync(stats, event_sync, postsync_start_ns, end_ns);
@@ -519,7 +519,12 @@ uint_fast32_t Sweeper_minSweepCursor(Heap *heap) {
     return min;
 }
 
-void Sweeper_LazyCoalesce(Heap *heap, Stats *stats) {
+/**
+ * Coalesces the blocks that all the sweepers are done with. Returns false if
+ * there were none and calling again right away would not help.
+ */
+bool Sweeper_LazyCoalesce(Heap *heap, Stats *stats) {
+    BlockRangeVal observed = heap->lazySweep.lastActivityObserved;
     // the previous coalesce is done and there is work
     uint_fast32_t startIdx = heap->sweep.coalesceDone;
     uint_fast32_t limitIdx = Sweeper_minSweepCursor(heap);
@@ -605,9 +610,47 @@ void Sweeper_LazyCoalesce(Heap *heap, Stats *stats) {
         }
 
         heap->sweep.coalesceDone = limitIdx;
+        Parker_Signal(&heap->sweep.parker);
         Stats_RecordTimeBatch(stats, end_ns);
         Stats_RecordEventBatches(stats, event_coalesce_batch, start_ns, end_ns);
+        return true;
+    }
+    // the lazy sweeper stopped since the last call, it may be ignored next time
+    return heap->lazySweep.lastActivityObserved != observed;
+}
+
+/**
+ * Sweeps along with the GC threads until the sweep is done, like the lazy
+ * sweep of the allocators does when it finds no room.
+ */
+void Sweeper_SweepAll(Heap *heap) {
+    uint64_t sweepStart_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
+    // one mutator thread sweeps at a time, the others wait for the sweep
+    if (pthread_mutex_trylock(&heap->lazySweep.mutex) == 0) {
+        // mark as active
+        heap->lazySweep.lastActivity = BlockRange_Pack(1, heap->sweep.cursor);
+        while (heap->sweep.cursor < heap->sweep.limit) {
+            Sweeper_Sweep(heap, heap->stats, &heap->lazySweep.cursorDone,
+                          LAZY_SWEEP_MIN_BATCH);
+        }
+        // mark as inactive
+        heap->lazySweep.lastActivity = BlockRange_Pack(0, heap->sweep.cursor);
+        pthread_mutex_unlock(&heap->lazySweep.mutex);
+    }
+    Parker *parker = &heap->sweep.parker;
+    Parker_Signal(parker);
+    while (!Sweeper_IsSweepDone(heap)) {
+        Safepoint_Poll();
+        uint32_t epoch = Parker_Prepare(parker);
+        if (!Sweeper_IsSweepDone(heap)) {
+            // wait for the GC threads to sweep or coalesce the last blocks
+            Parker_Park(parker, heap->stats, epoch);
+        }
+        Parker_Leave(parker);
     }
+    CpuProfiler_LeavePhase(phase);
+    Heap_RecordSweep(heap, trace_lazy_sweep, sweepStart_ns);
 }
 
 #ifdef DEBUG_ASSERT
@@ -0,0 +1,72 @@
+#include "GreyDeque.h"
+#include "../Log.h"
+
+// The orderings follow "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (Le et al., PPoPP 2013).
+
+#define GREY_DEQUE_MASK (MARK_DEQUE_SIZE - 1)
+
+void GreyDeque_Init(GreyDeque *deque) {
+    assert((MARK_DEQUE_SIZE & GREY_DEQUE_MASK) == 0);
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+}
+
+bool GreyDeque_Push(GreyDeque *deque, GreyPacket *packet) {
+    int_fast64_t bottom =
+        atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int_fast64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= MARK_DEQUE_SIZE) {
+        return false;
+    }
+    atomic_store_explicit(&deque->items[bottom & GREY_DEQUE_MASK],
+                          (uintptr_t)packet, memory_order_relaxed);
+    // publishes the packet contents together with the slot
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+GreyPacket *GreyDeque_Pop(GreyDeque *deque) {
+    int_fast64_t bottom =
+        atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int_fast64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    GreyPacket *packet = NULL;
+    if (top <= bottom) {
+        packet = (GreyPacket *)atomic_load_explicit(
+            &deque->items[bottom & GREY_DEQUE_MASK], memory_order_relaxed);
+        if (top == bottom) {
+            // the last packet, race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(
+                    &deque->top, &top, top + 1, memory_order_seq_cst,
+                    memory_order_relaxed)) {
+                packet = NULL;
+            }
+            atomic_store_explicit(&deque->bottom, bottom + 1,
+                                  memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return packet;
+}
+
+GreyPacket *GreyDeque_Steal(GreyDeque *deque) {
+    int_fast64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int_fast64_t bottom =
+        atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top < bottom) {
+        GreyPacket *packet = (GreyPacket *)atomic_load_explicit(
+            &deque->items[top & GREY_DEQUE_MASK], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                    memory_order_seq_cst,
+                                                    memory_order_relaxed)) {
+            return packet;
+        }
+    }
+    // empty or lost the race, the caller moves on to another victim
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef IMMIX_GREYDEQUE_H
+#define IMMIX_GREYDEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "../Constants.h"
+#include "GreyPacket.h"
+
+// Chase-Lev work-stealing deque of full grey packets. The owning marker pushes
+// and pops at the bottom, other markers steal from the top. The capacity is
+// fixed, packets that do not fit go to the global full packet list instead.
+typedef struct {
+    atomic_int_fast64_t top;
+    // the owner works on the bottom, keep it off the thieves' cache line
+    char padding[MARK_CACHE_LINE_SIZE - sizeof(atomic_int_fast64_t)];
+    atomic_int_fast64_t bottom;
+    atomic_uintptr_t items[MARK_DEQUE_SIZE];
+} GreyDeque;
+
+void GreyDeque_Init(GreyDeque *deque);
+bool GreyDeque_Push(GreyDeque *deque, GreyPacket *packet);
+GreyPacket *GreyDeque_Pop(GreyDeque *deque);
+GreyPacket *GreyDeque_Steal(GreyDeque *deque);
+
+static inline uint32_t GreyDeque_Size(GreyDeque *deque) {
+    int_fast64_t size = atomic_load_explicit(&deque->bottom,
+                                             memory_order_relaxed) -
+                        atomic_load_explicit(&deque->top, memory_order_relaxed);
+    // the owner can briefly take the bottom below the top when popping
+    return size > 0 ? (uint32_t)size : 0;
+}
+
+#endif // IMMIX_GREYDEQUE_H
@@ -17,7 +17,8 @@ typedef enum {
     block_superblock_tail = 0x3,
     block_marked = 0x5,              // 0x4 | block_simple
     block_superblock_start_me = 0xb, // block_superblock_tail | 0x8
-    block_coalesce_me = 0x13         // block_superblock_tail | 0x10
+    block_coalesce_me = 0x13,        // block_superblock_tail | 0x10
+    block_uncommitted = 0x20 // free, its memory is returned to the OS
 } BlockFlag;
 
 typedef struct {
@@ -56,6 +57,9 @@ typedef enum {
 static inline bool BlockMeta_IsFree(BlockMeta *blockMeta) {
     return blockMeta->block.simple.flags == block_free;
 }
+static inline bool BlockMeta_IsUncommitted(BlockMeta *blockMeta) {
+    return blockMeta->block.simple.flags == block_uncommitted;
+}
 static inline bool BlockMeta_IsSimpleBlock(BlockMeta *blockMeta) {
     // blockMeta->block.simple.flags == block_simple ||
     // blockMeta->block.simple.flags == block_marked
@@ -0,0 +1,22 @@
+#ifndef IMMIX_CARDMETA_H
+#define IMMIX_CARDMETA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    card_clean = 0x0,
+    card_dirty = 0x1,
+} CardFlag;
+
+typedef uint8_t CardMeta;
+
+static inline bool Card_IsDirty(CardMeta *cardMeta) {
+    return *cardMeta == card_dirty;
+}
+static inline void Card_MarkDirty(CardMeta *cardMeta) {
+    *cardMeta = card_dirty;
+}
+static inline void Card_Clear(CardMeta *cardMeta) { *cardMeta = card_clean; }
+
+#endif // IMMIX_CARDMETA_H
@@ -0,0 +1,93 @@
+#ifndef IMMIX_CROSSINGMETA_H
+#define IMMIX_CROSSINGMETA_H
+
+#include <stddef.h>
+#include <string.h>
+#include "../GCTypes.h"
+#include "../Constants.h"
+
+// The crossing map has one entry per line. It tells where the object that
+// covers the start of a line begins, so that an interior pointer can be
+// resolved without walking the bytemap back line by line.
+//
+// An entry is CROSSING_NONE if no object was allocated across the start of
+// its line. Otherwise it holds the distance in lines back to the line where
+// the object starts, up to CROSSING_MAX_DISTANCE. Further into large objects
+// it holds CROSSING_MAX_DISTANCE + k, meaning "skip back 2^k lines and look
+// again", so that the first line is found in a logarithmic number of steps.
+//
+// Entries of dead objects may stay behind in lines that are still in use, the
+// object found through them is always checked against the bytemap and size.
+typedef uint8_t CrossingMeta;
+
+#define CROSSING_NONE 0
+#define CROSSING_MAX_DISTANCE_BITS 7
+#define CROSSING_MAX_DISTANCE (1 << CROSSING_MAX_DISTANCE_BITS)
+
+static inline CrossingMeta *Crossing_ForWord(word_t *crossingMetaStart,
+                                             word_t *heapStart, word_t *word) {
+    word_t lineGlobalIndex =
+        ((word_t)word - (word_t)heapStart) >> LINE_SIZE_BITS;
+    return (CrossingMeta *)crossingMetaStart + lineGlobalIndex;
+}
+
+static inline void Crossing_ClearLines(CrossingMeta *crossing,
+                                       uint32_t lines) {
+    memset(crossing, CROSSING_NONE, lines * CROSSING_METADATA_SIZE);
+}
+
+/**
+ * Records an object that starts in the line of `first` and covers `lines`
+ * more lines after it.
+ */
+static inline void Crossing_Record(CrossingMeta *first, size_t lines) {
+    size_t exact =
+        lines < CROSSING_MAX_DISTANCE ? lines : CROSSING_MAX_DISTANCE;
+    for (size_t distance = 1; distance <= exact; distance++) {
+        first[distance] = (CrossingMeta)distance;
+    }
+    // lines in (2^k, 2^(k+1)] skip back 2^k, which never reaches `first`
+    for (uint32_t k = CROSSING_MAX_DISTANCE_BITS; ((size_t)1 << k) < lines;
+         k++) {
+        size_t from = ((size_t)1 << k) + 1;
+        size_t to = (size_t)2 << k;
+        if (to > lines) {
+            to = lines;
+        }
+        memset(first + from, CROSSING_MAX_DISTANCE + k, to - from + 1);
+    }
+}
+
+/**
+ * Records the object allocated at [start, start + size). Objects that fit in
+ * their first line are left out, the bytemap of that line finds them.
+ */
+static inline void Crossing_RecordObject(word_t *crossingMetaStart,
+                                         word_t *heapStart, word_t *start,
+                                         size_t size) {
+    // lines are aligned, the heap starts at a block boundary
+    word_t firstLine = (word_t)start >> LINE_SIZE_BITS;
+    word_t lastLine = ((word_t)start + size - 1) >> LINE_SIZE_BITS;
+    if (lastLine != firstLine) {
+        Crossing_Record(Crossing_ForWord(crossingMetaStart, heapStart, start),
+                        lastLine - firstLine);
+    }
+}
+
+/**
+ * Returns the entry of the line where the object covering the start of the
+ * line of `crossing` begins, or NULL if there is none.
+ */
+static inline CrossingMeta *Crossing_FirstLine(CrossingMeta *crossing) {
+    CrossingMeta value = *crossing;
+    while (value > CROSSING_MAX_DISTANCE) {
+        crossing -= (size_t)1 << (value - CROSSING_MAX_DISTANCE);
+        value = *crossing;
+    }
+    if (value == CROSSING_NONE) {
+        return NULL;
+    }
+    return crossing - value;
+}
+
+#endif // IMMIX_CROSSINGMETA_H
@@ -3,8 +3,15 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "../GCTypes.h"
 #include "../Constants.h"
+#include "../Log.h"
 
 typedef struct {
     int8_t next;
@@ -28,4 +35,84 @@ static LineMeta *Line_getFromBlockIndex(word_t *lineMetaStart, uint32_t block) {
     return (LineMeta *)lineMetaStart + block * LINE_COUNT;
 }
 
+// one bit per line of a block, see Line_MarkMask
+#define LINE_MASK_WORDS (LINE_COUNT / 64)
+
+// Collects the mark bits of the lines of a block into `mask`, bit i of word
+// w is set when line w * 64 + i is marked.
+static inline void Line_MarkMask(LineMeta *lineMetas, uint64_t *mask) {
+    assert(LINE_COUNT % 64 == 0 && LINE_METADATA_SIZE == 1);
+    for (int word = 0; word < LINE_MASK_WORDS; word++) {
+        LineMeta *cursor = lineMetas + word * 64;
+        uint64_t bits = 0;
+        // line_marked is the lowest bit, the shifts move it to the top of
+        // its byte where movemask picks it up
+#if defined(__AVX2__)
+        for (int i = 0; i < 64; i += 32) {
+            __m256i lines = _mm256_loadu_si256((__m256i *)(cursor + i));
+            uint32_t marked =
+                _mm256_movemask_epi8(_mm256_slli_epi16(lines, 7));
+            bits |= (uint64_t)marked << i;
+        }
+#elif defined(__SSE2__)
+        for (int i = 0; i < 64; i += 16) {
+            __m128i lines = _mm_loadu_si128((__m128i *)(cursor + i));
+            uint16_t marked = _mm_movemask_epi8(_mm_slli_epi16(lines, 7));
+            bits |= (uint64_t)marked << i;
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        // there is no movemask, weigh each lane by its bit and add them up
+        static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                            1, 2, 4, 8, 16, 32, 64, 128};
+        uint8x16_t weight = vld1q_u8(weights);
+        for (int i = 0; i < 64; i += 16) {
+            uint8x16_t lines = vandq_u8(vld1q_u8(cursor + i),
+                                        vdupq_n_u8(line_marked));
+            uint8x16_t marked = vmulq_u8(lines, weight);
+            bits |= (uint64_t)vaddv_u8(vget_low_u8(marked)) << i;
+            bits |= (uint64_t)vaddv_u8(vget_high_u8(marked)) << (i + 8);
+        }
+#else
+        for (int i = 0; i < 64; i += 8) {
+            uint64_t lines = *(uint64_t *)(cursor + i) & 0x0101010101010101UL;
+            // gathers the lowest bit of each byte into the top byte
+            bits |= ((lines * 0x0102040810204080UL) >> 56) << i;
+        }
+#endif
+        mask[word] = bits;
+    }
+}
+
+// Returns the index of the first line from `from` whose mark is `marked`, or
+// LINE_COUNT if there is none.
+static inline uint32_t Line_NextInMask(uint64_t *mask, uint32_t from,
+                                       bool marked) {
+    for (uint32_t word = from / 64; word < LINE_MASK_WORDS; word++) {
+        uint64_t bits = marked ? mask[word] : ~mask[word];
+        if (word == from / 64) {
+            bits &= UINT64_MAX << (from % 64);
+        }
+        if (bits != 0) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return LINE_COUNT;
+}
+
+static inline uint32_t Line_CountInMask(uint64_t *mask) {
+    uint32_t count = 0;
+    for (int word = 0; word < LINE_MASK_WORDS; word++) {
+        count += __builtin_popcountll(mask[word]);
+    }
+    return count;
+}
+
+// Unmarks the marked lines of a block, the others are empty already. With
+// `sticky` the marked lines keep their marks.
+static inline void Line_SweepBlock(LineMeta *lineMetas, bool sticky) {
+    if (!sticky) {
+        memset(lineMetas, 0, LINE_COUNT * LINE_METADATA_SIZE);
+    }
+}
+
 #endif // IMMIX_LINEMETA_H
@@ -4,6 +4,11 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 typedef enum {
     om_free = 0x0,
@@ -46,8 +51,9 @@ static inline void ObjectMeta_SetMarked(ObjectMeta *metadata) {
     *metadata = om_marked;
 }
 
-static inline void ObjectMeta_ClearLineAt(ObjectMeta *cursor) {
-    memset(cursor, 0, WORDS_IN_LINE / ALLOCATION_ALIGNMENT_WORDS);
+static inline void ObjectMeta_ClearLinesAt(ObjectMeta *cursor,
+                                           uint32_t lines) {
+    memset(cursor, 0, lines * (WORDS_IN_LINE / ALLOCATION_ALIGNMENT_WORDS));
 }
 
 static inline void ObjectMeta_ClearBlockAt(ObjectMeta *cursor) {
@@ -55,24 +61,67 @@ static inline void ObjectMeta_ClearBlockAt(ObjectMeta *cursor) {
 }
 
 #define SWEEP_MASK 0x0404040404040404UL
-static inline void ObjectMeta_SweepLineAt(ObjectMeta *start) {
-    //    implements this, just with hardcoded constants:
-    //
-    //    size_t startIndex = Bytemap_index(bytemap, start);
-    //    size_t endIndex = startIndex + WORDS_IN_LINE /
-    //    ALLOCATION_ALIGNMENT_WORDS; ObjectMeta *data = bytemap->data;
-    //
-    //    for (size_t i = startIndex; i < endIndex; i++) {
-    //        if (data[i] == om_marked) {
-    //            data[i] = om_allocated;
-    //        } else {
-    //            data[i] = om_free;
-    //        }
-    //    }
-    assert(WORDS_IN_LINE / ALLOCATION_ALIGNMENT_WORDS / 8 == 2);
-    uint64_t *first = (uint64_t *)start;
-    first[0] = (first[0] & SWEEP_MASK) >> 1;
-    first[1] = (first[1] & SWEEP_MASK) >> 1;
+
+// Sweeps the ObjectMetas of `lines` consecutive lines in vector passes.
+// Implements this, sixteen or thirty-two ObjectMetas at a time:
+//
+//    if (ObjectMeta_IsMarked(cursor)) {
+//        if (!sticky) {
+//            ObjectMeta_SetAllocated(cursor);
+//        }
+//    } else {
+//        ObjectMeta_SetFree(cursor)
+//    }
+//
+// In generational mode mark bits are sticky: marked objects form the old
+// generation and stay marked, only unmarked (young) objects are freed.
+static inline void ObjectMeta_SweepLinesAt(ObjectMeta *start, uint32_t lines,
+                                           bool sticky) {
+    ObjectMeta *end =
+        start + lines * (WORDS_IN_LINE / ALLOCATION_ALIGNMENT_WORDS);
+    ObjectMeta *cursor = start;
+    assert((WORDS_IN_LINE / ALLOCATION_ALIGNMENT_WORDS) % 16 == 0);
+    // the shifts work on wider lanes, after masking only om_marked is left
+    // and it cannot cross into the neighbouring byte
+#if defined(__AVX2__)
+    __m256i mask256 = _mm256_set1_epi8(om_marked);
+    for (; cursor + 32 <= end; cursor += 32) {
+        __m256i metas = _mm256_and_si256(
+            _mm256_loadu_si256((__m256i *)cursor), mask256);
+        if (!sticky) {
+            metas = _mm256_srli_epi16(metas, 1);
+        }
+        _mm256_storeu_si256((__m256i *)cursor, metas);
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i mask128 = _mm_set1_epi8(om_marked);
+    for (; cursor < end; cursor += 16) {
+        __m128i metas =
+            _mm_and_si128(_mm_loadu_si128((__m128i *)cursor), mask128);
+        if (!sticky) {
+            metas = _mm_srli_epi16(metas, 1);
+        }
+        _mm_storeu_si128((__m128i *)cursor, metas);
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t mask128 = vdupq_n_u8(om_marked);
+    for (; cursor < end; cursor += 16) {
+        uint8x16_t metas = vandq_u8(vld1q_u8(cursor), mask128);
+        if (!sticky) {
+            metas = vshrq_n_u8(metas, 1);
+        }
+        vst1q_u8(cursor, metas);
+    }
+#else
+    for (; cursor < end; cursor += 8) {
+        uint64_t *metas = (uint64_t *)cursor;
+        *metas = *metas & SWEEP_MASK;
+        if (!sticky) {
+            *metas >>= 1;
+        }
+    }
+#endif
 }
 
 static inline void ObjectMeta_Sweep(ObjectMeta *cursor) {
@@ -86,6 +135,25 @@ static inline void ObjectMeta_Sweep(ObjectMeta *cursor) {
     *cursor = (*cursor & 0x04) >> 1;
 }
 
+static inline void ObjectMeta_SweepSticky(ObjectMeta *cursor) {
+    *cursor = *cursor & 0x04;
+}
+
+static inline void ObjectMeta_UnstickRange(ObjectMeta *start,
+                                           ObjectMeta *end) {
+    //    implements this, eight ObjectMetas at a time:
+    //
+    //    if (ObjectMeta_IsMarked(cursor)) {
+    //        ObjectMeta_SetAllocated(cursor);
+    //    }
+    assert(((word_t)start & 7) == 0 && ((word_t)end & 7) == 0);
+    for (uint64_t *cursor = (uint64_t *)start; cursor < (uint64_t *)end;
+         cursor++) {
+        uint64_t marked = *cursor & SWEEP_MASK;
+        *cursor ^= marked | (marked >> 1);
+    }
+}
+
 #ifdef DEBUG_ASSERT
 static inline void ObjectMeta_AssertIsValidAllocation(ObjectMeta *start,
                                                       size_t size) {
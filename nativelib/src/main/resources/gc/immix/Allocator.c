@@ -7,64 +7,122 @@
 bool Allocator_getNextLine(Allocator *allocator);
 bool Allocator_newBlock(Allocator *allocator);
 
+/**
+ * Forgets the objects that crossed lines in a free block before it is reused.
+ */
+static inline void Allocator_clearCrossings(Allocator *allocator,
+                                            word_t *blockStart) {
+    Crossing_ClearLines(Crossing_ForWord(allocator->crossingMetaStart,
+                                         allocator->heapStart, blockStart),
+                        LINE_COUNT);
+}
+
 void Allocator_Init(Allocator *allocator, BlockAllocator *blockAllocator,
                     Bytemap *bytemap, word_t *blockMetaStart,
-                    word_t *heapStart) {
+                    word_t *crossingMetaStart, word_t *heapStart) {
     allocator->blockMetaStart = blockMetaStart;
     allocator->blockAllocator = blockAllocator;
     allocator->bytemap = bytemap;
+    allocator->crossingMetaStart = crossingMetaStart;
     allocator->heapStart = heapStart;
 
     BlockList_Init(&allocator->recycledBlocks, blockMetaStart);
 
+    allocator->nextSample = UINT64_MAX;
+    Allocator_Clear(allocator);
+}
+
+/**
+ * Forgets the recycled blocks and the blocks of both cursors. The first
+ * allocation afterwards takes the slow path, which takes new blocks when they
+ * are needed. Until then the sweep does not have to find any.
+ */
+void Allocator_Clear(Allocator *allocator) {
+    allocator->holeBytes = Allocator_AllocatedBytes(allocator);
+    allocator->limitAfterSample = NULL;
+    BlockList_Clear(&allocator->recycledBlocks);
     allocator->recycledBlockCount = 0;
+    allocator->block = NULL;
+    allocator->blockStart = NULL;
+    allocator->cursor = NULL;
+    allocator->limit = NULL;
+    allocator->largeBlock = NULL;
+    allocator->largeBlockStart = NULL;
+    allocator->largeCursor = NULL;
+    allocator->largeLimit = NULL;
+}
+
+static inline uint64_t Allocator_bytesBetween(word_t *start, word_t *end) {
+    return (uint64_t)((uint8_t *)end - (uint8_t *)start);
+}
 
-    Allocator_InitCursors(allocator);
+/**
+ * Returns the bytes allocated so far, which is what the holes taken add up to
+ * without the rest of the current ones. Counting holes keeps the fast path
+ * as it is.
+ */
+uint64_t Allocator_AllocatedBytes(Allocator *allocator) {
+    word_t *limit = allocator->limitAfterSample != NULL
+                        ? allocator->limitAfterSample
+                        : allocator->limit;
+    return allocator->holeBytes -
+           Allocator_bytesBetween(allocator->cursor, limit) -
+           Allocator_bytesBetween(allocator->largeCursor,
+                                  allocator->largeLimit);
 }
 
 /**
- * The Allocator needs one free block for overflow allocation and a free or
- * recyclable block for normal allocation.
- *
- * @param allocator
- * @return `true` if there are enough block to initialise the cursors, `false`
- * otherwise.
+ * Pulls the limit back to the next sample of the profiler if it falls in the
+ * current hole, so that the fast path takes the slow one there.
  */
-bool Allocator_CanInitCursors(Allocator *allocator) {
-    uint64_t freeBlockCount = allocator->blockAllocator->freeBlockCount;
-    return freeBlockCount >= 2 ||
-           (freeBlockCount == 1 && allocator->recycledBlockCount > 0);
+void Allocator_ArmSample(Allocator *allocator) {
+    uint64_t allocated = Allocator_AllocatedBytes(allocator);
+    if (allocator->limitAfterSample != NULL ||
+        allocator->nextSample <= allocated) {
+        return;
+    }
+    uint64_t distance = allocator->nextSample - allocated;
+    word_t *cursor = allocator->cursor;
+    if (distance < Allocator_bytesBetween(cursor, allocator->limit)) {
+        allocator->limitAfterSample = allocator->limit;
+        allocator->limit = (word_t *)((uint8_t *)cursor + distance);
+    }
 }
 
-void Allocator_InitCursors(Allocator *allocator) {
-
-    // Init cursor
-    bool didInit = Allocator_newBlock(allocator);
-    assert(didInit);
-
-    // Init large cursor
-    BlockMeta *largeBlock =
-        BlockAllocator_GetFreeBlock(allocator->blockAllocator);
-    assert(largeBlock != NULL);
-    allocator->largeBlock = largeBlock;
-    word_t *largeBlockStart = BlockMeta_GetBlockStart(
-        allocator->blockMetaStart, allocator->heapStart, largeBlock);
-    allocator->largeBlockStart = largeBlockStart;
-    allocator->largeCursor = largeBlockStart;
-    allocator->largeLimit = Block_GetBlockEnd(largeBlockStart);
+/**
+ * Gives the limit back its place at the end of the hole, before the slow path
+ * moves on to another one.
+ */
+void Allocator_DisarmSample(Allocator *allocator) {
+    if (allocator->limitAfterSample != NULL) {
+        allocator->limit = allocator->limitAfterSample;
+        allocator->limitAfterSample = NULL;
+    }
 }
 
-void Allocator_Clear(Allocator *allocator) {
-    BlockList_Clear(&allocator->recycledBlocks);
-    allocator->recycledBlockCount = 0;
+static inline void Allocator_setHole(Allocator *allocator, word_t *cursor,
+                                     word_t *limit) {
+    allocator->holeBytes += Allocator_bytesBetween(cursor, limit) -
+                            Allocator_bytesBetween(allocator->cursor,
+                                                   allocator->limit);
+    allocator->cursor = cursor;
+    allocator->limit = limit;
+}
+
+static inline void Allocator_setLargeHole(Allocator *allocator,
+                                          word_t *cursor, word_t *limit) {
+    allocator->holeBytes += Allocator_bytesBetween(cursor, limit) -
+                            Allocator_bytesBetween(allocator->largeCursor,
+                                                   allocator->largeLimit);
+    allocator->largeCursor = cursor;
+    allocator->largeLimit = limit;
 }
 
 /**
- * Overflow allocation uses only free blocks, it is used when the bump limit of
- * the fast allocator is too small to fit
- * the block to alloc.
+ * Bumps the cursor of the overflow allocator, taking a new free block when
+ * the current one is full. Returns NULL if there are no free blocks left.
  */
-word_t *Allocator_overflowAllocation(Allocator *allocator, size_t size) {
+word_t *Allocator_overflowBump(Allocator *allocator, size_t size) {
     word_t *start = allocator->largeCursor;
     word_t *end = (word_t *)((uint8_t *)start + size);
 
@@ -78,18 +136,41 @@ word_t *Allocator_overflowAllocation(Allocator *allocator, size_t size) {
         word_t *blockStart = BlockMeta_GetBlockStart(
             allocator->blockMetaStart, allocator->heapStart, block);
         allocator->largeBlockStart = blockStart;
-        allocator->largeCursor = blockStart;
-        allocator->largeLimit = Block_GetBlockEnd(blockStart);
-        return Allocator_overflowAllocation(allocator, size);
+        Allocator_setLargeHole(allocator, blockStart,
+                               Block_GetBlockEnd(blockStart));
+        Allocator_clearCrossings(allocator, blockStart);
+        return Allocator_overflowBump(allocator, size);
     }
 
-    memset(start, 0, size);
-
     allocator->largeCursor = end;
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          start, size);
 
     return start;
 }
 
+/**
+ * Overflow allocation uses only free blocks, it is used when the bump limit of
+ * the fast allocator is too small to fit
+ * the block to alloc.
+ */
+word_t *Allocator_overflowAllocation(Allocator *allocator, size_t size) {
+    word_t *start = Allocator_overflowBump(allocator, size);
+    if (start != NULL) {
+        memset(start, 0, size);
+    }
+    return start;
+}
+
+/**
+ * Allocates space for an object evacuated during marking. Like overflow
+ * allocation it uses only free blocks, so that objects are never copied into
+ * fragmented blocks. The memory is not cleared, the object is copied over it.
+ */
+word_t *Allocator_AllocEvacuated(Allocator *allocator, size_t size) {
+    return Allocator_overflowBump(allocator, size);
+}
+
 /**
  * Allocation fast path, uses the cursor and limit.
  */
@@ -116,6 +197,8 @@ INLINE word_t *Allocator_Alloc(Allocator *allocator, size_t size) {
     memset(start, 0, size);
 
     allocator->cursor = end;
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          start, size);
 
     return start;
 }
@@ -127,6 +210,9 @@ bool Allocator_getNextLine(Allocator *allocator) {
     BlockMeta *block = allocator->block;
     word_t *blockStart = allocator->blockStart;
 
+    if (block == NULL) {
+        return Allocator_newBlock(allocator);
+    }
     int lineIndex = BlockMeta_FirstFreeLine(block);
     if (lineIndex == LAST_HOLE) {
         return Allocator_newBlock(allocator);
@@ -134,11 +220,10 @@ bool Allocator_getNextLine(Allocator *allocator) {
 
     word_t *line = Block_GetLineAddress(blockStart, lineIndex);
 
-    allocator->cursor = line;
     FreeLineMeta *lineMeta = (FreeLineMeta *)line;
     BlockMeta_SetFirstFreeLine(block, lineMeta->next);
     uint16_t size = lineMeta->size;
-    allocator->limit = line + (size * WORDS_IN_LINE);
+    Allocator_setHole(allocator, line, line + (size * WORDS_IN_LINE));
     assert(allocator->limit <= Block_GetBlockEnd(blockStart));
 
     return true;
@@ -160,12 +245,11 @@ bool Allocator_newBlock(Allocator *allocator) {
         assert(lineIndex < LINE_COUNT);
         word_t *line = Block_GetLineAddress(blockStart, lineIndex);
 
-        allocator->cursor = line;
         FreeLineMeta *lineMeta = (FreeLineMeta *)line;
         BlockMeta_SetFirstFreeLine(block, lineMeta->next);
         uint16_t size = lineMeta->size;
         assert(size > 0);
-        allocator->limit = line + (size * WORDS_IN_LINE);
+        Allocator_setHole(allocator, line, line + (size * WORDS_IN_LINE));
         assert(allocator->limit <= Block_GetBlockEnd(blockStart));
     } else {
         block = BlockAllocator_GetFreeBlock(allocator->blockAllocator);
@@ -175,9 +259,10 @@ bool Allocator_newBlock(Allocator *allocator) {
         blockStart = BlockMeta_GetBlockStart(allocator->blockMetaStart,
                                              allocator->heapStart, block);
 
-        allocator->cursor = blockStart;
-        allocator->limit = Block_GetBlockEnd(blockStart);
+        Allocator_setHole(allocator, blockStart,
+                          Block_GetBlockEnd(blockStart));
         BlockMeta_SetFirstFreeLine(block, LAST_HOLE);
+        Allocator_clearCrossings(allocator, blockStart);
     }
 
     allocator->block = block;
@@ -5,12 +5,14 @@
 #include <stddef.h>
 #include "datastructures/BlockList.h"
 #include "datastructures/Bytemap.h"
+#include "metadata/CrossingMeta.h"
 #include "BlockAllocator.h"
 
 typedef struct {
     word_t *blockMetaStart;
     Bytemap *bytemap;
     BlockAllocator *blockAllocator;
+    word_t *crossingMetaStart;
     word_t *heapStart;
     BlockList recycledBlocks;
     uint32_t recycledBlockCount;
@@ -22,14 +24,27 @@ typedef struct {
     word_t *largeBlockStart;
     word_t *largeCursor;
     word_t *largeLimit;
+    // bytes of all the holes taken, including the rest of the current ones
+    uint64_t holeBytes;
+    // the end of the hole while `limit` is pulled back to the next sample of
+    // the profiler, NULL otherwise
+    word_t *limitAfterSample;
+    // the allocated bytes at which the next sample is taken
+    uint64_t nextSample;
 } Allocator;
 
 void Allocator_Init(Allocator *allocator, BlockAllocator *blockAllocator,
                     Bytemap *bytemap, word_t *blockMetaStart,
-                    word_t *heapStart);
-bool Allocator_CanInitCursors(Allocator *allocator);
-void Allocator_InitCursors(Allocator *allocator);
+                    word_t *crossingMetaStart, word_t *heapStart);
 void Allocator_Clear(Allocator *allocator);
 word_t *Allocator_Alloc(Allocator *allocator, size_t size);
+word_t *Allocator_AllocEvacuated(Allocator *allocator, size_t size);
+uint64_t Allocator_AllocatedBytes(Allocator *allocator);
+void Allocator_ArmSample(Allocator *allocator);
+void Allocator_DisarmSample(Allocator *allocator);
+
+static inline bool Allocator_ReachedSample(Allocator *allocator) {
+    return Allocator_AllocatedBytes(allocator) >= allocator->nextSample;
+}
 
 #endif // IMMIX_ALLOCATOR_H
@@ -7,94 +7,83 @@
 #include "Allocator.h"
 #include "Marker.h"
 
-INLINE void Block_recycleUnmarkedBlock(Allocator *allocator,
-                                       BlockMeta *blockMeta,
-                                       word_t *blockStart) {
+INLINE void Block_sweepUnmarkedBlock(Allocator *allocator,
+                                     BlockMeta *blockMeta, word_t *blockStart,
+                                     LineMeta *lineMetas) {
+    // leaves the block free
     memset(blockMeta, 0, sizeof(BlockMeta));
-    // does not unmark in LineMetas because those are ignored by the allocator
-    BlockAllocator_AddFreeBlocks(allocator->blockAllocator, blockMeta, 1);
+    // there are no marked lines, but pins of dead objects need to go
+    memset(lineMetas, 0, LINE_COUNT * LINE_METADATA_SIZE);
     ObjectMeta_ClearBlockAt(Bytemap_Get(allocator->bytemap, blockStart));
 }
 
 /**
- * recycles a block and adds it to the allocator
+ * Sweeps a simple block. Afterwards it is either free or its first free line
+ * is set, LAST_HOLE if it has none. It only touches the metadata of the block,
+ * the `Sweeper` adds it to the allocators. With `sticky` the block and line
+ * marks of the survivors are kept for the next young collection.
  */
-void Block_Recycle(Allocator *allocator, BlockMeta *blockMeta,
-                   word_t *blockStart, LineMeta *lineMetas) {
+void Block_Sweep(Allocator *allocator, BlockMeta *blockMeta,
+                 word_t *blockStart, LineMeta *lineMetas, bool sticky) {
 
     // If the block is not marked, it means that it's completely free
     if (!BlockMeta_IsMarked(blockMeta)) {
-        Block_recycleUnmarkedBlock(allocator, blockMeta, blockStart);
+        Block_sweepUnmarkedBlock(allocator, blockMeta, blockStart, lineMetas);
     } else {
         // If the block is marked, we need to recycle line by line
         assert(BlockMeta_IsMarked(blockMeta));
-        BlockMeta_Unmark(blockMeta);
+        if (!sticky) {
+            BlockMeta_Unmark(blockMeta);
+        }
         Bytemap *bytemap = allocator->bytemap;
 
-        // start at line zero, keep separate pointers into all affected data
-        // structures
-        int lineIndex = 0;
-        LineMeta *lineMeta = lineMetas;
-        word_t *lineStart = blockStart;
-        ObjectMeta *bytemapCursor = Bytemap_Get(bytemap, lineStart);
+        // works on runs of marked and free lines found in the line marks
+        uint64_t marks[LINE_MASK_WORDS];
+        Line_MarkMask(lineMetas, marks);
+        Line_SweepBlock(lineMetas, sticky);
 
         FreeLineMeta *lastRecyclable = NULL;
+        uint32_t lineIndex = 0;
         while (lineIndex < LINE_COUNT) {
-            // If the line is marked, we need to unmark all objects in the line
-            if (Line_IsMarked(lineMeta)) {
-                // Unmark line
-                Line_Unmark(lineMeta);
-                ObjectMeta_SweepLineAt(bytemapCursor);
-
-                // next line
-                lineIndex++;
-                lineMeta++;
-                lineStart += WORDS_IN_LINE;
-                bytemapCursor = Bytemap_NextLine(bytemapCursor);
-            } else {
-                // If the line is not marked, we need to merge all continuous
-                // unmarked lines.
-
-                // If it's the first free line, update the block header to point
-                // to it.
-                if (lastRecyclable == NULL) {
-                    BlockMeta_SetFirstFreeLine(blockMeta, lineIndex);
-                } else {
-                    // Update the last recyclable line to point to the current
-                    // one
-                    lastRecyclable->next = lineIndex;
-                }
-                ObjectMeta_ClearLineAt(bytemapCursor);
-                lastRecyclable = (FreeLineMeta *)lineStart;
-
-                // next line
-                lineIndex++;
-                lineMeta++;
-                lineStart += WORDS_IN_LINE;
-                bytemapCursor = Bytemap_NextLine(bytemapCursor);
+            // unmark all objects in the marked lines up to the next free one
+            uint32_t freeIndex = Line_NextInMask(marks, lineIndex, false);
+            ObjectMeta_SweepLinesAt(
+                Bytemap_Get(bytemap, blockStart + lineIndex * WORDS_IN_LINE),
+                freeIndex - lineIndex, sticky);
+            if (freeIndex == LINE_COUNT) {
+                break;
+            }
 
-                uint8_t size = 1;
-                while (lineIndex < LINE_COUNT && !Line_IsMarked(lineMeta)) {
-                    ObjectMeta_ClearLineAt(bytemapCursor);
-                    size++;
+            // merge all continuous free lines into one hole
+            lineIndex = Line_NextInMask(marks, freeIndex, true);
 
-                    // next line
-                    lineIndex++;
-                    lineMeta++;
-                    lineStart += WORDS_IN_LINE;
-                    bytemapCursor = Bytemap_NextLine(bytemapCursor);
-                }
-                lastRecyclable->size = size;
+            // If it's the first free line, update the block header to point
+            // to it.
+            if (lastRecyclable == NULL) {
+                BlockMeta_SetFirstFreeLine(blockMeta, freeIndex);
+            } else {
+                // Update the last recyclable line to point to the current one
+                lastRecyclable->next = freeIndex;
             }
+            word_t *lineStart = blockStart + freeIndex * WORDS_IN_LINE;
+            ObjectMeta_ClearLinesAt(Bytemap_Get(bytemap, lineStart),
+                                    lineIndex - freeIndex);
+            Crossing_ClearLines(Crossing_ForWord(allocator->crossingMetaStart,
+                                                 allocator->heapStart,
+                                                 lineStart),
+                                lineIndex - freeIndex);
+            lastRecyclable = (FreeLineMeta *)lineStart;
+            lastRecyclable->size = lineIndex - freeIndex;
         }
         // If there is no recyclable line, the block is unavailable
         if (lastRecyclable != NULL) {
             lastRecyclable->next = LAST_HOLE;
-            BlockList_AddLast(&allocator->recycledBlocks, blockMeta);
 
             assert(BlockMeta_FirstFreeLine(blockMeta) >= 0);
             assert(BlockMeta_FirstFreeLine(blockMeta) < LINE_COUNT);
-            allocator->recycledBlockCount++;
+        } else {
+            BlockMeta_SetFirstFreeLine(blockMeta, LAST_HOLE);
         }
+        BlockMeta_SetMarkedLines(blockMeta, Line_CountInMask(marks));
     }
 }
\ No newline at end of file
@@ -4,6 +4,6 @@
 #include "metadata/BlockMeta.h"
 #include "Heap.h"
 
-void Block_Recycle(Allocator *allocator, BlockMeta *block, word_t *blockStart,
-                   LineMeta *lineMetas);
+void Block_Sweep(Allocator *allocator, BlockMeta *block, word_t *blockStart,
+                 LineMeta *lineMetas, bool sticky);
 #endif // IMMIX_BLOCK_H
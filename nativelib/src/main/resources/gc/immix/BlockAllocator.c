@@ -52,6 +52,7 @@ BlockAllocator_getFreeBlockSlow(BlockAllocator *blockAllocator) {
         // it might be safe to remove this
         BlockMeta_SetSuperblockSize(superblock, 0);
         BlockMeta_SetFlag(superblock, block_simple);
+        BlockMeta_SetMarkedLines(superblock, LINE_COUNT);
         return superblock;
     } else {
         return NULL;
@@ -65,6 +66,7 @@ INLINE BlockMeta *BlockAllocator_GetFreeBlock(BlockAllocator *blockAllocator) {
     }
     BlockMeta *block = blockAllocator->smallestSuperblock.cursor;
     BlockMeta_SetFlag(block, block_simple);
+    BlockMeta_SetMarkedLines(block, LINE_COUNT);
     blockAllocator->smallestSuperblock.cursor++;
 
     // not decrementing freeBlockCount, because it is only used after sweep
@@ -162,6 +164,22 @@ void BlockAllocator_AddFreeBlocks(BlockAllocator *blockAllocator,
     blockAllocator->freeBlockCount += count;
 }
 
+/**
+ * Takes a free superblock of `1 << index` blocks out of the free lists, NULL if
+ * there is none.
+ */
+BlockMeta *BlockAllocator_PollFreeSuperblock(BlockAllocator *blockAllocator,
+                                             int index) {
+    assert(index >= 0 && index < SUPERBLOCK_LIST_SIZE);
+    BlockMeta *superblock =
+        BlockList_Poll(&blockAllocator->freeSuperblocks[index]);
+    if (superblock != NULL) {
+        assert(BlockMeta_SuperblockSize(superblock) == 1U << index);
+        blockAllocator->freeBlockCount -= 1U << index;
+    }
+    return superblock;
+}
+
 void BlockAllocator_SweepDone(BlockAllocator *blockAllocator) {
     if (blockAllocator->coalescingSuperblock.first != NULL) {
         uint32_t size = (uint32_t)(blockAllocator->coalescingSuperblock.limit -
@@ -21,6 +21,16 @@
 
 #define LINE_COUNT (BLOCK_TOTAL_SIZE / LINE_SIZE)
 
+// One card per line, so that card and line metadata share indices
+#define CARD_SIZE_BITS LINE_SIZE_BITS
+#define CARD_SIZE (1UL << CARD_SIZE_BITS)
+#define CARD_METADATA_SIZE 1
+#define CARD_COUNT (BLOCK_TOTAL_SIZE / CARD_SIZE)
+#define WORDS_IN_CARD (CARD_SIZE / WORD_SIZE)
+
+// One crossing map entry per line
+#define CROSSING_METADATA_SIZE 1
+
 #define WORDS_IN_LINE (LINE_SIZE / WORD_SIZE)
 #define WORDS_IN_BLOCK (BLOCK_TOTAL_SIZE / WORD_SIZE)
 
@@ -39,9 +49,30 @@
 #define EARLY_GROWTH_THRESHOLD (128 * 1024 * 1024UL)
 #define EARLY_GROWTH_RATE 2.0
 #define GROWTH_RATE 1.414213562
+// the heap grows at the early rate only below this part of its maximum size
+#define EARLY_GROWTH_MAX_RATIO 0.25
+
+// part of a cgroup memory limit taken as the default maximum heap size
+#define CONTAINER_HEAP_RATIO 0.75
+
+// see SizingPolicy, the overhead is the share of the time spent in pauses
+#define DEFAULT_OVERHEAD_TARGET 0.05
+#define SIZING_AVERAGE_WEIGHT 0.3
+// bounds of the factor the heap is scaled by after a collection
+#define SIZING_MIN_FACTOR 0.5
+#define SIZING_MAX_FACTOR 2.0
+// the heap shrinks by the factor while the overhead is below this part of the
+// target
+#define SIZING_SHRINK_OVERHEAD 0.5
+#define SIZING_SHRINK_FACTOR 0.9
+// part of the heap kept free after a full collection whatever the goals, and
+// the most of it that may be free
+#define SIZING_MIN_FREE_RATIO 0.2
+#define SIZING_MAX_FREE_RATIO 0.7
 
 #define METADATA_PER_BLOCK                                                     \
     (sizeof(BlockMeta) + LINE_COUNT * LINE_METADATA_SIZE +                     \
+     LINE_COUNT * CROSSING_METADATA_SIZE +                                     \
      WORDS_IN_BLOCK / ALLOCATION_ALIGNMENT_WORDS)
 #define SPACE_USED_PER_BLOCK (BLOCK_TOTAL_SIZE + METADATA_PER_BLOCK)
 #define MAX_HEAP_SIZE ((uint64_t)SPACE_USED_PER_BLOCK * MAX_BLOCK_COUNT)
@@ -50,6 +81,88 @@
 #define DEFAULT_MIN_HEAP_SIZE (128 * SPACE_USED_PER_BLOCK)
 #define UNLIMITED_HEAP_SIZE (~((size_t)0))
 
+// free blocks kept out of the evacuation budget, the allocator needs two of
+// them to initialise its cursors after the collection
+#define EVACUATION_RESERVE_BLOCKS 3
+// evacuate when free lines in fragmented blocks exceed this part of the heap
+#define EVACUATION_TRIGGER_RATIO 0.1
+
+// free memory is returned to the OS once it has been in excess for this long
+#define DEFAULT_UNCOMMIT_DELAY_MS 1000
+// committed blocks kept above what would make the heap grow
+#define UNCOMMIT_HEADROOM 1.25
+
+// objects of this size and above get their own mapping, see HugeSpace
+#define DEFAULT_HUGE_OBJECT_SIZE (1024 * 1024UL)
+
+// alignment of the heap when it is backed by transparent huge pages
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024UL)
+
+#define GREY_PACKET_RATIO 0.01
+// packets reserved even for the smallest heaps, they are only backed by
+// memory once they are used
+#define MIN_GREY_PACKET_COUNT 1024
+
+#ifndef GREY_PACKET_SIZE
+#define GREY_PACKET_SIZE (2 * 1024)
+#endif
+
+#define GREY_PACKET_ITEMS ((GREY_PACKET_SIZE / WORD_SIZE) - 2)
+
+#ifndef ARRAY_SPLIT_THRESHOLD
+#define ARRAY_SPLIT_THRESHOLD 512
+#endif
+#define ARRAY_SPLIT_BATCH ARRAY_SPLIT_THRESHOLD
+
+// upper bound of the default number of GC threads that help with marking
+#define MAX_DEFAULT_GC_THREADS 7
+// upper bound of SCALANATIVE_GC_THREADS
+#define MAX_GC_THREADS 256
+
+#ifndef MARK_MIN_PACKETS_PER_THREAD
+#define MARK_MIN_PACKETS_PER_THREAD 3
+#endif
+
+// one for current thread other for mutator thread
+#define MARK_SPAWN_THREADS_MIN_PACKETS (2 * MARK_MIN_PACKETS_PER_THREAD)
+
+// full packets kept in a marker's work-stealing deque, must be a power of two
+#ifndef MARK_DEQUE_SIZE
+#define MARK_DEQUE_SIZE 64
+#endif
+
+#define MARK_CACHE_LINE_SIZE 64
+
+// objects are prefetched this many pops before they are scanned, off by
+// default as no workload has shown a gain yet
+#ifndef MARK_PREFETCH_DISTANCE
+#define MARK_PREFETCH_DISTANCE 0
+#endif
+
+// fields whose object metadata is prefetched together before they are marked
+#ifndef MARK_PREFETCH_FIELDS
+#define MARK_PREFETCH_FIELDS 16
+#endif
+
+#ifndef MARK_MAX_WORK_PER_PACKET
+#define MARK_MAX_WORK_PER_PACKET 512
+#endif
+
+// blocks that are swept together, see Sweeper.c
+#ifndef SWEEP_BATCH_SIZE
+#define SWEEP_BATCH_SIZE 32
+#endif
+
 #define STATS_MEASUREMENTS 100
 
+// events kept per thread while tracing, see Trace.h
+#define TRACE_BUFFER_SIZE 8192
+#define TRACE_NAME_SIZE 32
+
+// average bytes allocated between two samples of the allocation profiler, see
+// Profiler.h
+#define DEFAULT_PROFILE_INTERVAL (2 * 1024 * 1024UL)
+// frames kept of the stack of a sample
+#define PROFILER_MAX_DEPTH 64
+
 #endif // IMMIX_CONSTANTS_H
@@ -0,0 +1,80 @@
+#include "GCThread.h"
+#include "Constants.h"
+#include "Marker.h"
+#include "Sweeper.h"
+#include "Trace.h"
+#include "../../pprof/CpuProfiler.h"
+#include <semaphore.h>
+
+// The GC threads help the mutator with marking and, in the concurrent sweep
+// mode, sweep batches of blocks ahead of the mutator, see Sweeper.c. A thread
+// is counted as active from the moment it is woken up until it runs out of
+// work, so the mutator knows when no thread can touch the grey packets or the
+// sweep batches anymore.
+
+void *GCThread_loop(void *arg) {
+    GCThread *thread = (GCThread *)arg;
+    Heap *heap = thread->heap;
+    sem_t *start = heap->gcThreads.start;
+    Trace_NameThread("gc thread", thread->id);
+    CpuProfiler_EnterPhase(cpu_gc);
+
+    while (true) {
+        sem_wait(start);
+        // hard fence before proceeding with marking or sweeping
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (heap->gcThreads.phase == gc_sweep) {
+            uint64_t start_ns = scalanative_nano_time();
+            Sweeper_SweepBatches(heap);
+            Heap_RecordSweep(heap, trace_sweep, start_ns);
+        } else {
+            uint64_t start_ns = Trace_Start();
+            CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_mark);
+            Marker_Mark(heap, thread->deque);
+            CpuProfiler_LeavePhase(phase);
+            // Marker on the GC thread stops after failing to get a full
+            // packet.
+            Trace_End(trace_mark, start_ns, 0);
+        }
+
+        atomic_fetch_sub(&heap->gcThreads.active, 1);
+    }
+    return NULL;
+}
+
+void GCThread_Init(GCThread *thread, int id, Heap *heap) {
+    thread->id = id;
+    thread->heap = heap;
+    thread->deque = &heap->mark.deques[id];
+    // we do not use the pthread value
+    pthread_t self;
+    pthread_create(&self, NULL, GCThread_loop, (void *)thread);
+}
+
+bool GCThread_AnyActive(Heap *heap) { return heap->gcThreads.active > 0; }
+
+void GCThread_WakeWorkers(Heap *heap, int toWake) {
+    sem_t *start = heap->gcThreads.start;
+    atomic_fetch_add(&heap->gcThreads.active, toWake);
+    for (int i = 0; i < toWake; i++) {
+        sem_post(start);
+    }
+}
+
+void GCThread_ScaleMarkerThreads(Heap *heap, uint32_t remainingFullPackets) {
+    if (remainingFullPackets > MARK_SPAWN_THREADS_MIN_PACKETS) {
+        int maxThreads = heap->gcThreads.count;
+        int activeThreads = heap->gcThreads.active;
+        int targetThreadCount =
+            (remainingFullPackets - MARK_SPAWN_THREADS_MIN_PACKETS) /
+            MARK_MIN_PACKETS_PER_THREAD;
+        if (targetThreadCount > maxThreads) {
+            targetThreadCount = maxThreads;
+        }
+        int toSpawn = targetThreadCount - activeThreads;
+        if (toSpawn > 0) {
+            GCThread_WakeWorkers(heap, toSpawn);
+        }
+    }
+}
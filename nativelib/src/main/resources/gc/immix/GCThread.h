@@ -0,0 +1,20 @@
+#ifndef IMMIX_GCTHREAD_H
+#define IMMIX_GCTHREAD_H
+
+#include "Heap.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef struct {
+    int id;
+    Heap *heap;
+    GreyDeque *deque;
+} GCThread;
+
+void GCThread_Init(GCThread *thread, int id, Heap *heap);
+bool GCThread_AnyActive(Heap *heap);
+void GCThread_WakeWorkers(Heap *heap, int toWake);
+void GCThread_ScaleMarkerThreads(Heap *heap, uint32_t remainingFullPackets);
+
+#endif // IMMIX_GCTHREAD_H
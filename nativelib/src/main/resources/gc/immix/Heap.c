@@ -6,13 +6,23 @@
 #include "Log.h"
 #include "Allocator.h"
 #include "Marker.h"
+#include "GCThread.h"
+#include "Sweeper.h"
+#include "Object.h"
 #include "State.h"
 #include "utils/MathUtils.h"
 #include "StackTrace.h"
 #include "Settings.h"
 #include "Memory.h"
+#include "Container.h"
+#include "Trace.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "../../pprof/CpuProfiler.h"
 #include <memory.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Allow read and write
 #define HEAP_MEM_PROT (PROT_READ | PROT_WRITE)
@@ -21,19 +31,49 @@
 // Map anonymous memory (not a file)
 #define HEAP_MEM_FD -1
 #define HEAP_MEM_FD_OFFSET 0
+// Release the pages of free blocks, they read as zero when touched again
+#if defined(__linux__)
+#define HEAP_MEM_UNCOMMIT MADV_DONTNEED
+#else
+#define HEAP_MEM_UNCOMMIT MADV_FREE
+#endif
 
 void Heap_exitWithOutOfMemory() {
     printf("Out of heap space\n");
+    HeapDump_OnOutOfMemory(&heap);
     StackTrace_PrintStackTrace();
     exit(1);
 }
 
+/**
+ * Returns the number of blocks the heap can still commit. The huge objects
+ * count against the maximum heap size as well.
+ */
+uint32_t Heap_availableBlockCount(Heap *heap) {
+    uint64_t used =
+        (uint64_t)Heap_CommittedBlockCount(heap) +
+        MathUtils_DivAndRoundUp(heap->hugeSpace.bytes, SPACE_USED_PER_BLOCK);
+    if (used >= heap->maxBlockCount) {
+        return 0;
+    }
+    return heap->maxBlockCount - (uint32_t)used;
+}
+
 bool Heap_isGrowingPossible(Heap *heap, uint32_t incrementInBlocks) {
-    return heap->blockCount + incrementInBlocks <= heap->maxBlockCount;
+    return incrementInBlocks <= Heap_availableBlockCount(heap);
 }
 
+/**
+ * Returns the default maximum heap size, the physical memory unless the cgroup
+ * allows less. Then only a part of the cgroup limit is taken, the rest of the
+ * process has to fit under it too.
+ */
 size_t Heap_getMemoryLimit() {
     size_t memorySize = getMemorySize();
+    size_t containerLimit = Container_MemoryLimit();
+    if (containerLimit != 0 && containerLimit < memorySize) {
+        memorySize = (size_t)(containerLimit * CONTAINER_HEAP_RATIO);
+    }
     if ((uint64_t)memorySize > MAX_HEAP_SIZE) {
         return (size_t)MAX_HEAP_SIZE;
     } else {
@@ -59,6 +99,83 @@ word_t *Heap_mapAndAlign(size_t memoryLimit, size_t alignmentSize) {
     return heapStart;
 }
 
+/**
+ * Asks the OS to back the range with transparent huge pages where the
+ * alignment allows it.
+ */
+static void Heap_adviseHugePages(void *start, size_t size) {
+#ifdef MADV_HUGEPAGE
+    word_t pageMask = (word_t)sysconf(_SC_PAGESIZE) - 1;
+    word_t first = (word_t)start & ~pageMask;
+    madvise((void *)first, (word_t)start + size - first, MADV_HUGEPAGE);
+#endif
+}
+
+/**
+ * Faults in the pages of the range, so that the allocation fast path does not
+ * pay for first touches.
+ */
+static void Heap_prefault(void *start, void *end) {
+    word_t pageSize = (word_t)sysconf(_SC_PAGESIZE);
+    word_t first = (word_t)start & ~(pageSize - 1);
+#ifdef MADV_POPULATE_WRITE
+    if (madvise((void *)first, (word_t)end - first, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    // the memory is freshly mapped, writing zeros does not change it
+    for (word_t page = first; page < (word_t)end; page += pageSize) {
+        *(volatile ubyte_t *)page = 0;
+    }
+}
+
+/**
+ * Starts the GC threads that help the mutator with marking and sweeping, each
+ * of them and the mutator get a work-stealing deque.
+ */
+static void Heap_initGCThreads(Heap *heap, uint32_t gcThreadCount) {
+    // size = static part + 32 bit int as string
+    char startName[24 + 10];
+    snprintf(startName, 24 + 10, "scalanative_immix_start_%d", getpid());
+    // only reason for using a named semaphore here is for compatibility with
+    // MacOs we do not share it across processes
+    heap->gcThreads.start = sem_open(startName, O_CREAT | O_EXCL, 0644, 0);
+    // clean up when process closes
+    // also prevents any other process from `sem_open`ing it
+    sem_unlink(startName);
+
+    heap->gcThreads.count = gcThreadCount;
+    atomic_init(&heap->gcThreads.active, 0);
+    heap->mark.deques =
+        (GreyDeque *)malloc(sizeof(GreyDeque) * (gcThreadCount + 1));
+    for (uint32_t i = 0; i <= gcThreadCount; i++) {
+        GreyDeque_Init(&heap->mark.deques[i]);
+    }
+    GCThread *gcThreads = (GCThread *)malloc(sizeof(GCThread) * gcThreadCount);
+    heap->gcThreads.all = (void *)gcThreads;
+    for (uint32_t i = 0; i < gcThreadCount; i++) {
+        GCThread_Init(&gcThreads[i], i, heap);
+    }
+}
+
+/**
+ * Reports the limits the defaults are derived from and the effective values,
+ * in the runs that record stats.
+ */
+static void Heap_logLimits(Heap *heap) {
+    size_t memorySize = getMemorySize();
+    size_t containerLimit = Container_MemoryLimit();
+    fprintf(stderr, "GC limits: memory %zum, cgroup memory ", memorySize >> 20);
+    if (containerLimit == 0 || containerLimit >= memorySize) {
+        fprintf(stderr, "none");
+    } else {
+        fprintf(stderr, "%zum", containerLimit >> 20);
+    }
+    fprintf(stderr, ", processors %d, max heap %zum, GC threads %u\n",
+            Container_ProcessorCount(), heap->maxHeapSize >> 20,
+            heap->gcThreads.count);
+}
+
 /**
  * Allocates the heap struct and initializes it
  */
@@ -120,79 +237,280 @@ void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize) {
     heap->lineMetaEnd = lineMetaStart + initialBlockCount * LINE_COUNT *
                                             LINE_METADATA_SIZE / WORD_SIZE;
 
-    word_t *heapStart = Heap_mapAndAlign(maxHeapSize, BLOCK_TOTAL_SIZE);
+    // reserve space for the crossing map
+    size_t crossingMetaSpaceSize =
+        (size_t)maxNumberOfBlocks * LINE_COUNT * CROSSING_METADATA_SIZE;
+    word_t *crossingMetaStart =
+        Heap_mapAndAlign(crossingMetaSpaceSize, WORD_SIZE);
+    heap->crossingMetaStart = crossingMetaStart;
+    assert(LINE_COUNT * CROSSING_METADATA_SIZE % WORD_SIZE == 0);
+    heap->crossingMetaEnd =
+        crossingMetaStart +
+        initialBlockCount * LINE_COUNT * CROSSING_METADATA_SIZE / WORD_SIZE;
+
+    heap->evacuation.enabled = Settings_Evacuation();
+    heap->evacuation.active = false;
+
+    heap->uncommit.delay_ns = Settings_UncommitDelay() * 1000000;
+    heap->uncommit.excessSince_ns = 0;
+    heap->uncommit.blockCount = 0;
+    heap->uncommit.minBlockCount = initialBlockCount;
+    SizingPolicy_Init(&heap->sizing, Settings_PauseTarget(),
+                      Settings_OverheadTarget());
+
+    heap->generational = Settings_Generational();
+    heap->fullRequested = false;
+    HugeSpace_Init(&heap->hugeSpace, Settings_HugeObjectSize(),
+                   heap->generational, minHeapSize);
+    if (heap->generational) {
+        // reserve space for the card table
+        size_t cardMetaSpaceSize =
+            (size_t)maxNumberOfBlocks * CARD_COUNT * CARD_METADATA_SIZE;
+        word_t *cardMetaStart = Heap_mapAndAlign(cardMetaSpaceSize, WORD_SIZE);
+        heap->cardMetaStart = cardMetaStart;
+        assert(CARD_COUNT * CARD_METADATA_SIZE % WORD_SIZE == 0);
+        heap->cardMetaEnd = cardMetaStart + initialBlockCount * CARD_COUNT *
+                                                CARD_METADATA_SIZE / WORD_SIZE;
+    }
+
+    heap->hugePages = Settings_HugePages();
+    heap->prefault = Settings_Prefault();
+    heap->markPrefetchDistance = Settings_MarkPrefetchDistance();
+
+    word_t *heapStart;
+    if (heap->hugePages) {
+        // map one more huge page so that aligning the start keeps the size
+        heapStart =
+            Heap_mapAndAlign(maxHeapSize + HUGE_PAGE_SIZE, HUGE_PAGE_SIZE);
+        Heap_adviseHugePages(heapStart, maxHeapSize);
+    } else {
+        heapStart = Heap_mapAndAlign(maxHeapSize, BLOCK_TOTAL_SIZE);
+    }
 
     BlockAllocator_Init(&blockAllocator, blockMetaStart, initialBlockCount);
+    GreyList_Init(&heap->mark.empty);
+    GreyList_Init(&heap->mark.full);
+    uint32_t greyPacketCount =
+        (uint32_t)(maxHeapSize * GREY_PACKET_RATIO / GREY_PACKET_SIZE);
+    if (greyPacketCount < MIN_GREY_PACKET_COUNT) {
+        greyPacketCount = MIN_GREY_PACKET_COUNT;
+    }
+    heap->mark.total = greyPacketCount;
+    word_t *greyPacketsStart =
+        Heap_mapAndAlign(greyPacketCount * sizeof(GreyPacket), WORD_SIZE);
+    heap->greyPacketsStart = greyPacketsStart;
+    GreyList_PushAll(&heap->mark.empty, greyPacketsStart,
+                     (GreyPacket *)greyPacketsStart, greyPacketCount);
 
     // reserve space for bytemap
     Bytemap *bytemap = (Bytemap *)Heap_mapAndAlign(
         maxHeapSize / ALLOCATION_ALIGNMENT + sizeof(Bytemap),
         ALLOCATION_ALIGNMENT);
     heap->bytemap = bytemap;
+    if (heap->hugePages) {
+        Heap_adviseHugePages(bytemap, maxHeapSize / ALLOCATION_ALIGNMENT);
+    }
 
     // Init heap for small objects
     heap->heapSize = minHeapSize;
     heap->heapStart = heapStart;
     heap->heapEnd = heapStart + minHeapSize / WORD_SIZE;
     Bytemap_Init(bytemap, heapStart, maxHeapSize);
+    if (heap->prefault) {
+        Heap_prefault(heapStart, heap->heapEnd);
+        Heap_prefault(Bytemap_Get(bytemap, heapStart),
+                      Bytemap_Get(bytemap, heap->heapEnd));
+        Heap_prefault(blockMetaStart, heap->blockMetaEnd);
+        Heap_prefault(lineMetaStart, heap->lineMetaEnd);
+        Heap_prefault(crossingMetaStart, heap->crossingMetaEnd);
+    }
     Allocator_Init(&allocator, &blockAllocator, bytemap, blockMetaStart,
-                   heapStart);
+                   crossingMetaStart, heapStart);
+    allocator.nextSample = Profiler_NextSampleDistance();
+    heap->totals.nextLargeSample = Profiler_NextSampleDistance();
 
     LargeAllocator_Init(&largeAllocator, &blockAllocator, bytemap,
-                        blockMetaStart, heapStart);
+                        blockMetaStart, crossingMetaStart, heapStart);
     char *statsFile = Settings_StatsFileName();
     if (statsFile != NULL) {
         heap->stats = malloc(sizeof(Stats));
-        Stats_Init(heap->stats, statsFile);
+        Stats_Init(heap->stats, statsFile, heap->hugePages, heap->prefault);
+    }
+
+    Heap_initGCThreads(heap, Settings_GCThreadCount());
+
+    heap->sweep.mode = Settings_SweepMode();
+    if (heap->sweep.mode == sweep_concurrent && heap->gcThreads.count == 0) {
+        heap->sweep.mode = sweep_lazy;
+    }
+    heap->sweep.batches = (atomic_uchar *)Heap_mapAndAlign(
+        maxNumberOfBlocks / SWEEP_BATCH_SIZE + 1, WORD_SIZE);
+    heap->sweep.cursor = 0;
+    heap->sweep.limit = 0;
+
+    if (heap->stats != NULL) {
+        Heap_logLimits(heap);
     }
 }
+
 /**
- * Allocates large objects using the `LargeAllocator`.
+ * Requests an object from the `LargeAllocator`, sweeping more of the heap
+ * until it fits or the sweep is done.
+ */
+static Object *Heap_allocLargeSweeping(Heap *heap, uint32_t size) {
+    Object *object = LargeAllocator_GetBlock(&largeAllocator, size);
+    if (object == NULL) {
+        uint64_t start_ns = scalanative_nano_time();
+        while (object == NULL && Sweeper_LazySweep(heap)) {
+            object = LargeAllocator_GetBlock(&largeAllocator, size);
+        }
+        Heap_RecordSweep(heap, trace_lazy_sweep, start_ns);
+    }
+    return object;
+}
+
+static bool Heap_isHugeAllocPossible(Heap *heap, uint32_t size) {
+    return MathUtils_DivAndRoundUp(size, SPACE_USED_PER_BLOCK) <=
+           Heap_availableBlockCount(heap);
+}
+
+/**
+ * Allocates a huge object in its own mapping, see `HugeSpace`. Once the huge
+ * objects have outgrown the limit set by the last full collection, or when the
+ * object does not fit under the maximum heap size, a collection comes first so
+ * that dead huge objects are unmapped.
+ */
+static word_t *Heap_allocHuge(Heap *heap, uint32_t size) {
+    HugeSpace *space = &heap->hugeSpace;
+    if (space->bytes > space->limit || !Heap_isHugeAllocPossible(heap, size)) {
+        bool young = heap->generational && !heap->fullRequested;
+        Heap_Collect(heap);
+        // old huge objects are only unmapped by a full collection
+        if (young && (space->bytes > space->limit ||
+                      !Heap_isHugeAllocPossible(heap, size))) {
+            heap->fullRequested = true;
+            Heap_Collect(heap);
+        }
+        if (!Heap_isHugeAllocPossible(heap, size)) {
+            Heap_exitWithOutOfMemory();
+        }
+    }
+    word_t *object = HugeSpace_Alloc(space, size);
+    if (object == NULL) {
+        Heap_exitWithOutOfMemory();
+    }
+    return object;
+}
+
+/**
+ * Allocates large objects using the `LargeAllocator`, or the `HugeSpace` from
+ * its threshold on.
  * If allocation fails, because there is not enough memory available, it will
  * trigger a collection of both the small and the large heap.
  */
-word_t *Heap_AllocLarge(Heap *heap, uint32_t size) {
+static word_t *Heap_allocLarge(Heap *heap, uint32_t size) {
 
     assert(size % ALLOCATION_ALIGNMENT == 0);
     assert(size >= MIN_BLOCK_SIZE);
 
-    // Request an object from the `LargeAllocator`
-    Object *object = LargeAllocator_GetBlock(&largeAllocator, size);
+    heap->totals.largeBytes += size;
+    if (size >= heap->hugeSpace.threshold) {
+        return Heap_allocHuge(heap, size);
+    }
+
+    Object *object = Heap_allocLargeSweeping(heap, size);
     // If the object is not NULL, update it's metadata and return it
     if (object != NULL) {
         return (word_t *)object;
     } else {
         // Otherwise collect
-        Heap_Collect(heap, &stack);
+        Heap_Collect(heap);
 
         // After collection, try to alloc again, if it fails, grow the heap by
         // at least the size of the object we want to alloc
-        object = LargeAllocator_GetBlock(&largeAllocator, size);
+        object = Heap_allocLargeSweeping(heap, size);
+        // the young collection freed too little, see `Heap_SweepDone`
+        if (object == NULL && heap->fullRequested) {
+            Heap_Collect(heap);
+            object = Heap_allocLargeSweeping(heap, size);
+        }
         if (object != NULL) {
             assert(Heap_IsWordInHeap(heap, (word_t *)object));
             return (word_t *)object;
         } else {
             size_t increment = MathUtils_DivAndRoundUp(size, BLOCK_TOTAL_SIZE);
             uint32_t pow2increment = 1U << MathUtils_Log2Ceil(increment);
-            Heap_Grow(heap, pow2increment);
-
-            object = LargeAllocator_GetBlock(&largeAllocator, size);
-            assert(object != NULL);
+            // recommitted blocks are not necessarily contiguous, keep growing
+            // until the heap is extended
+            do {
+                Heap_Grow(heap, pow2increment);
+                object = LargeAllocator_GetBlock(&largeAllocator, size);
+            } while (object == NULL);
             assert(Heap_IsWordInHeap(heap, (word_t *)object));
             return (word_t *)object;
         }
     }
 }
 
+/**
+ * Large objects are sampled by the profiler on their own, they are counted
+ * apart from the allocator's holes.
+ */
+word_t *Heap_AllocLarge(Heap *heap, uint32_t size) {
+    if (HeapDump_Requested()) {
+        HeapDump_OnRequest(heap);
+    }
+    word_t *object = Heap_allocLarge(heap, size);
+    if (heap->totals.largeBytes >= heap->totals.nextLargeSample) {
+        Profiler_Sample(object, size);
+        heap->totals.nextLargeSample =
+            heap->totals.largeBytes + Profiler_NextSampleDistance();
+    }
+    return object;
+}
+
+/**
+ * Allocates with the `Allocator`, sweeping more of the heap when it runs out of
+ * blocks until the object fits or the sweep is done.
+ */
+static Object *Heap_allocSmallSweeping(Heap *heap, uint32_t size) {
+    Object *object = (Object *)Allocator_Alloc(&allocator, size);
+    if (object == NULL) {
+        uint64_t start_ns = scalanative_nano_time();
+        while (object == NULL && Sweeper_LazySweep(heap)) {
+            object = (Object *)Allocator_Alloc(&allocator, size);
+            if (object == NULL) {
+                // the free blocks at the end of the batch are still waiting to
+                // be coalesced with the next one, the allocator needs them now
+                BlockAllocator_SweepDone(&blockAllocator);
+                object = (Object *)Allocator_Alloc(&allocator, size);
+            }
+        }
+        Heap_RecordSweep(heap, trace_lazy_sweep, start_ns);
+    }
+    return object;
+}
+
 NOINLINE word_t *Heap_allocSmallSlow(Heap *heap, uint32_t size) {
     Object *object;
-    object = (Object *)Allocator_Alloc(&allocator, size);
+    // the fast path may have stopped at the sample point
+    Allocator_DisarmSample(&allocator);
+    if (HeapDump_Requested()) {
+        HeapDump_OnRequest(heap);
+    }
+    object = Heap_allocSmallSweeping(heap, size);
 
     if (object != NULL)
         goto done;
 
-    Heap_Collect(heap, &stack);
-    object = (Object *)Allocator_Alloc(&allocator, size);
+    Heap_Collect(heap);
+    object = Heap_allocSmallSweeping(heap, size);
+
+    // the young collection freed too little, see `Heap_SweepDone`
+    if (object == NULL && heap->fullRequested) {
+        Heap_Collect(heap);
+        object = Heap_allocSmallSweeping(heap, size);
+    }
 
     if (object != NULL)
         goto done;
@@ -207,6 +525,12 @@ done:
     assert(object != NULL);
     ObjectMeta *objectMeta = Bytemap_Get(allocator.bytemap, (word_t *)object);
     ObjectMeta_SetAllocated(objectMeta);
+    if (Allocator_ReachedSample(&allocator)) {
+        Profiler_Sample((word_t *)object, size);
+        allocator.nextSample = Allocator_AllocatedBytes(&allocator) +
+                               Profiler_NextSampleDistance();
+    }
+    Allocator_ArmSample(&allocator);
     return (word_t *)object;
 }
 
@@ -225,6 +549,8 @@ INLINE word_t *Heap_AllocSmall(Heap *heap, uint32_t size) {
     allocator.cursor = end;
 
     memset(start, 0, size);
+    Crossing_RecordObject(allocator.crossingMetaStart, allocator.heapStart,
+                          start, size);
 
     Object *object = (Object *)start;
     ObjectMeta *objectMeta = Bytemap_Get(allocator.bytemap, (word_t *)object);
@@ -246,34 +572,25 @@ word_t *Heap_Alloc(Heap *heap, uint32_t objectSize) {
     }
 }
 
-void Heap_Collect(Heap *heap, Stack *stack) {
-    uint64_t start_ns, sweep_start_ns, end_ns;
-    Stats *stats = heap->stats;
-#ifdef DEBUG_PRINT
-    printf("\nCollect\n");
-    fflush(stdout);
-#endif
-    if (stats != NULL) {
-        start_ns = scalanative_nano_time();
-    }
-    Marker_MarkRoots(heap, stack);
-    if (stats != NULL) {
-        sweep_start_ns = scalanative_nano_time();
+void Heap_WriteBarrierRange(Heap *heap, word_t *address, size_t size) {
+    if (!heap->generational || size == 0) {
+        return;
     }
-    Heap_Recycle(heap);
-    if (stats != NULL) {
-        end_ns = scalanative_nano_time();
-        Stats_RecordCollection(stats, start_ns, sweep_start_ns, end_ns);
+    if (Heap_IsWordInHeap(heap, address)) {
+        word_t *last = (word_t *)((ubyte_t *)address + size - 1);
+        CardMeta *lastCard = Heap_CardMetaForWord(heap, last);
+        for (CardMeta *card = Heap_CardMetaForWord(heap, address);
+             card <= lastCard; card++) {
+            Card_MarkDirty(card);
+        }
+    } else if (HugeSpace_MayContain(&heap->hugeSpace, address)) {
+        HugeSpace_WriteBarrierRange(&heap->hugeSpace, address, size);
     }
-#ifdef DEBUG_PRINT
-    printf("End collect\n");
-    fflush(stdout);
-#endif
 }
 
 bool Heap_shouldGrow(Heap *heap) {
     uint32_t freeBlockCount = blockAllocator.freeBlockCount;
-    uint32_t blockCount = heap->blockCount;
+    uint32_t blockCount = Heap_CommittedBlockCount(heap);
     uint32_t recycledBlockCount = allocator.recycledBlockCount;
     uint32_t unavailableBlockCount =
         blockCount - (freeBlockCount + recycledBlockCount);
@@ -290,61 +607,489 @@ bool Heap_shouldGrow(Heap *heap) {
            4 * unavailableBlockCount > blockCount;
 }
 
-void Heap_Recycle(Heap *heap) {
-    Allocator_Clear(&allocator);
-    LargeAllocator_Clear(&largeAllocator);
-    BlockAllocator_Clear(&blockAllocator);
+static void Heap_uncommitRange(void *start, size_t size) {
+    word_t pageMask = (word_t)sysconf(_SC_PAGESIZE) - 1;
+    // only pages that belong to the range alone
+    word_t first = ((word_t)start + pageMask) & ~pageMask;
+    word_t limit = ((word_t)start + size) & ~pageMask;
+    if (first < limit) {
+        madvise((void *)first, limit - first, HEAP_MEM_UNCOMMIT);
+    }
+}
+
+/**
+ * Returns the memory of `count` free blocks, and the metadata pages that only
+ * describe them, to the OS.
+ */
+void Heap_uncommitBlocks(Heap *heap, BlockMeta *superblock, uint32_t count) {
+    uint64_t start_ns = Trace_Start();
+    uint32_t index = BlockMeta_GetBlockIndex(heap->blockMetaStart, superblock);
+    BlockMeta *limit = superblock + count;
+    for (BlockMeta *current = superblock; current < limit; current++) {
+        BlockMeta_SetFlag(current, block_uncommitted);
+    }
+    word_t *blockStart = BlockMeta_GetBlockStart(heap->blockMetaStart,
+                                                 heap->heapStart, superblock);
+    Heap_uncommitRange(blockStart, (size_t)count * BLOCK_TOTAL_SIZE);
+    Heap_uncommitRange((LineMeta *)heap->lineMetaStart +
+                           (size_t)index * LINE_COUNT,
+                       (size_t)count * LINE_COUNT * LINE_METADATA_SIZE);
+    Heap_uncommitRange((CrossingMeta *)heap->crossingMetaStart +
+                           (size_t)index * LINE_COUNT,
+                       (size_t)count * LINE_COUNT * CROSSING_METADATA_SIZE);
+    Heap_uncommitRange(Bytemap_Get(heap->bytemap, blockStart),
+                       (size_t)count * WORDS_IN_BLOCK /
+                           ALLOCATION_ALIGNMENT_WORDS);
+    if (heap->generational) {
+        Heap_uncommitRange((CardMeta *)heap->cardMetaStart +
+                               (size_t)index * CARD_COUNT,
+                           (size_t)count * CARD_COUNT * CARD_METADATA_SIZE);
+    }
+    heap->uncommit.blockCount += count;
+    Trace_End(trace_uncommit, start_ns, count);
+}
 
+/**
+ * Uncommits up to `excess` free blocks, the largest free superblocks first.
+ */
+static void Heap_uncommitExcess(Heap *heap, uint32_t excess) {
+    for (int i = SUPERBLOCK_LIST_SIZE - 1; i >= 0 && excess > 0; i--) {
+        uint32_t size = 1U << i;
+        while (size <= excess) {
+            BlockMeta *superblock =
+                BlockAllocator_PollFreeSuperblock(&blockAllocator, i);
+            if (superblock == NULL) {
+                break;
+            }
+            Heap_uncommitBlocks(heap, superblock, size);
+            excess -= size;
+        }
+    }
+}
+
+/**
+ * Returns the committed block count that meets the goals of the sizing policy
+ * after a full collection, within the bounds on the free part of the heap.
+ */
+static uint32_t Heap_sizingTarget(Heap *heap) {
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint32_t usedBlockCount =
+        committedBlockCount - blockAllocator.freeBlockCount;
+    double target = committedBlockCount * SizingPolicy_Factor(&heap->sizing);
+    double minTarget = usedBlockCount / (1.0 - SIZING_MIN_FREE_RATIO);
+    double maxTarget = usedBlockCount / (1.0 - SIZING_MAX_FREE_RATIO);
+    if (target > maxTarget) {
+        target = maxTarget;
+    }
+    if (target < minTarget) {
+        target = minTarget;
+    }
+    if (target < heap->uncommit.minBlockCount) {
+        target = heap->uncommit.minBlockCount;
+    }
+    double availableTarget =
+        (double)committedBlockCount + Heap_availableBlockCount(heap);
+    if (target > availableTarget) {
+        target = availableTarget;
+    }
+    return (uint32_t)target;
+}
+
+/**
+ * Shrinks the committed heap once it has been larger than needed for
+ * `uncommit.delay_ns`. It keeps the blocks that would not make the heap grow
+ * after this collection, with some headroom, and uncommits the largest free
+ * superblocks beyond that. `Heap_Grow` commits them again. With a sizing
+ * policy the heap is shrunk to its target instead.
+ */
+void Heap_uncommitIfIdle(Heap *heap) {
+    if (heap->uncommit.delay_ns < 0) {
+        return;
+    }
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    if (heap->sizing.enabled) {
+        // the policy shrinks the heap right away, young collections keep it
+        if (!heap->sweep.young) {
+            uint32_t target = Heap_sizingTarget(heap);
+            if (target < committedBlockCount) {
+                Heap_uncommitExcess(heap, committedBlockCount - target);
+            }
+        }
+        return;
+    }
+    // uncommitting free blocks does not change these, see `Heap_shouldGrow`
+    uint32_t usedBlockCount =
+        committedBlockCount - blockAllocator.freeBlockCount;
+    uint32_t unavailableBlockCount =
+        usedBlockCount - allocator.recycledBlockCount;
+    uint64_t needed = 2 * (uint64_t)usedBlockCount;
+    if (4 * (uint64_t)unavailableBlockCount > needed) {
+        needed = 4 * (uint64_t)unavailableBlockCount;
+    }
+    uint64_t target = (uint64_t)(needed * UNCOMMIT_HEADROOM);
+    if (target < heap->uncommit.minBlockCount) {
+        target = heap->uncommit.minBlockCount;
+    }
+    if (target >= committedBlockCount) {
+        heap->uncommit.excessSince_ns = 0;
+        return;
+    }
+
+    uint64_t now_ns = scalanative_nano_time();
+    if (heap->uncommit.excessSince_ns == 0) {
+        heap->uncommit.excessSince_ns = now_ns;
+    }
+    if (now_ns - heap->uncommit.excessSince_ns <
+        (uint64_t)heap->uncommit.delay_ns) {
+        return;
+    }
+    heap->uncommit.excessSince_ns = 0;
+    Heap_uncommitExcess(heap, committedBlockCount - (uint32_t)target);
+}
+
+/**
+ * Gives uncommitted blocks back to the block allocator, until
+ * `incrementInBlocks` have been recommitted or there are none left. Their
+ * pages are committed again by the OS when they are touched.
+ */
+uint32_t Heap_recommit(Heap *heap, uint32_t incrementInBlocks) {
+    uint32_t recommitted = 0;
     BlockMeta *current = (BlockMeta *)heap->blockMetaStart;
-    word_t *currentBlockStart = heap->heapStart;
-    LineMeta *lineMetas = (LineMeta *)heap->lineMetaStart;
-    word_t *end = heap->blockMetaEnd;
-    while ((word_t *)current < end) {
-        int size = 1;
-        assert(!BlockMeta_IsSuperblockMiddle(current));
-        if (BlockMeta_IsSimpleBlock(current)) {
-            Block_Recycle(&allocator, current, currentBlockStart, lineMetas);
-        } else if (BlockMeta_IsSuperblockStart(current)) {
-            size = BlockMeta_SuperblockSize(current);
-            LargeAllocator_Sweep(&largeAllocator, current, currentBlockStart);
-        } else {
-            assert(BlockMeta_IsFree(current));
-            BlockAllocator_AddFreeBlocks(&blockAllocator, current, 1);
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    while (current < end && recommitted < incrementInBlocks &&
+           recommitted < heap->uncommit.blockCount) {
+        if (!BlockMeta_IsUncommitted(current)) {
+            current++;
+            continue;
+        }
+        BlockMeta *first = current;
+        while (current < end && BlockMeta_IsUncommitted(current) &&
+               recommitted < incrementInBlocks) {
+            BlockMeta_SetFlag(current, block_free);
+            recommitted++;
+            current++;
         }
-        assert(size > 0);
-        current += size;
-        currentBlockStart += WORDS_IN_BLOCK * size;
-        lineMetas += LINE_COUNT * size;
+        BlockAllocator_AddFreeBlocks(&blockAllocator, first,
+                                     (uint32_t)(current - first));
     }
+    heap->uncommit.blockCount -= recommitted;
+    BlockAllocator_SweepDone(&blockAllocator);
+    return recommitted;
+}
 
-    if (Heap_shouldGrow(heap)) {
-        double growth;
-        if (heap->heapSize < EARLY_GROWTH_THRESHOLD) {
-            growth = EARLY_GROWTH_RATE;
-        } else {
-            growth = GROWTH_RATE;
+/**
+ * Marks every object as allocated again and forgets all remembered old
+ * objects, so that a full collection can trace the whole heap.
+ */
+void Heap_unstick(Heap *heap) {
+    ObjectMeta *bytemapStart = Bytemap_Get(heap->bytemap, heap->heapStart);
+    ObjectMeta_UnstickRange(bytemapStart,
+                            bytemapStart + (heap->heapEnd - heap->heapStart) /
+                                               ALLOCATION_ALIGNMENT_WORDS);
+    // keeps the pins
+    LineMeta *lineMeta = (LineMeta *)heap->lineMetaStart;
+    LineMeta *lineMetaEnd = (LineMeta *)heap->lineMetaEnd;
+    for (; lineMeta < lineMetaEnd; lineMeta++) {
+        Line_Unmark(lineMeta);
+    }
+    memset(heap->cardMetaStart, 0,
+           (heap->cardMetaEnd - heap->cardMetaStart) * WORD_SIZE);
+    HugeSpace_Unstick(&heap->hugeSpace);
+    BlockMeta *current = (BlockMeta *)heap->blockMetaStart;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    for (; current < end; current++) {
+        if (BlockMeta_IsMarked(current)) {
+            BlockMeta_Unmark(current);
         }
-        uint32_t blocks = heap->blockCount * (growth - 1);
-        if (Heap_isGrowingPossible(heap, blocks)) {
-            Heap_Grow(heap, blocks);
-        } else {
-            uint32_t remainingGrowth = heap->maxBlockCount - heap->blockCount;
-            if (remainingGrowth > 0) {
-                Heap_Grow(heap, remainingGrowth);
+    }
+}
+
+/**
+ * Prevents evacuation of the object at `address`, because its address has been
+ * exposed to the program.
+ */
+void Heap_Pin(Heap *heap, word_t *address) {
+    if (heap->evacuation.enabled && Heap_IsWordInHeap(heap, address)) {
+        BlockMeta *blockMeta =
+            Block_GetBlockMeta(heap->blockMetaStart, heap->heapStart, address);
+        // a GC thread sweeping the block would lose the pin
+        Sweeper_AwaitBlock(heap, blockMeta);
+        // large objects are never evacuated
+        if (!BlockMeta_ContainsLargeObjects(blockMeta)) {
+            word_t *lastWord = Object_LastWord((Object *)address);
+            LineMeta *lastLineMeta = Heap_LineMetaForWord(heap, lastWord);
+            for (LineMeta *lineMeta = Heap_LineMetaForWord(heap, address);
+                 lineMeta <= lastLineMeta; lineMeta++) {
+                Line_Pin(lineMeta);
             }
         }
     }
+}
+
+/**
+ * A block is fragmented if the last collection left holes in it. The blocks
+ * the allocator is currently bumping into are never evacuated.
+ */
+static inline bool Heap_isFragmented(BlockMeta *blockMeta) {
+    return BlockMeta_IsSimpleBlock(blockMeta) &&
+           !BlockMeta_IsSuperblockMiddle(blockMeta) &&
+           blockMeta != allocator.block && blockMeta != allocator.largeBlock &&
+           BlockMeta_MarkedLines(blockMeta) < LINE_COUNT;
+}
+
+/**
+ * Opportunistic defragmentation as described in the immix paper. When enough
+ * free lines were left in fragmented blocks by the last collection, the blocks
+ * with the fewest marked lines are selected for evacuation, as long as their
+ * marked lines fit into the free blocks.
+ */
+void Heap_selectEvacuationCandidates(Heap *heap) {
+    // number of fragmented blocks by marked lines
+    uint32_t histogram[LINE_COUNT] = {0};
+    uint32_t freeBlockCount = 0;
+    uint64_t fragmentedFreeLines = 0;
+
+    BlockMeta *current = (BlockMeta *)heap->blockMetaStart;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    for (; current < end; current++) {
+        if (BlockMeta_IsFree(current)) {
+            freeBlockCount++;
+        } else if (Heap_isFragmented(current)) {
+            uint8_t markedLines = BlockMeta_MarkedLines(current);
+            histogram[markedLines]++;
+            fragmentedFreeLines += LINE_COUNT - markedLines;
+        }
+    }
+
+    if (freeBlockCount <= EVACUATION_RESERVE_BLOCKS ||
+        fragmentedFreeLines <
+            (uint64_t)heap->blockCount * LINE_COUNT * EVACUATION_TRIGGER_RATIO) {
+        return;
+    }
+
+    uint64_t availableLines =
+        (uint64_t)(freeBlockCount - EVACUATION_RESERVE_BLOCKS) * LINE_COUNT;
+    uint64_t requiredLines = 0;
+    int threshold = -1;
+    for (int marked = 0; marked < LINE_COUNT; marked++) {
+        uint64_t required = requiredLines + histogram[marked] * marked;
+        if (required > availableLines) {
+            break;
+        }
+        requiredLines = required;
+        threshold = marked;
+    }
+    if (threshold < 0) {
+        return;
+    }
+
+    for (current = (BlockMeta *)heap->blockMetaStart; current < end;
+         current++) {
+        if (Heap_isFragmented(current) &&
+            BlockMeta_MarkedLines(current) <= threshold) {
+            BlockMeta_SetEvacuationCandidate(current);
+        }
+    }
+    heap->evacuation.active = true;
+    heap->evacuation.budget =
+        (size_t)(freeBlockCount - EVACUATION_RESERVE_BLOCKS) * BLOCK_TOTAL_SIZE;
+}
+
+/**
+ * Returns where `object` is after marking, or NULL if it is dead, see
+ * `Profiler_OnMarked`.
+ */
+static word_t *Heap_survivor(void *heapPtr, word_t *object) {
+    Heap *heap = (Heap *)heapPtr;
+    if (Heap_IsWordInHeap(heap, object)) {
+        ObjectMeta *objectMeta = Bytemap_Get(heap->bytemap, object);
+        if (ObjectMeta_IsMarked(objectMeta)) {
+            return object;
+        } else if (ObjectMeta_IsForwarded(objectMeta)) {
+            return (word_t *)((Object *)object)->rtti;
+        }
+        return NULL;
+    }
+    HugeObject *huge = HugeSpace_Find(&heap->hugeSpace, object);
+    return huge != NULL && huge->marked ? object : NULL;
+}
+
+/**
+ * Marks the heap and starts sweeping it. Unless the sweep is eager, blocks are
+ * swept when the allocators run out of them.
+ */
+void Heap_collect(Heap *heap, bool young) {
+    Stats *stats = heap->stats;
+#ifdef DEBUG_PRINT
+    printf("\nCollect (%s)\n", young ? "young" : "full");
+    fflush(stdout);
+#endif
+    uint64_t start_ns = scalanative_nano_time();
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc);
+    if (!young) {
+        heap->fullRequested = false;
+        if (heap->generational) {
+            Heap_unstick(heap);
+        }
+    }
+    // objects of young collections can be referenced from clean cards, which
+    // are not visited, so only full collections evacuate
+    heap->evacuation.evacuatedBytes = 0;
+    if (!young && heap->evacuation.enabled) {
+        Heap_selectEvacuationCandidates(heap);
+    }
+    heap->gcThreads.phase = gc_mark;
+    CpuProfiler_EnterPhase(cpu_gc_mark);
+    Marker_MarkRoots(heap, young);
+    Marker_MarkUntilDone(heap);
+    CpuProfiler_EnterPhase(cpu_gc);
+    heap->evacuation.active = false;
+    Profiler_OnMarked(heap, Heap_survivor);
+    uint64_t sweep_start_ns = scalanative_nano_time();
+    CpuProfiler_EnterPhase(cpu_gc_sweep);
+    HugeSpace_Sweep(&heap->hugeSpace, young,
+                    (size_t)Heap_CommittedBlockCount(heap) * BLOCK_TOTAL_SIZE);
+    CpuProfiler_EnterPhase(cpu_gc);
+    Sweeper_Start(heap, young);
+    if (heap->sweep.mode == sweep_eager) {
+        Sweeper_SweepAll(heap);
+    }
+    uint64_t end_ns = scalanative_nano_time();
+    SizingPolicy_Record(&heap->sizing, start_ns, end_ns, !young);
+    uint64_t pause_ns = end_ns - start_ns;
+    heap->totals.collections++;
+    heap->totals.lastPause_ns = pause_ns;
+    heap->totals.totalPause_ns += pause_ns;
+    if (pause_ns > heap->totals.maxPause_ns) {
+        heap->totals.maxPause_ns = pause_ns;
+    }
+    heap->totals.mark_ns += sweep_start_ns - start_ns;
+    if (heap->sweep.mode == sweep_eager) {
+        atomic_fetch_add_explicit(&heap->totals.sweep_ns,
+                                  end_ns - sweep_start_ns,
+                                  memory_order_relaxed);
+    }
+    if (Trace_Enabled()) {
+        Trace_Record(trace_collection, start_ns, end_ns, young);
+        Trace_Record(trace_mark, start_ns, sweep_start_ns, 0);
+        if (heap->sweep.mode == sweep_eager) {
+            Trace_Record(trace_sweep, sweep_start_ns, end_ns, 0);
+        }
+    }
+    if (stats != NULL) {
+        Stats_RecordCollection(
+            stats, start_ns, sweep_start_ns, end_ns, young,
+            heap->evacuation.evacuatedBytes,
+            (size_t)heap->uncommit.blockCount * BLOCK_TOTAL_SIZE);
+    }
+#ifdef DEBUG_PRINT
+    printf("End collect\n");
+    fflush(stdout);
+#endif
+    CpuProfiler_LeavePhase(phase);
+}
+
+void Heap_Collect(Heap *heap) {
+    // marking needs the previous collection to be swept
+    uint64_t start_ns = scalanative_nano_time();
+    Sweeper_SweepAll(heap);
+    Heap_RecordSweep(heap, trace_lazy_sweep, start_ns);
+    bool young = heap->generational && !heap->fullRequested;
+    Heap_collect(heap, young);
+    // an eager sweep knows right away if the young collection freed too little
+    if (young && heap->fullRequested) {
+        Heap_collect(heap, false);
+    }
+}
+
+/**
+ * Called by the `Sweeper` once all blocks have been given to the allocators,
+ * takes the decisions that need to know how much the collection freed.
+ */
+void Heap_SweepDone(Heap *heap) {
     BlockAllocator_SweepDone(&blockAllocator);
-    if (!Allocator_CanInitCursors(&allocator)) {
-        Heap_exitWithOutOfMemory();
+    Heap_uncommitIfIdle(heap);
+    if (heap->sizing.enabled && !heap->sweep.young) {
+        uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+        uint32_t target = Heap_sizingTarget(heap);
+        if (target > committedBlockCount) {
+            Heap_Grow(heap, target - committedBlockCount);
+        }
+        return;
+    }
+    if (!Heap_shouldGrow(heap)) {
+        return;
+    }
+    if (heap->sweep.young) {
+        // Too little was freed by the young collection, the old generation is
+        // filling up.
+        heap->fullRequested = true;
+        return;
+    }
+    double growth;
+    // no doubling close to the maximum, which may be a small cgroup limit
+    if (heap->heapSize < EARLY_GROWTH_THRESHOLD &&
+        heap->heapSize < heap->maxHeapSize * EARLY_GROWTH_MAX_RATIO) {
+        growth = EARLY_GROWTH_RATE;
+    } else {
+        growth = GROWTH_RATE;
+    }
+    uint32_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint32_t blocks = committedBlockCount * (growth - 1);
+    if (Heap_isGrowingPossible(heap, blocks)) {
+        Heap_Grow(heap, blocks);
+    } else {
+        uint32_t remainingGrowth = Heap_availableBlockCount(heap);
+        if (remainingGrowth > 0) {
+            Heap_Grow(heap, remainingGrowth);
+        }
     }
-    Allocator_InitCursors(&allocator);
+}
+
+/**
+ * Fills in `stats`. Blocks count with their metadata, like the maximum heap
+ * size. The free blocks are only known once the sweep is done, so it is
+ * finished first.
+ */
+void Heap_Stats(Heap *heap, GCStats *stats) {
+    uint64_t start_ns = scalanative_nano_time();
+    Sweeper_SweepAll(heap);
+    Heap_RecordSweep(heap, trace_lazy_sweep, start_ns);
+    uint64_t committedBlockCount = Heap_CommittedBlockCount(heap);
+    uint64_t freeBlockCount = blockAllocator.freeBlockCount;
+    uint64_t hugeBytes = heap->hugeSpace.bytes;
+    stats->heapSize = committedBlockCount * SPACE_USED_PER_BLOCK + hugeBytes;
+    stats->maxHeapSize = heap->maxHeapSize;
+    stats->usedBytes =
+        (committedBlockCount - freeBlockCount) * SPACE_USED_PER_BLOCK +
+        hugeBytes;
+    stats->freeBlocks = freeBlockCount;
+    stats->recycledBlocks = allocator.recycledBlockCount;
+    stats->allocatedBytes =
+        Allocator_AllocatedBytes(&allocator) + heap->totals.largeBytes;
+    stats->collections = heap->totals.collections;
+    stats->lastPause_ns = heap->totals.lastPause_ns;
+    stats->maxPause_ns = heap->totals.maxPause_ns;
+    stats->totalPause_ns = heap->totals.totalPause_ns;
+    stats->mark_ns = heap->totals.mark_ns;
+    stats->sweep_ns = atomic_load_explicit(&heap->totals.sweep_ns,
+                                           memory_order_relaxed);
 }
 
 void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
+    // recommitted blocks could be ahead of the sweep
+    assert(Sweeper_IsSweepDone(heap));
     if (!Heap_isGrowingPossible(heap, incrementInBlocks)) {
         Heap_exitWithOutOfMemory();
     }
+    uint64_t start_ns = Trace_Start();
+    uint32_t recommitted = Heap_recommit(heap, incrementInBlocks);
+    if (recommitted == incrementInBlocks) {
+        Trace_End(trace_grow, start_ns, incrementInBlocks);
+        return;
+    }
+    // there is nothing left to recommit
+    incrementInBlocks -= recommitted;
 
 #ifdef DEBUG_PRINT
     printf("Growing small heap by %zu bytes, to %zu bytes\n",
@@ -361,6 +1106,12 @@ void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
         (word_t *)(((BlockMeta *)heap->blockMetaEnd) + incrementInBlocks);
     heap->lineMetaEnd +=
         incrementInBlocks * LINE_COUNT * LINE_METADATA_SIZE / WORD_SIZE;
+    heap->crossingMetaEnd +=
+        incrementInBlocks * LINE_COUNT * CROSSING_METADATA_SIZE / WORD_SIZE;
+    if (heap->generational) {
+        heap->cardMetaEnd +=
+            incrementInBlocks * CARD_COUNT * CARD_METADATA_SIZE / WORD_SIZE;
+    }
 
     BlockAllocator_AddFreeBlocks(&blockAllocator, (BlockMeta *)blockMetaEnd,
                                  incrementInBlocks);
@@ -369,4 +1120,5 @@ void Heap_Grow(Heap *heap, uint32_t incrementInBlocks) {
 
     // immediately add the block to freelists
     BlockAllocator_SweepDone(&blockAllocator);
+    Trace_End(trace_grow, start_ns, recommitted + incrementInBlocks);
 }
@@ -4,27 +4,128 @@
 #include "GCTypes.h"
 #include "Allocator.h"
 #include "LargeAllocator.h"
-#include "datastructures/Stack.h"
+#include "HugeSpace.h"
+#include "SizingPolicy.h"
 #include "datastructures/Bytemap.h"
+#include "datastructures/GreyPacket.h"
+#include "datastructures/GreyDeque.h"
 #include "metadata/LineMeta.h"
+#include "metadata/CardMeta.h"
+#include "metadata/CrossingMeta.h"
 #include "Stats.h"
+#include "Settings.h"
+#include "Trace.h"
+#include "../shared/GCStats.h"
 #include <stdio.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+// what the GC threads do when they are woken up
+typedef enum { gc_mark, gc_sweep } GCThreadPhase;
 
 typedef struct {
     word_t *blockMetaStart;
     word_t *blockMetaEnd;
     word_t *lineMetaStart;
     word_t *lineMetaEnd;
+    word_t *cardMetaStart;
+    word_t *cardMetaEnd;
+    word_t *crossingMetaStart;
+    word_t *crossingMetaEnd;
     word_t *heapStart;
     word_t *heapEnd;
+    word_t *greyPacketsStart;
     size_t heapSize;
     size_t maxHeapSize;
     uint32_t blockCount;
     uint32_t maxBlockCount;
     Bytemap *bytemap;
+    // objects too large for the heap, see HugeSpace
+    HugeSpace hugeSpace;
+    // goals for the heap size set by the user, if any
+    SizingPolicy sizing;
     Stats *stats;
+    bool generational;
+    // a young collection freed too little, the next collection is full
+    bool fullRequested;
+    // the heap is aligned for and advised to use transparent huge pages
+    bool hugePages;
+    // the memory of the initial heap is touched when it is mapped
+    bool prefault;
+    // objects are prefetched this many pops before they are marked, 0 turns
+    // the prefetching of objects and of their fields' metadata off
+    int markPrefetchDistance;
+    struct {
+        bool enabled;
+        // the current collection evacuates the candidate blocks
+        bool active;
+        // number of bytes that can still be copied into free blocks
+        size_t budget;
+        size_t evacuatedBytes;
+    } evacuation;
+    struct {
+        uint32_t total;
+        GreyList empty;
+        // full packets that did not fit in the deques
+        GreyList full;
+        // a deque for each GC thread followed by one for the mutator
+        GreyDeque *deques;
+    } mark;
+    struct {
+        sem_t *start;
+        uint32_t count;
+        // threads that have been woken up and have not run out of work yet
+        atomic_int active;
+        GCThreadPhase phase;
+        void *all;
+    } gcThreads;
+    struct {
+        SweepMode mode;
+        // blocks before the cursor have been given to the allocators
+        uint32_t cursor;
+        // number of blocks when the sweep started
+        uint32_t limit;
+        uint32_t batchCount;
+        // next batch for the GC threads to claim
+        atomic_uint nextBatch;
+        // the BatchState of each batch, see Sweeper.c
+        atomic_uchar *batches;
+        // the collection being swept was young
+        bool young;
+    } sweep;
+    struct {
+        // how long free memory is kept in excess, negative to keep it forever
+        int64_t delay_ns;
+        // when the committed heap was first found too large, 0 if it is not
+        uint64_t excessSince_ns;
+        // free blocks whose memory has been returned to the OS
+        uint32_t blockCount;
+        uint32_t minBlockCount;
+    } uncommit;
+    // what `scalanative_gc_stats` reports besides the sizes, see GCStats
+    struct {
+        uint64_t collections;
+        uint64_t lastPause_ns;
+        uint64_t maxPause_ns;
+        uint64_t totalPause_ns;
+        uint64_t mark_ns;
+        // summed over the threads that sweep
+        atomic_uint_fast64_t sweep_ns;
+        // bytes of the objects that do not come from the allocator's holes
+        uint64_t largeBytes;
+        // the large bytes at which the profiler samples next, see Profiler.h
+        uint64_t nextLargeSample;
+    } totals;
 } Heap;
 
+static inline uint32_t Heap_CommittedBlockCount(Heap *heap) {
+    return heap->blockCount - heap->uncommit.blockCount;
+}
+
+static inline GreyDeque *Heap_MutatorDeque(Heap *heap) {
+    return &heap->mark.deques[heap->gcThreads.count];
+}
+
 static inline bool Heap_IsWordInHeap(Heap *heap, word_t *word) {
     return word >= heap->heapStart && word < heap->heapEnd;
 }
@@ -41,14 +142,69 @@ static inline LineMeta *Heap_LineMetaForWord(Heap *heap, word_t *word) {
     return lineMeta;
 }
 
+static inline CardMeta *Heap_CardMetaForWord(Heap *heap, word_t *word) {
+    assert(Heap_IsWordInHeap(heap, word));
+    word_t cardGlobalIndex =
+        ((word_t)word - (word_t)heap->heapStart) >> CARD_SIZE_BITS;
+    CardMeta *cardMeta = (CardMeta *)heap->cardMetaStart + cardGlobalIndex;
+    assert(cardMeta < (CardMeta *)heap->cardMetaEnd);
+    return cardMeta;
+}
+
+static inline CrossingMeta *Heap_CrossingMetaForWord(Heap *heap,
+                                                     word_t *word) {
+    // conservative roots can point past the last block, the reserved entries
+    // there are empty
+    assert(Heap_IsWordInHeap(heap, word));
+    return Crossing_ForWord(heap->crossingMetaStart, heap->heapStart, word);
+}
+
+static inline word_t *Heap_CardStart(Heap *heap, CardMeta *cardMeta) {
+    word_t cardGlobalIndex = cardMeta - (CardMeta *)heap->cardMetaStart;
+    return heap->heapStart + cardGlobalIndex * WORDS_IN_CARD;
+}
+
+/**
+ * Adds the time since `start_ns` to the sweep time, and records it as an event
+ * of `type` while tracing.
+ */
+static inline void Heap_RecordSweep(Heap *heap, TraceEventType type,
+                                    uint64_t start_ns) {
+    uint64_t end_ns = scalanative_nano_time();
+    atomic_fetch_add_explicit(&heap->totals.sweep_ns, end_ns - start_ns,
+                              memory_order_relaxed);
+    if (Trace_Enabled()) {
+        Trace_Record(type, start_ns, end_ns, 0);
+    }
+}
+
+/**
+ * Records a reference store to `address` so that young collections can find
+ * old-to-young pointers. Stores outside of the heap and the huge objects are
+ * ignored.
+ */
+static inline void Heap_WriteBarrier(Heap *heap, word_t *address) {
+    if (heap->generational) {
+        if (Heap_IsWordInHeap(heap, address)) {
+            Card_MarkDirty(Heap_CardMetaForWord(heap, address));
+        } else if (HugeSpace_MayContain(&heap->hugeSpace, address)) {
+            HugeSpace_WriteBarrier(&heap->hugeSpace, address);
+        }
+    }
+}
+
 void Heap_Init(Heap *heap, size_t minHeapSize, size_t maxHeapSize);
 word_t *Heap_Alloc(Heap *heap, uint32_t objectSize);
 word_t *Heap_AllocSmall(Heap *heap, uint32_t objectSize);
 word_t *Heap_AllocLarge(Heap *heap, uint32_t objectSize);
 
-void Heap_Collect(Heap *heap, Stack *stack);
+void Heap_Collect(Heap *heap);
+
+void Heap_WriteBarrierRange(Heap *heap, word_t *address, size_t size);
+void Heap_Pin(Heap *heap, word_t *address);
 
-void Heap_Recycle(Heap *heap);
+void Heap_SweepDone(Heap *heap);
 void Heap_Grow(Heap *heap, uint32_t increment);
+void Heap_Stats(Heap *heap, GCStats *stats);
 
 #endif // IMMIX_HEAP_H
@@ -0,0 +1,351 @@
+#include "HeapDump.h"
+#include "Object.h"
+#include "Sweeper.h"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// characters of a class name in the histogram and the dump
+#define HEAP_DUMP_NAME_SIZE 256
+#define HEAP_DUMP_INITIAL_CAPACITY 1024
+
+volatile atomic_bool heapDumpRequested = false;
+static const char *HeapDump_histogramPath = NULL;
+static const char *HeapDump_dumpPath = NULL;
+static bool HeapDump_outOfMemory = false;
+
+typedef struct {
+    Rtti *rtti;
+    uint64_t count;
+    uint64_t bytes;
+} HeapDumpClass;
+
+typedef struct {
+    // open addressing table of the classes seen so far
+    HeapDumpClass *classes;
+    uint32_t classCount;
+    uint32_t capacity;
+    // the references of the current object
+    uint64_t *references;
+    uint32_t referenceCount;
+    uint32_t referenceCapacity;
+    // NULL unless a dump is written
+    FILE *file;
+    // the memory ran out, the histogram is incomplete
+    bool failed;
+} HeapDump;
+
+static void HeapDump_onSignal(int signal) {
+    atomic_store(&heapDumpRequested, true);
+}
+
+/**
+ * Remembers the files written on SIGQUIT and out of memory. The signal is only
+ * handled if one of them is set and the program does not handle it itself.
+ */
+void HeapDump_Init(const char *histogramPath, const char *dumpPath) {
+    HeapDump_histogramPath = histogramPath;
+    HeapDump_dumpPath = dumpPath;
+    if (histogramPath == NULL && dumpPath == NULL) {
+        return;
+    }
+    struct sigaction previous;
+    if (sigaction(SIGQUIT, NULL, &previous) != 0 ||
+        previous.sa_handler != SIG_DFL) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = HeapDump_onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGQUIT, &action, NULL);
+}
+
+static void HeapDump_write32(HeapDump *dump, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, dump->file);
+}
+
+static void HeapDump_write64(HeapDump *dump, uint64_t value) {
+    fwrite(&value, sizeof(value), 1, dump->file);
+}
+
+static inline uint32_t HeapDump_hash(Rtti *rtti, uint32_t capacity) {
+    return (uint32_t)(((uintptr_t)rtti >> 4) * 0x9E3779B97F4A7C15ULL >> 32) &
+           (capacity - 1);
+}
+
+static bool HeapDump_grow(HeapDump *dump) {
+    uint32_t capacity = dump->capacity == 0 ? HEAP_DUMP_INITIAL_CAPACITY
+                                            : 2 * dump->capacity;
+    HeapDumpClass *classes = calloc(capacity, sizeof(HeapDumpClass));
+    if (classes == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < dump->capacity; i++) {
+        HeapDumpClass *class = &dump->classes[i];
+        if (class->rtti != NULL) {
+            uint32_t slot = HeapDump_hash(class->rtti, capacity);
+            while (classes[slot].rtti != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            classes[slot] = *class;
+        }
+    }
+    free(dump->classes);
+    dump->classes = classes;
+    dump->capacity = capacity;
+    return true;
+}
+
+/**
+ * Returns the entry of the class, added and written to the dump the first
+ * time. Returns NULL if the memory ran out.
+ */
+static HeapDumpClass *HeapDump_class(HeapDump *dump, Rtti *rtti) {
+    if (2 * (dump->classCount + 1) > dump->capacity && !HeapDump_grow(dump)) {
+        return NULL;
+    }
+    uint32_t slot = HeapDump_hash(rtti, dump->capacity);
+    while (dump->classes[slot].rtti != NULL) {
+        if (dump->classes[slot].rtti == rtti) {
+            return &dump->classes[slot];
+        }
+        slot = (slot + 1) & (dump->capacity - 1);
+    }
+    HeapDumpClass *class = &dump->classes[slot];
+    class->rtti = rtti;
+    dump->classCount++;
+    if (dump->file != NULL) {
+        char name[HEAP_DUMP_NAME_SIZE];
+        Object_ClassName(rtti, name, sizeof(name));
+        uint32_t length = strlen(name);
+        fputc(HEAP_DUMP_CLASS, dump->file);
+        HeapDump_write32(dump, (uint32_t)rtti->rt.id);
+        HeapDump_write32(dump, length);
+        fwrite(name, 1, length, dump->file);
+    }
+    return class;
+}
+
+static void HeapDump_addReference(HeapDump *dump, word_t *reference) {
+    if (reference == NULL) {
+        return;
+    }
+    if (dump->referenceCount == dump->referenceCapacity) {
+        uint32_t capacity = dump->referenceCapacity == 0
+                                ? HEAP_DUMP_INITIAL_CAPACITY
+                                : 2 * dump->referenceCapacity;
+        uint64_t *references =
+            realloc(dump->references, capacity * sizeof(uint64_t));
+        if (references == NULL) {
+            dump->failed = true;
+            return;
+        }
+        dump->references = references;
+        dump->referenceCapacity = capacity;
+    }
+    dump->references[dump->referenceCount++] = (uint64_t)reference;
+}
+
+static void HeapDump_writeObject(HeapDump *dump, Object *object, size_t size) {
+    Rtti *rtti = object->rtti;
+    dump->referenceCount = 0;
+    if (Object_IsArray(object)) {
+        if (rtti->rt.id == __object_array_id) {
+            ArrayHeader *arrayHeader = (ArrayHeader *)object;
+            word_t **fields = (word_t **)(arrayHeader + 1);
+            for (int32_t i = 0; i < arrayHeader->length; i++) {
+                HeapDump_addReference(dump, fields[i]);
+            }
+        }
+    } else if (rtti->refMapBits != 0) {
+        for (uint64_t bits = rtti->refMapBits; bits != 0; bits &= bits - 1) {
+            HeapDump_addReference(dump,
+                                  object->fields[__builtin_ctzll(bits)]);
+        }
+    } else {
+        for (int64_t *offset = rtti->refMapStruct;
+             *offset != LAST_FIELD_OFFSET; offset++) {
+            HeapDump_addReference(dump, object->fields[*offset]);
+        }
+    }
+    fputc(HEAP_DUMP_OBJECT, dump->file);
+    HeapDump_write64(dump, (uint64_t)object);
+    HeapDump_write32(dump, (uint32_t)rtti->rt.id);
+    HeapDump_write64(dump, size);
+    HeapDump_write32(dump, dump->referenceCount);
+    fwrite(dump->references, sizeof(uint64_t), dump->referenceCount,
+           dump->file);
+}
+
+static void HeapDump_visit(HeapDump *dump, Object *object) {
+    // allocated, but its class is not stored yet
+    if (object->rtti == NULL) {
+        return;
+    }
+    size_t size = Object_Size(object);
+    HeapDumpClass *class = HeapDump_class(dump, object->rtti);
+    if (class == NULL) {
+        dump->failed = true;
+        return;
+    }
+    class->count++;
+    class->bytes += size;
+    if (dump->file != NULL) {
+        HeapDump_writeObject(dump, object, size);
+    }
+}
+
+/**
+ * Visits the objects of a swept heap, which are the allocated and the marked
+ * ones. Free blocks have no objects and the huge objects are in the
+ * `HugeSpace`.
+ */
+static void HeapDump_walk(Heap *heap, HeapDump *dump) {
+    Bytemap *bytemap = heap->bytemap;
+    BlockMeta *end = (BlockMeta *)heap->blockMetaEnd;
+    word_t *blockStart = heap->heapStart;
+    for (BlockMeta *blockMeta = (BlockMeta *)heap->blockMetaStart;
+         blockMeta < end; blockMeta++, blockStart += WORDS_IN_BLOCK) {
+        if (BlockMeta_IsFree(blockMeta) || BlockMeta_IsUncommitted(blockMeta)) {
+            continue;
+        }
+        ObjectMeta *first = Bytemap_Get(bytemap, blockStart);
+        uint64_t *cursor = (uint64_t *)first;
+        uint64_t *limit = cursor + WORDS_IN_BLOCK / ALLOCATION_ALIGNMENT_WORDS /
+                                       sizeof(uint64_t);
+        for (; cursor < limit; cursor++) {
+            // skips eight free entries at once
+            if (*cursor == 0) {
+                continue;
+            }
+            ObjectMeta *objectMeta = (ObjectMeta *)cursor;
+            for (int i = 0; i < sizeof(uint64_t); i++, objectMeta++) {
+                if (ObjectMeta_IsAllocated(objectMeta) ||
+                    ObjectMeta_IsMarked(objectMeta)) {
+                    HeapDump_visit(
+                        dump,
+                        (Object *)(blockStart + (objectMeta - first) *
+                                                   ALLOCATION_ALIGNMENT_WORDS));
+                }
+            }
+        }
+    }
+    HugeSpace *space = &heap->hugeSpace;
+    for (uint32_t i = 0; i < space->count; i++) {
+        HeapDump_visit(dump, (Object *)space->objects[i].start);
+    }
+}
+
+static int HeapDump_compareBytes(const void *a, const void *b) {
+    uint64_t aBytes = ((HeapDumpClass *)a)->bytes;
+    uint64_t bBytes = ((HeapDumpClass *)b)->bytes;
+    return aBytes < bBytes ? 1 : aBytes > bBytes ? -1 : 0;
+}
+
+/**
+ * Writes the classes by decreasing bytes, this takes the table apart.
+ */
+static bool HeapDump_writeHistogram(HeapDump *dump, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return false;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < dump->capacity; i++) {
+        if (dump->classes[i].rtti != NULL) {
+            dump->classes[count++] = dump->classes[i];
+        }
+    }
+    qsort(dump->classes, count, sizeof(HeapDumpClass), HeapDump_compareBytes);
+    fprintf(out, " num     #instances         #bytes  class name\n"
+                 "----------------------------------------------\n");
+    uint64_t totalCount = 0;
+    uint64_t totalBytes = 0;
+    char name[HEAP_DUMP_NAME_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        HeapDumpClass *class = &dump->classes[i];
+        Object_ClassName(class->rtti, name, sizeof(name));
+        fprintf(out, "%4" PRIu32 ": %14" PRIu64 " %14" PRIu64 "  %s\n", i + 1,
+                class->count, class->bytes, name);
+        totalCount += class->count;
+        totalBytes += class->bytes;
+    }
+    fprintf(out, "Total %14" PRIu64 " %14" PRIu64 "\n", totalCount,
+            totalBytes);
+    bool written = !ferror(out);
+    return fclose(out) == 0 && written;
+}
+
+/**
+ * Writes the histogram and the dump of a swept heap, either path may be NULL.
+ * Returns false if a file could not be written in full.
+ */
+static bool HeapDump_write(Heap *heap, const char *histogramPath,
+                           const char *dumpPath) {
+    HeapDump dump = {0};
+    bool written = true;
+    if (dumpPath != NULL) {
+        dump.file = fopen(dumpPath, "wb");
+        if (dump.file == NULL) {
+            written = false;
+        } else {
+            fwrite(HEAP_DUMP_MAGIC, 1, strlen(HEAP_DUMP_MAGIC), dump.file);
+        }
+    }
+    HeapDump_walk(heap, &dump);
+    if (dump.file != NULL) {
+        fputc(HEAP_DUMP_END, dump.file);
+        written = !ferror(dump.file) && written;
+        written = fclose(dump.file) == 0 && written;
+    }
+    if (histogramPath != NULL) {
+        written = HeapDump_writeHistogram(&dump, histogramPath) && written;
+    }
+    free(dump.classes);
+    free(dump.references);
+    return written && !dump.failed;
+}
+
+/**
+ * Collects the whole heap and writes what survived, either path may be NULL.
+ * Returns false if a file could not be written in full.
+ */
+bool HeapDump_Collect(Heap *heap, const char *histogramPath,
+                      const char *dumpPath) {
+    heap->fullRequested = true;
+    Heap_Collect(heap);
+    // the dead objects are only told apart from the live ones by the marks
+    // until they are swept
+    uint64_t start_ns = scalanative_nano_time();
+    Sweeper_SweepAll(heap);
+    Heap_RecordSweep(heap, trace_lazy_sweep, start_ns);
+    return HeapDump_write(heap, histogramPath, dumpPath);
+}
+
+void HeapDump_OnRequest(Heap *heap) {
+    atomic_store(&heapDumpRequested, false);
+    if (!HeapDump_Collect(heap, HeapDump_histogramPath, HeapDump_dumpPath)) {
+        fprintf(stderr, "GC heap dump: cannot write %s\n",
+                HeapDump_histogramPath != NULL ? HeapDump_histogramPath
+                                               : HeapDump_dumpPath);
+    }
+}
+
+void HeapDump_OnOutOfMemory(Heap *heap) {
+    // only the first out of memory is dumped
+    if (HeapDump_outOfMemory ||
+        (HeapDump_histogramPath == NULL && HeapDump_dumpPath == NULL)) {
+        return;
+    }
+    HeapDump_outOfMemory = true;
+    Sweeper_SweepAll(heap);
+    if (!HeapDump_write(heap, HeapDump_histogramPath, HeapDump_dumpPath)) {
+        fprintf(stderr, "GC heap dump: cannot write %s\n",
+                HeapDump_histogramPath != NULL ? HeapDump_histogramPath
+                                               : HeapDump_dumpPath);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef IMMIX_HEAPDUMP_H
+#define IMMIX_HEAPDUMP_H
+
+#include "Heap.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Tells what fills the heap: a histogram of the live objects by class, as
+// text, and a dump of every live object with its references. They are written
+// after a full collection by `scalanative_gc_heap_dump`, on SIGQUIT to the
+// files of HISTOGRAM_FILE_SETTING and HEAP_DUMP_FILE_SETTING, and to the same
+// files when the program runs out of memory. That last one is not preceded by
+// a collection, it shows the objects of the last one and those allocated
+// since.
+//
+// The dump is binary, in the byte order of the machine. It starts with the
+// eight bytes HEAP_DUMP_MAGIC, followed by records of a tag byte and fields:
+// - HEAP_DUMP_CLASS: the class id int32, the length of its name uint32 and the
+//   name in ASCII. It comes before the first object of the class.
+// - HEAP_DUMP_OBJECT: the address uint64, the class id int32, the size uint64,
+//   the number of references uint32 and the address of each referenced object
+//   uint64, null references are left out.
+// The last record is the tag HEAP_DUMP_END.
+
+#define HEAP_DUMP_MAGIC "SNHEAP01"
+#define HEAP_DUMP_END 0
+#define HEAP_DUMP_CLASS 1
+#define HEAP_DUMP_OBJECT 2
+
+extern volatile atomic_bool heapDumpRequested;
+
+void HeapDump_Init(const char *histogramPath, const char *dumpPath);
+bool HeapDump_Collect(Heap *heap, const char *histogramPath,
+                      const char *dumpPath);
+void HeapDump_OnRequest(Heap *heap);
+void HeapDump_OnOutOfMemory(Heap *heap);
+
+/**
+ * Returns true after SIGQUIT, the allocation slow paths then call
+ * `HeapDump_OnRequest`.
+ */
+static inline bool HeapDump_Requested() {
+    return atomic_load_explicit(&heapDumpRequested, memory_order_relaxed);
+}
+
+#endif // IMMIX_HEAPDUMP_H
@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "HugeSpace.h"
+#include "Log.h"
+#include "utils/MathUtils.h"
+
+#define HUGE_SPACE_INITIAL_CAPACITY 16
+
+void HugeSpace_Init(HugeSpace *space, size_t threshold, bool generational,
+                    size_t limit) {
+    space->objects = NULL;
+    space->count = 0;
+    space->capacity = 0;
+    space->low = (word_t *)UINTPTR_MAX;
+    space->high = NULL;
+    space->threshold = threshold;
+    space->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    space->bytes = 0;
+    space->limit = limit;
+    space->generational = generational;
+}
+
+static inline size_t HugeSpace_mappedSize(HugeSpace *space, size_t size) {
+    return MathUtils_RoundToNextMultiple(size, space->pageSize);
+}
+
+static void HugeSpace_updateBounds(HugeSpace *space) {
+    if (space->count == 0) {
+        space->low = (word_t *)UINTPTR_MAX;
+        space->high = NULL;
+    } else {
+        HugeObject *last = &space->objects[space->count - 1];
+        space->low = space->objects[0].start;
+        space->high = (word_t *)((ubyte_t *)last->start + last->size);
+    }
+}
+
+/**
+ * Returns the index of the first object that starts after `word`.
+ */
+static inline uint32_t HugeSpace_upperBound(HugeSpace *space, word_t *word) {
+    uint32_t low = 0;
+    uint32_t high = space->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (space->objects[middle].start <= word) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Maps a zeroed region for an object of `size` bytes and records it, NULL if
+ * the memory cannot be had.
+ */
+word_t *HugeSpace_Alloc(HugeSpace *space, size_t size) {
+    if (space->count == space->capacity) {
+        uint32_t capacity = space->capacity == 0 ? HUGE_SPACE_INITIAL_CAPACITY
+                                                 : 2 * space->capacity;
+        HugeObject *objects =
+            realloc(space->objects, capacity * sizeof(HugeObject));
+        if (objects == NULL) {
+            return NULL;
+        }
+        space->objects = objects;
+        space->capacity = capacity;
+    }
+
+    size_t mappedSize = HugeSpace_mappedSize(space, size);
+    word_t *start =
+        mmap(NULL, mappedSize, PROT_READ | PROT_WRITE,
+             MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) {
+        return NULL;
+    }
+    CardMeta *cards = NULL;
+    if (space->generational) {
+        cards = calloc(HugeObject_CardCount(size), CARD_METADATA_SIZE);
+        if (cards == NULL) {
+            munmap(start, mappedSize);
+            return NULL;
+        }
+    }
+
+    uint32_t index = HugeSpace_upperBound(space, start);
+    memmove(&space->objects[index + 1], &space->objects[index],
+            (space->count - index) * sizeof(HugeObject));
+    HugeObject *object = &space->objects[index];
+    object->start = start;
+    object->size = size;
+    object->cards = cards;
+    object->marked = false;
+    space->count++;
+    space->bytes += mappedSize;
+    HugeSpace_updateBounds(space);
+    return start;
+}
+
+/**
+ * Returns the huge object that contains `word`, or NULL.
+ */
+HugeObject *HugeSpace_Find(HugeSpace *space, word_t *word) {
+    if (!HugeSpace_MayContain(space, word)) {
+        return NULL;
+    }
+    // the first object starts at or before `word`, the index is not 0
+    HugeObject *object = &space->objects[HugeSpace_upperBound(space, word) - 1];
+    if (word < (word_t *)((ubyte_t *)object->start + object->size)) {
+        return object;
+    } else {
+        return NULL;
+    }
+}
+
+/**
+ * Unmaps the huge objects that were not marked. In generational mode the
+ * survivors stay marked, they are old from now on. A full collection sets the
+ * next limit, so that as many bytes as are live, or as the heap holds, can be
+ * allocated before the next collection.
+ */
+void HugeSpace_Sweep(HugeSpace *space, bool young, size_t heapBytes) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < space->count; i++) {
+        HugeObject *object = &space->objects[i];
+        if (object->marked) {
+            if (!space->generational) {
+                object->marked = false;
+            }
+            space->objects[kept++] = *object;
+        } else {
+            size_t mappedSize = HugeSpace_mappedSize(space, object->size);
+            munmap(object->start, mappedSize);
+            free(object->cards);
+            space->bytes -= mappedSize;
+        }
+    }
+    space->count = kept;
+    HugeSpace_updateBounds(space);
+    if (!young) {
+        size_t room = space->bytes > heapBytes ? space->bytes : heapBytes;
+        space->limit = space->bytes + room;
+    }
+}
+
+/**
+ * Forgets the old huge objects and their dirty cards before a full collection.
+ */
+void HugeSpace_Unstick(HugeSpace *space) {
+    for (uint32_t i = 0; i < space->count; i++) {
+        HugeObject *object = &space->objects[i];
+        object->marked = false;
+        if (object->cards != NULL) {
+            memset(object->cards, 0,
+                   HugeObject_CardCount(object->size) * CARD_METADATA_SIZE);
+        }
+    }
+}
+
+void HugeSpace_WriteBarrier(HugeSpace *space, word_t *address) {
+    HugeObject *object = HugeSpace_Find(space, address);
+    if (object != NULL) {
+        size_t card = ((ubyte_t *)address - (ubyte_t *)object->start) >>
+                      CARD_SIZE_BITS;
+        Card_MarkDirty(&object->cards[card]);
+    }
+}
+
+void HugeSpace_WriteBarrierRange(HugeSpace *space, word_t *address,
+                                 size_t size) {
+    HugeObject *object = HugeSpace_Find(space, address);
+    if (object != NULL) {
+        ubyte_t *start = (ubyte_t *)object->start;
+        ubyte_t *end = start + object->size;
+        ubyte_t *last = (ubyte_t *)address + size - 1;
+        if (last >= end) {
+            last = end - 1;
+        }
+        size_t lastCard = (last - start) >> CARD_SIZE_BITS;
+        for (size_t card = ((ubyte_t *)address - start) >> CARD_SIZE_BITS;
+             card <= lastCard; card++) {
+            Card_MarkDirty(&object->cards[card]);
+        }
+    }
+}
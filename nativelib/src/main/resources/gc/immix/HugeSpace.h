@@ -0,0 +1,63 @@
+#ifndef IMMIX_HUGESPACE_H
+#define IMMIX_HUGESPACE_H
+
+#include "GCTypes.h"
+#include "Constants.h"
+#include "metadata/CardMeta.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+// Objects of at least `threshold` bytes do not take blocks of the heap, each
+// one gets its own mapping. They are kept in a table sorted by address, which
+// the marker searches for references that point outside of the heap. The mark
+// bit lives in the table, and dead objects are unmapped right after marking.
+
+typedef struct {
+    word_t *start;
+    // size of the object, the mapping is rounded up to pages
+    size_t size;
+    // one card per CARD_SIZE bytes of the object, only when generational
+    CardMeta *cards;
+    bool marked;
+} HugeObject;
+
+/**
+ * Returns the number of cards of an object of `size` bytes, rounded up so that
+ * the cards can be scanned a word at a time.
+ */
+static inline size_t HugeObject_CardCount(size_t size) {
+    size_t cards = (size + CARD_SIZE - 1) >> CARD_SIZE_BITS;
+    return (cards + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+typedef struct {
+    HugeObject *objects;
+    uint32_t count;
+    uint32_t capacity;
+    // every huge object lies in [low, high)
+    word_t *low;
+    word_t *high;
+    size_t threshold;
+    size_t pageSize;
+    // mapped bytes of all the huge objects
+    size_t bytes;
+    // a collection is started before allocating once `bytes` exceeds this
+    size_t limit;
+    bool generational;
+} HugeSpace;
+
+void HugeSpace_Init(HugeSpace *space, size_t threshold, bool generational,
+                    size_t limit);
+word_t *HugeSpace_Alloc(HugeSpace *space, size_t size);
+HugeObject *HugeSpace_Find(HugeSpace *space, word_t *word);
+void HugeSpace_Sweep(HugeSpace *space, bool young, size_t heapBytes);
+void HugeSpace_Unstick(HugeSpace *space);
+void HugeSpace_WriteBarrier(HugeSpace *space, word_t *address);
+void HugeSpace_WriteBarrierRange(HugeSpace *space, word_t *address,
+                                 size_t size);
+
+static inline bool HugeSpace_MayContain(HugeSpace *space, word_t *word) {
+    return word >= space->low && word < space->high;
+}
+
+#endif // IMMIX_HUGESPACE_H
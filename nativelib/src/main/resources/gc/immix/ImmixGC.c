@@ -1,9 +1,10 @@
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
 #include "GCTypes.h"
 #include "Heap.h"
-#include "datastructures/Stack.h"
 #include "Marker.h"
 #include "Log.h"
 #include "Object.h"
@@ -11,16 +12,36 @@
 #include "utils/MathUtils.h"
 #include "Constants.h"
 #include "Settings.h"
+#include "Trace.h"
+#include "Profiler.h"
+#include "HeapDump.h"
+#include "../../pprof/CpuProfiler.h"
 
 void scalanative_collect();
 
+// Whether objects may move, read by `runtime.pin` before it calls
+// `scalanative_pin`. Set once the heap is initialized.
+bool scalanative_gc_moves_objects = false;
+
+// Whether the card table has to be kept up to date, read by `Array.copy`
+// before it calls `scalanative_write_barrier_range`. Only with
+// `nativeGenerational`, see Settings_Generational.
+bool scalanative_gc_generational = false;
+
 void scalanative_afterexit() {
     Stats_OnExit(heap.stats);
+    Trace_OnExit();
+    Profiler_OnExit();
 }
 
 NOINLINE void scalanative_init() {
+    CpuProfiler_Init();
+    Trace_Init(Settings_TraceFileName());
+    Profiler_Init(Settings_ProfileFileName(), Settings_ProfileInterval());
+    HeapDump_Init(Settings_HistogramFileName(), Settings_HeapDumpFileName());
     Heap_Init(&heap, Settings_MinHeapSize(), Settings_MaxHeapSize());
-    Stack_Init(&stack, INITIAL_STACK_SIZE);
+    scalanative_gc_moves_objects = heap.evacuation.enabled;
+    scalanative_gc_generational = heap.generational;
     atexit(scalanative_afterexit);
 }
 
@@ -52,4 +73,38 @@ INLINE void *scalanative_alloc_atomic(void *info, size_t size) {
     return scalanative_alloc(info, size);
 }
 
-INLINE void scalanative_collect() { Heap_Collect(&heap, &stack); }
+INLINE void scalanative_collect() { Heap_Collect(&heap); }
+
+INLINE void scalanative_write_barrier(void *address) {
+    Heap_WriteBarrier(&heap, (word_t *)address);
+}
+
+void scalanative_write_barrier_range(void *address, size_t size) {
+    Heap_WriteBarrierRange(&heap, (word_t *)address, size);
+}
+
+void scalanative_pin(void *address) { Heap_Pin(&heap, (word_t *)address); }
+
+// Starts tracing into the file at `path`, or stops and writes the trace when it
+// is NULL, see Trace.h
+void scalanative_gc_trace(const char *path) { Trace_Set(path); }
+
+void scalanative_gc_stats(GCStats *stats) { Heap_Stats(&heap, stats); }
+
+// Collects the heap and writes the class histogram to `histogramPath` and the
+// dump to `dumpPath`, either may be NULL, see HeapDump.h
+bool scalanative_gc_heap_dump(const char *histogramPath, const char *dumpPath) {
+    return HeapDump_Collect(&heap, histogramPath, dumpPath);
+}
+
+// Only the stack of the main thread is scanned, no other thread may be started.
+int scalanative_pthread_create(pthread_t *thread, pthread_attr_t *attr,
+                               void *(*routine)(void *), void *arg) {
+    return ENOTSUP;
+}
+
+int scalanative_pthread_detach(pthread_t thread) {
+    return pthread_detach(thread);
+}
+
+void scalanative_pthread_exit(void *result) { pthread_exit(result); }
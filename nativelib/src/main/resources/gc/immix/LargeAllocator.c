@@ -47,9 +47,11 @@ void LargeAllocator_freeListInit(FreeList *freeList) {
 
 void LargeAllocator_Init(LargeAllocator *allocator,
                          BlockAllocator *blockAllocator, Bytemap *bytemap,
-                         word_t *blockMetaStart, word_t *heapStart) {
+                         word_t *blockMetaStart, word_t *crossingMetaStart,
+                         word_t *heapStart) {
     allocator->heapStart = heapStart;
     allocator->blockMetaStart = blockMetaStart;
+    allocator->crossingMetaStart = crossingMetaStart;
     allocator->bytemap = bytemap;
     allocator->blockAllocator = blockAllocator;
 
@@ -132,6 +134,8 @@ Object *LargeAllocator_GetBlock(LargeAllocator *allocator,
     ObjectMeta_SetAllocated(objectMeta);
     Object *object = (Object *)chunk;
     memset(object, 0, actualBlockSize);
+    Crossing_RecordObject(allocator->crossingMetaStart, allocator->heapStart,
+                          (word_t *)object, actualBlockSize);
     return object;
 }
 
@@ -143,7 +147,7 @@ void LargeAllocator_Clear(LargeAllocator *allocator) {
 }
 
 void LargeAllocator_Sweep(LargeAllocator *allocator, BlockMeta *blockMeta,
-                          word_t *blockStart) {
+                          word_t *blockStart, bool sticky) {
     // Objects that are larger than a block
     // are always allocated at the begining the smallest possible superblock.
     // Any gaps at the end can be filled with large objects, that are smaller
@@ -172,7 +176,11 @@ void LargeAllocator_Sweep(LargeAllocator *allocator, BlockMeta *blockMeta,
     if (!ObjectMeta_IsMarked(firstObject)) {
         chunkStart = lastBlockStart;
     }
-    ObjectMeta_Sweep(firstObject);
+    if (sticky) {
+        ObjectMeta_SweepSticky(firstObject);
+    } else {
+        ObjectMeta_Sweep(firstObject);
+    }
 
     word_t *current = lastBlockStart + (MIN_BLOCK_SIZE / WORD_SIZE);
     ObjectMeta *currentMeta = Bytemap_Get(allocator->bytemap, current);
@@ -191,7 +199,11 @@ void LargeAllocator_Sweep(LargeAllocator *allocator, BlockMeta *blockMeta,
                 chunkStart = NULL;
             }
         }
-        ObjectMeta_Sweep(currentMeta);
+        if (sticky) {
+            ObjectMeta_SweepSticky(currentMeta);
+        } else {
+            ObjectMeta_Sweep(currentMeta);
+        }
 
         current += MIN_BLOCK_SIZE / WORD_SIZE;
         currentMeta += MIN_BLOCK_SIZE / ALLOCATION_ALIGNMENT;
@@ -2,6 +2,7 @@
 #define IMMIX_LARGEALLOCATOR_H
 
 #include "datastructures/Bytemap.h"
+#include "metadata/CrossingMeta.h"
 #include "GCTypes.h"
 #include "Constants.h"
 #include "headers/ObjectHeader.h"
@@ -19,19 +20,21 @@ typedef struct {
     FreeList freeLists[FREE_LIST_COUNT];
     word_t *heapStart;
     word_t *blockMetaStart;
+    word_t *crossingMetaStart;
     Bytemap *bytemap;
     BlockAllocator *blockAllocator;
 } LargeAllocator;
 
 void LargeAllocator_Init(LargeAllocator *allocator,
                          BlockAllocator *blockAllocator, Bytemap *bytemap,
-                         word_t *blockMetaStart, word_t *heapStart);
+                         word_t *blockMetaStart, word_t *crossingMetaStart,
+                         word_t *heapStart);
 void LargeAllocator_AddChunk(LargeAllocator *allocator, Chunk *chunk,
                              size_t total_block_size);
 Object *LargeAllocator_GetBlock(LargeAllocator *allocator,
                                 size_t requestedBlockSize);
 void LargeAllocator_Clear(LargeAllocator *allocator);
 void LargeAllocator_Sweep(LargeAllocator *allocator, BlockMeta *blockMeta,
-                          word_t *blockStart);
+                          word_t *blockStart, bool sticky);
 
 #endif // IMMIX_LARGEALLOCATOR_H
@@ -1,29 +1,237 @@
 #include <stdio.h>
 #include <setjmp.h>
+#include <memory.h>
 #include "Marker.h"
 #include "Object.h"
 #include "Log.h"
 #include "State.h"
-#include "datastructures/Stack.h"
 #include "headers/ObjectHeader.h"
+#include "datastructures/GreyPacket.h"
 #include "Block.h"
+#include "GCThread.h"
+#include "Trace.h"
+#include <sched.h>
 
 extern word_t *__modules;
 extern int __modules_size;
 extern word_t **__stack_bottom;
 
-#define LAST_FIELD_OFFSET -1
+// LLVM's shadow stack, see ShadowStackGCLowering. With precise stack maps
+// every frame that has gcroot slots links a StackEntry into
+// llvm_gc_root_chain, the slots with metadata come first.
+typedef struct {
+    int32_t numRoots;
+    int32_t numMeta;
+    const void *meta[0];
+} FrameMap;
 
-void Marker_markObject(Heap *heap, Stack *stack, Bytemap *bytemap,
-                       Object *object, ObjectMeta *objectMeta) {
-    assert(ObjectMeta_IsAllocated(objectMeta));
+typedef struct StackEntry {
+    struct StackEntry *next;
+    const FrameMap *map;
+    word_t *roots[0];
+} StackEntry;
+
+// The generated code only has linkonce definitions of the chain, so this one
+// is used. It stays NULL unless the code was compiled with precise stack maps.
+StackEntry *llvm_gc_root_chain = NULL;
+
+// Marking follows the commix marker. Objects to trace are kept in grey packets,
+// fixed size lists taken from a separate memory region (see
+// heap->greyPacketsStart). Each marker traces the objects of its "in" packet
+// and puts the objects it marks into its "out" packet. Full packets go to the
+// marker's own work-stealing deque (see heap->mark.deques), or to the global
+// full packet list when the deque is full, and are stolen from the top of the
+// deques by the other markers. Marking is done when all the packets are empty
+// and in the empty packet list.
+//
+// The mutator traces the roots and keeps marking until everything is done.
+// While it does so it wakes up GC threads, depending on the number of full
+// packets, which mark in parallel and stop when they cannot find any more
+// work. The mark bytes are not synchronized, marking is idempotent. Two
+// markers can both mark and trace the same object, which costs less than a
+// compare-and-swap on every object.
+//
+// Evacuation copies objects and updates the references to them, which is only
+// correct if every object is traced exactly once. Collections that evacuate are
+// marked by the mutator alone.
+
+static inline GreyPacket *Marker_takeEmptyPacket(Heap *heap) {
+    GreyPacket *packet =
+        GreyList_Pop(&heap->mark.empty, heap->greyPacketsStart);
+    if (packet != NULL) {
+        // Another thread setting size = 0 might not arrived, just write it now.
+        // Avoiding a memfence.
+        packet->size = 0;
+        packet->type = grey_packet_reflist;
+    }
+    return packet;
+}
+
+static inline GreyPacket *Marker_steal(Heap *heap, GreyDeque *deque) {
+    GreyDeque *deques = heap->mark.deques;
+    int count = heap->gcThreads.count + 1;
+    int self = (int)(deque - deques);
+    for (int i = 1; i < count; i++) {
+        GreyDeque *victim = &deques[(self + i) % count];
+        // a failed steal means another marker took the packet, try again
+        // while there is something left
+        while (GreyDeque_Size(victim) > 0) {
+            GreyPacket *packet = GreyDeque_Steal(victim);
+            if (packet != NULL) {
+                return packet;
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline GreyPacket *Marker_takeFullPacket(Heap *heap, GreyDeque *deque) {
+    GreyPacket *packet = GreyDeque_Pop(deque);
+    if (packet == NULL) {
+        packet = GreyList_Pop(&heap->mark.full, heap->greyPacketsStart);
+        if (packet != NULL) {
+            atomic_thread_fence(memory_order_release);
+        } else {
+            // only stealing is traced, it is rare unless markers run out
+            uint64_t start_ns = Trace_Start();
+            packet = Marker_steal(heap, deque);
+            Trace_End(trace_sync, start_ns, 0);
+        }
+    }
+    assert(packet == NULL || packet->type == grey_packet_refrange ||
+           packet->size > 0);
+    return packet;
+}
+
+static inline void Marker_giveEmptyPacket(Heap *heap, GreyPacket *packet) {
+    assert(packet->size == 0);
+    // no memfence needed see Marker_takeEmptyPacket
+    GreyList_Push(&heap->mark.empty, heap->greyPacketsStart, packet);
+}
+
+static inline void Marker_giveFullPacket(Heap *heap, GreyDeque *deque,
+                                         GreyPacket *packet) {
+    assert(packet->type == grey_packet_refrange || packet->size > 0);
+    // make all the contents visible to other threads
+    atomic_thread_fence(memory_order_acquire);
+    if (!GreyDeque_Push(deque, packet)) {
+        // the own deque is full, overflow to the global list
+        assert(GreyList_Size(&heap->mark.full) <= heap->mark.total);
+        GreyList_Push(&heap->mark.full, heap->greyPacketsStart, packet);
+    }
+}
+
+static inline void Marker_push(Heap *heap, GreyDeque *deque,
+                               GreyPacket **outHolder, Object *object) {
+    GreyPacket *out = *outHolder;
+    if (!GreyPacket_Push(out, object)) {
+        Marker_giveFullPacket(heap, deque, out);
+        *outHolder = out = Marker_takeEmptyPacket(heap);
+        assert(out != NULL);
+        GreyPacket_Push(out, object);
+    }
+}
+
+void Marker_markObject(Heap *heap, GreyDeque *deque, GreyPacket **outHolder,
+                       Bytemap *bytemap, Object *object,
+                       ObjectMeta *objectMeta) {
+    assert(ObjectMeta_IsAllocated(objectMeta) ||
+           ObjectMeta_IsMarked(objectMeta));
 
     assert(Object_Size(object) != 0);
     Object_Mark(heap, object, objectMeta);
-    Stack_Push(stack, object);
+    Marker_push(heap, deque, outHolder, object);
+}
+
+/**
+ * Copies an object out of an evacuation candidate into a free block and leaves
+ * a forwarding pointer to the copy in place of its rtti. Returns NULL if the
+ * object has to be marked in place instead.
+ */
+Object *Marker_evacuate(Heap *heap, GreyDeque *deque, GreyPacket **outHolder,
+                        Bytemap *bytemap, Object *object,
+                        ObjectMeta *objectMeta) {
+    BlockMeta *blockMeta = Block_GetBlockMeta(
+        heap->blockMetaStart, heap->heapStart, (word_t *)object);
+    if (!BlockMeta_IsEvacuationCandidate(blockMeta) ||
+        Line_IsPinned(Heap_LineMetaForWord(heap, (word_t *)object))) {
+        return NULL;
+    }
+    size_t size = Object_Size(object);
+    if (size > heap->evacuation.budget) {
+        return NULL;
+    }
+    word_t *copy = Allocator_AllocEvacuated(&allocator, size);
+    if (copy == NULL) {
+        heap->evacuation.budget = 0;
+        return NULL;
+    }
+    heap->evacuation.budget -= size;
+    heap->evacuation.evacuatedBytes += size;
+
+    memcpy(copy, object, size);
+    ObjectMeta *copyMeta = Bytemap_Get(bytemap, copy);
+    ObjectMeta_SetAllocated(copyMeta);
+    Marker_markObject(heap, deque, outHolder, bytemap, (Object *)copy,
+                      copyMeta);
+
+    ObjectMeta_SetForwarded(objectMeta);
+    object->rtti = (Rtti *)copy;
+    return (Object *)copy;
 }
 
-void Marker_markConservative(Heap *heap, Stack *stack, word_t *address) {
+/**
+ * Marks the huge object that contains `word`, if there is one, see HugeSpace.
+ * Returns 1 if there is.
+ */
+static inline int Marker_markHuge(Heap *heap, GreyDeque *deque,
+                                  GreyPacket **outHolder, word_t *word) {
+    HugeObject *huge = HugeSpace_Find(&heap->hugeSpace, word);
+    if (huge == NULL) {
+        return 0;
+    }
+    if (!huge->marked) {
+        huge->marked = true;
+        Marker_push(heap, deque, outHolder, (Object *)huge->start);
+    }
+    return 1;
+}
+
+/**
+ * Marks the object referenced from a precise `slot`. During evacuation the
+ * slot is updated if the object has been moved. Returns 1 if the slot points
+ * into the heap.
+ */
+static inline int Marker_markSlot(Heap *heap, GreyDeque *deque,
+                                  GreyPacket **outHolder, Bytemap *bytemap,
+                                  word_t **slot) {
+    word_t *field = *slot;
+    if (Heap_IsWordInHeap(heap, field)) {
+        ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
+        if (ObjectMeta_IsAllocated(fieldMeta)) {
+            Object *copy = NULL;
+            if (heap->evacuation.active) {
+                copy = Marker_evacuate(heap, deque, outHolder, bytemap,
+                                       (Object *)field, fieldMeta);
+            }
+            if (copy != NULL) {
+                *slot = (word_t *)copy;
+            } else {
+                Marker_markObject(heap, deque, outHolder, bytemap,
+                                  (Object *)field, fieldMeta);
+            }
+        } else if (ObjectMeta_IsForwarded(fieldMeta)) {
+            *slot = (word_t *)((Object *)field)->rtti;
+        }
+        return 1;
+    } else if (HugeSpace_MayContain(&heap->hugeSpace, field)) {
+        return Marker_markHuge(heap, deque, outHolder, field);
+    }
+    return 0;
+}
+
+void Marker_markConservative(Heap *heap, GreyDeque *deque,
+                             GreyPacket **outHolder, word_t *address) {
     assert(Heap_IsWordInHeap(heap, address));
     Object *object = Object_GetUnmarkedObject(heap, address);
     Bytemap *bytemap = heap->bytemap;
@@ -31,52 +239,422 @@ void Marker_markConservative(Heap *heap, Stack *stack, word_t *address) {
         ObjectMeta *objectMeta = Bytemap_Get(bytemap, (word_t *)object);
         assert(ObjectMeta_IsAllocated(objectMeta));
         if (ObjectMeta_IsAllocated(objectMeta)) {
-            Marker_markObject(heap, stack, bytemap, object, objectMeta);
+            Marker_markObject(heap, deque, outHolder, bytemap, object,
+                              objectMeta);
         }
     }
 }
 
-void Marker_Mark(Heap *heap, Stack *stack) {
-    Bytemap *bytemap = heap->bytemap;
-    while (!Stack_IsEmpty(stack)) {
-        Object *object = Stack_Pop(stack);
+static inline void Marker_prefetchFieldMeta(Heap *heap, Bytemap *bytemap,
+                                            word_t *field) {
+    if (heap->markPrefetchDistance > 0 && Heap_IsWordInHeap(heap, field)) {
+        // rw = 1 => the metadata is written when the field gets marked
+        __builtin_prefetch(Bytemap_Get(bytemap, field), 1, 3);
+    }
+}
+
+int Marker_markRange(Heap *heap, GreyDeque *deque, GreyPacket **outHolder,
+                     Bytemap *bytemap, word_t **fields, size_t length) {
+    int objectsTraced = 0;
+    word_t **limit = fields + length;
+    // the metadata of a batch of fields is fetched in parallel
+    for (word_t **batch = fields; batch < limit;
+         batch += MARK_PREFETCH_FIELDS) {
+        word_t **batchLimit = batch + MARK_PREFETCH_FIELDS;
+        if (batchLimit > limit) {
+            batchLimit = limit;
+        }
+        for (word_t **current = batch; current < batchLimit; current++) {
+            Marker_prefetchFieldMeta(heap, bytemap, *current);
+        }
+        for (word_t **current = batch; current < batchLimit; current++) {
+            objectsTraced +=
+                Marker_markSlot(heap, deque, outHolder, bytemap, current);
+        }
+    }
+    return objectsTraced;
+}
+
+int Marker_markRegularObject(Heap *heap, GreyDeque *deque, Object *object,
+                             GreyPacket **outHolder, Bytemap *bytemap) {
+    int objectsTraced = 0;
+    uint64_t refMapBits = object->rtti->refMapBits;
+    if (refMapBits != 0) {
+        // visits the set bits from the lowest, clearing each one in turn
+        for (uint64_t bits = refMapBits; bits != 0; bits &= bits - 1) {
+            Marker_prefetchFieldMeta(heap, bytemap,
+                                     object->fields[__builtin_ctzll(bits)]);
+        }
+        for (uint64_t bits = refMapBits; bits != 0; bits &= bits - 1) {
+            objectsTraced +=
+                Marker_markSlot(heap, deque, outHolder, bytemap,
+                                &object->fields[__builtin_ctzll(bits)]);
+        }
+    } else {
+        int64_t *ptr_map = object->rtti->refMapStruct;
+        for (int64_t *current = ptr_map; *current != LAST_FIELD_OFFSET;
+             current++) {
+            Marker_prefetchFieldMeta(heap, bytemap, object->fields[*current]);
+        }
+        for (int64_t *current = ptr_map; *current != LAST_FIELD_OFFSET;
+             current++) {
+            objectsTraced += Marker_markSlot(heap, deque, outHolder, bytemap,
+                                             &object->fields[*current]);
+        }
+    }
+    return objectsTraced;
+}
+
+int Marker_splitObjectArray(Heap *heap, GreyDeque *deque,
+                            GreyPacket **outHolder, Bytemap *bytemap,
+                            word_t **fields, size_t length) {
+    word_t **limit = fields + length;
+    word_t **lastBatch =
+        fields + (length / ARRAY_SPLIT_BATCH) * ARRAY_SPLIT_BATCH;
+
+    assert(lastBatch <= limit);
+    for (word_t **batchFields = fields; batchFields < lastBatch;
+         batchFields += ARRAY_SPLIT_BATCH) {
+        GreyPacket *slice = Marker_takeEmptyPacket(heap);
+        if (slice == NULL) {
+            // out of packets, the rest of the array is marked right away
+            lastBatch = batchFields;
+            break;
+        }
+        slice->type = grey_packet_refrange;
+        slice->items[0] = (Stack_Type)batchFields;
+        // no point writing the size, because it is constant
+        Marker_giveFullPacket(heap, deque, slice);
+    }
+
+    size_t lastBatchSize = limit - lastBatch;
+    int objectsTraced = 0;
+    if (lastBatchSize > 0) {
+        objectsTraced = Marker_markRange(heap, deque, outHolder, bytemap,
+                                         lastBatch, lastBatchSize);
+    }
+    return objectsTraced;
+}
 
+int Marker_markObjectArray(Heap *heap, GreyDeque *deque, Object *object,
+                           GreyPacket **outHolder, Bytemap *bytemap) {
+    ArrayHeader *arrayHeader = (ArrayHeader *)object;
+    size_t length = arrayHeader->length;
+    word_t **fields = (word_t **)(arrayHeader + 1);
+    int objectsTraced;
+    if (length <= ARRAY_SPLIT_THRESHOLD) {
+        objectsTraced = Marker_markRange(heap, deque, outHolder, bytemap,
+                                         fields, length);
+    } else {
+        // object array is two large, split it into pieces for multiple threads
+        // to handle
+        objectsTraced = Marker_splitObjectArray(heap, deque, outHolder,
+                                                bytemap, fields, length);
+    }
+    return objectsTraced;
+}
+
+static inline void Marker_splitIncomingPacket(Heap *heap, GreyDeque *deque,
+                                              GreyPacket *in) {
+    int toMove = in->size / 2;
+    if (toMove > 0) {
+        GreyPacket *slice = Marker_takeEmptyPacket(heap);
+        if (slice != NULL) {
+            GreyPacket_MoveItems(in, slice, toMove);
+            Marker_giveFullPacket(heap, deque, slice);
+        }
+    }
+}
+
+void Marker_markPacket(Heap *heap, GreyDeque *deque, GreyPacket *in,
+                       GreyPacket **outHolder) {
+    Bytemap *bytemap = heap->bytemap;
+    int objectsTraced = 0;
+    // The packet is popped from the top, so it acts as the prefetch FIFO:
+    // the object scanned `distance` pops later is fetched now.
+    int distance = heap->markPrefetchDistance;
+    if (distance > 0) {
+        int prefetched = in->size - distance;
+        for (int i = prefetched < 0 ? 0 : prefetched; i < in->size; i++) {
+            __builtin_prefetch(in->items[i], 0, 3);
+        }
+    }
+    while (!GreyPacket_IsEmpty(in)) {
+        if (distance > 0 && in->size > distance) {
+            __builtin_prefetch(in->items[in->size - 1 - distance], 0, 3);
+        }
+        Object *object = GreyPacket_Pop(in);
         if (Object_IsArray(object)) {
             if (object->rtti->rt.id == __object_array_id) {
-                ArrayHeader *arrayHeader = (ArrayHeader *)object;
-                size_t length = arrayHeader->length;
-                word_t **fields = (word_t **)(arrayHeader + 1);
-                for (int i = 0; i < length; i++) {
-                    word_t *field = fields[i];
-                    if (Heap_IsWordInHeap(heap, field)) {
-                        ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
-                        if (ObjectMeta_IsAllocated(fieldMeta)) {
-                            Marker_markObject(heap, stack, bytemap,
-                                              (Object *)field, fieldMeta);
-                        }
-                    }
-                }
+                objectsTraced += Marker_markObjectArray(heap, deque, object,
+                                                        outHolder, bytemap);
             }
             // non-object arrays do not contain pointers
         } else {
-            int64_t *ptr_map = object->rtti->refMapStruct;
-            int i = 0;
-            while (ptr_map[i] != LAST_FIELD_OFFSET) {
-                word_t *field = object->fields[ptr_map[i]];
-                if (Heap_IsWordInHeap(heap, field)) {
-                    ObjectMeta *fieldMeta = Bytemap_Get(bytemap, field);
-                    if (ObjectMeta_IsAllocated(fieldMeta)) {
-                        Marker_markObject(heap, stack, bytemap, (Object *)field,
-                                          fieldMeta);
+            objectsTraced += Marker_markRegularObject(heap, deque, object,
+                                                      outHolder, bytemap);
+        }
+        if (objectsTraced > MARK_MAX_WORK_PER_PACKET) {
+            // the packet has a lot of work split the remainder in two
+            Marker_splitIncomingPacket(heap, deque, in);
+            objectsTraced = 0;
+        }
+    }
+}
+
+void Marker_markRangePacket(Heap *heap, GreyDeque *deque, GreyPacket *in,
+                            GreyPacket **outHolder) {
+    word_t **fields = (word_t **)in->items[0];
+    Marker_markRange(heap, deque, outHolder, heap->bytemap, fields,
+                     ARRAY_SPLIT_BATCH);
+    in->type = grey_packet_reflist;
+    in->size = 0;
+}
+
+static inline void Marker_markBatch(Heap *heap, GreyDeque *deque,
+                                    GreyPacket *in, GreyPacket **outHolder) {
+    if (*outHolder == NULL) {
+        GreyPacket *fresh = Marker_takeEmptyPacket(heap);
+        assert(fresh != NULL);
+        *outHolder = fresh;
+    }
+    switch (in->type) {
+    case grey_packet_reflist:
+        Marker_markPacket(heap, deque, in, outHolder);
+        break;
+    case grey_packet_refrange:
+        Marker_markRangePacket(heap, deque, in, outHolder);
+        break;
+    }
+}
+
+/**
+ * Estimates the number of full packets in the global list and all the deques.
+ */
+static inline uint32_t Marker_fullPacketCount(Heap *heap) {
+    uint32_t count = GreyList_Size(&heap->mark.full);
+    int dequeCount = heap->gcThreads.count + 1;
+    for (int i = 0; i < dequeCount; i++) {
+        count += GreyDeque_Size(&heap->mark.deques[i]);
+    }
+    return count;
+}
+
+/**
+ * Marks until no full packet is left. The mutator passes `scale` to wake up
+ * GC threads as long as there is enough work for them.
+ */
+static inline void Marker_mark(Heap *heap, GreyDeque *deque, bool scale) {
+    GreyPacket *in = Marker_takeFullPacket(heap, deque);
+    GreyPacket *out = NULL;
+    while (in != NULL) {
+        Marker_markBatch(heap, deque, in, &out);
+
+        assert(out != NULL);
+        assert(GreyPacket_IsEmpty(in));
+        GreyPacket *next = Marker_takeFullPacket(heap, deque);
+        if (next != NULL) {
+            Marker_giveEmptyPacket(heap, in);
+            if (scale) {
+                GCThread_ScaleMarkerThreads(heap,
+                                            Marker_fullPacketCount(heap));
+            }
+        } else {
+            if (!GreyPacket_IsEmpty(out)) {
+                // use the out packet as source
+                next = out;
+                out = in;
+            } else {
+                // next == NULL, exits
+                Marker_giveEmptyPacket(heap, in);
+                Marker_giveEmptyPacket(heap, out);
+            }
+        }
+        in = next;
+    }
+}
+
+void Marker_Mark(Heap *heap, GreyDeque *deque) {
+    Marker_mark(heap, deque, false);
+}
+
+void Marker_MarkUntilDone(Heap *heap) {
+    GreyDeque *deque = Heap_MutatorDeque(heap);
+    // see the comment on evacuation at the top
+    bool scale = !heap->evacuation.active && heap->gcThreads.count > 0;
+    while (!Marker_IsMarkDone(heap)) {
+        Marker_mark(heap, deque, scale);
+        if (!Marker_IsMarkDone(heap)) {
+            sched_yield();
+        }
+    }
+    // GC threads that were woken up late find no work, but they still have to
+    // stop looking for it before the heap is swept
+    while (GCThread_AnyActive(heap)) {
+        sched_yield();
+    }
+}
+
+/**
+ * Scans the part of a remembered old object that lies on a dirty card. Object
+ * arrays are only scanned within the card, other objects are scanned whole.
+ */
+void Marker_markRememberedObject(Heap *heap, GreyDeque *deque,
+                                 GreyPacket **outHolder, Object *object,
+                                 word_t *cardStart, word_t *cardEnd) {
+    if (Object_IsArray(object)) {
+        if (object->rtti->rt.id == __object_array_id) {
+            ArrayHeader *arrayHeader = (ArrayHeader *)object;
+            word_t **fields = (word_t **)(arrayHeader + 1);
+            word_t **end = fields + arrayHeader->length;
+            if (fields < (word_t **)cardStart) {
+                fields = (word_t **)cardStart;
+            }
+            if (end > (word_t **)cardEnd) {
+                end = (word_t **)cardEnd;
+            }
+            if (fields < end) {
+                Marker_markRange(heap, deque, outHolder, heap->bytemap,
+                                 fields, end - fields);
+            }
+        }
+    } else {
+        Marker_push(heap, deque, outHolder, object);
+    }
+}
+
+void Marker_markCard(Heap *heap, GreyDeque *deque, GreyPacket **outHolder,
+                     word_t *cardStart) {
+    BlockMeta *blockMeta =
+        Block_GetBlockMeta(heap->blockMetaStart, heap->heapStart, cardStart);
+    if (BlockMeta_IsFree(blockMeta)) {
+        return;
+    }
+    word_t *cardEnd = cardStart + WORDS_IN_CARD;
+
+    // the object overlapping the start of the card
+    Object *object = Object_GetMarkedObject(heap, cardStart);
+    if (object != NULL) {
+        Marker_markRememberedObject(heap, deque, outHolder, object, cardStart,
+                                    cardEnd);
+    }
+
+    // large objects are aligned to MIN_BLOCK_SIZE, so only a single one can
+    // start on a card
+    if (!BlockMeta_ContainsLargeObjects(blockMeta)) {
+        ObjectMeta *cursor = Bytemap_Get(heap->bytemap, cardStart);
+        for (word_t *current = cardStart + ALLOCATION_ALIGNMENT_WORDS;
+             current < cardEnd; current += ALLOCATION_ALIGNMENT_WORDS) {
+            cursor++;
+            if (ObjectMeta_IsMarked(cursor)) {
+                Marker_markRememberedObject(heap, deque, outHolder,
+                                            (Object *)current, cardStart,
+                                            cardEnd);
+            }
+        }
+    }
+}
+
+/**
+ * The dirty cards of old huge objects are roots of a young collection as well.
+ * Their cards are cleared like the ones of the heap.
+ */
+void Marker_markDirtyHugeCards(Heap *heap, GreyDeque *deque,
+                               GreyPacket **outHolder) {
+    HugeSpace *space = &heap->hugeSpace;
+    for (uint32_t i = 0; i < space->count; i++) {
+        HugeObject *huge = &space->objects[i];
+        uint64_t *cursor = (uint64_t *)huge->cards;
+        uint64_t *end = cursor + HugeObject_CardCount(huge->size) /
+                                     sizeof(uint64_t);
+        for (; cursor < end; cursor++) {
+            // skips eight clean cards at once
+            if (*cursor == 0) {
+                continue;
+            }
+            CardMeta *cardMeta = (CardMeta *)cursor;
+            for (int j = 0; j < sizeof(uint64_t); j++, cardMeta++) {
+                if (Card_IsDirty(cardMeta)) {
+                    Card_Clear(cardMeta);
+                    // young huge objects are traced whole if they survive
+                    if (huge->marked) {
+                        word_t *cardStart =
+                            huge->start +
+                            (cardMeta - huge->cards) * WORDS_IN_CARD;
+                        Marker_markRememberedObject(
+                            heap, deque, outHolder, (Object *)huge->start,
+                            cardStart, cardStart + WORDS_IN_CARD);
                     }
                 }
-                ++i;
             }
         }
     }
 }
 
-void Marker_markProgramStack(Heap *heap, Stack *stack) {
+/**
+ * Old objects on dirty cards are roots of a young collection. All cards are
+ * clean afterwards, because every survivor of a young collection is old.
+ */
+void Marker_markDirtyCards(Heap *heap, GreyDeque *deque,
+                           GreyPacket **outHolder) {
+    assert(CARD_COUNT % sizeof(uint64_t) == 0);
+    uint64_t *cursor = (uint64_t *)heap->cardMetaStart;
+    uint64_t *end = (uint64_t *)heap->cardMetaEnd;
+    for (; cursor < end; cursor++) {
+        // skips eight clean cards at once
+        if (*cursor != 0) {
+            CardMeta *cardMeta = (CardMeta *)cursor;
+            for (int i = 0; i < sizeof(uint64_t); i++, cardMeta++) {
+                if (Card_IsDirty(cardMeta)) {
+                    Card_Clear(cardMeta);
+                    Marker_markCard(heap, deque, outHolder,
+                                    Heap_CardStart(heap, cardMeta));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Marks the roots in the gcroot slots of the shadow stack. Reference slots
+ * hold the start of an object, raw pointer slots may point inside one and are
+ * marked conservatively.
+ */
+void Marker_markShadowStack(Heap *heap, GreyDeque *deque,
+                            GreyPacket **outHolder) {
+    Bytemap *bytemap = heap->bytemap;
+    for (StackEntry *entry = llvm_gc_root_chain; entry != NULL;
+         entry = entry->next) {
+        int32_t numMeta = entry->map->numMeta;
+        int32_t numRoots = entry->map->numRoots;
+        for (int32_t i = 0; i < numRoots; i++) {
+            word_t *root = entry->roots[i];
+            if (!Heap_IsWordInHeap(heap, root)) {
+                if (HugeSpace_MayContain(&heap->hugeSpace, root)) {
+                    Marker_markHuge(heap, deque, outHolder, root);
+                }
+                continue;
+            }
+            if (i < numMeta) {
+                Marker_markConservative(heap, deque, outHolder, root);
+            } else {
+                ObjectMeta *rootMeta = Bytemap_Get(bytemap, root);
+                if (ObjectMeta_IsAllocated(rootMeta)) {
+                    Marker_markObject(heap, deque, outHolder, bytemap,
+                                      (Object *)root, rootMeta);
+                }
+            }
+        }
+    }
+}
+
+void Marker_markProgramStack(Heap *heap, GreyDeque *deque,
+                             GreyPacket **outHolder) {
+    if (llvm_gc_root_chain != NULL) {
+        Marker_markShadowStack(heap, deque, outHolder);
+        return;
+    }
+
     // Dumps registers into 'regs' which is on stack
     jmp_buf regs;
     setjmp(regs);
@@ -89,33 +667,47 @@ void Marker_markProgramStack(Heap *heap, Stack *stack) {
 
         word_t *stackObject = *current;
         if (Heap_IsWordInHeap(heap, stackObject)) {
-            Marker_markConservative(heap, stack, stackObject);
+            Marker_markConservative(heap, deque, outHolder, stackObject);
+        } else if (HugeSpace_MayContain(&heap->hugeSpace, stackObject)) {
+            Marker_markHuge(heap, deque, outHolder, stackObject);
         }
         current += 1;
     }
 }
 
-void Marker_markModules(Heap *heap, Stack *stack) {
+void Marker_markModules(Heap *heap, GreyDeque *deque,
+                        GreyPacket **outHolder) {
     word_t **modules = &__modules;
     int nb_modules = __modules_size;
     Bytemap *bytemap = heap->bytemap;
     for (int i = 0; i < nb_modules; i++) {
-        Object *object = (Object *)modules[i];
-        if (Heap_IsWordInHeap(heap, (word_t *)object)) {
-            // is within heap
-            ObjectMeta *objectMeta = Bytemap_Get(bytemap, (word_t *)object);
-            if (ObjectMeta_IsAllocated(objectMeta)) {
-                Marker_markObject(heap, stack, bytemap, object, objectMeta);
-            }
-        }
+        Marker_markSlot(heap, deque, outHolder, bytemap, &modules[i]);
     }
 }
 
-void Marker_MarkRoots(Heap *heap, Stack *stack) {
+void Marker_MarkRoots(Heap *heap, bool young) {
+    GreyDeque *deque = Heap_MutatorDeque(heap);
+    GreyPacket *out = Marker_takeEmptyPacket(heap);
+    assert(out != NULL);
+    if (young) {
+        Marker_markDirtyCards(heap, deque, &out);
+        Marker_markDirtyHugeCards(heap, deque, &out);
+    }
 
-    Marker_markProgramStack(heap, stack);
+    // The stack is scanned conservatively, so the objects it references are
+    // pinned. They are marked before anything is evacuated. The same holds for
+    // the shadow stack, its slots are copies of values kept in registers.
+    Marker_markProgramStack(heap, deque, &out);
 
-    Marker_markModules(heap, stack);
+    Marker_markModules(heap, deque, &out);
+    if (GreyPacket_IsEmpty(out)) {
+        // a young collection can find all the roots already marked
+        Marker_giveEmptyPacket(heap, out);
+    } else {
+        Marker_giveFullPacket(heap, deque, out);
+    }
+}
 
-    Marker_Mark(heap, stack);
+bool Marker_IsMarkDone(Heap *heap) {
+    return GreyList_Size(&heap->mark.empty) == heap->mark.total;
 }
@@ -2,9 +2,11 @@
 #define IMMIX_MARKER_H
 
 #include "Heap.h"
-#include "datastructures/Stack.h"
+#include "datastructures/GreyDeque.h"
 
-void Marker_MarkRoots(Heap *heap, Stack *stack);
-void Marker_Mark(Heap *heap, Stack *stack);
+void Marker_MarkRoots(Heap *heap, bool young);
+void Marker_Mark(Heap *heap, GreyDeque *deque);
+void Marker_MarkUntilDone(Heap *heap);
+bool Marker_IsMarkDone(Heap *heap);
 
 #endif // IMMIX_MARKER_H
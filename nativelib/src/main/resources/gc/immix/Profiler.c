@@ -0,0 +1,372 @@
+#include "Profiler.h"
+#include "Constants.h"
+#include "StackTrace.h"
+#include "Object.h"
+#include "../../pprof/Pprof.h"
+#include <math.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// buckets of the tables of stacks and of sites
+#define PROFILER_TABLE_SIZE 4096
+// characters of a class name in the profile
+#define PROFILER_NAME_SIZE 256
+
+extern long long scalanative_nano_time();
+
+// the entry points of allocations, their frames and the ones they call are
+// left out of the stacks
+void *scalanative_alloc(void *info, size_t size);
+void *scalanative_alloc_small(void *info, size_t size);
+void *scalanative_alloc_large(void *info, size_t size);
+void *scalanative_alloc_atomic(void *info, size_t size);
+
+typedef struct ProfilerStack {
+    struct ProfilerStack *next;
+    uint64_t hash;
+    int depth;
+    // return addresses, innermost first
+    uintptr_t addresses[];
+} ProfilerStack;
+
+// what was sampled at a stack for a class, scaled to estimate all allocations
+typedef struct ProfilerSite {
+    struct ProfilerSite *next;
+    ProfilerStack *stack;
+    Rtti *rtti;
+    double allocObjects;
+    double allocBytes;
+    double inuseObjects;
+    double inuseBytes;
+} ProfilerSite;
+
+typedef struct {
+    word_t *object;
+    // NULL until the class of the object is known, which is after the
+    // allocation returns
+    ProfilerSite *site;
+    ProfilerStack *stack;
+    uint64_t size;
+    // the allocations the sample stands for
+    double weight;
+} ProfilerSample;
+
+static char *Profiler_path = NULL;
+static double Profiler_interval = 0;
+static uint64_t Profiler_random = 0;
+static uint64_t Profiler_start_ns = 0;
+static uint64_t Profiler_startTime_ns = 0;
+static volatile atomic_bool Profiler_dumpRequested = false;
+static ProfilerStack *Profiler_stacks[PROFILER_TABLE_SIZE];
+static ProfilerSite *Profiler_sites[PROFILER_TABLE_SIZE];
+// the samples of objects that may still be alive
+static ProfilerSample *Profiler_samples = NULL;
+static size_t Profiler_sampleCount = 0;
+static size_t Profiler_sampleCapacity = 0;
+
+static void Profiler_onSignal(int signal) {
+    atomic_store(&Profiler_dumpRequested, true);
+}
+
+/**
+ * Dumps the profile on SIGUSR2 unless the program handles the signal itself.
+ */
+static void Profiler_installSignalHandler() {
+    struct sigaction previous;
+    if (sigaction(SIGUSR2, NULL, &previous) != 0 ||
+        previous.sa_handler != SIG_DFL) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Profiler_onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR2, &action, NULL);
+}
+
+/**
+ * Turns the profiler on if `path` is not NULL, the profile is written there.
+ */
+void Profiler_Init(const char *path, size_t interval) {
+    if (path == NULL) {
+        return;
+    }
+    Profiler_path = strdup(path);
+    if (Profiler_path == NULL) {
+        return;
+    }
+    Profiler_interval = (double)interval;
+    Profiler_start_ns = scalanative_nano_time();
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    Profiler_startTime_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    Profiler_random = Profiler_start_ns ^ ((uint64_t)getpid() << 32);
+    if (Profiler_random == 0) {
+        Profiler_random = 1;
+    }
+    Profiler_installSignalHandler();
+}
+
+bool Profiler_Enabled() { return Profiler_path != NULL; }
+
+/**
+ * Returns a number in (0, 1], xorshift64*.
+ */
+static double Profiler_uniform() {
+    uint64_t x = Profiler_random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    Profiler_random = x;
+    return ((x * 2685821657736338717ULL >> 11) + 1) * 0x1.0p-53;
+}
+
+/**
+ * Returns the bytes to allocate until the next sample, UINT64_MAX if the
+ * profiler is off.
+ */
+uint64_t Profiler_NextSampleDistance() {
+    if (!Profiler_Enabled()) {
+        return UINT64_MAX;
+    }
+    return (uint64_t)(-log(Profiler_uniform()) * Profiler_interval) + 1;
+}
+
+static bool Profiler_isEntryPoint(unw_word_t start) {
+    return start == (unw_word_t)scalanative_alloc ||
+           start == (unw_word_t)scalanative_alloc_small ||
+           start == (unw_word_t)scalanative_alloc_large ||
+           start == (unw_word_t)scalanative_alloc_atomic;
+}
+
+/**
+ * Fills `addresses` with the stack above the entry point of the allocation,
+ * or the whole stack if there is none, and returns its depth.
+ */
+static int Profiler_captureStack(uintptr_t *addresses) {
+    unw_cursor_t cursor;
+    unw_context_t context;
+    unw_getcontext(&context);
+    unw_init_local(&cursor, &context);
+    int depth = 0;
+    bool inProgram = false;
+    while (depth < PROFILER_MAX_DEPTH && unw_step(&cursor) > 0) {
+        unw_word_t ip;
+        unw_get_reg(&cursor, UNW_REG_IP, &ip);
+        if (ip == 0) {
+            break;
+        }
+        if (!inProgram) {
+            unw_proc_info_t info;
+            if (unw_get_proc_info(&cursor, &info) == 0 &&
+                Profiler_isEntryPoint(info.start_ip)) {
+                depth = 0;
+                inProgram = true;
+                continue;
+            }
+        }
+        addresses[depth++] = ip;
+    }
+    return depth;
+}
+
+static uint64_t Profiler_hash(const void *data, size_t size, uint64_t hash) {
+    // FNV-1a
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Returns the stack with these addresses, which is only stored once. Returns
+ * NULL if the memory ran out.
+ */
+static ProfilerStack *Profiler_internStack(uintptr_t *addresses, int depth) {
+    size_t size = depth * sizeof(uintptr_t);
+    uint64_t hash = Profiler_hash(addresses, size, 14695981039346656037ULL);
+    ProfilerStack **bucket = &Profiler_stacks[hash % PROFILER_TABLE_SIZE];
+    for (ProfilerStack *stack = *bucket; stack != NULL; stack = stack->next) {
+        if (stack->hash == hash && stack->depth == depth &&
+            memcmp(stack->addresses, addresses, size) == 0) {
+            return stack;
+        }
+    }
+    ProfilerStack *stack = malloc(sizeof(ProfilerStack) + size);
+    if (stack == NULL) {
+        return NULL;
+    }
+    stack->hash = hash;
+    stack->depth = depth;
+    memcpy(stack->addresses, addresses, size);
+    stack->next = *bucket;
+    *bucket = stack;
+    return stack;
+}
+
+static ProfilerSite *Profiler_site(ProfilerStack *stack, Rtti *rtti) {
+    uint64_t hash = Profiler_hash(&rtti, sizeof(rtti), stack->hash);
+    ProfilerSite **bucket = &Profiler_sites[hash % PROFILER_TABLE_SIZE];
+    for (ProfilerSite *site = *bucket; site != NULL; site = site->next) {
+        if (site->stack == stack && site->rtti == rtti) {
+            return site;
+        }
+    }
+    ProfilerSite *site = calloc(1, sizeof(ProfilerSite));
+    if (site == NULL) {
+        return NULL;
+    }
+    site->stack = stack;
+    site->rtti = rtti;
+    site->next = *bucket;
+    *bucket = site;
+    return site;
+}
+
+/**
+ * Counts the allocation of the sample at the site of its class. Returns false
+ * if the memory ran out.
+ */
+static bool Profiler_resolve(ProfilerSample *sample, Rtti *rtti, bool alive) {
+    ProfilerSite *site = Profiler_site(sample->stack, rtti);
+    if (site == NULL) {
+        return false;
+    }
+    sample->site = site;
+    site->allocObjects += sample->weight;
+    site->allocBytes += sample->weight * sample->size;
+    if (alive) {
+        site->inuseObjects += sample->weight;
+        site->inuseBytes += sample->weight * sample->size;
+    }
+    return true;
+}
+
+static void Profiler_dump() {
+    atomic_store(&Profiler_dumpRequested, false);
+    // the objects of the samples not yet resolved are alive until the next
+    // collection says otherwise
+    for (size_t i = 0; i < Profiler_sampleCount; i++) {
+        ProfilerSample *sample = &Profiler_samples[i];
+        if (sample->site == NULL) {
+            Profiler_resolve(sample, ((Object *)sample->object)->rtti, true);
+        }
+    }
+    PprofValueType sampleTypes[] = {{"alloc_objects", "count"},
+                                    {"alloc_space", "bytes"},
+                                    {"inuse_objects", "count"},
+                                    {"inuse_space", "bytes"}};
+    PprofValueType periodType = {"space", "bytes"};
+    Pprof *pprof = Pprof_Create(sampleTypes, 4, periodType,
+                                (int64_t)Profiler_interval);
+    if (pprof == NULL) {
+        fprintf(stderr, "GC profile: cannot write %s\n", Profiler_path);
+        return;
+    }
+    char name[PROFILER_NAME_SIZE];
+    for (int i = 0; i < PROFILER_TABLE_SIZE; i++) {
+        for (ProfilerSite *site = Profiler_sites[i]; site != NULL;
+             site = site->next) {
+            int64_t values[] = {llround(site->allocObjects),
+                                llround(site->allocBytes),
+                                llround(site->inuseObjects),
+                                llround(site->inuseBytes)};
+            Object_ClassName(site->rtti, name, sizeof(name));
+            Pprof_AddSample(pprof, site->stack->addresses, site->stack->depth,
+                            values, "object", name);
+        }
+    }
+    uint64_t duration_ns = scalanative_nano_time() - Profiler_start_ns;
+    if (!Pprof_Write(pprof, Profiler_path, Profiler_startTime_ns,
+                     duration_ns)) {
+        fprintf(stderr, "GC profile: cannot write %s\n", Profiler_path);
+    }
+    Pprof_Free(pprof);
+}
+
+/**
+ * Records the allocation of `object`, called by the slow paths once the
+ * allocator reaches the sample point.
+ */
+void Profiler_Sample(word_t *object, size_t size) {
+    if (!Profiler_Enabled()) {
+        return;
+    }
+    // before the sample, whose object has no class yet
+    if (atomic_load_explicit(&Profiler_dumpRequested, memory_order_relaxed)) {
+        Profiler_dump();
+    }
+    if (Profiler_sampleCount == Profiler_sampleCapacity) {
+        size_t capacity =
+            Profiler_sampleCapacity == 0 ? 1024 : 2 * Profiler_sampleCapacity;
+        ProfilerSample *samples =
+            realloc(Profiler_samples, capacity * sizeof(ProfilerSample));
+        if (samples == NULL) {
+            return;
+        }
+        Profiler_samples = samples;
+        Profiler_sampleCapacity = capacity;
+    }
+    uintptr_t addresses[PROFILER_MAX_DEPTH];
+    int depth = Profiler_captureStack(addresses);
+    ProfilerStack *stack = Profiler_internStack(addresses, depth);
+    if (stack == NULL) {
+        return;
+    }
+    ProfilerSample *sample = &Profiler_samples[Profiler_sampleCount++];
+    sample->object = object;
+    sample->site = NULL;
+    sample->stack = stack;
+    sample->size = size;
+    // an object of this size is sampled with the probability
+    // 1 - exp(-size / interval)
+    sample->weight = 1 / (1 - exp(-(double)size / Profiler_interval));
+}
+
+/**
+ * Called after marking, before the heap is swept. Forgets the samples of dead
+ * objects and follows the ones that moved. The classes of the objects sampled
+ * since the last collection are read now, from the old copy for those that
+ * are dead.
+ */
+void Profiler_OnMarked(void *heap, ProfilerSurvivor survivor) {
+    if (!Profiler_Enabled()) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < Profiler_sampleCount; i++) {
+        ProfilerSample sample = Profiler_samples[i];
+        word_t *object = survivor(heap, sample.object);
+        if (sample.site == NULL) {
+            word_t *copy = object != NULL ? object : sample.object;
+            if (!Profiler_resolve(&sample, ((Object *)copy)->rtti,
+                                  object != NULL)) {
+                continue;
+            }
+        } else if (object == NULL) {
+            sample.site->inuseObjects -= sample.weight;
+            sample.site->inuseBytes -= sample.weight * sample.size;
+        }
+        if (object != NULL) {
+            sample.object = object;
+            Profiler_samples[kept++] = sample;
+        }
+    }
+    Profiler_sampleCount = kept;
+    if (atomic_load_explicit(&Profiler_dumpRequested, memory_order_relaxed)) {
+        Profiler_dump();
+    }
+}
+
+void Profiler_OnExit() {
+    if (Profiler_Enabled()) {
+        Profiler_dump();
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef IMMIX_PROFILER_H
+#define IMMIX_PROFILER_H
+
+#include "GCTypes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Samples allocations on average once every `interval` bytes, with the
+// distances between samples drawn from an exponential distribution so that
+// every allocated byte is equally likely to be sampled. Each sample keeps the
+// stack of the allocation and, once known, the class of the object. Samples
+// are followed across collections to tell which allocations are still in use.
+//
+// The profile is written in the pprof format to PROFILE_FILE_SETTING when the
+// program exits, or after SIGUSR2 at the next sample or collection. Only the
+// allocation slow paths call the profiler, see `Allocator_ArmSample`.
+
+// Returns where `object` is after marking, or NULL if it is dead.
+typedef word_t *(*ProfilerSurvivor)(void *heap, word_t *object);
+
+void Profiler_Init(const char *path, size_t interval);
+bool Profiler_Enabled();
+uint64_t Profiler_NextSampleDistance();
+void Profiler_Sample(word_t *object, size_t size);
+void Profiler_OnMarked(void *heap, ProfilerSurvivor survivor);
+void Profiler_OnExit();
+
+#endif // IMMIX_PROFILER_H
@@ -1,9 +1,11 @@
 #include "Settings.h"
 #include "Constants.h"
+#include "Container.h"
 #include "metadata/BlockMeta.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 /*
  Accepts number of bytes or number with a suffix letter for indicating the units.
@@ -62,4 +64,171 @@ size_t Settings_MaxHeapSize() {
 
 char *Settings_StatsFileName() {
     return getenv(STATS_FILE_SETTING);
-}
\ No newline at end of file
+}
+
+/*
+ Opt-in flags are enabled by any value other than "0" or "false".
+*/
+bool Settings_parseFlag(const char *name) {
+    char *flagStr = getenv(name);
+    return flagStr != NULL && strcmp(flagStr, "0") != 0 &&
+           strcmp(flagStr, "false") != 0;
+}
+
+// set by the generated code, 1 if it was built with `nativeGenerational`
+extern int __write_barriers;
+
+bool Settings_Generational() {
+    if (!Settings_parseFlag("SCALANATIVE_GC_GENERATIONAL")) {
+        return false;
+    }
+    if (!__write_barriers) {
+        // without write barriers old objects would lose their young children
+        fprintf(stderr, "SCALANATIVE_GC_GENERATIONAL is ignored, the program "
+                        "was not built with nativeGenerational := true\n");
+        return false;
+    }
+    return true;
+}
+
+bool Settings_Evacuation() {
+    return Settings_parseFlag("SCALANATIVE_GC_EVACUATION");
+}
+
+/*
+ Milliseconds for which free memory has to be in excess before it is returned
+ to the OS, a negative value keeps all the memory.
+*/
+int64_t Settings_UncommitDelay() {
+    char *delayStr = getenv("SCALANATIVE_UNCOMMIT_DELAY");
+    if (delayStr == NULL) {
+        return DEFAULT_UNCOMMIT_DELAY_MS;
+    } else {
+        long long delay;
+        sscanf(delayStr, "%lld", &delay);
+        return delay;
+    }
+}
+
+bool Settings_HugePages() {
+    return Settings_parseFlag("SCALANATIVE_GC_HUGE_PAGES");
+}
+
+bool Settings_Prefault() {
+    return Settings_parseFlag("SCALANATIVE_GC_PREFAULT");
+}
+
+/*
+ Number of objects prefetched ahead of the one being marked, 0 marks without
+ prefetching. Defaults to MARK_PREFETCH_DISTANCE.
+*/
+int Settings_MarkPrefetchDistance() {
+    char *distanceStr = getenv("SCALANATIVE_GC_PREFETCH_DISTANCE");
+    if (distanceStr == NULL) {
+        return MARK_PREFETCH_DISTANCE;
+    }
+    int distance = 0;
+    sscanf(distanceStr, "%d", &distance);
+    return distance < 0 ? 0 : distance;
+}
+/*
+ Number of GC threads that mark together with the mutator, 0 marks on the
+ mutator only. Defaults to the number of processors the process may use - 1,
+ but no more than MAX_DEFAULT_GC_THREADS. Explicit counts are clamped to
+ MAX_GC_THREADS.
+*/
+uint32_t Settings_GCThreadCount() {
+    char *countStr = getenv("SCALANATIVE_GC_THREADS");
+    if (countStr == NULL) {
+        int processorCount = Container_ProcessorCount();
+        int defaultCount = processorCount - 1;
+        if (defaultCount < 0) {
+            defaultCount = 0;
+        } else if (defaultCount > MAX_DEFAULT_GC_THREADS) {
+            defaultCount = MAX_DEFAULT_GC_THREADS;
+        }
+        return defaultCount;
+    } else {
+        int count = 0;
+        sscanf(countStr, "%d", &count);
+        if (count < 0) {
+            count = 0;
+        } else if (count > MAX_GC_THREADS) {
+            count = MAX_GC_THREADS;
+        }
+        return (uint32_t)count;
+    }
+}
+
+/*
+ One of "eager", "lazy" or "concurrent", see SweepMode. Defaults to lazy.
+*/
+SweepMode Settings_SweepMode() {
+    char *modeStr = getenv("SCALANATIVE_GC_SWEEP");
+    if (modeStr != NULL && strcmp(modeStr, "eager") == 0) {
+        return sweep_eager;
+    } else if (modeStr != NULL && strcmp(modeStr, "concurrent") == 0) {
+        return sweep_concurrent;
+    } else {
+        return sweep_lazy;
+    }
+}
+
+/*
+ Size from which objects are allocated outside of the heap, each in its own
+ mapping. Accepts the same units as the heap sizes, 0 turns it off.
+*/
+size_t Settings_HugeObjectSize() {
+    char *sizeStr = getenv("SCALANATIVE_GC_HUGE_OBJECT_SIZE");
+    if (sizeStr == NULL) {
+        return DEFAULT_HUGE_OBJECT_SIZE;
+    }
+    size_t size = Settings_parseSizeStr(sizeStr);
+    return size == 0 ? UNLIMITED_HEAP_SIZE : size;
+}
+
+/*
+ Milliseconds the pauses of full collections should not exceed on average.
+ Setting it, or the overhead target, sizes the heap by SizingPolicy.
+*/
+double Settings_PauseTarget() {
+    char *str = getenv("SCALANATIVE_GC_PAUSE_TARGET_MS");
+    double target = 0;
+    if (str != NULL) {
+        sscanf(str, "%lf", &target);
+    }
+    return target;
+}
+
+/*
+ Share of the time the program may spend in collections, e.g. 0.05.
+*/
+double Settings_OverheadTarget() {
+    char *str = getenv("SCALANATIVE_GC_OVERHEAD_TARGET");
+    double target = 0;
+    if (str != NULL) {
+        sscanf(str, "%lf", &target);
+    }
+    return target;
+}
+
+char *Settings_TraceFileName() { return getenv(TRACE_FILE_SETTING); }
+
+char *Settings_ProfileFileName() { return getenv(PROFILE_FILE_SETTING); }
+
+/*
+ Average bytes allocated between two samples of the allocation profiler.
+ Accepts the same units as the heap sizes.
+*/
+size_t Settings_ProfileInterval() {
+    char *intervalStr = getenv("SCALANATIVE_GC_PROFILE_INTERVAL");
+    if (intervalStr == NULL) {
+        return DEFAULT_PROFILE_INTERVAL;
+    }
+    size_t interval = Settings_parseSizeStr(intervalStr);
+    return interval == 0 ? DEFAULT_PROFILE_INTERVAL : interval;
+}
+
+char *Settings_HistogramFileName() { return getenv(HISTOGRAM_FILE_SETTING); }
+
+char *Settings_HeapDumpFileName() { return getenv(HEAP_DUMP_FILE_SETTING); }
@@ -2,11 +2,42 @@
 #define IMMIX_SETTINGS_H
 
 #define STATS_FILE_SETTING "SCALANATIVE_STATS_FILE"
+#define TRACE_FILE_SETTING "SCALANATIVE_GC_TRACE_FILE"
+#define PROFILE_FILE_SETTING "SCALANATIVE_GC_PROFILE_FILE"
+#define HISTOGRAM_FILE_SETTING "SCALANATIVE_GC_HISTOGRAM_FILE"
+#define HEAP_DUMP_FILE_SETTING "SCALANATIVE_GC_HEAP_DUMP_FILE"
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    // the whole heap is swept while the program is stopped
+    sweep_eager,
+    // blocks are swept when the allocators run out of them
+    sweep_lazy,
+    // like lazy, and the GC threads sweep ahead in the background
+    sweep_concurrent
+} SweepMode;
 
 size_t Settings_MinHeapSize();
 size_t Settings_MaxHeapSize();
 char *Settings_StatsFileName();
+bool Settings_Generational();
+bool Settings_Evacuation();
+int64_t Settings_UncommitDelay();
+bool Settings_HugePages();
+bool Settings_Prefault();
+int Settings_MarkPrefetchDistance();
+uint32_t Settings_GCThreadCount();
+SweepMode Settings_SweepMode();
+size_t Settings_HugeObjectSize();
+double Settings_PauseTarget();
+double Settings_OverheadTarget();
+char *Settings_TraceFileName();
+char *Settings_ProfileFileName();
+size_t Settings_ProfileInterval();
+char *Settings_HistogramFileName();
+char *Settings_HeapDumpFileName();
 
 #endif // IMMIX_SETTINGS_H
\ No newline at end of file
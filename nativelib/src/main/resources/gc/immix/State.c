@@ -1,7 +1,6 @@
 #include "State.h"
 
 Heap heap;
-Stack stack;
 Allocator allocator;
 LargeAllocator largeAllocator;
 BlockAllocator blockAllocator;
\ No newline at end of file
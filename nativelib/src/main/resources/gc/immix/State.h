@@ -4,7 +4,6 @@
 #include "Heap.h"
 
 extern Heap heap;
-extern Stack stack;
 extern Allocator allocator;
 extern LargeAllocator largeAllocator;
 extern BlockAllocator blockAllocator;
@@ -4,16 +4,21 @@
 
 void Stats_writeToFile(Stats *stats);
 
-void Stats_Init(Stats *stats, const char *statsFile) {
+void Stats_Init(Stats *stats, const char *statsFile, bool hugePages, bool prefault) {
     stats->outFile = fopen(statsFile, "w");
-    fprintf(stats->outFile, "mark_time_ns,sweep_time_ns\n");
+    stats->hugePages = hugePages;
+    stats->prefault = prefault;
+    fprintf(stats->outFile, "mark_time_ns,sweep_time_ns,young,evacuated_bytes,uncommitted_bytes,huge_pages,prefault\n");
     stats->collections = 0;
 }
 
-void Stats_RecordCollection(Stats *stats, uint64_t start_ns, uint64_t sweep_start_ns, uint64_t end_ns) {
+void Stats_RecordCollection(Stats *stats, uint64_t start_ns, uint64_t sweep_start_ns, uint64_t end_ns, bool young, size_t evacuated_bytes, size_t uncommitted_bytes) {
     uint64_t index = stats->collections % STATS_MEASUREMENTS;
     stats->mark_time_ns[index] = sweep_start_ns - start_ns;
     stats->sweep_time_ns[index] = end_ns - sweep_start_ns;
+    stats->young[index] = young;
+    stats->evacuated_bytes[index] = evacuated_bytes;
+    stats->uncommitted_bytes[index] = uncommitted_bytes;
     stats->collections += 1;
     if (stats->collections % STATS_MEASUREMENTS == 0) {
         Stats_writeToFile(stats);
@@ -28,7 +33,7 @@ void Stats_writeToFile(Stats *stats) {
     }
     FILE *outFile = stats->outFile;
     for (uint64_t i = 0; i < remainder; i++) {
-        fprintf(outFile, "%" PRIu64 ",%" PRIu64 "\n", stats->mark_time_ns[i], stats->sweep_time_ns[i]);
+        fprintf(outFile, "%" PRIu64 ",%" PRIu64 ",%d,%zu,%zu,%d,%d\n", stats->mark_time_ns[i], stats->sweep_time_ns[i], stats->young[i], stats->evacuated_bytes[i], stats->uncommitted_bytes[i], stats->hugePages, stats->prefault);
     }
     fflush(outFile);
 }
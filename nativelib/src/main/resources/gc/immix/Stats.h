@@ -3,18 +3,25 @@
 
 #include "Constants.h"
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 
 typedef struct {
     FILE *outFile;
+    bool hugePages;
+    bool prefault;
     uint64_t collections;
     uint64_t mark_time_ns[STATS_MEASUREMENTS];
     uint64_t sweep_time_ns[STATS_MEASUREMENTS];
+    bool young[STATS_MEASUREMENTS];
+    size_t evacuated_bytes[STATS_MEASUREMENTS];
+    size_t uncommitted_bytes[STATS_MEASUREMENTS];
 } Stats;
 
-void Stats_Init(Stats *stats, const char *statsFile);
-void Stats_RecordCollection(Stats *stats, uint64_t start_ns, uint64_t sweep_start_ns, uint64_t end_ns);
+void Stats_Init(Stats *stats, const char *statsFile, bool hugePages, bool prefault);
+void Stats_RecordCollection(Stats *stats, uint64_t start_ns, uint64_t sweep_start_ns, uint64_t end_ns, bool young, size_t evacuated_bytes, size_t uncommitted_bytes);
 void Stats_OnExit(Stats *stats);
 
 extern long long scalanative_nano_time();
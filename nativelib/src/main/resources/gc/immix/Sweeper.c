@@ -0,0 +1,207 @@
+#include <string.h>
+#include <sched.h>
+#include "Sweeper.h"
+#include "Block.h"
+#include "GCThread.h"
+#include "State.h"
+#include "Trace.h"
+#include "../../pprof/CpuProfiler.h"
+#include "utils/MathUtils.h"
+
+// Sweeping happens in two steps.
+//
+// First the simple blocks are swept: a dead block becomes free and the holes
+// of a live one are linked together. This only touches the metadata of the
+// block itself, so the heap is split into batches of SWEEP_BATCH_SIZE blocks
+// that are swept by whoever claims them first, the mutator or, in the
+// concurrent mode, a GC thread. Free blocks need nothing and superblocks are
+// left for the second step.
+//
+// Then the mutator hands the blocks over to the allocators. It moves its
+// cursor through the heap in address order, one batch at a time, so that
+// neighbouring free blocks are coalesced like before. The cursor moves when
+// an allocation finds no block, and at the start of the next collection,
+// which needs the whole heap to be swept. A superblock is swept when the
+// cursor reaches it, after every batch it overlaps has been swept. Otherwise a
+// batch could still be looking at blocks that are in use again.
+//
+// Once the cursor reaches the end, `Heap_SweepDone` takes the decisions that
+// depend on the whole heap: growing it, shrinking it and requesting a full
+// collection.
+
+typedef enum {
+    batch_unswept = 0x0,
+    batch_claimed = 0x1,
+    batch_swept = 0x2
+} BatchState;
+
+void Sweeper_Start(Heap *heap, bool young) {
+    Allocator_Clear(&allocator);
+    LargeAllocator_Clear(&largeAllocator);
+    BlockAllocator_Clear(&blockAllocator);
+
+    uint32_t batchCount =
+        (uint32_t)MathUtils_DivAndRoundUp(heap->blockCount, SWEEP_BATCH_SIZE);
+    memset(heap->sweep.batches, batch_unswept, batchCount);
+    atomic_init(&heap->sweep.nextBatch, 0);
+    heap->sweep.batchCount = batchCount;
+    heap->sweep.young = young;
+    heap->sweep.cursor = 0;
+    heap->sweep.limit = heap->blockCount;
+
+    if (heap->sweep.mode == sweep_concurrent) {
+        heap->gcThreads.phase = gc_sweep;
+        GCThread_WakeWorkers(heap, heap->gcThreads.count);
+    }
+}
+
+static bool Sweeper_claim(Heap *heap, uint32_t batch) {
+    unsigned char expected = batch_unswept;
+    return atomic_compare_exchange_strong(&heap->sweep.batches[batch],
+                                          &expected, batch_claimed);
+}
+
+static void Sweeper_sweepBatch(Heap *heap, uint32_t batch) {
+    // in generational mode survivors keep their marks and become old
+    bool sticky = heap->generational;
+    uint32_t first = batch * SWEEP_BATCH_SIZE;
+    uint32_t limit = first + SWEEP_BATCH_SIZE;
+    if (limit > heap->sweep.limit) {
+        limit = heap->sweep.limit;
+    }
+    BlockMeta *current =
+        BlockMeta_GetFromIndex(heap->blockMetaStart, first);
+    word_t *currentBlockStart = heap->heapStart + (size_t)first * WORDS_IN_BLOCK;
+    LineMeta *lineMetas =
+        (LineMeta *)heap->lineMetaStart + (size_t)first * LINE_COUNT;
+    for (uint32_t index = first; index < limit; index++) {
+        if (BlockMeta_IsSimpleBlock(current) &&
+            !BlockMeta_IsSuperblockMiddle(current)) {
+            Block_Sweep(&allocator, current, currentBlockStart, lineMetas,
+                        sticky);
+        }
+        current++;
+        currentBlockStart += WORDS_IN_BLOCK;
+        lineMetas += LINE_COUNT;
+    }
+    atomic_store_explicit(&heap->sweep.batches[batch], batch_swept,
+                          memory_order_release);
+}
+
+/**
+ * Returns once `batch` has been swept, sweeping it on the current thread if
+ * nobody has claimed it yet.
+ */
+static void Sweeper_awaitBatch(Heap *heap, uint32_t batch) {
+    if (Sweeper_claim(heap, batch)) {
+        Sweeper_sweepBatch(heap, batch);
+        return;
+    }
+    if (atomic_load_explicit(&heap->sweep.batches[batch],
+                             memory_order_acquire) == batch_swept) {
+        return;
+    }
+    // a GC thread is still sweeping it
+    uint64_t start_ns = Trace_Start();
+    while (atomic_load_explicit(&heap->sweep.batches[batch],
+                                memory_order_acquire) != batch_swept) {
+        sched_yield();
+    }
+    Trace_End(trace_sync, start_ns, 0);
+}
+
+/**
+ * Sweeps batches until all of them have been claimed, this is what the GC
+ * threads do in the concurrent mode.
+ */
+void Sweeper_SweepBatches(Heap *heap) {
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
+    uint32_t batchCount = heap->sweep.batchCount;
+    uint32_t batch;
+    while ((batch = atomic_fetch_add(&heap->sweep.nextBatch, 1)) < batchCount) {
+        if (Sweeper_claim(heap, batch)) {
+            Sweeper_sweepBatch(heap, batch);
+        }
+    }
+    CpuProfiler_LeavePhase(phase);
+}
+
+/**
+ * Hands the blocks of the next batch over to the allocators. Returns false if
+ * there was nothing left to sweep.
+ */
+bool Sweeper_LazySweep(Heap *heap) {
+    if (Sweeper_IsSweepDone(heap)) {
+        return false;
+    }
+    CpuProfilerPhase phase = CpuProfiler_EnterPhase(cpu_gc_sweep);
+    bool sticky = heap->generational;
+    uint32_t cursor = heap->sweep.cursor;
+    uint32_t limit = heap->sweep.limit;
+    uint32_t batch = cursor / SWEEP_BATCH_SIZE;
+    uint32_t batchLimit = (batch + 1) * SWEEP_BATCH_SIZE;
+    if (batchLimit > limit) {
+        batchLimit = limit;
+    }
+    Sweeper_awaitBatch(heap, batch);
+
+    // a superblock started in an earlier batch can end past this one
+    while (cursor < batchLimit) {
+        BlockMeta *current = BlockMeta_GetFromIndex(heap->blockMetaStart, cursor);
+        uint32_t size = 1;
+        assert(!BlockMeta_IsSuperblockMiddle(current));
+        if (BlockMeta_IsSuperblockStart(current)) {
+            size = BlockMeta_SuperblockSize(current);
+            uint32_t lastBatch = (cursor + size - 1) / SWEEP_BATCH_SIZE;
+            for (uint32_t next = batch + 1; next <= lastBatch; next++) {
+                Sweeper_awaitBatch(heap, next);
+            }
+            word_t *blockStart = BlockMeta_GetBlockStart(
+                heap->blockMetaStart, heap->heapStart, current);
+            LargeAllocator_Sweep(&largeAllocator, current, blockStart, sticky);
+        } else if (BlockMeta_IsFree(current)) {
+            BlockAllocator_AddFreeBlocks(&blockAllocator, current, 1);
+        } else if (BlockMeta_IsSimpleBlock(current)) {
+            // If there is no recyclable line, the block is unavailable
+            if (BlockMeta_FirstFreeLine(current) != LAST_HOLE) {
+                BlockList_AddLast(&allocator.recycledBlocks, current);
+                allocator.recycledBlockCount++;
+            }
+        } else {
+            // stays out of the free lists until the heap grows
+            assert(BlockMeta_IsUncommitted(current));
+        }
+        assert(size > 0);
+        cursor += size;
+    }
+    heap->sweep.cursor = cursor;
+
+    if (cursor >= limit) {
+        Heap_SweepDone(heap);
+    }
+    CpuProfiler_LeavePhase(phase);
+    return true;
+}
+
+/**
+ * Sweeps what is left of the heap. Afterwards no GC thread is sweeping.
+ */
+void Sweeper_SweepAll(Heap *heap) {
+    while (Sweeper_LazySweep(heap)) {
+    }
+    // the GC threads can still be looking for batches to claim
+    while (GCThread_AnyActive(heap)) {
+        sched_yield();
+    }
+}
+
+/**
+ * Returns once the block has been swept, so that the mutator can update its
+ * line metadata without racing with a GC thread.
+ */
+void Sweeper_AwaitBlock(Heap *heap, BlockMeta *blockMeta) {
+    uint32_t index = BlockMeta_GetBlockIndex(heap->blockMetaStart, blockMeta);
+    if (index >= heap->sweep.cursor && index < heap->sweep.limit) {
+        Sweeper_awaitBatch(heap, index / SWEEP_BATCH_SIZE);
+    }
+}
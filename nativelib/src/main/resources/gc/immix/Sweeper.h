@@ -0,0 +1,17 @@
+#ifndef IMMIX_SWEEPER_H
+#define IMMIX_SWEEPER_H
+
+#include "Heap.h"
+#include <stdbool.h>
+
+void Sweeper_Start(Heap *heap, bool young);
+bool Sweeper_LazySweep(Heap *heap);
+void Sweeper_SweepAll(Heap *heap);
+void Sweeper_SweepBatches(Heap *heap);
+void Sweeper_AwaitBlock(Heap *heap, BlockMeta *blockMeta);
+
+static inline bool Sweeper_IsSweepDone(Heap *heap) {
+    return heap->sweep.cursor >= heap->sweep.limit;
+}
+
+#endif // IMMIX_SWEEPER_H
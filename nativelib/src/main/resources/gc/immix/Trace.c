@@ -0,0 +1,172 @@
+#include "Trace.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+atomic_bool traceEnabled = false;
+
+static const char *const Trace_eventNames[] = {
+    "collection", "mark",     "sweep", "lazy_sweep",
+    "grow",       "uncommit", "sync",  "park"};
+// the argument of each event type, NULL if it has none
+static const char *const Trace_argNames[] = {
+    "young", NULL, NULL, NULL, "blocks", "blocks", NULL, NULL};
+
+// serializes starting, stopping and writing the trace
+static pthread_mutex_t Trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+// the file of the current trace, NULL while tracing is off
+static char *Trace_path = NULL;
+// events before this belong to an earlier trace
+static uint64_t Trace_since_ns = 0;
+// timestamps in the file are relative to it
+static uint64_t Trace_origin_ns = 0;
+// all the buffers ever created, they are never freed
+static _Atomic(TraceBuffer *) Trace_buffers = NULL;
+static atomic_int Trace_bufferCount = 0;
+
+static _Thread_local TraceBuffer *Trace_threadBuffer = NULL;
+static _Thread_local const char *Trace_threadName = "mutator";
+static _Thread_local int Trace_threadId = -1;
+
+static void Trace_nameBuffer(TraceBuffer *buffer) {
+    if (Trace_threadId < 0) {
+        snprintf(buffer->name, TRACE_NAME_SIZE, "%s", Trace_threadName);
+    } else {
+        snprintf(buffer->name, TRACE_NAME_SIZE, "%s %d", Trace_threadName,
+                 Trace_threadId);
+    }
+}
+
+/**
+ * Returns the buffer of the current thread, created by its first event.
+ */
+static TraceBuffer *Trace_buffer() {
+    TraceBuffer *buffer = Trace_threadBuffer;
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(TraceBuffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        buffer->tid = atomic_fetch_add(&Trace_bufferCount, 1) + 1;
+        Trace_nameBuffer(buffer);
+        TraceBuffer *head = atomic_load(&Trace_buffers);
+        do {
+            buffer->next = head;
+        } while (!atomic_compare_exchange_weak(&Trace_buffers, &head, buffer));
+        Trace_threadBuffer = buffer;
+    }
+    return buffer;
+}
+
+/**
+ * Names the lane of the current thread, `id` is appended unless negative.
+ * Threads that do not name themselves are mutators.
+ */
+void Trace_NameThread(const char *name, int id) {
+    Trace_threadName = name;
+    Trace_threadId = id;
+    if (Trace_threadBuffer != NULL) {
+        Trace_nameBuffer(Trace_threadBuffer);
+    }
+}
+
+void Trace_Record(TraceEventType type, uint64_t start_ns, uint64_t end_ns,
+                  uint64_t arg) {
+    TraceBuffer *buffer = Trace_buffer();
+    if (buffer == NULL) {
+        return;
+    }
+    uint64_t count =
+        atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    TraceEvent *event = &buffer->events[count % TRACE_BUFFER_SIZE];
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->arg = arg;
+    event->type = type;
+    // the event is complete before a writer can see it
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+static void Trace_writeEvent(FILE *out, int pid, int tid, TraceEvent *event) {
+    fprintf(out,
+            ",\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"X\",\"pid\":%d,"
+            "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+            Trace_eventNames[event->type], pid, tid,
+            (event->start_ns - Trace_origin_ns) / 1000.0,
+            (event->end_ns - event->start_ns) / 1000.0);
+    const char *argName = Trace_argNames[event->type];
+    if (argName != NULL) {
+        fprintf(out, ",\"args\":{\"%s\":%" PRIu64 "}", argName, event->arg);
+    }
+    fprintf(out, "}");
+}
+
+/**
+ * Writes the events since `since_ns` of all threads. Threads that are still
+ * tracing may overwrite the oldest events meanwhile, those that no longer
+ * make sense are left out.
+ */
+static void Trace_write(const char *path, uint64_t since_ns) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "GC trace: cannot write %s\n", path);
+        return;
+    }
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                 "\"tid\":0,\"args\":{\"name\":\"GC\"}}",
+            pid);
+    TraceBuffer *buffer = atomic_load(&Trace_buffers);
+    for (; buffer != NULL; buffer = buffer->next) {
+        fprintf(out,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                pid, buffer->tid, buffer->name);
+        uint64_t count =
+            atomic_load_explicit(&buffer->count, memory_order_acquire);
+        uint64_t first =
+            count > TRACE_BUFFER_SIZE ? count - TRACE_BUFFER_SIZE : 0;
+        for (uint64_t i = first; i < count; i++) {
+            TraceEvent event = buffer->events[i % TRACE_BUFFER_SIZE];
+            if (event.start_ns >= since_ns && event.end_ns >= event.start_ns &&
+                event.type <= trace_park) {
+                Trace_writeEvent(out, pid, buffer->tid, &event);
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+}
+
+/**
+ * Starts tracing into the file at `path`, or stops when it is NULL. Stopping,
+ * or starting another trace, writes the file of the current one.
+ */
+void Trace_Set(const char *path) {
+    pthread_mutex_lock(&Trace_mutex);
+    if (Trace_path != NULL) {
+        atomic_store(&traceEnabled, false);
+        Trace_write(Trace_path, Trace_since_ns);
+        free(Trace_path);
+        Trace_path = NULL;
+    }
+    if (path != NULL) {
+        Trace_path = strdup(path);
+        Trace_since_ns = scalanative_nano_time();
+        atomic_store(&traceEnabled, Trace_path != NULL);
+    }
+    pthread_mutex_unlock(&Trace_mutex);
+}
+
+void Trace_Init(const char *path) {
+    Trace_origin_ns = scalanative_nano_time();
+    if (path != NULL) {
+        Trace_Set(path);
+    }
+}
+
+void Trace_OnExit() { Trace_Set(NULL); }
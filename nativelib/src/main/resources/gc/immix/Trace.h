@@ -0,0 +1,83 @@
+#ifndef IMMIX_TRACE_H
+#define IMMIX_TRACE_H
+
+#include "Constants.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Records what the collector does into a ring buffer per thread and writes
+// them out as a single Chrome trace event file, which chrome://tracing and
+// Perfetto show with a lane per thread. Unlike Stats it is always compiled in:
+// while it is off an event costs a load and a branch. It is turned on by the
+// TRACE_FILE_SETTING variable or `scalanative_gc_trace`.
+//
+// Only its own thread writes to a buffer, which keeps the last
+// TRACE_BUFFER_SIZE events. The file is written when tracing stops or the
+// program exits.
+
+typedef enum {
+    // the mutator is stopped for a collection
+    trace_collection,
+    trace_mark,
+    trace_sweep,
+    // the mutator sweeps blocks it needs to allocate
+    trace_lazy_sweep,
+    trace_grow,
+    trace_uncommit,
+    // waiting for or synchronizing with other GC threads
+    trace_sync,
+    // asleep waiting for another thread
+    trace_park
+} TraceEventType;
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t end_ns;
+    // see Trace_argNames
+    uint64_t arg;
+    TraceEventType type;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    int tid;
+    char name[TRACE_NAME_SIZE];
+    // events recorded so far, the next one goes to count % TRACE_BUFFER_SIZE
+    atomic_uint_fast64_t count;
+    TraceEvent events[TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+extern atomic_bool traceEnabled;
+
+extern long long scalanative_nano_time();
+
+void Trace_Init(const char *path);
+void Trace_Set(const char *path);
+void Trace_NameThread(const char *name, int id);
+void Trace_Record(TraceEventType type, uint64_t start_ns, uint64_t end_ns,
+                  uint64_t arg);
+void Trace_OnExit();
+
+static inline bool Trace_Enabled() {
+    return atomic_load_explicit(&traceEnabled, memory_order_relaxed);
+}
+
+/**
+ * Returns the start of an event, or 0 while tracing is off.
+ */
+static inline uint64_t Trace_Start() {
+    if (Trace_Enabled()) {
+        return scalanative_nano_time();
+    }
+    return 0;
+}
+
+static inline void Trace_End(TraceEventType type, uint64_t start_ns,
+                             uint64_t arg) {
+    if (start_ns != 0) {
+        Trace_Record(type, start_ns, scalanative_nano_time(), arg);
+    }
+}
+
+#endif // IMMIX_TRACE_H
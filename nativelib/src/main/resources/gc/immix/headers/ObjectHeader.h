@@ -23,8 +23,14 @@ typedef struct {
     int32_t size;
     int32_t idRangeUntil;
     int64_t *refMapStruct;
+    // bit i is set when fields[i] is a reference, 0 if refMapStruct has to be
+    // used instead
+    uint64_t refMapBits;
 } Rtti;
 
+// ends the field offsets of refMapStruct
+#define LAST_FIELD_OFFSET -1
+
 typedef word_t *Field_t;
 
 typedef struct {
@@ -14,7 +14,11 @@ typedef enum {
     block_simple = 0x1,
     block_superblock_start = 0x2,
     block_superblock_middle = 0x3,
-    block_marked = 0x5
+    block_marked = 0x5,
+    // simple block whose objects are evacuated during the current collection
+    block_evacuate = 0x9,
+    // free block whose memory has been returned to the OS
+    block_uncommitted = 0x20
 } BlockFlag;
 
 typedef struct {
@@ -22,6 +26,9 @@ typedef struct {
         struct {
             uint8_t flags;
             int8_t first;
+            // lines marked by the last collection, LINE_COUNT if the block
+            // has not been swept since it was taken from the free blocks
+            uint8_t markedLines;
         } simple;
         struct {
             uint8_t flags;
@@ -34,6 +41,9 @@ typedef struct {
 static inline bool BlockMeta_IsFree(BlockMeta *blockMeta) {
     return blockMeta->block.simple.flags == block_free;
 }
+static inline bool BlockMeta_IsUncommitted(BlockMeta *blockMeta) {
+    return blockMeta->block.simple.flags == block_uncommitted;
+}
 static inline bool BlockMeta_IsSimpleBlock(BlockMeta *blockMeta) {
     return (blockMeta->block.simple.flags & block_simple) != 0;
 }
@@ -74,6 +84,17 @@ static inline int8_t BlockMeta_FirstFreeLine(BlockMeta *blockMeta) {
     return blockMeta->block.simple.first;
 }
 
+static inline void BlockMeta_SetMarkedLines(BlockMeta *blockMeta,
+                                            uint8_t markedLines) {
+    assert(markedLines <= LINE_COUNT);
+    blockMeta->block.simple.markedLines = markedLines;
+}
+
+static inline uint8_t BlockMeta_MarkedLines(BlockMeta *blockMeta) {
+    assert(BlockMeta_IsSimpleBlock(blockMeta));
+    return blockMeta->block.simple.markedLines;
+}
+
 static inline void BlockMeta_SetFlag(BlockMeta *blockMeta,
                                      BlockFlag blockFlag) {
     blockMeta->block.simple.flags = blockFlag;
@@ -91,6 +112,14 @@ static inline void BlockMeta_Mark(BlockMeta *blockMeta) {
     blockMeta->block.simple.flags = block_marked;
 }
 
+static inline bool BlockMeta_IsEvacuationCandidate(BlockMeta *blockMeta) {
+    return blockMeta->block.simple.flags == block_evacuate;
+}
+
+static inline void BlockMeta_SetEvacuationCandidate(BlockMeta *blockMeta) {
+    blockMeta->block.simple.flags = block_evacuate;
+}
+
 // Block specific
 
 static inline word_t *Block_GetLineAddress(word_t *blockStart, int lineIndex) {
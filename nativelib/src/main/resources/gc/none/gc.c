@@ -1,5 +1,11 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include "../shared/GCStats.h"
+#include "../../pprof/CpuProfiler.h"
 
 // Darwin defines MAP_ANON instead of MAP_ANONYMOUS
 #if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
@@ -20,10 +26,21 @@
 
 void *current = 0;
 void *end = 0;
+void *chunkStart = 0;
+// chunks mapped so far, and the bytes allocated in the ones before the current
+size_t chunkCount = 0;
+size_t retiredBytes = 0;
 
+// also called for every new chunk
 void scalanative_init() {
+    if (chunkCount == 0) {
+        CpuProfiler_Init();
+    }
+    retiredBytes += current - chunkStart;
+    chunkCount++;
     current = mmap(NULL, CHUNK, DUMMY_GC_PROT, DUMMY_GC_FLAGS, DUMMY_GC_FD,
                    DUMMY_GC_FD_OFFSET);
+    chunkStart = current;
     end = current + CHUNK;
 }
 
@@ -53,3 +70,40 @@ void *scalanative_alloc_atomic(void *info, size_t size) {
 }
 
 void scalanative_collect() {}
+
+void scalanative_write_barrier(void *address) {}
+
+void scalanative_write_barrier_range(void *address, size_t size) {}
+
+bool scalanative_gc_moves_objects = false;
+
+bool scalanative_gc_generational = false;
+
+void scalanative_pin(void *address) {}
+
+void scalanative_gc_trace(const char *path) {}
+
+bool scalanative_gc_heap_dump(const char *histogramPath, const char *dumpPath) {
+    return false;
+}
+
+void scalanative_gc_stats(GCStats *stats) {
+    size_t allocatedBytes = retiredBytes + (current - chunkStart);
+    memset(stats, 0, sizeof(GCStats));
+    stats->heapSize = chunkCount * CHUNK;
+    stats->maxHeapSize = GC_STATS_UNLIMITED;
+    stats->usedBytes = allocatedBytes;
+    stats->allocatedBytes = allocatedBytes;
+}
+
+// Allocation is not synchronized, no other thread may be started.
+int scalanative_pthread_create(pthread_t *thread, pthread_attr_t *attr,
+                               void *(*routine)(void *), void *arg) {
+    return ENOTSUP;
+}
+
+int scalanative_pthread_detach(pthread_t thread) {
+    return pthread_detach(thread);
+}
+
+void scalanative_pthread_exit(void *result) { pthread_exit(result); }
@@ -0,0 +1,36 @@
+#ifndef GC_SHARED_GCSTATS_H
+#define GC_SHARED_GCSTATS_H
+
+#include <stdint.h>
+
+// What every collector reports through `scalanative_gc_stats`, mirrored by
+// `GC.Stats` in Scala. Sizes are in bytes and times in nanoseconds, the
+// counters start with the program. A collector reports 0 for what it does not
+// keep track of.
+typedef struct {
+    // memory taken by the heap now, and the most it may take
+    uint64_t heapSize;
+    uint64_t maxHeapSize;
+    // the part of the heap that is not free
+    uint64_t usedBytes;
+    uint64_t freeBlocks;
+    // blocks with free lines in between live objects
+    uint64_t recycledBlocks;
+    uint64_t allocatedBytes;
+    uint64_t collections;
+    // the time the program was stopped for collections
+    uint64_t lastPause_ns;
+    uint64_t maxPause_ns;
+    uint64_t totalPause_ns;
+    // time spent marking, and sweeping summed over the threads that sweep,
+    // which may overlap the program
+    uint64_t mark_ns;
+    uint64_t sweep_ns;
+} GCStats;
+
+// the maximum heap size of a heap that is not limited
+#define GC_STATS_UNLIMITED INT64_MAX
+
+void scalanative_gc_stats(GCStats *stats);
+
+#endif // GC_SHARED_GCSTATS_H
@@ -0,0 +1,578 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef __APPLE__
+#include <sys/syscall.h>
+#endif
+
+// Monitors of java.lang.Object and the interruption of threads.
+//
+// Objects have no lock word in their header. The lock word of an object that
+// is locked or waited on is kept in a table keyed by its address, which is
+// split into stripes that each have their own mutex. Its entry is dropped once
+// no thread holds it, enters it or waits on it, so that the table only holds
+// the monitors in use. Threads that cannot enter a monitor wait on its
+// condition variable, threads in `wait` on their own one.
+//
+// Until a second thread starts no thread can contend for a monitor. Entering
+// and exiting one then only push and pop the object on `Monitor_elided`, as
+// synchronized blocks nest. Before the second thread starts, the monitors
+// recorded there are entered for real, see scalanative_monitor_start_threads.
+// Threads attached by native code start using the table once they first call
+// into this file, monitors they entered before are not seen by the others.
+// Such a thread switches to the table while the owner of the recorded
+// monitors runs, `Monitor_elidedMutex` orders the two.
+
+#define MONITOR_STRIPE_COUNT 256
+
+// the results of the monitor operations, see Monitor.scala
+#define MONITOR_OK 0
+#define MONITOR_NOT_OWNER 1
+#define MONITOR_INTERRUPTED 2
+
+typedef struct ThreadState {
+    // `wait` and `sleep` wait on it, with `waitMutex` held
+    pthread_cond_t cond;
+    // held by `sleep`
+    pthread_mutex_t mutex;
+    _Atomic(pthread_mutex_t *) waitMutex;
+    atomic_bool interrupted;
+    // set by `notify`, under the mutex of the stripe of the monitor
+    bool notified;
+    struct ThreadState *nextWaiter;
+    // the java.lang.Thread, which is kept alive by the Scala side
+    void *thread;
+} ThreadState;
+
+typedef struct Monitor {
+    void *object;
+    ThreadState *owner;
+    uint32_t count;
+    // the threads waiting for the owner to exit
+    uint32_t entrants;
+    pthread_cond_t exited;
+    // the threads in `wait`, in the order of arrival
+    ThreadState *waiters;
+    struct Monitor *next;
+} Monitor;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    Monitor *monitors;
+    // dropped monitors, reused with their condition variable
+    Monitor *free;
+} MonitorStripe;
+
+static MonitorStripe Monitor_stripes[MONITOR_STRIPE_COUNT];
+static pthread_once_t Monitor_once = PTHREAD_ONCE_INIT;
+static pthread_key_t Thread_key;
+static _Thread_local ThreadState *Thread_current = NULL;
+
+static atomic_bool Monitor_threadsStarted = false;
+// held while the recorded monitors are used and while they are moved to the
+// table
+static pthread_mutex_t Monitor_elidedMutex = PTHREAD_MUTEX_INITIALIZER;
+// the monitors held while there is a single thread, innermost last
+static void **Monitor_elided = NULL;
+static size_t Monitor_elidedCount = 0;
+static size_t Monitor_elidedCapacity = 0;
+static ThreadState *Monitor_elidedOwner = NULL;
+
+void scalanative_monitor_start_threads();
+bool scalanative_thread_is_main();
+
+// detaches the java.lang.Thread of a thread that exits without having
+// cleared it, i.e. one that was not started by Thread.start
+static void (*Thread_exitHook)(void *thread) = NULL;
+
+static void Thread_detach(ThreadState *self) {
+    if (self->thread != NULL && Thread_exitHook != NULL) {
+        // the thread object must not refer to the state once it is freed
+        Thread_exitHook(self->thread);
+        self->thread = NULL;
+    }
+}
+
+static void Thread_free(void *data) {
+    ThreadState *self = (ThreadState *)data;
+    // usually done by scalanative_thread_exiting already
+    Thread_detach(self);
+    Thread_current = NULL;
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->mutex);
+    free(self);
+}
+
+static void Monitor_init() {
+    for (int i = 0; i < MONITOR_STRIPE_COUNT; i++) {
+        pthread_mutex_init(&Monitor_stripes[i].mutex, NULL);
+        Monitor_stripes[i].monitors = NULL;
+        Monitor_stripes[i].free = NULL;
+    }
+    // frees the state of a thread when it exits
+    pthread_key_create(&Thread_key, Thread_free);
+}
+
+/**
+ * Returns the state of the calling thread, created on first use.
+ */
+static ThreadState *Thread_self() {
+    ThreadState *self = Thread_current;
+    if (self == NULL) {
+        pthread_once(&Monitor_once, Monitor_init);
+        self = (ThreadState *)calloc(1, sizeof(ThreadState));
+        pthread_cond_init(&self->cond, NULL);
+        pthread_mutex_init(&self->mutex, NULL);
+        Thread_current = self;
+        pthread_setspecific(Thread_key, self);
+        if (!atomic_load(&Monitor_threadsStarted) &&
+            !scalanative_thread_is_main()) {
+            // a thread that native code started
+            scalanative_monitor_start_threads();
+        }
+    }
+    return self;
+}
+
+static inline bool Monitor_single() {
+    return !atomic_load_explicit(&Monitor_threadsStarted, memory_order_acquire);
+}
+
+/**
+ * Locks the recorded monitors. Returns false without locking them if the
+ * threads started meanwhile.
+ */
+static bool Monitor_lockElided() {
+    pthread_mutex_lock(&Monitor_elidedMutex);
+    if (Monitor_single()) {
+        return true;
+    }
+    pthread_mutex_unlock(&Monitor_elidedMutex);
+    return false;
+}
+
+static void Monitor_unlockElided() {
+    pthread_mutex_unlock(&Monitor_elidedMutex);
+}
+
+static void Monitor_elide(ThreadState *self, void *object) {
+    if (Monitor_elidedCount == Monitor_elidedCapacity) {
+        Monitor_elidedCapacity =
+            Monitor_elidedCapacity == 0 ? 16 : 2 * Monitor_elidedCapacity;
+        Monitor_elided = (void **)realloc(
+            Monitor_elided, Monitor_elidedCapacity * sizeof(void *));
+    }
+    Monitor_elided[Monitor_elidedCount++] = object;
+    Monitor_elidedOwner = self;
+}
+
+static bool Monitor_elidedHolds(void *object) {
+    for (size_t i = 0; i < Monitor_elidedCount; i++) {
+        if (Monitor_elided[i] == object) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static MonitorStripe *Monitor_stripe(void *object) {
+    uintptr_t address = (uintptr_t)object;
+    return &Monitor_stripes[(address >> 4 ^ address >> 12) %
+                            MONITOR_STRIPE_COUNT];
+}
+
+static Monitor *Monitor_find(MonitorStripe *stripe, void *object) {
+    for (Monitor *monitor = stripe->monitors; monitor != NULL;
+         monitor = monitor->next) {
+        if (monitor->object == object) {
+            return monitor;
+        }
+    }
+    return NULL;
+}
+
+static Monitor *Monitor_findOrAdd(MonitorStripe *stripe, void *object) {
+    Monitor *monitor = Monitor_find(stripe, object);
+    if (monitor != NULL) {
+        return monitor;
+    }
+    monitor = stripe->free;
+    if (monitor != NULL) {
+        stripe->free = monitor->next;
+    } else {
+        monitor = (Monitor *)malloc(sizeof(Monitor));
+        pthread_cond_init(&monitor->exited, NULL);
+    }
+    monitor->object = object;
+    monitor->owner = NULL;
+    monitor->count = 0;
+    monitor->entrants = 0;
+    monitor->waiters = NULL;
+    monitor->next = stripe->monitors;
+    stripe->monitors = monitor;
+    return monitor;
+}
+
+// Drops the monitor once no thread uses it.
+static void Monitor_dropIfUnused(MonitorStripe *stripe, Monitor *monitor) {
+    if (monitor->owner != NULL || monitor->entrants > 0 ||
+        monitor->waiters != NULL) {
+        return;
+    }
+    Monitor **link = &stripe->monitors;
+    while (*link != monitor) {
+        link = &(*link)->next;
+    }
+    *link = monitor->next;
+    monitor->object = NULL;
+    monitor->next = stripe->free;
+    stripe->free = monitor;
+}
+
+// Takes the monitor once its owner exits, with the stripe locked.
+static void Monitor_acquire(MonitorStripe *stripe, Monitor *monitor,
+                            ThreadState *self, uint32_t count) {
+    if (monitor->owner != NULL) {
+        monitor->entrants++;
+        while (monitor->owner != NULL) {
+            pthread_cond_wait(&monitor->exited, &stripe->mutex);
+        }
+        monitor->entrants--;
+    }
+    monitor->owner = self;
+    monitor->count = count;
+}
+
+static void Monitor_release(Monitor *monitor) {
+    monitor->owner = NULL;
+    monitor->count = 0;
+    if (monitor->entrants > 0) {
+        pthread_cond_signal(&monitor->exited);
+    }
+}
+
+void scalanative_monitor_enter(void *object) {
+    ThreadState *self = Thread_self();
+    if (Monitor_single() && Monitor_lockElided()) {
+        Monitor_elide(self, object);
+        Monitor_unlockElided();
+        return;
+    }
+    MonitorStripe *stripe = Monitor_stripe(object);
+    pthread_mutex_lock(&stripe->mutex);
+    Monitor *monitor = Monitor_findOrAdd(stripe, object);
+    if (monitor->owner == self) {
+        monitor->count++;
+    } else {
+        Monitor_acquire(stripe, monitor, self, 1);
+    }
+    pthread_mutex_unlock(&stripe->mutex);
+}
+
+/**
+ * Returns MONITOR_NOT_OWNER if the calling thread does not hold the monitor.
+ */
+int scalanative_monitor_exit(void *object) {
+    ThreadState *self = Thread_self();
+    if (Monitor_single() && Monitor_lockElided()) {
+        int result = MONITOR_OK;
+        if (Monitor_elidedCount == 0 ||
+            Monitor_elided[Monitor_elidedCount - 1] != object) {
+            result = MONITOR_NOT_OWNER;
+        } else {
+            Monitor_elidedCount--;
+        }
+        Monitor_unlockElided();
+        return result;
+    }
+    MonitorStripe *stripe = Monitor_stripe(object);
+    pthread_mutex_lock(&stripe->mutex);
+    Monitor *monitor = Monitor_find(stripe, object);
+    int result = MONITOR_OK;
+    if (monitor == NULL || monitor->owner != self) {
+        result = MONITOR_NOT_OWNER;
+    } else if (--monitor->count == 0) {
+        Monitor_release(monitor);
+        Monitor_dropIfUnused(stripe, monitor);
+    }
+    pthread_mutex_unlock(&stripe->mutex);
+    return result;
+}
+
+bool scalanative_monitor_holds(void *object) {
+    ThreadState *self = Thread_self();
+    if (Monitor_single() && Monitor_lockElided()) {
+        bool holds = Monitor_elidedHolds(object);
+        Monitor_unlockElided();
+        return holds;
+    }
+    MonitorStripe *stripe = Monitor_stripe(object);
+    pthread_mutex_lock(&stripe->mutex);
+    Monitor *monitor = Monitor_find(stripe, object);
+    bool holds = monitor != NULL && monitor->owner == self;
+    pthread_mutex_unlock(&stripe->mutex);
+    return holds;
+}
+
+static void Thread_deadline(struct timespec *deadline, int64_t timeout_ns) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    int64_t ns = deadline->tv_nsec + timeout_ns % 1000000000;
+    deadline->tv_sec += timeout_ns / 1000000000 + ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+}
+
+/**
+ * Waits on the condition of the thread with `mutex` held until `done` or the
+ * thread is interrupted, for at most `timeout_ns` unless it is 0. Returns false
+ * on timeout. An interrupt takes `mutex` before it signals, it cannot be
+ * missed.
+ */
+static bool Thread_wait(ThreadState *self, pthread_mutex_t *mutex,
+                        int64_t timeout_ns, bool *done) {
+    struct timespec deadline;
+    if (timeout_ns > 0) {
+        Thread_deadline(&deadline, timeout_ns);
+    }
+    atomic_store(&self->waitMutex, mutex);
+    bool timedOut = false;
+    while (!*done && !atomic_load(&self->interrupted) && !timedOut) {
+        if (timeout_ns > 0) {
+            timedOut = pthread_cond_timedwait(&self->cond, mutex, &deadline) ==
+                       ETIMEDOUT;
+        } else {
+            pthread_cond_wait(&self->cond, mutex);
+        }
+    }
+    atomic_store(&self->waitMutex, NULL);
+    return !timedOut;
+}
+
+/**
+ * Waits for `timeout_ns`, forever if it is 0, unless the calling thread is
+ * interrupted. Returns true if it is, which clears the interrupt.
+ */
+static bool Thread_sleep(ThreadState *self, int64_t timeout_ns) {
+    pthread_mutex_lock(&self->mutex);
+    bool never = false;
+    Thread_wait(self, &self->mutex, timeout_ns, &never);
+    bool interrupted = atomic_exchange(&self->interrupted, false);
+    pthread_mutex_unlock(&self->mutex);
+    return interrupted;
+}
+
+/**
+ * Waits for a notification of the monitor of `object`, which the calling
+ * thread holds, for at most `timeout_ns` unless it is 0. Returns
+ * MONITOR_INTERRUPTED if the thread is interrupted, which clears the interrupt.
+ */
+int scalanative_monitor_wait(void *object, int64_t timeout_ns) {
+    ThreadState *self = Thread_self();
+    if (Monitor_single() && Monitor_lockElided()) {
+        bool holds = Monitor_elidedHolds(object);
+        // set once the threads start, see scalanative_monitor_start_threads
+        self->notified = false;
+        Monitor_unlockElided();
+        if (!holds) {
+            return MONITOR_NOT_OWNER;
+        }
+        // No other thread can notify before the threads start. The thread
+        // then wakes up as if spuriously, with the monitor in the table.
+        pthread_mutex_lock(&self->mutex);
+        Thread_wait(self, &self->mutex, timeout_ns, &self->notified);
+        bool interrupted = atomic_exchange(&self->interrupted, false);
+        pthread_mutex_unlock(&self->mutex);
+        return interrupted ? MONITOR_INTERRUPTED : MONITOR_OK;
+    }
+    MonitorStripe *stripe = Monitor_stripe(object);
+    pthread_mutex_lock(&stripe->mutex);
+    Monitor *monitor = Monitor_find(stripe, object);
+    if (monitor == NULL || monitor->owner != self) {
+        pthread_mutex_unlock(&stripe->mutex);
+        return MONITOR_NOT_OWNER;
+    }
+    if (atomic_exchange(&self->interrupted, false)) {
+        pthread_mutex_unlock(&stripe->mutex);
+        return MONITOR_INTERRUPTED;
+    }
+    uint32_t count = monitor->count;
+    Monitor_release(monitor);
+    self->notified = false;
+    self->nextWaiter = NULL;
+    ThreadState **link = &monitor->waiters;
+    while (*link != NULL) {
+        link = &(*link)->nextWaiter;
+    }
+    *link = self;
+
+    Thread_wait(self, &stripe->mutex, timeout_ns, &self->notified);
+    if (!self->notified) {
+        // timed out or interrupted, still queued
+        link = &monitor->waiters;
+        while (*link != self) {
+            link = &(*link)->nextWaiter;
+        }
+        *link = self->nextWaiter;
+    }
+    Monitor_acquire(stripe, monitor, self, count);
+    int result = MONITOR_OK;
+    // a notified thread returns normally, its interrupt stays pending
+    if (!self->notified && atomic_exchange(&self->interrupted, false)) {
+        result = MONITOR_INTERRUPTED;
+    }
+    pthread_mutex_unlock(&stripe->mutex);
+    return result;
+}
+
+/**
+ * Wakes one or all of the threads waiting on the monitor of `object`, which
+ * the calling thread holds.
+ */
+int scalanative_monitor_notify(void *object, bool all) {
+    ThreadState *self = Thread_self();
+    if (Monitor_single() && Monitor_lockElided()) {
+        bool holds = Monitor_elidedHolds(object);
+        Monitor_unlockElided();
+        return holds ? MONITOR_OK : MONITOR_NOT_OWNER;
+    }
+    MonitorStripe *stripe = Monitor_stripe(object);
+    pthread_mutex_lock(&stripe->mutex);
+    Monitor *monitor = Monitor_find(stripe, object);
+    if (monitor == NULL || monitor->owner != self) {
+        pthread_mutex_unlock(&stripe->mutex);
+        return MONITOR_NOT_OWNER;
+    }
+    do {
+        ThreadState *waiter = monitor->waiters;
+        if (waiter == NULL) {
+            break;
+        }
+        monitor->waiters = waiter->nextWaiter;
+        waiter->notified = true;
+        pthread_cond_signal(&waiter->cond);
+    } while (all);
+    pthread_mutex_unlock(&stripe->mutex);
+    return MONITOR_OK;
+}
+
+/**
+ * Called before a second thread starts, or by a thread that native code
+ * attached, from then on the monitors are kept in the table. The monitors
+ * recorded so far are entered for their owner, which wakes up if it waits on
+ * one of them.
+ */
+void scalanative_monitor_start_threads() {
+    if (atomic_load(&Monitor_threadsStarted)) {
+        return;
+    }
+    pthread_mutex_lock(&Monitor_elidedMutex);
+    if (atomic_load(&Monitor_threadsStarted)) {
+        pthread_mutex_unlock(&Monitor_elidedMutex);
+        return;
+    }
+    ThreadState *owner = Monitor_elidedOwner;
+    for (size_t i = 0; i < Monitor_elidedCount; i++) {
+        void *object = Monitor_elided[i];
+        MonitorStripe *stripe = Monitor_stripe(object);
+        pthread_mutex_lock(&stripe->mutex);
+        Monitor *monitor = Monitor_findOrAdd(stripe, object);
+        monitor->owner = owner;
+        monitor->count++;
+        pthread_mutex_unlock(&stripe->mutex);
+    }
+    free(Monitor_elided);
+    Monitor_elided = NULL;
+    Monitor_elidedCount = 0;
+    Monitor_elidedCapacity = 0;
+    atomic_store(&Monitor_threadsStarted, true);
+    pthread_mutex_unlock(&Monitor_elidedMutex);
+    if (owner != NULL) {
+        pthread_mutex_lock(&owner->mutex);
+        owner->notified = true;
+        pthread_cond_broadcast(&owner->cond);
+        pthread_mutex_unlock(&owner->mutex);
+    }
+}
+
+/**
+ * Returns the state of the calling thread, which lives until the thread exits.
+ */
+void *scalanative_thread_self() { return Thread_self(); }
+
+void *scalanative_thread_get_object(void *state) {
+    return ((ThreadState *)state)->thread;
+}
+
+void scalanative_thread_set_object(void *state, void *thread) {
+    ((ThreadState *)state)->thread = thread;
+}
+
+/**
+ * Called by the GC when a thread it registered exits, before the thread is
+ * unregistered. The exit hook runs Scala code, which may allocate, and the
+ * order of the destructors of the thread-specific values is unspecified.
+ */
+void scalanative_thread_exiting() {
+    ThreadState *self = Thread_current;
+    if (self != NULL) {
+        Thread_detach(self);
+    }
+}
+
+/**
+ * Sets the function that is called with the thread object of an exiting
+ * thread whose object is still set, before its state is freed.
+ */
+void scalanative_thread_set_exit_hook(void (*hook)(void *thread)) {
+    Thread_exitHook = hook;
+}
+
+bool scalanative_thread_is_main() {
+#ifdef __APPLE__
+    return pthread_main_np() != 0;
+#else
+    return getpid() == (pid_t)syscall(SYS_gettid);
+#endif
+}
+
+/**
+ * Interrupts the thread of `state`, which must not have exited. Wakes it up
+ * if it waits in `wait` or `sleep`.
+ */
+void scalanative_thread_interrupt(void *state) {
+    ThreadState *thread = (ThreadState *)state;
+    atomic_store(&thread->interrupted, true);
+    pthread_mutex_t *mutex = atomic_load(&thread->waitMutex);
+    if (mutex != NULL) {
+        // the thread is in `pthread_cond_wait` once the mutex is free, or it
+        // has stopped waiting
+        pthread_mutex_lock(mutex);
+        pthread_cond_broadcast(&thread->cond);
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+bool scalanative_thread_interrupted(void *state, bool clear) {
+    ThreadState *thread = (ThreadState *)state;
+    if (clear) {
+        return atomic_exchange(&thread->interrupted, false);
+    }
+    return atomic_load(&thread->interrupted);
+}
+
+/**
+ * Sleeps for `duration_ns`. Returns true if the calling thread is interrupted,
+ * which clears the interrupt.
+ */
+bool scalanative_thread_sleep(int64_t duration_ns) {
+    ThreadState *self = Thread_self();
+    if (duration_ns > 0) {
+        return Thread_sleep(self, duration_ns);
+    }
+    return atomic_exchange(&self->interrupted, false);
+}
@@ -0,0 +1,548 @@
+#define _GNU_SOURCE
+#include "CpuProfiler.h"
+#include "Pprof.h"
+#include "../libunwind/include-libunwind/libunwind.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define CPU_PROFILE_FILE_SETTING "SCALANATIVE_CPU_PROFILE_FILE"
+#define CPU_PROFILE_FREQUENCY_SETTING "SCALANATIVE_CPU_PROFILE_FREQUENCY"
+#define CPU_PROFILE_FORMAT_SETTING "SCALANATIVE_CPU_PROFILE_FORMAT"
+
+#define CPU_PROFILER_DEFAULT_FREQUENCY 100
+// the timer cannot fire more often than the kernel ticks
+#define CPU_PROFILER_MAX_FREQUENCY 1000
+#define CPU_PROFILER_MAX_DEPTH 64
+// samples waiting to be aggregated, a power of two
+#define CPU_PROFILER_BUFFER_SIZE 4096
+// how often the buffer is emptied
+#define CPU_PROFILER_DRAIN_INTERVAL_NS 100000000L
+#define CPU_PROFILER_INITIAL_CAPACITY 1024
+#define CPU_PROFILER_NAME_SIZE 1024
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define CPU_PROFILER_SUPPORTED
+#elif defined(__APPLE__) && (defined(__x86_64__) || defined(__aarch64__))
+#define CPU_PROFILER_SUPPORTED
+#endif
+
+_Thread_local volatile sig_atomic_t cpuProfilerPhase = cpu_mutator;
+
+#ifdef CPU_PROFILER_SUPPORTED
+
+static const char *CpuProfiler_phaseNames[] = {"mutator", "gc", "gc mark",
+                                               "gc sweep"};
+
+// A slot of the buffer, written by the signal handlers and read by the drain
+// thread. `sequence` tells whose turn it is, as in Vyukov's bounded queue: the
+// position of the next write while free, that position + 1 once written.
+typedef struct {
+    atomic_uint_fast64_t sequence;
+    int phase;
+    int depth;
+    uintptr_t addresses[CPU_PROFILER_MAX_DEPTH];
+} CpuProfilerSlot;
+
+// An aggregated stack with the samples that had it.
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    int phase;
+    int depth;
+    uintptr_t *addresses;
+} CpuProfilerStack;
+
+static char *CpuProfiler_path = NULL;
+static bool CpuProfiler_folded = false;
+static int CpuProfiler_frequency = CPU_PROFILER_DEFAULT_FREQUENCY;
+static uint64_t CpuProfiler_start_ns = 0;
+static uint64_t CpuProfiler_startTime_ns = 0;
+
+static CpuProfilerSlot *CpuProfiler_slots = NULL;
+static atomic_uint_fast64_t CpuProfiler_writePosition = 0;
+static uint64_t CpuProfiler_readPosition = 0;
+// samples dropped because the buffer was full
+static atomic_uint_fast64_t CpuProfiler_lost = 0;
+
+// only touched by the drain thread, then by the exit handler once it stopped
+static CpuProfilerStack *CpuProfiler_stacks = NULL;
+static uint32_t CpuProfiler_stackCount = 0;
+static uint32_t CpuProfiler_stackCapacity = 0;
+// open addressing table of the indices + 1 of the stacks
+static uint32_t *CpuProfiler_table = NULL;
+static uint32_t CpuProfiler_tableSize = 0;
+static bool CpuProfiler_failed = false;
+
+static pthread_t CpuProfiler_drainThread;
+static atomic_bool CpuProfiler_stopping = false;
+
+static uint64_t CpuProfiler_now(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Initializes `cursor` with the registers the signal interrupted, so that the
+ * first frame is the interrupted function. This libunwind cannot step out of
+ * a signal handler through the kernel's trampoline.
+ */
+static bool CpuProfiler_initCursor(unw_cursor_t *cursor, unw_context_t *local,
+                                   ucontext_t *context) {
+    if (unw_getcontext(local) != 0 || unw_init_local(cursor, local) != 0) {
+        return false;
+    }
+#if defined(__linux__) && defined(__x86_64__)
+    greg_t *registers = context->uc_mcontext.gregs;
+    unw_set_reg(cursor, UNW_X86_64_RAX, registers[REG_RAX]);
+    unw_set_reg(cursor, UNW_X86_64_RDX, registers[REG_RDX]);
+    unw_set_reg(cursor, UNW_X86_64_RCX, registers[REG_RCX]);
+    unw_set_reg(cursor, UNW_X86_64_RBX, registers[REG_RBX]);
+    unw_set_reg(cursor, UNW_X86_64_RSI, registers[REG_RSI]);
+    unw_set_reg(cursor, UNW_X86_64_RDI, registers[REG_RDI]);
+    unw_set_reg(cursor, UNW_X86_64_RBP, registers[REG_RBP]);
+    unw_set_reg(cursor, UNW_X86_64_RSP, registers[REG_RSP]);
+    unw_set_reg(cursor, UNW_X86_64_R8, registers[REG_R8]);
+    unw_set_reg(cursor, UNW_X86_64_R9, registers[REG_R9]);
+    unw_set_reg(cursor, UNW_X86_64_R10, registers[REG_R10]);
+    unw_set_reg(cursor, UNW_X86_64_R11, registers[REG_R11]);
+    unw_set_reg(cursor, UNW_X86_64_R12, registers[REG_R12]);
+    unw_set_reg(cursor, UNW_X86_64_R13, registers[REG_R13]);
+    unw_set_reg(cursor, UNW_X86_64_R14, registers[REG_R14]);
+    unw_set_reg(cursor, UNW_X86_64_R15, registers[REG_R15]);
+    unw_word_t ip = registers[REG_RIP];
+#elif defined(__linux__) && defined(__aarch64__)
+    for (int i = 0; i <= 30; i++) {
+        unw_set_reg(cursor, UNW_ARM64_X0 + i, context->uc_mcontext.regs[i]);
+    }
+    unw_set_reg(cursor, UNW_REG_SP, context->uc_mcontext.sp);
+    unw_word_t ip = context->uc_mcontext.pc;
+#elif defined(__APPLE__) && defined(__x86_64__)
+    _STRUCT_X86_THREAD_STATE64 *registers = &context->uc_mcontext->__ss;
+    unw_set_reg(cursor, UNW_X86_64_RAX, registers->__rax);
+    unw_set_reg(cursor, UNW_X86_64_RDX, registers->__rdx);
+    unw_set_reg(cursor, UNW_X86_64_RCX, registers->__rcx);
+    unw_set_reg(cursor, UNW_X86_64_RBX, registers->__rbx);
+    unw_set_reg(cursor, UNW_X86_64_RSI, registers->__rsi);
+    unw_set_reg(cursor, UNW_X86_64_RDI, registers->__rdi);
+    unw_set_reg(cursor, UNW_X86_64_RBP, registers->__rbp);
+    unw_set_reg(cursor, UNW_X86_64_RSP, registers->__rsp);
+    unw_set_reg(cursor, UNW_X86_64_R8, registers->__r8);
+    unw_set_reg(cursor, UNW_X86_64_R9, registers->__r9);
+    unw_set_reg(cursor, UNW_X86_64_R10, registers->__r10);
+    unw_set_reg(cursor, UNW_X86_64_R11, registers->__r11);
+    unw_set_reg(cursor, UNW_X86_64_R12, registers->__r12);
+    unw_set_reg(cursor, UNW_X86_64_R13, registers->__r13);
+    unw_set_reg(cursor, UNW_X86_64_R14, registers->__r14);
+    unw_set_reg(cursor, UNW_X86_64_R15, registers->__r15);
+    unw_word_t ip = registers->__rip;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    _STRUCT_ARM_THREAD_STATE64 *registers = &context->uc_mcontext->__ss;
+    for (int i = 0; i <= 28; i++) {
+        unw_set_reg(cursor, UNW_ARM64_X0 + i, registers->__x[i]);
+    }
+    unw_set_reg(cursor, UNW_ARM64_X29, registers->__fp);
+    unw_set_reg(cursor, UNW_ARM64_X30, registers->__lr);
+    unw_set_reg(cursor, UNW_REG_SP, registers->__sp);
+    unw_word_t ip = registers->__pc;
+#endif
+    // last, setting the ip looks up the unwind info of the function
+    return unw_set_reg(cursor, UNW_REG_IP, ip) == 0;
+}
+
+/**
+ * Fills `addresses` with the stack the signal interrupted, innermost first,
+ * and returns its depth. Walking the stack allocates nothing. libunwind finds
+ * the unwind tables with dl_iterate_phdr, whose lock is recursive, so even a
+ * thread interrupted while holding it can be sampled.
+ */
+static int CpuProfiler_unwind(ucontext_t *context, uintptr_t *addresses) {
+    unw_cursor_t cursor;
+    unw_context_t local;
+    if (!CpuProfiler_initCursor(&cursor, &local, context)) {
+        return 0;
+    }
+    int depth = 0;
+    do {
+        unw_word_t ip;
+        if (unw_get_reg(&cursor, UNW_REG_IP, &ip) != 0 || ip == 0) {
+            break;
+        }
+        // stored like the return addresses of the outer frames, which are
+        // symbolized at the address before them
+        addresses[depth] = depth == 0 ? ip + 1 : ip;
+        depth++;
+    } while (depth < CPU_PROFILER_MAX_DEPTH && unw_step(&cursor) > 0);
+    return depth;
+}
+
+/**
+ * Takes a sample of the interrupted thread. Only touches the buffer, a slot is
+ * claimed with a compare and swap and published by its sequence.
+ */
+static void CpuProfiler_onSignal(int signal, siginfo_t *info, void *context) {
+    int savedErrno = errno;
+    uint64_t position = atomic_load_explicit(&CpuProfiler_writePosition,
+                                             memory_order_relaxed);
+    CpuProfilerSlot *slot;
+    while (true) {
+        slot = &CpuProfiler_slots[position & (CPU_PROFILER_BUFFER_SIZE - 1)];
+        uint64_t sequence =
+            atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == position) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &CpuProfiler_writePosition, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // the drain thread is behind
+            atomic_fetch_add_explicit(&CpuProfiler_lost, 1,
+                                      memory_order_relaxed);
+            errno = savedErrno;
+            return;
+        } else {
+            position = atomic_load_explicit(&CpuProfiler_writePosition,
+                                            memory_order_relaxed);
+        }
+    }
+    slot->phase = cpuProfilerPhase;
+    slot->depth = CpuProfiler_unwind((ucontext_t *)context, slot->addresses);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    errno = savedErrno;
+}
+
+static uint64_t CpuProfiler_hash(int phase, const uintptr_t *addresses,
+                                 int depth) {
+    // FNV-1a over the words
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)phase;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ addresses[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool CpuProfiler_growTable() {
+    uint32_t size = CpuProfiler_tableSize == 0 ? CPU_PROFILER_INITIAL_CAPACITY
+                                               : 2 * CpuProfiler_tableSize;
+    uint32_t *table = calloc(size, sizeof(uint32_t));
+    if (table == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < CpuProfiler_stackCount; i++) {
+        uint32_t index = CpuProfiler_stacks[i].hash & (size - 1);
+        while (table[index] != 0) {
+            index = (index + 1) & (size - 1);
+        }
+        table[index] = i + 1;
+    }
+    free(CpuProfiler_table);
+    CpuProfiler_table = table;
+    CpuProfiler_tableSize = size;
+    return true;
+}
+
+/**
+ * Counts a sample of the stack, added the first time it is seen.
+ */
+static void CpuProfiler_aggregate(int phase, const uintptr_t *addresses,
+                                  int depth) {
+    if (2 * (CpuProfiler_stackCount + 1) > CpuProfiler_tableSize &&
+        !CpuProfiler_growTable()) {
+        CpuProfiler_failed = true;
+        return;
+    }
+    uint64_t hash = CpuProfiler_hash(phase, addresses, depth);
+    uint32_t mask = CpuProfiler_tableSize - 1;
+    uint32_t index = hash & mask;
+    for (; CpuProfiler_table[index] != 0; index = (index + 1) & mask) {
+        CpuProfilerStack *stack =
+            &CpuProfiler_stacks[CpuProfiler_table[index] - 1];
+        if (stack->hash == hash && stack->phase == phase &&
+            stack->depth == depth &&
+            memcmp(stack->addresses, addresses, depth * sizeof(uintptr_t)) ==
+                0) {
+            stack->count++;
+            return;
+        }
+    }
+    if (CpuProfiler_stackCount == CpuProfiler_stackCapacity) {
+        uint32_t capacity = CpuProfiler_stackCapacity == 0
+                                ? CPU_PROFILER_INITIAL_CAPACITY
+                                : 2 * CpuProfiler_stackCapacity;
+        CpuProfilerStack *stacks = realloc(
+            CpuProfiler_stacks, capacity * sizeof(CpuProfilerStack));
+        if (stacks == NULL) {
+            CpuProfiler_failed = true;
+            return;
+        }
+        CpuProfiler_stacks = stacks;
+        CpuProfiler_stackCapacity = capacity;
+    }
+    uintptr_t *copy = malloc((depth > 0 ? depth : 1) * sizeof(uintptr_t));
+    if (copy == NULL) {
+        CpuProfiler_failed = true;
+        return;
+    }
+    memcpy(copy, addresses, depth * sizeof(uintptr_t));
+    CpuProfiler_stacks[CpuProfiler_stackCount] =
+        (CpuProfilerStack){hash, 1, phase, depth, copy};
+    CpuProfiler_table[index] = ++CpuProfiler_stackCount;
+}
+
+/**
+ * Aggregates the samples published so far. It stops at the first slot still
+ * being written, which is read next time.
+ */
+static void CpuProfiler_drain() {
+    while (true) {
+        uint64_t position = CpuProfiler_readPosition;
+        CpuProfilerSlot *slot =
+            &CpuProfiler_slots[position & (CPU_PROFILER_BUFFER_SIZE - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+            position + 1) {
+            return;
+        }
+        CpuProfiler_aggregate(slot->phase, slot->addresses, slot->depth);
+        atomic_store_explicit(&slot->sequence,
+                              position + CPU_PROFILER_BUFFER_SIZE,
+                              memory_order_release);
+        CpuProfiler_readPosition = position + 1;
+    }
+}
+
+static void *CpuProfiler_drainLoop(void *arg) {
+    struct timespec interval = {0, CPU_PROFILER_DRAIN_INTERVAL_NS};
+    while (!atomic_load(&CpuProfiler_stopping)) {
+        nanosleep(&interval, NULL);
+        CpuProfiler_drain();
+    }
+    return NULL;
+}
+
+/**
+ * Writes the name of the function at `address` to `buffer`, or the object it
+ * is in and the offset when it has no symbol.
+ */
+static void CpuProfiler_frameName(uintptr_t address, char *buffer,
+                                  size_t size) {
+    Dl_info info;
+    if (dladdr((void *)(address - 1), &info) == 0) {
+        snprintf(buffer, size, "0x%" PRIxPTR, address - 1);
+    } else if (info.dli_sname != NULL) {
+        snprintf(buffer, size, "%s", info.dli_sname);
+    } else {
+        const char *file = info.dli_fname != NULL ? info.dli_fname : "";
+        const char *slash = strrchr(file, '/');
+        snprintf(buffer, size, "%s+0x%" PRIxPTR,
+                 slash != NULL ? slash + 1 : file,
+                 address - 1 - (uintptr_t)info.dli_fbase);
+    }
+}
+
+typedef struct {
+    char *frames;
+    uint64_t count;
+} CpuProfilerLine;
+
+static int CpuProfiler_compareLines(const void *a, const void *b) {
+    return strcmp(((CpuProfilerLine *)a)->frames,
+                  ((CpuProfilerLine *)b)->frames);
+}
+
+/**
+ * Returns the phase then the frames of `stack` from the outermost, separated
+ * by semicolons, or NULL if the memory ran out.
+ */
+static char *CpuProfiler_foldStack(CpuProfilerStack *stack) {
+    char *frames = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&frames, &size);
+    if (out == NULL) {
+        return NULL;
+    }
+    fprintf(out, "[%s]", CpuProfiler_phaseNames[stack->phase]);
+    char name[CPU_PROFILER_NAME_SIZE];
+    for (int i = stack->depth - 1; i >= 0; i--) {
+        CpuProfiler_frameName(stack->addresses[i], name, sizeof(name));
+        // the separator of the format cannot be in a frame
+        for (char *c = name; *c != '\0'; c++) {
+            if (*c == ';') {
+                *c = '_';
+            }
+        }
+        fprintf(out, ";%s", name);
+    }
+    bool failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        free(frames);
+        return NULL;
+    }
+    return frames;
+}
+
+/**
+ * Writes a line per stack, its frames followed by the number of samples.
+ * Stacks that differ only by addresses in the same functions are merged.
+ */
+static bool CpuProfiler_writeFolded(const char *path) {
+    uint32_t count = CpuProfiler_stackCount;
+    CpuProfilerLine *lines = calloc(count + 1, sizeof(CpuProfilerLine));
+    if (lines == NULL) {
+        return false;
+    }
+    bool written = true;
+    for (uint32_t i = 0; i < count && written; i++) {
+        lines[i].frames = CpuProfiler_foldStack(&CpuProfiler_stacks[i]);
+        lines[i].count = CpuProfiler_stacks[i].count;
+        written = lines[i].frames != NULL;
+    }
+    FILE *out = written ? fopen(path, "w") : NULL;
+    if (out != NULL) {
+        qsort(lines, count, sizeof(CpuProfilerLine), CpuProfiler_compareLines);
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t samples = lines[i].count;
+            while (i + 1 < count &&
+                   strcmp(lines[i].frames, lines[i + 1].frames) == 0) {
+                samples += lines[++i].count;
+            }
+            fprintf(out, "%s %" PRIu64 "\n", lines[i].frames, samples);
+        }
+        written = !ferror(out);
+        written = fclose(out) == 0 && written;
+    } else {
+        written = false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        free(lines[i].frames);
+    }
+    free(lines);
+    return written;
+}
+
+static bool CpuProfiler_writePprof(const char *path, uint64_t period_ns) {
+    PprofValueType sampleTypes[] = {{"samples", "count"},
+                                    {"cpu", "nanoseconds"}};
+    PprofValueType periodType = {"cpu", "nanoseconds"};
+    Pprof *pprof = Pprof_Create(sampleTypes, 2, periodType, period_ns);
+    if (pprof == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < CpuProfiler_stackCount; i++) {
+        CpuProfilerStack *stack = &CpuProfiler_stacks[i];
+        int64_t values[] = {stack->count, stack->count * period_ns};
+        Pprof_AddSample(pprof, stack->addresses, stack->depth, values, "phase",
+                        CpuProfiler_phaseNames[stack->phase]);
+    }
+    uint64_t duration_ns =
+        CpuProfiler_now(CLOCK_MONOTONIC) - CpuProfiler_start_ns;
+    bool written =
+        Pprof_Write(pprof, path, CpuProfiler_startTime_ns, duration_ns);
+    Pprof_Free(pprof);
+    return written;
+}
+
+static void CpuProfiler_onExit() {
+    struct itimerval off = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &off, NULL);
+    atomic_store(&CpuProfiler_stopping, true);
+    pthread_join(CpuProfiler_drainThread, NULL);
+    CpuProfiler_drain();
+    uint64_t period_ns = 1000000000ULL / CpuProfiler_frequency;
+    bool written = CpuProfiler_folded
+                       ? CpuProfiler_writeFolded(CpuProfiler_path)
+                       : CpuProfiler_writePprof(CpuProfiler_path, period_ns);
+    if (!written || CpuProfiler_failed) {
+        fprintf(stderr, "CPU profile: cannot write %s\n", CpuProfiler_path);
+    }
+    uint64_t lost = atomic_load(&CpuProfiler_lost);
+    if (lost > 0) {
+        fprintf(stderr, "CPU profile: %" PRIu64 " samples lost\n", lost);
+    }
+}
+
+/**
+ * Starts the profiler if CPU_PROFILE_FILE_SETTING is set. The signal is only
+ * handled if the program does not handle it itself.
+ */
+void CpuProfiler_Init() {
+    char *path = getenv(CPU_PROFILE_FILE_SETTING);
+    if (path == NULL || CpuProfiler_path != NULL) {
+        return;
+    }
+    char *frequency = getenv(CPU_PROFILE_FREQUENCY_SETTING);
+    if (frequency != NULL) {
+        CpuProfiler_frequency = atoi(frequency);
+        if (CpuProfiler_frequency <= 0 ||
+            CpuProfiler_frequency > CPU_PROFILER_MAX_FREQUENCY) {
+            fprintf(stderr,
+                    CPU_PROFILE_FREQUENCY_SETTING
+                    " should be between 1 and %d\n",
+                    CPU_PROFILER_MAX_FREQUENCY);
+            exit(1);
+        }
+    }
+    char *format = getenv(CPU_PROFILE_FORMAT_SETTING);
+    CpuProfiler_folded = format != NULL && strcmp(format, "folded") == 0;
+
+    struct sigaction previous;
+    if (sigaction(SIGPROF, NULL, &previous) != 0 ||
+        previous.sa_handler != SIG_DFL) {
+        return;
+    }
+    CpuProfiler_path = strdup(path);
+    CpuProfiler_slots =
+        calloc(CPU_PROFILER_BUFFER_SIZE, sizeof(CpuProfilerSlot));
+    if (CpuProfiler_path == NULL || CpuProfiler_slots == NULL) {
+        return;
+    }
+    for (uint64_t i = 0; i < CPU_PROFILER_BUFFER_SIZE; i++) {
+        atomic_init(&CpuProfiler_slots[i].sequence, i);
+    }
+    CpuProfiler_start_ns = CpuProfiler_now(CLOCK_MONOTONIC);
+    CpuProfiler_startTime_ns = CpuProfiler_now(CLOCK_REALTIME);
+
+    // the drain thread is not sampled
+    sigset_t profile, saved;
+    sigemptyset(&profile);
+    sigaddset(&profile, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &profile, &saved);
+    int error = pthread_create(&CpuProfiler_drainThread, NULL,
+                               CpuProfiler_drainLoop, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (error != 0) {
+        return;
+    }
+    atexit(CpuProfiler_onExit);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = CpuProfiler_onSignal;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    long interval_us = 1000000L / CpuProfiler_frequency;
+    struct itimerval timer = {{interval_us / 1000000, interval_us % 1000000},
+                              {interval_us / 1000000, interval_us % 1000000}};
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+#else
+
+void CpuProfiler_Init() {
+    if (getenv(CPU_PROFILE_FILE_SETTING) != NULL) {
+        fprintf(stderr, "CPU profile: not supported on this platform\n");
+    }
+}
+
+#endif // CPU_PROFILER_SUPPORTED
@@ -0,0 +1,45 @@
+#ifndef SCALANATIVE_CPU_PROFILER_H
+#define SCALANATIVE_CPU_PROFILER_H
+
+#include <signal.h>
+#include <stdatomic.h>
+
+// Samples the stacks of the running threads with SIGPROF, on average
+// SCALANATIVE_CPU_PROFILE_FREQUENCY times per second of CPU time (100 by
+// default), when SCALANATIVE_CPU_PROFILE_FILE is set. The profile is written
+// there when the program exits, in the pprof format, or as folded stacks for
+// flame graphs if SCALANATIVE_CPU_PROFILE_FORMAT is "folded".
+//
+// Each sample is tagged with what the thread was doing, so that the time of
+// the collector can be told apart from the time of the program. The GCs set
+// the phase around their work with `CpuProfiler_EnterPhase`.
+
+typedef enum {
+    cpu_mutator = 0,
+    // collecting, but neither marking nor sweeping
+    cpu_gc = 1,
+    cpu_gc_mark = 2,
+    cpu_gc_sweep = 3
+} CpuProfilerPhase;
+
+extern _Thread_local volatile sig_atomic_t cpuProfilerPhase;
+
+void CpuProfiler_Init();
+
+/**
+ * Tags the samples of this thread with `phase` until `CpuProfiler_LeavePhase`
+ * restores the phase returned.
+ */
+static inline CpuProfilerPhase CpuProfiler_EnterPhase(CpuProfilerPhase phase) {
+    CpuProfilerPhase previous = (CpuProfilerPhase)cpuProfilerPhase;
+    cpuProfilerPhase = phase;
+    atomic_signal_fence(memory_order_seq_cst);
+    return previous;
+}
+
+static inline void CpuProfiler_LeavePhase(CpuProfilerPhase previous) {
+    atomic_signal_fence(memory_order_seq_cst);
+    cpuProfilerPhase = previous;
+}
+
+#endif // SCALANATIVE_CPU_PROFILER_H
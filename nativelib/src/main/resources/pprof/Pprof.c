@@ -0,0 +1,472 @@
+#define _GNU_SOURCE
+#include "Pprof.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// field numbers of profile.proto
+#define PROFILE_SAMPLE_TYPE 1
+#define PROFILE_SAMPLE 2
+#define PROFILE_MAPPING 3
+#define PROFILE_LOCATION 4
+#define PROFILE_FUNCTION 5
+#define PROFILE_STRING_TABLE 6
+#define PROFILE_TIME_NANOS 9
+#define PROFILE_DURATION_NANOS 10
+#define PROFILE_PERIOD_TYPE 11
+#define PROFILE_PERIOD 12
+#define VALUE_TYPE_TYPE 1
+#define VALUE_TYPE_UNIT 2
+#define SAMPLE_LOCATION_ID 1
+#define SAMPLE_VALUE 2
+#define SAMPLE_LABEL 3
+#define LABEL_KEY 1
+#define LABEL_STR 2
+#define MAPPING_ID 1
+#define MAPPING_MEMORY_START 2
+#define MAPPING_MEMORY_LIMIT 3
+#define MAPPING_FILENAME 5
+#define MAPPING_HAS_FUNCTIONS 7
+#define LOCATION_ID 1
+#define LOCATION_MAPPING_ID 2
+#define LOCATION_ADDRESS 3
+#define LOCATION_LINE 4
+#define LINE_FUNCTION_ID 1
+#define FUNCTION_ID 1
+#define FUNCTION_NAME 2
+#define FUNCTION_SYSTEM_NAME 3
+#define FUNCTION_FILENAME 4
+
+#define WIRE_VARINT 0
+#define WIRE_BYTES 2
+
+#define PPROF_INITIAL_CAPACITY 256
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    // an allocation failed, the contents are incomplete
+    bool failed;
+} PprofBuffer;
+
+// Interned strings or addresses, found through an open addressing table of
+// their indices + 1.
+typedef struct {
+    void *items;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t slotCount;
+} PprofTable;
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t limit;
+    uint32_t filename;
+} PprofMapping;
+
+struct Pprof {
+    PprofValueType *sampleTypes;
+    int sampleTypeCount;
+    PprofValueType periodType;
+    int64_t period;
+    // Sample fields of the profile, encoded as they are added
+    PprofBuffer samples;
+    // the string table, the first string is empty
+    PprofTable strings;
+    // the address of each location, the location id is the index + 1
+    PprofTable addresses;
+};
+
+static bool PprofBuffer_reserve(PprofBuffer *buffer, size_t size) {
+    if (buffer->failed) {
+        return false;
+    }
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity == 0 ? PPROF_INITIAL_CAPACITY
+                                                : buffer->capacity * 2;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(buffer->data, capacity);
+        if (data == NULL) {
+            buffer->failed = true;
+            return false;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    return true;
+}
+
+static void PprofBuffer_append(PprofBuffer *buffer, const void *data,
+                               size_t size) {
+    if (PprofBuffer_reserve(buffer, size)) {
+        memcpy(buffer->data + buffer->size, data, size);
+        buffer->size += size;
+    }
+}
+
+static void PprofBuffer_varint(PprofBuffer *buffer, uint64_t value) {
+    uint8_t bytes[10];
+    int count = 0;
+    do {
+        bytes[count] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+        count++;
+    } while (value != 0);
+    PprofBuffer_append(buffer, bytes, count);
+}
+
+static void PprofBuffer_varintField(PprofBuffer *buffer, int field,
+                                    uint64_t value) {
+    PprofBuffer_varint(buffer, (uint64_t)field << 3 | WIRE_VARINT);
+    PprofBuffer_varint(buffer, value);
+}
+
+static void PprofBuffer_bytesField(PprofBuffer *buffer, int field,
+                                   const void *data, size_t size) {
+    PprofBuffer_varint(buffer, (uint64_t)field << 3 | WIRE_BYTES);
+    PprofBuffer_varint(buffer, size);
+    PprofBuffer_append(buffer, data, size);
+}
+
+/**
+ * Appends `message` as the field and empties it for the next message.
+ */
+static void PprofBuffer_messageField(PprofBuffer *buffer, int field,
+                                     PprofBuffer *message) {
+    if (message->failed) {
+        buffer->failed = true;
+    }
+    PprofBuffer_bytesField(buffer, field, message->data, message->size);
+    message->size = 0;
+}
+
+static void PprofBuffer_free(PprofBuffer *buffer) { free(buffer->data); }
+
+static uint64_t Pprof_hashBytes(const void *data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t Pprof_hashString(PprofTable *table, uint32_t index) {
+    const char *string = ((char **)table->items)[index];
+    return Pprof_hashBytes(string, strlen(string));
+}
+
+static uint64_t Pprof_hashAddress(PprofTable *table, uint32_t index) {
+    uintptr_t address = ((uintptr_t *)table->items)[index];
+    return Pprof_hashBytes(&address, sizeof(address));
+}
+
+typedef uint64_t (*PprofHash)(PprofTable *table, uint32_t index);
+
+/**
+ * Makes room for one more item, `itemSize` bytes large. Returns false if the
+ * memory ran out.
+ */
+static bool PprofTable_reserve(PprofTable *table, size_t itemSize,
+                               PprofHash hash) {
+    if (table->count == table->capacity) {
+        uint32_t capacity = table->capacity == 0 ? PPROF_INITIAL_CAPACITY
+                                                 : table->capacity * 2;
+        void *items = realloc(table->items, capacity * itemSize);
+        if (items == NULL) {
+            return false;
+        }
+        table->items = items;
+        table->capacity = capacity;
+    }
+    // at most half full
+    if (2 * (table->count + 1) > table->slotCount) {
+        uint32_t slotCount = table->slotCount == 0 ? 2 * PPROF_INITIAL_CAPACITY
+                                                   : table->slotCount * 2;
+        uint32_t *slots = calloc(slotCount, sizeof(uint32_t));
+        if (slots == NULL) {
+            return false;
+        }
+        for (uint32_t i = 0; i < table->count; i++) {
+            uint32_t slot = hash(table, i) & (slotCount - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->slotCount = slotCount;
+    }
+    return true;
+}
+
+/**
+ * Returns the index of `string` in the string table, adding it if needed.
+ * Returns 0, the empty string, if the memory ran out.
+ */
+static uint32_t Pprof_string(Pprof *pprof, const char *string) {
+    PprofTable *table = &pprof->strings;
+    if (!PprofTable_reserve(table, sizeof(char *), Pprof_hashString)) {
+        return 0;
+    }
+    uint32_t mask = table->slotCount - 1;
+    uint32_t slot = Pprof_hashBytes(string, strlen(string)) & mask;
+    char **strings = table->items;
+    for (; table->slots[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t index = table->slots[slot] - 1;
+        if (strcmp(strings[index], string) == 0) {
+            return index;
+        }
+    }
+    char *copy = strdup(string);
+    if (copy == NULL) {
+        return 0;
+    }
+    strings[table->count] = copy;
+    table->slots[slot] = ++table->count;
+    return table->count - 1;
+}
+
+/**
+ * Returns the id of the location at `address`, adding it if needed. Returns 0
+ * if the memory ran out.
+ */
+static uint32_t Pprof_location(Pprof *pprof, uintptr_t address) {
+    PprofTable *table = &pprof->addresses;
+    if (!PprofTable_reserve(table, sizeof(uintptr_t), Pprof_hashAddress)) {
+        return 0;
+    }
+    uint32_t mask = table->slotCount - 1;
+    uint32_t slot = Pprof_hashBytes(&address, sizeof(address)) & mask;
+    uintptr_t *addresses = table->items;
+    for (; table->slots[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t index = table->slots[slot] - 1;
+        if (addresses[index] == address) {
+            return index + 1;
+        }
+    }
+    addresses[table->count] = address;
+    table->slots[slot] = ++table->count;
+    return table->count;
+}
+
+Pprof *Pprof_Create(const PprofValueType *sampleTypes, int sampleTypeCount,
+                    PprofValueType periodType, int64_t period) {
+    Pprof *pprof = calloc(1, sizeof(Pprof));
+    if (pprof == NULL) {
+        return NULL;
+    }
+    pprof->sampleTypes = calloc(sampleTypeCount, sizeof(PprofValueType));
+    if (pprof->sampleTypes == NULL) {
+        free(pprof);
+        return NULL;
+    }
+    memcpy(pprof->sampleTypes, sampleTypes,
+           sampleTypeCount * sizeof(PprofValueType));
+    pprof->sampleTypeCount = sampleTypeCount;
+    pprof->periodType = periodType;
+    pprof->period = period;
+    Pprof_string(pprof, "");
+    return pprof;
+}
+
+/**
+ * Adds a sample with a value for each sample type. The label is left out if
+ * `labelKey` is NULL.
+ */
+void Pprof_AddSample(Pprof *pprof, const uintptr_t *addresses, int depth,
+                     const int64_t *values, const char *labelKey,
+                     const char *labelValue) {
+    PprofBuffer sample = {0};
+    PprofBuffer packed = {0};
+    for (int i = 0; i < depth; i++) {
+        PprofBuffer_varint(&packed, Pprof_location(pprof, addresses[i]));
+    }
+    PprofBuffer_messageField(&sample, SAMPLE_LOCATION_ID, &packed);
+    for (int i = 0; i < pprof->sampleTypeCount; i++) {
+        PprofBuffer_varint(&packed, (uint64_t)values[i]);
+    }
+    PprofBuffer_messageField(&sample, SAMPLE_VALUE, &packed);
+    if (labelKey != NULL) {
+        PprofBuffer_varintField(&packed, LABEL_KEY,
+                                Pprof_string(pprof, labelKey));
+        PprofBuffer_varintField(&packed, LABEL_STR,
+                                Pprof_string(pprof, labelValue));
+        PprofBuffer_messageField(&sample, SAMPLE_LABEL, &packed);
+    }
+    PprofBuffer_messageField(&pprof->samples, PROFILE_SAMPLE, &sample);
+    PprofBuffer_free(&sample);
+    PprofBuffer_free(&packed);
+}
+
+static void Pprof_valueTypeField(Pprof *pprof, PprofBuffer *buffer, int field,
+                                 PprofValueType valueType) {
+    PprofBuffer message = {0};
+    PprofBuffer_varintField(&message, VALUE_TYPE_TYPE,
+                            Pprof_string(pprof, valueType.type));
+    PprofBuffer_varintField(&message, VALUE_TYPE_UNIT,
+                            Pprof_string(pprof, valueType.unit));
+    PprofBuffer_messageField(buffer, field, &message);
+    PprofBuffer_free(&message);
+}
+
+/**
+ * Writes the locations, with the functions and mappings they are in, to `out`.
+ * A location whose address is not in a symbol has no function.
+ */
+static bool Pprof_writeLocations(Pprof *pprof, PprofBuffer *out) {
+    uint32_t count = pprof->addresses.count;
+    uintptr_t *addresses = pprof->addresses.items;
+    // the function name of each location, 0 if there is none
+    uint32_t *names = calloc(count + 1, sizeof(uint32_t));
+    uint32_t *mappingIds = calloc(count + 1, sizeof(uint32_t));
+    PprofMapping *mappings = calloc(count + 1, sizeof(PprofMapping));
+    uint32_t mappingCount = 0;
+    if (names == NULL || mappingIds == NULL || mappings == NULL) {
+        free(names);
+        free(mappingIds);
+        free(mappings);
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        Dl_info info;
+        // return addresses are past the call, which may be the last
+        // instruction of the function
+        if (dladdr((void *)(addresses[i] - 1), &info) == 0) {
+            continue;
+        }
+        if (info.dli_sname != NULL) {
+            names[i] = Pprof_string(pprof, info.dli_sname);
+        }
+        uintptr_t start = (uintptr_t)info.dli_fbase;
+        uint32_t mapping = 0;
+        while (mapping < mappingCount && mappings[mapping].start != start) {
+            mapping++;
+        }
+        if (mapping == mappingCount) {
+            mappings[mapping].start = start;
+            mappings[mapping].filename = Pprof_string(
+                pprof, info.dli_fname != NULL ? info.dli_fname : "");
+            mappingCount++;
+        }
+        if (addresses[i] + 1 > mappings[mapping].limit) {
+            mappings[mapping].limit = addresses[i] + 1;
+        }
+        mappingIds[i] = mapping + 1;
+    }
+
+    PprofBuffer message = {0};
+    PprofBuffer line = {0};
+    for (uint32_t i = 0; i < mappingCount; i++) {
+        PprofBuffer_varintField(&message, MAPPING_ID, i + 1);
+        PprofBuffer_varintField(&message, MAPPING_MEMORY_START,
+                                mappings[i].start);
+        PprofBuffer_varintField(&message, MAPPING_MEMORY_LIMIT,
+                                mappings[i].limit);
+        PprofBuffer_varintField(&message, MAPPING_FILENAME,
+                                mappings[i].filename);
+        PprofBuffer_varintField(&message, MAPPING_HAS_FUNCTIONS, 1);
+        PprofBuffer_messageField(out, PROFILE_MAPPING, &message);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        PprofBuffer_varintField(&message, LOCATION_ID, i + 1);
+        if (mappingIds[i] != 0) {
+            PprofBuffer_varintField(&message, LOCATION_MAPPING_ID,
+                                    mappingIds[i]);
+        }
+        PprofBuffer_varintField(&message, LOCATION_ADDRESS, addresses[i]);
+        if (names[i] != 0) {
+            PprofBuffer_varintField(&line, LINE_FUNCTION_ID, names[i]);
+            PprofBuffer_messageField(&message, LOCATION_LINE, &line);
+        }
+        PprofBuffer_messageField(out, PROFILE_LOCATION, &message);
+    }
+    // a function for each name, its id is the index of the name
+    uint32_t stringCount = pprof->strings.count;
+    bool *written = calloc(stringCount, sizeof(bool));
+    if (written == NULL) {
+        out->failed = true;
+    }
+    for (uint32_t i = 0; i < count && written != NULL; i++) {
+        uint32_t name = names[i];
+        if (name != 0 && !written[name]) {
+            written[name] = true;
+            PprofBuffer_varintField(&message, FUNCTION_ID, name);
+            PprofBuffer_varintField(&message, FUNCTION_NAME, name);
+            PprofBuffer_varintField(&message, FUNCTION_SYSTEM_NAME, name);
+            if (mappingIds[i] != 0) {
+                PprofBuffer_varintField(
+                    &message, FUNCTION_FILENAME,
+                    mappings[mappingIds[i] - 1].filename);
+            }
+            PprofBuffer_messageField(out, PROFILE_FUNCTION, &message);
+        }
+    }
+    PprofBuffer_free(&message);
+    PprofBuffer_free(&line);
+    free(written);
+    free(names);
+    free(mappingIds);
+    free(mappings);
+    return !out->failed;
+}
+
+/**
+ * Writes the profile to the file at `path`, returns false if it could not.
+ */
+bool Pprof_Write(Pprof *pprof, const char *path, int64_t time_ns,
+                 int64_t duration_ns) {
+    PprofBuffer out = {0};
+    for (int i = 0; i < pprof->sampleTypeCount; i++) {
+        Pprof_valueTypeField(pprof, &out, PROFILE_SAMPLE_TYPE,
+                             pprof->sampleTypes[i]);
+    }
+    Pprof_valueTypeField(pprof, &out, PROFILE_PERIOD_TYPE, pprof->periodType);
+    PprofBuffer_varintField(&out, PROFILE_PERIOD, (uint64_t)pprof->period);
+    PprofBuffer_varintField(&out, PROFILE_TIME_NANOS, (uint64_t)time_ns);
+    PprofBuffer_varintField(&out, PROFILE_DURATION_NANOS,
+                            (uint64_t)duration_ns);
+    PprofBuffer_append(&out, pprof->samples.data, pprof->samples.size);
+    // interns the function and file names, the string table goes last
+    Pprof_writeLocations(pprof, &out);
+    char **strings = pprof->strings.items;
+    for (uint32_t i = 0; i < pprof->strings.count; i++) {
+        PprofBuffer_bytesField(&out, PROFILE_STRING_TABLE, strings[i],
+                               strlen(strings[i]));
+    }
+
+    bool written = false;
+    if (!out.failed && !pprof->samples.failed) {
+        FILE *file = fopen(path, "wb");
+        if (file != NULL) {
+            written = fwrite(out.data, 1, out.size, file) == out.size;
+            written = fclose(file) == 0 && written;
+        }
+    }
+    PprofBuffer_free(&out);
+    return written;
+}
+
+void Pprof_Free(Pprof *pprof) {
+    if (pprof == NULL) {
+        return;
+    }
+    char **strings = pprof->strings.items;
+    for (uint32_t i = 0; i < pprof->strings.count; i++) {
+        free(strings[i]);
+    }
+    free(pprof->strings.items);
+    free(pprof->strings.slots);
+    free(pprof->addresses.items);
+    free(pprof->addresses.slots);
+    PprofBuffer_free(&pprof->samples);
+    free(pprof->sampleTypes);
+    free(pprof);
+}
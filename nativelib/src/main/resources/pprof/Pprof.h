@@ -0,0 +1,31 @@
+#ifndef SCALANATIVE_PPROF_H
+#define SCALANATIVE_PPROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Builds a profile in the protocol buffer format of pprof, see
+// https://github.com/google/pprof/blob/master/proto/profile.proto
+// Samples are stacks of return addresses, innermost first, with one value per
+// sample type. The addresses are symbolized with dladdr when the profile is
+// written, which relies on the binary being linked with -rdynamic. The file is
+// not compressed, pprof reads it as it is.
+
+typedef struct Pprof Pprof;
+
+typedef struct {
+    const char *type;
+    const char *unit;
+} PprofValueType;
+
+Pprof *Pprof_Create(const PprofValueType *sampleTypes, int sampleTypeCount,
+                    PprofValueType periodType, int64_t period);
+void Pprof_AddSample(Pprof *pprof, const uintptr_t *addresses, int depth,
+                     const int64_t *values, const char *labelKey,
+                     const char *labelValue);
+bool Pprof_Write(Pprof *pprof, const char *path, int64_t time_ns,
+                 int64_t duration_ns);
+void Pprof_Free(Pprof *pprof);
+
+#endif // SCALANATIVE_PPROF_H
@@ -11,7 +11,10 @@ class _Object {
     this eq that
 
   @inline def __hashCode(): scala.Int = {
-    val addr = castRawPtrToLong(castObjectToRawPtr(this))
+    val rawptr = castObjectToRawPtr(this)
+    // the hash is derived from the address, the object must not move anymore
+    runtime.pin(rawptr)
+    val addr = castRawPtrToLong(rawptr)
     addr.toInt ^ (addr >> 32).toInt
   }
 
@@ -22,19 +25,19 @@ class _Object {
     new _Class(runtime.getRawType(this))
 
   @inline def __notify(): Unit =
-    runtime.getMonitor(this)._notify
+    runtime.Monitor._notify(this)
 
   @inline def __notifyAll(): Unit =
-    runtime.getMonitor(this)._notifyAll
+    runtime.Monitor._notifyAll(this)
 
   @inline def __wait(): Unit =
-    runtime.getMonitor(this)._wait
+    runtime.Monitor._wait(this, 0L, 0)
 
   @inline def __wait(timeout: scala.Long): Unit =
-    runtime.getMonitor(this)._wait(timeout)
+    runtime.Monitor._wait(this, timeout, 0)
 
   @inline def __wait(timeout: scala.Long, nanos: Int): Unit =
-    runtime.getMonitor(this)._wait(timeout, nanos)
+    runtime.Monitor._wait(this, timeout, nanos)
 
   @inline def __scala_==(that: _Object): scala.Boolean = {
     // This implementation is only called for classes that don't override
@@ -47,7 +50,9 @@ class _Object {
     // This implementation is only called for classes that don't override
     // hashCode. Otherwise, whenever hashCode is overriden, we also update the
     // vtable entry for scala_## to point to the override directly.
-    val addr = castRawPtrToLong(castObjectToRawPtr(this))
+    val rawptr = castObjectToRawPtr(this)
+    runtime.pin(rawptr)
+    val addr = castRawPtrToLong(rawptr)
     addr.toInt ^ (addr >> 32).toInt
   }
 
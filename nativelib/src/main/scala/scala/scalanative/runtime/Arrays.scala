@@ -23,10 +23,16 @@ sealed abstract class Array[T]
   /** Size between elements in the array. */
   def stride: CSize
 
-  /** Pointer to the element. */
-  @inline def at(i: Int): Ptr[T] = fromRawPtr[T](atRaw(i))
+  /** Pointer to the element. The array does not move anymore, the pointer
+   *  may be kept, also in native memory.
+   */
+  @inline def at(i: Int): Ptr[T] = {
+    val rawptr = atRaw(i)
+    pin(castObjectToRawPtr(this))
+    fromRawPtr[T](rawptr)
+  }
 
-  /** Raw pointer to the element. */
+  /** Raw pointer to the element, only valid until the next allocation. */
   def atRaw(i: Int): RawPtr
 
   /** Loads element at i, throws IndexOutOfBoundsException. */
@@ -82,6 +88,10 @@ object Array {
       val toPtr   = to.atRaw(toPos)
       val size    = to.stride * len
       libc.memmove(toPtr, fromPtr, size)
+      // the card table only exists with nativeGenerational
+      if (GC.generational && to.isInstanceOf[ObjectArray]) {
+        GC.write_barrier_range(toPtr, size)
+      }
     }
   }
 
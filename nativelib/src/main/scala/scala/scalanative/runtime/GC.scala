@@ -10,10 +10,29 @@ import scalanative.unsafe._
  */
 @extern
 object GC {
+
+  /** The fields of `GCStats` in gc/shared/GCStats.h, see [[GCStats]]. */
+  type Stats = CStruct12[Long, Long, Long, Long, Long, Long, Long, Long, Long,
+                         Long, Long, Long]
+
   @name("scalanative_alloc")
   def alloc(rawty: RawPtr, size: CSize): RawPtr = extern
   @name("scalanative_alloc_atomic")
   def alloc_atomic(rawty: RawPtr, size: CSize): RawPtr = extern
   @name("scalanative_collect")
   def collect(): Unit = extern
+  @name("scalanative_write_barrier_range")
+  def write_barrier_range(addr: RawPtr, size: CSize): Unit = extern
+  @name("scalanative_pin")
+  def pin(obj: RawPtr): Unit = extern
+  @name("scalanative_gc_moves_objects")
+  var movesObjects: CBool = extern
+  @name("scalanative_gc_generational")
+  var generational: CBool = extern
+  @name("scalanative_gc_trace")
+  def trace(path: CString): Unit = extern
+  @name("scalanative_gc_heap_dump")
+  def heapDump(histogram: CString, dump: CString): CBool = extern
+  @name("scalanative_gc_stats")
+  def stats(out: Ptr[Stats]): Unit = extern
 }
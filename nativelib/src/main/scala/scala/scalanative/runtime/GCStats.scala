@@ -0,0 +1,61 @@
+package scala.scalanative
+package runtime
+
+import scalanative.unsafe._
+
+/**
+ * What the garbage collector reports about itself. Sizes are in bytes and
+ * times in nanoseconds, counters start with the program. A collector reports 0
+ * for what it does not keep track of.
+ *
+ * @param heapSize       memory taken by the heap now
+ * @param maxHeapSize    the most the heap may take, `Long.MaxValue` if it is
+ *                       not limited
+ * @param usedBytes      the part of the heap that is not free
+ * @param freeBlocks     free blocks of the heap
+ * @param recycledBlocks blocks with free lines in between live objects
+ * @param allocatedBytes bytes allocated since the program started
+ * @param collections    number of collections
+ * @param lastPause      the time the program was stopped by the last collection
+ * @param maxPause       the longest time it was stopped by a collection
+ * @param totalPause     the time it was stopped by all collections
+ * @param markTime       time spent marking
+ * @param sweepTime      time spent sweeping, summed over the threads that sweep
+ */
+final case class GCStats(heapSize: Long,
+                         maxHeapSize: Long,
+                         usedBytes: Long,
+                         freeBlocks: Long,
+                         recycledBlocks: Long,
+                         allocatedBytes: Long,
+                         collections: Long,
+                         lastPause: Long,
+                         maxPause: Long,
+                         totalPause: Long,
+                         markTime: Long,
+                         sweepTime: Long) {
+
+  /** The part of the heap that is free. */
+  def freeBytes: Long = heapSize - usedBytes
+}
+
+object GCStats {
+
+  /** Returns the statistics of the collector now. */
+  def current(): GCStats = {
+    val stats = stackalloc[GC.Stats]
+    GC.stats(stats)
+    GCStats(stats._1,
+            stats._2,
+            stats._3,
+            stats._4,
+            stats._5,
+            stats._6,
+            stats._7,
+            stats._8,
+            stats._9,
+            stats._10,
+            stats._11,
+            stats._12)
+  }
+}
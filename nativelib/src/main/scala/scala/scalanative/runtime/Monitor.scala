@@ -1,17 +1,74 @@
 package scala.scalanative.runtime
 
 import scalanative.annotation.alwaysinline
+import scalanative.unsafe._
 
-sealed class Monitor private () {
-  @alwaysinline def _notify(): Unit                              = ()
-  @alwaysinline def _notifyAll(): Unit                           = ()
-  @alwaysinline def _wait(): Unit                                = ()
-  @alwaysinline def _wait(timeout: scala.Long): Unit             = ()
-  @alwaysinline def _wait(timeout: scala.Long, nanos: Int): Unit = ()
-  @alwaysinline def enter(): Unit                                = ()
-  @alwaysinline def exit(): Unit                                 = ()
+/** The monitors of objects. Their state is kept by the runtime in a table
+ *  keyed by the address of the object, see monitor.c. Until a second thread
+ *  starts, the runtime only records which monitors are held.
+ */
+object Monitor {
+  // the results of the native operations
+  private final val Ok          = 0
+  private final val NotOwner    = 1
+  private final val Interrupted = 2
+
+  @alwaysinline private def address(obj: Object): RawPtr = {
+    val rawptr = Intrinsics.castObjectToRawPtr(obj)
+    // the monitor is found by the address, the object must not move anymore
+    pin(rawptr)
+    rawptr
+  }
+
+  private def check(result: CInt): Unit = result match {
+    case Ok => ()
+    case NotOwner =>
+      throw new IllegalMonitorStateException("current thread is not owner")
+    case Interrupted =>
+      throw new InterruptedException()
+  }
+
+  @alwaysinline def enter(obj: Object): Unit =
+    NativeMonitor.enter(address(obj))
+
+  @alwaysinline def exit(obj: Object): Unit =
+    check(NativeMonitor.exit(address(obj)))
+
+  def _notify(obj: Object): Unit =
+    check(NativeMonitor.wake(address(obj), false))
+
+  def _notifyAll(obj: Object): Unit =
+    check(NativeMonitor.wake(address(obj), true))
+
+  def _wait(obj: Object, timeout: scala.Long, nanos: Int): Unit = {
+    if (timeout < 0) {
+      throw new IllegalArgumentException("timeout value is negative")
+    }
+    if (nanos < 0 || nanos > 999999) {
+      throw new IllegalArgumentException(
+        "nanosecond timeout value out of range")
+    }
+    val timeoutNanos =
+      if (timeout > (scala.Long.MaxValue - nanos) / 1000000) scala.Long.MaxValue
+      else timeout * 1000000 + nanos
+    check(NativeMonitor.await(address(obj), timeoutNanos))
+  }
+
+  /** Whether the current thread holds the monitor of `obj`. */
+  def holds(obj: Object): Boolean =
+    NativeMonitor.holds(Intrinsics.castObjectToRawPtr(obj))
 }
 
-object Monitor {
-  @alwaysinline def dummy: Monitor = new Monitor
+@extern
+private[runtime] object NativeMonitor {
+  @name("scalanative_monitor_enter")
+  def enter(obj: RawPtr): Unit = extern
+  @name("scalanative_monitor_exit")
+  def exit(obj: RawPtr): CInt = extern
+  @name("scalanative_monitor_wait")
+  def await(obj: RawPtr, timeoutNanos: scala.Long): CInt = extern
+  @name("scalanative_monitor_notify")
+  def wake(obj: RawPtr, all: CBool): CInt = extern
+  @name("scalanative_monitor_holds")
+  def holds(obj: RawPtr): CBool = extern
 }
@@ -39,8 +39,12 @@ package object runtime {
     Intrinsics.loadRawPtr(rawptr)
   }
 
-  /** Get monitor for given object. */
-  @alwaysinline def getMonitor(obj: Object): Monitor = Monitor.dummy
+  /** Keeps the object at `rawptr` in place from now on, as its address is
+   *  used after the next collection. A load and a branch unless the GC
+   *  moves objects.
+   */
+  @alwaysinline def pin(rawptr: RawPtr): Unit =
+    if (GC.movesObjects) GC.pin(rawptr)
 
   /** Initialize runtime with given arguments and return the
    *  rest as Java-style array.
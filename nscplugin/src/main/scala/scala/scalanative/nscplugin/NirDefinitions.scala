@@ -96,22 +96,18 @@ trait NirDefinitions { self: NirGlobalAddons =>
 
     lazy val RuntimePackage = getPackage(TermName("scala.scalanative.runtime"))
 
-    lazy val RuntimeMonitorClass = getRequiredClass(
-      "scala.scalanative.runtime.Monitor")
     lazy val RuntimeMonitorModule = getRequiredModule(
       "scala.scalanative.runtime.Monitor")
     lazy val RuntimeMonitorEnterMethod =
-      getDecl(RuntimeMonitorClass, TermName("enter"))
+      getDecl(RuntimeMonitorModule, TermName("enter"))
     lazy val RuntimeMonitorExitMethod =
-      getDecl(RuntimeMonitorClass, TermName("exit"))
+      getDecl(RuntimeMonitorModule, TermName("exit"))
 
     lazy val RuntimeTypeClass = getRequiredClass(
       "scala.scalanative.runtime.Type")
 
     lazy val RuntimeModule = getRequiredModule(
       "scala.scalanative.runtime.package")
-    lazy val GetMonitorMethod =
-      getMember(RuntimeModule, TermName("getMonitor"))
 
     lazy val IntrinsicsModule = getRequiredModule(
       "scala.scalanative.runtime.Intrinsics")
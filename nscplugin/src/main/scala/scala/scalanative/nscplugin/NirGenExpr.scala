@@ -1314,19 +1314,19 @@ trait NirGenExpr { self: NirGenPhase =>
     def genSynchronized(app: Apply): Val = {
       val Apply(Select(receiverp, _), List(argp)) = app
 
-      val monitor =
-        genApplyModuleMethod(RuntimeModule, GetMonitorMethod, Seq(receiverp))
-      val enter = genApplyMethod(RuntimeMonitorEnterMethod,
-                                statically = true,
-                                monitor,
-                                Seq())
-      val arg = genExpr(argp)
-      val exit = genApplyMethod(RuntimeMonitorExitMethod,
-                               statically = true,
-                               monitor,
-                               Seq())
-
-      arg
+      val monitor = genModule(RuntimeMonitorModule)
+      val obj     = genExpr(receiverp)
+      genApplyMethod(RuntimeMonitorEnterMethod,
+                     statically = true,
+                     monitor,
+                     Seq(ValTree(obj)))
+      // The monitor is exited on every way out of the body, including
+      // exceptions, as if it was the finalizer of a try.
+      val exitp =
+        Apply(Select(ValTree(monitor), RuntimeMonitorExitMethod),
+              List(ValTree(obj)))
+
+      genTry(genType(app.tpe), argp, Nil, exitp)
     }
 
     def genCoercion(app: Apply, receiver: Tree, code: Int): Val = {
@@ -51,6 +51,15 @@ object ScalaNativePlugin extends AutoPlugin {
     val nativeDump =
       settingKey[Boolean](
         "Shall native toolchain dump intermediate NIR to disk during linking?")
+
+    val nativePreciseStack =
+      settingKey[Boolean](
+        "Shall the GC find stack roots through stack maps? " +
+          "Only the main thread may run in this mode.")
+
+    val nativeGenerational =
+      settingKey[Boolean](
+        "Shall the code support the generational mode of immix and commix?")
   }
 
   @deprecated("use autoImport instead", "0.3.7")
@@ -73,7 +73,11 @@ object ScalaNativePluginInternal {
     nativeCheck := false,
     nativeCheck in NativeTest := (nativeCheck in Test).value,
     nativeDump := false,
-    nativeDump in NativeTest := (nativeDump in Test).value
+    nativeDump in NativeTest := (nativeDump in Test).value,
+    nativePreciseStack := false,
+    nativePreciseStack in NativeTest := (nativePreciseStack in Test).value,
+    nativeGenerational := false,
+    nativeGenerational in NativeTest := (nativeGenerational in Test).value
   )
 
   lazy val scalaNativeGlobalSettings: Seq[Setting[_]] = Seq(
@@ -136,6 +140,8 @@ object ScalaNativePluginInternal {
         .withLTO(nativeLTO.value)
         .withCheck(nativeCheck.value)
         .withDump(nativeDump.value)
+        .withPreciseStack(nativePreciseStack.value)
+        .withGenerational(nativeGenerational.value)
     },
     nativeLink := {
       val logger  = streams.value.log.toLogger
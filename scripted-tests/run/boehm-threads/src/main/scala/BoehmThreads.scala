@@ -0,0 +1,189 @@
+import scalanative.unsafe._
+import scalanative.posix.sys.types.pthread_t
+
+/**
+ * Runs threads that allocate and share a counter and a queue under their
+ * monitors, and interrupts a thread that waits.
+ */
+object BoehmThreads {
+  @extern
+  object libc {
+    // not registered with the runtime, unlike scalanative_pthread_create
+    @name("pthread_create")
+    def pthread_create(thread: Ptr[pthread_t],
+                       attr: Ptr[Byte],
+                       routine: CFuncPtr1[Ptr[Byte], Ptr[Byte]],
+                       arg: Ptr[Byte]): CInt = extern
+    @name("pthread_join")
+    def pthread_join(thread: pthread_t, result: Ptr[Ptr[Byte]]): CInt = extern
+  }
+
+  final class Cell(val value: Int, val next: Cell)
+
+  def list(n: Int): Cell = {
+    var cell: Cell = null
+    var i          = 1
+    while (i <= n) {
+      cell = new Cell(i, cell)
+      i += 1
+    }
+    cell
+  }
+
+  def sum(cell: Cell): Int =
+    if (cell == null) 0 else cell.value + sum(cell.next)
+
+  val lock    = new Object
+  var counter = 0
+
+  // the first thread starts while the main thread holds a monitor, which
+  // the runtime had only recorded until then
+  def startWhileLocked(): Unit = {
+    var signalled = false
+    lock.synchronized {
+      val thread = new Thread(new Runnable {
+        def run(): Unit = lock.synchronized {
+          signalled = true
+          lock.notifyAll()
+        }
+      })
+      thread.start()
+      while (!signalled) {
+        lock.wait()
+      }
+    }
+  }
+
+  val other            = new Object
+  var attached: Thread = null
+  var entered          = false
+
+  val Attach = new CFuncPtr1[Ptr[Byte], Ptr[Byte]] {
+    def apply(arg: Ptr[Byte]): Ptr[Byte] = {
+      val thread = Thread.currentThread()
+      other.synchronized {
+        attached = thread
+      }
+      lock.synchronized {
+        entered = true
+      }
+      null
+    }
+  }
+
+  // a thread that native code starts attaches while the main thread enters
+  // and exits monitors, which the runtime had only recorded until then
+  def attachWhileLocked(): Unit = {
+    val handle  = stackalloc[pthread_t]
+    var waiting = true
+    lock.synchronized {
+      assert(libc.pthread_create(handle, null, Attach, null) == 0)
+      while (waiting) {
+        other.synchronized {
+          assert(Thread.holdsLock(other))
+          waiting = attached == null
+        }
+      }
+      assert(Thread.holdsLock(lock))
+      assert(!Thread.holdsLock(other))
+      Thread.sleep(100)
+      assert(!entered)
+    }
+    assert(libc.pthread_join(!handle, null) == 0)
+    assert(entered)
+    assert(attached ne Thread.currentThread())
+    assert(!attached.isAlive())
+  }
+
+  def increment(times: Int): Unit = {
+    var i = 0
+    while (i < times) {
+      assert(sum(list(100)) == 5050)
+      lock.synchronized {
+        counter += 1
+      }
+      i += 1
+    }
+  }
+
+  def counters(): Unit = {
+    val threads = Array.fill(4)(new Thread(new Runnable {
+      def run(): Unit = increment(10000)
+    }))
+    threads.foreach(_.start())
+    threads.foreach(_.join())
+    assert(counter == 40000)
+  }
+
+  val queue = new java.util.LinkedList[Integer]
+
+  def producerConsumer(): Unit = {
+    val count = 10000
+    var total = 0L
+    val consumer = new Thread(new Runnable {
+      def run(): Unit = {
+        var i = 0
+        while (i < count) {
+          queue.synchronized {
+            while (queue.isEmpty()) {
+              queue.wait()
+            }
+            total += queue.poll().intValue
+          }
+          i += 1
+        }
+      }
+    })
+    consumer.start()
+    var i = 1
+    while (i <= count) {
+      queue.synchronized {
+        queue.add(i)
+        queue.notify()
+      }
+      i += 1
+    }
+    consumer.join()
+    assert(total == count.toLong * (count + 1) / 2)
+  }
+
+  def interrupts(): Unit = {
+    var interrupted = false
+    val waiter = new Thread(new Runnable {
+      def run(): Unit =
+        try {
+          lock.synchronized(lock.wait())
+        } catch {
+          case _: InterruptedException =>
+            interrupted = true
+        }
+    })
+    waiter.start()
+    Thread.sleep(100)
+    waiter.interrupt()
+    waiter.join(10000)
+    assert(!waiter.isAlive())
+    assert(interrupted)
+  }
+
+  def unlockOnException(): Unit = {
+    try {
+      lock.synchronized {
+        throw new IllegalStateException()
+      }
+    } catch {
+      case _: IllegalStateException => ()
+    }
+    assert(!Thread.holdsLock(lock))
+  }
+
+  def main(args: Array[String]): Unit = {
+    attachWhileLocked()
+    startWhileLocked()
+    counters()
+    producerConsumer()
+    interrupts()
+    unlockOnException()
+    println("ok")
+  }
+}
@@ -0,0 +1,43 @@
+import java.util.HashMap
+
+/**
+ * Measures how fast the collector marks pointer-heavy graphs: a binary tree
+ * and a chained hash map that stay alive across explicit collections. The
+ * test runs it without prefetching and with a prefetch distance of 8.
+ */
+object MarkThroughput {
+  final class Node(val left: Node, val right: Node)
+
+  def tree(depth: Int): Node =
+    if (depth == 0) null
+    else new Node(tree(depth - 1), tree(depth - 1))
+
+  def main(args: Array[String]): Unit = {
+    val depth       = if (args.length > 0) args(0).toInt else 20
+    val entries     = if (args.length > 1) args(1).toInt else 500000
+    val collections = if (args.length > 2) args(2).toInt else 10
+
+    val root = tree(depth)
+    val map  = new HashMap[Integer, Integer]
+    var i    = 0
+    while (i < entries) {
+      map.put(Integer.valueOf(i * 31), Integer.valueOf(i))
+      i += 1
+    }
+
+    var best = Long.MaxValue
+    var c    = 0
+    while (c < collections) {
+      val start = System.nanoTime()
+      System.gc()
+      best = Math.min(best, System.nanoTime() - start)
+      c += 1
+    }
+    val distance = System.getenv("SCALANATIVE_GC_PREFETCH_DISTANCE")
+    println(
+      s"prefetch distance $distance, best collection of $collections: " +
+        s"${best / 1000} us")
+
+    assert(root.left != null && map.size == entries)
+  }
+}
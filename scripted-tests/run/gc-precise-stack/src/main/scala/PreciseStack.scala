@@ -0,0 +1,57 @@
+/**
+ * Collects while every frame of a deep recursion holds a list in a local,
+ * with the stack scanned precisely through the shadow stack. The lists must
+ * survive, also in the frame that catches an exception thrown below it.
+ */
+object PreciseStack {
+  final class Cell(val value: Int, val next: Cell)
+
+  def list(n: Int): Cell = {
+    var cell: Cell = null
+    var i          = 1
+    while (i <= n) {
+      cell = new Cell(i, cell)
+      i += 1
+    }
+    cell
+  }
+
+  def sum(cell: Cell): Int =
+    if (cell == null) 0 else cell.value + sum(cell.next)
+
+  def garbage(): Unit = {
+    var i = 0
+    while (i < 100000) {
+      list(10)
+      i += 1
+    }
+  }
+
+  def recurse(depth: Int): Int = {
+    val local = list(100)
+    val below =
+      if (depth == 0) {
+        garbage()
+        System.gc()
+        throw new IllegalStateException("bottom")
+      } else if (depth == 1) {
+        try recurse(depth - 1)
+        catch {
+          case e: IllegalStateException =>
+            garbage()
+            System.gc()
+            e.getMessage.length
+        }
+      } else {
+        recurse(depth - 1)
+      }
+    assert(sum(local) == 5050)
+    below + 1
+  }
+
+  def main(args: Array[String]): Unit = {
+    val depth = 500
+    assert(recurse(depth) == depth + "bottom".length)
+    println("ok")
+  }
+}
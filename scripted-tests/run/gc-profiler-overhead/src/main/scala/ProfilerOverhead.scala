@@ -0,0 +1,35 @@
+/**
+ * Measures what the allocation profiler costs at its default interval: the
+ * program allocates small objects, a few of which stay alive, and large
+ * arrays. The samples are taken on the allocation slow paths and followed
+ * across the collections. The test runs it without and with
+ * SCALANATIVE_GC_PROFILE_FILE.
+ */
+object ProfilerOverhead {
+  final class Node(val left: Node, val payload: Long)
+
+  def pair(i: Long): Node = new Node(new Node(null, -i), i)
+
+  def main(args: Array[String]): Unit = {
+    val total = if (args.length > 0) args(0).toLong else 20000000L
+    val live  = if (args.length > 1) args(1).toInt else 200000
+
+    val start = System.nanoTime()
+    val nodes = new Array[Node](live)
+    var bytes = 0L
+    var i     = 0L
+    while (i < total) {
+      nodes((i % live).toInt) = pair(i)
+      if (i % 256 == 0) {
+        bytes += new Array[Byte](8192).length
+      }
+      i += 1
+    }
+    val profile = System.getenv("SCALANATIVE_GC_PROFILE_FILE")
+    println(
+      s"profile $profile, $total nodes and ${bytes >> 20} MB of arrays: " +
+        s"${(System.nanoTime() - start) / 1000000} ms")
+
+    assert(nodes.forall(n => n.left.payload == -n.payload))
+  }
+}
@@ -56,6 +56,15 @@ sealed trait Config {
   /** Shall linker dump intermediate NIR after every phase? */
   def dump: Boolean
 
+  /** Shall the GC find stack roots through stack maps instead of scanning
+   *  the whole stack conservatively? The stack maps form a single chain, so
+   *  only the main thread may run Scala code in this mode. */
+  def preciseStack: Boolean
+
+  /** Shall the generated code keep the card table of the generational mode
+   *  of immix and commix up to date? */
+  def generational: Boolean
+
   /** Create a new config with given garbage collector. */
   def withGC(value: GC): Config
 
@@ -103,6 +112,12 @@ sealed trait Config {
 
   /** Create a new config with given dump value. */
   def withDump(value: Boolean): Config
+
+  /** Create a new config with given precise stack value. */
+  def withPreciseStack(value: Boolean): Config
+
+  /** Create a new config with given generational value. */
+  def withGenerational(value: Boolean): Config
 }
 
 object Config {
@@ -125,7 +140,9 @@ object Config {
       logger = Logger.default,
       LTO = "none",
       check = false,
-      dump = false
+      dump = false,
+      preciseStack = false,
+      generational = false
     )
 
   private final case class Impl(nativelib: Path,
@@ -143,7 +160,9 @@ object Config {
                                 logger: Logger,
                                 LTO: String,
                                 check: Boolean,
-                                dump: Boolean)
+                                dump: Boolean,
+                                preciseStack: Boolean,
+                                generational: Boolean)
       extends Config {
     def withNativelib(value: Path): Config =
       copy(nativelib = value)
@@ -192,5 +211,11 @@ object Config {
 
     def withDump(value: Boolean): Config =
       copy(dump = value)
+
+    def withPreciseStack(value: Boolean): Config =
+      copy(preciseStack = value)
+
+    def withGenerational(value: Boolean): Config =
+      copy(generational = value)
   }
 }
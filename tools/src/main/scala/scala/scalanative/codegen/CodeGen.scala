@@ -19,7 +19,7 @@ object CodeGen {
     val defns   = linked.defns
     val proxies = GenerateReflectiveProxies(linked.dynimpls, defns)
 
-    implicit val meta = new Metadata(linked, proxies)
+    implicit val meta = new Metadata(linked, config, proxies)
 
     val generated = Generate(Global.Top(config.mainClass), defns ++ proxies)
     val lowered   = lower(generated)
@@ -57,7 +57,8 @@ object CodeGen {
         partitionBy(assembly, procs)(_.name.top.mangle).par.foreach {
           case (id, defns) =>
             val sorted = defns.sortBy(_.name.show)
-            val impl   = new Impl(config.targetTriple, env, sorted)
+            val impl =
+              new Impl(config.targetTriple, config.preciseStack, env, sorted)
             val buffer = impl.gen()
             buffer.flip
             workdir.write(Paths.get(s"$id.ll"), buffer)
@@ -68,7 +69,8 @@ object CodeGen {
       // Clang's LTO is not available.
       def single(): Unit = {
         val sorted = assembly.sortBy(_.name.show)
-        val impl   = new Impl(config.targetTriple, env, sorted)
+        val impl =
+          new Impl(config.targetTriple, config.preciseStack, env, sorted)
         val buffer = impl.gen()
         buffer.flip
         workdir.write(Paths.get("out.ll"), buffer)
@@ -82,6 +84,7 @@ object CodeGen {
     }
 
   private final class Impl(targetTriple: String,
+                           preciseStack: Boolean,
                            env: Map[Global, Defn],
                            defns: Seq[Defn])(implicit meta: Metadata) {
     import Impl._
@@ -90,6 +93,7 @@ object CodeGen {
     var currentBlockSplit: Int  = _
 
     val copies    = mutable.Map.empty[Local, Val]
+    val roots     = mutable.Map.empty[Local, Type]
     val deps      = mutable.Set.empty[Global]
     val generated = mutable.Set.empty[String]
     val builder   = new ShowBuilder
@@ -184,6 +188,9 @@ object CodeGen {
       line("declare void @__cxa_end_catch()")
       line(
         "@_ZTIN11scalanative16ExceptionWrapperE = external constant { i8*, i8*, i8* }")
+      if (preciseStack) {
+        line("declare void @llvm.gcroot(i8**, i8*)")
+      }
     }
 
     def genConsts() =
@@ -260,6 +267,9 @@ object CodeGen {
           genAttr(attrs.inline)
         }
       }
+      if (preciseStack && !isDecl) {
+        str(" gc \"shadow-stack\"")
+      }
       if (!attrs.isExtern && !isDecl) {
         str(" ")
         str(gxxpersonality)
@@ -273,6 +283,9 @@ object CodeGen {
           case _ =>
             ()
         }
+        if (preciseStack) {
+          collectRoots(insts)
+        }
 
         val cfg = CFG(insts)
         cfg.all.foreach { block =>
@@ -286,7 +299,72 @@ object CodeGen {
         str("}")
 
         copies.clear()
+        roots.clear()
+      }
+    }
+
+    /** With precise stack maps every local that may hold a heap reference
+     *  lives in a gcroot slot as well. Slots of raw pointers carry metadata,
+     *  the GC treats them conservatively as they may point inside objects.
+     */
+    def collectRoots(insts: Seq[Inst]): Unit = {
+      def isRoot(ty: Type): Boolean = ty match {
+        case _: Type.RefKind | Type.Ptr => true
+        case _                          => false
+      }
+
+      insts.foreach {
+        case Inst.Label(_, params) =>
+          params.foreach { param =>
+            if (isRoot(param.ty)) {
+              roots(param.name) = param.ty
+            }
+          }
+        case Inst.Let(n, op, unwind) =>
+          if (!op.isInstanceOf[Op.Copy] && isRoot(op.resty)) {
+            roots(n) = op.resty
+          }
+          unwind match {
+            case Next.Unwind(Val.Local(exc, ty), _) if isRoot(ty) =>
+              roots(exc) = ty
+            case _ =>
+              ()
+          }
+        case _ =>
+          ()
+      }
+    }
+
+    def genRootSlots(): Unit =
+      roots.toSeq.sortBy(_._1.id).foreach {
+        case (local, ty) =>
+          newline()
+          str("%")
+          genRootSlot(local)
+          str(" = alloca i8*")
+          newline()
+          str("call void @llvm.gcroot(i8** %")
+          genRootSlot(local)
+          str(", i8* ")
+          str(if (ty == Type.Ptr) conservativeRoot else "null")
+          str(")")
+          newline()
+          str("store i8* null, i8** %")
+          genRootSlot(local)
       }
+
+    def genRootStore(local: Local): Unit =
+      if (roots.contains(local)) {
+        newline()
+        str("store i8* %")
+        genLocal(local)
+        str(", i8** %")
+        genRootSlot(local)
+      }
+
+    def genRootSlot(local: Local): Unit = {
+      genLocal(local)
+      str(".root")
     }
 
     def genFunctionReturnType(retty: Type): Unit = {
@@ -345,7 +423,11 @@ object CodeGen {
 
       genBlockHeader()
       indent()
+      if (isEntry) {
+        genRootSlots()
+      }
       genBlockPrologue(block)
+      params.foreach(param => genRootStore(param.name))
       rep(insts) { inst =>
         genInst(inst)
       }
@@ -449,6 +531,7 @@ object CodeGen {
       line(s"$w1 = bitcast i8* $w0 to i8**")
       line(s"$w2 = getelementptr i8*, i8** $w1, i32 1")
       line(s"$exc = load i8*, i8** $w2")
+      genRootStore(excname)
       line(s"call void @__cxa_end_catch()")
       genInst(Inst.Jump(next))
       unindent()
@@ -637,6 +720,7 @@ object CodeGen {
     def genInst(inst: Inst)(implicit fresh: Fresh): Unit = inst match {
       case inst: Inst.Let =>
         genLet(inst)
+        genRootStore(inst.name)
 
       case Inst.Unreachable(unwind) =>
         assert(unwind eq Next.None)
@@ -1033,6 +1117,7 @@ object CodeGen {
       "landingpad { i8*, i32 } catch i8* bitcast ({ i8*, i8*, i8* }* @_ZTIN11scalanative16ExceptionWrapperE to i8*)"
     val typeid =
       "call i32 @llvm.eh.typeid.for(i8* bitcast ({ i8*, i8*, i8* }* @_ZTIN11scalanative16ExceptionWrapperE to i8*))"
+    val conservativeRoot = "inttoptr (i64 1 to i8*)"
   }
 
   val depends: Seq[Global] = {
@@ -23,8 +23,9 @@ class FieldLayout(meta: Metadata, cls: Class) {
   val layout = MemoryLayout(struct.tys)
   val size   = layout.size
   val referenceOffsetsTy =
-    Type.StructValue(Seq(Type.Ptr))
+    Type.StructValue(Seq(Type.Ptr, Type.Long))
   val referenceOffsetsValue =
     Val.StructValue(
-      Seq(Val.Const(Val.ArrayValue(Type.Long, layout.offsetArray))))
+      Seq(Val.Const(Val.ArrayValue(Type.Long, layout.offsetArray)),
+          Val.Long(layout.referenceBitmap)))
 }
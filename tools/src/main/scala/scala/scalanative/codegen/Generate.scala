@@ -34,6 +34,8 @@ object Generate {
       genObjectArrayId()
       genArrayIds()
       genStackBottom()
+      genWriteBarriers()
+      genPreciseStack()
 
       buf
     }
@@ -171,6 +173,18 @@ object Generate {
     def genStackBottom(): Unit =
       buf += Defn.Var(Attrs.None, stackBottomName, Type.Ptr, Val.Null)
 
+    // tells the gc whether it may run in generational mode
+    def genWriteBarriers(): Unit = {
+      val value = if (Lower.hasWriteBarrier(meta.config)) 1 else 0
+      buf += Defn.Var(Attrs.None, writeBarriersName, Type.Int, Val.Int(value))
+    }
+
+    // tells the gc whether the stack roots are in the single shadow stack
+    def genPreciseStack(): Unit = {
+      val value = if (meta.config.preciseStack) 1 else 0
+      buf += Defn.Var(Attrs.None, preciseStackName, Type.Int, Val.Int(value))
+    }
+
     def genModuleAccessors(): Unit = {
       meta.classes.foreach { cls =>
         if (cls.isModule && cls.allocated) {
@@ -360,6 +374,8 @@ object Generate {
     val objectArrayIdName   = extern("__object_array_id")
     val arrayIdsMinName     = extern("__array_ids_min")
     val arrayIdsMaxName     = extern("__array_ids_max")
+    val writeBarriersName   = extern("__write_barriers")
+    val preciseStackName    = extern("__precise_stack")
 
     private def extern(id: String): Global =
       Global.Member(Global.Top("__"), Sig.Extern(id))
@@ -40,6 +40,8 @@ object Lower {
       names
     }
 
+    private val hasWriteBarrier = Lower.hasWriteBarrier(meta.config)
+
     private val fresh         = new util.ScopedVar[Fresh]
     private val unwindHandler = new util.ScopedVar[Option[Local]]
 
@@ -326,6 +328,9 @@ object Lower {
         buf.let(n, Op.Load(ty, Val.Local(slot, Type.Ptr)), unwind)
       case Op.Varstore(Val.Local(slot, Type.Var(ty)), value) =>
         buf.let(n, Op.Store(ty, Val.Local(slot, Type.Ptr), value), unwind)
+      case op @ Op.Store(_: Type.RefKind, ptr, _) =>
+        buf.let(n, op, unwind)
+        genWriteBarrier(buf, ptr)
       case op: Op.Arrayalloc =>
         genArrayallocOp(buf, n, op)
       case op: Op.Arrayload =>
@@ -338,6 +343,11 @@ object Lower {
         buf.let(n, op, unwind)
     }
 
+    def genWriteBarrier(buf: Buffer, ptr: Val): Unit =
+      if (hasWriteBarrier) {
+        buf.call(writeBarrierSig, writeBarrier, Seq(ptr), unwind)
+      }
+
     def genGuardNotNull(buf: Buffer, obj: Val): Unit = obj.ty match {
       case ty: Type.RefKind if !ty.isNullable =>
         ()
@@ -393,6 +403,9 @@ object Lower {
 
       val elem = genFieldElemOp(buf, obj, name)
       buf.let(n, Op.Store(ty, elem, value), unwind)
+      if (ty.isInstanceOf[Type.RefKind]) {
+        genWriteBarrier(buf, elem)
+      }
     }
 
     def genMethodOp(buf: Buffer, n: Local, op: Op.Method) = {
@@ -902,6 +915,9 @@ object Lower {
       val elemPtr =
         buf.elem(arrTy, arr, Seq(Val.Int(0), Val.Int(3), idx), unwind)
       buf.let(n, Op.Store(ty, elemPtr, value), unwind)
+      if (ty.isInstanceOf[Type.RefKind]) {
+        genWriteBarrier(buf, elemPtr)
+      }
     }
 
     def genArraylengthOp(buf: Buffer, n: Local, op: Op.Arraylength): Unit = {
@@ -969,6 +985,19 @@ object Lower {
   val largeAllocName = extern("scalanative_alloc_large")
   val largeAlloc     = Val.Global(largeAllocName, allocSig)
 
+  // Generational mode of immix and commix is enabled at runtime, the code
+  // only has to support it when built with it. Reference stores go through
+  // the write barrier then.
+  def hasWriteBarrier(config: build.Config): Boolean =
+    config.generational && (config.gc match {
+      case build.GC.Immix | build.GC.Commix => true
+      case _                                => false
+    })
+
+  val writeBarrierName = extern("scalanative_write_barrier")
+  val writeBarrierSig  = Type.Function(Seq(Type.Ptr), Type.Unit)
+  val writeBarrier     = Val.Global(writeBarrierName, writeBarrierSig)
+
   val dyndispatchName = extern("scalanative_dyndispatch")
   val dyndispatchSig =
     Type.Function(Seq(Type.Ptr, Type.Int), Type.Ptr)
@@ -1156,6 +1185,7 @@ object Lower {
     buf += Defn.Declare(Attrs.None, allocSmallName, allocSig)
     buf += Defn.Declare(Attrs.None, largeAllocName, allocSig)
     buf += Defn.Declare(Attrs.None, dyndispatchName, dyndispatchSig)
+    buf += Defn.Declare(Attrs.None, writeBarrierName, writeBarrierSig)
     buf += Defn.Declare(Attrs.None, throwName, throwSig)
     buf
   }
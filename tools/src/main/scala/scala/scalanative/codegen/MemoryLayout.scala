@@ -19,6 +19,23 @@ final case class MemoryLayout(size: Long,
 
     ptrOffsets :+ Val.Long(-1)
   }
+
+  /** Bit `i` is set when word `i` after the rtti holds a reference, zero if
+   *  some reference lies beyond the first 64 words.
+   */
+  lazy val referenceBitmap: Long = {
+    val ptrOffsets =
+      tys.collect {
+        case MemoryLayout.PositionedType(_: RefKind, offset) =>
+          offset / MemoryLayout.WORD_SIZE - 1
+      }
+
+    if (ptrOffsets.forall(_ < 64)) {
+      ptrOffsets.foldLeft(0L)((bitmap, offset) => bitmap | (1L << offset))
+    } else {
+      0L
+    }
+  }
 }
 
 object MemoryLayout {
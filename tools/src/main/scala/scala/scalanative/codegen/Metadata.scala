@@ -5,7 +5,9 @@ import scala.collection.mutable
 import scalanative.nir._
 import scalanative.linker.{Trait, Class}
 
-class Metadata(val linked: linker.Result, proxies: Seq[Defn]) {
+class Metadata(val linked: linker.Result,
+               val config: build.Config,
+               proxies: Seq[Defn]) {
   val rtti   = mutable.Map.empty[linker.Info, RuntimeTypeInformation]
   val vtable = mutable.Map.empty[linker.Class, VirtualTable]
   val layout = mutable.Map.empty[linker.Class, FieldLayout]
@@ -24,4 +24,11 @@ object RuntimeSuite extends tests.Suite {
     assert(proc.waitFor(5, TimeUnit.SECONDS))
     assert(out.split("\n").toSet == Set("echo.sh", "err.sh", "hello.sh", "ls"))
   }
+  test("memory") {
+    val runtime = Runtime.getRuntime
+    val total   = runtime.totalMemory()
+    assert(total > 0)
+    assert(runtime.freeMemory() >= 0)
+    assert(runtime.maxMemory() >= total)
+  }
 }